@@ -0,0 +1,276 @@
+#include "precomp.h"
+
+const char* Accumulator::formatName[FORMATS] = { "float4", "float SoA", "half", "RGB9E5" };
+
+// -----------------------------------------------------------
+// Shared exponent helpers, after EXT_texture_shared_exponent:
+// three 9-bit mantissas and a 5-bit exponent with bias 15
+// -----------------------------------------------------------
+static uint EncodeRGB9E5( const float3& c )
+{
+	const float r = clamp( c.x, 0.0f, 65408.0f ), g = clamp( c.y, 0.0f, 65408.0f ), b = clamp( c.z, 0.0f, 65408.0f );
+	const float m = max( max( r, g ), b );
+	// floor( log2( m ) ) straight from the float exponent
+	uint bits;
+	memcpy( &bits, &m, sizeof( bits ) );
+	const int log2m = (int)((bits >> 23) & 255) - 127;
+	int e = max( -16, log2m ) + 16;
+	float scale = ldexpf( 1, 24 - e );
+	if ((int)(m * scale + 0.5f) == 512) e++, scale *= 0.5f;
+	return (uint)(r * scale + 0.5f) + ((uint)(g * scale + 0.5f) << 9) + ((uint)(b * scale + 0.5f) << 18) + ((uint)e << 27);
+}
+static float3 DecodeRGB9E5( const uint v )
+{
+	const float scale = ldexpf( 1, (int)(v >> 27) - 24 );
+	return float3( (float)(v & 511), (float)((v >> 9) & 511), (float)((v >> 18) & 511) ) * scale;
+}
+
+// -----------------------------------------------------------
+// fp16 conversion of n pixels of four halves; F16C is checked
+// in Init, so these are only called on cpus that have it
+// -----------------------------------------------------------
+SIMD_TARGET( "f16c" ) static void HalfToFloat( const uchar* in, float4* out, const int n )
+{
+	for (int i = 0; i < n; i++) _mm_store_ps( &out[i].x, _mm_cvtph_ps( _mm_loadl_epi64( (const __m128i*)(in + i * 8) ) ) );
+}
+SIMD_TARGET( "f16c" ) static void FloatToHalf( const float4* in, uchar* out, const int n )
+{
+	for (int i = 0; i < n; i++) _mm_storel_epi64( (__m128i*)(out + i * 8), _mm_cvtps_ph( _mm_load_ps( &in[i].x ), _MM_FROUND_TO_NEAREST_INT ) );
+}
+
+// -----------------------------------------------------------
+// Scatter a span of float4 pixels to three float planes
+// -----------------------------------------------------------
+static void StorePlanes( float* r, const int planeSize, const int count, const float4* in )
+{
+	float* g = r + planeSize, * b = g + planeSize;
+	int i = 0;
+	for (; i < (count & ~3); i += 4)
+	{
+		__m128 r4 = _mm_load_ps( &in[i].x ), g4 = _mm_load_ps( &in[i + 1].x );
+		__m128 b4 = _mm_load_ps( &in[i + 2].x ), a4 = _mm_load_ps( &in[i + 3].x );
+		_MM_TRANSPOSE4_PS( r4, g4, b4, a4 );
+		_mm_storeu_ps( r + i, r4 ), _mm_storeu_ps( g + i, g4 ), _mm_storeu_ps( b + i, b4 );
+	}
+	for (; i < count; i++) r[i] = in[i].x, g[i] = in[i].y, b[i] = in[i].z;
+}
+
+// -----------------------------------------------------------
+// Allocate storage for the requested layout; contents start
+// out black, unless the caller clears it later, e.g. to control
+// which threads touch the pages first
+// -----------------------------------------------------------
+void Accumulator::Init( const int pixels, Format f, const bool clear )
+{
+	// fp16 conversion needs hardware support
+	if (f == HALF && !CPUCaps::HW_F16C) f = FLOAT4;
+	Memory::FreeLarge( data );
+	format = f, pixelCount = pixels;
+	// keep each plane 64-byte aligned
+	planeSize = (pixels + 15) & ~15;
+	data = (uchar*)Memory::AllocLarge( Bytes() );
+	if (clear) Clear();
+}
+
+// -----------------------------------------------------------
+// Set a span of pixels to black
+// -----------------------------------------------------------
+void Accumulator::Clear( const int first, const int count )
+{
+	switch (format)
+	{
+	case FLOAT_SOA:
+		for (int i = 0; i < 3; i++) memset( (float*)data + i * planeSize + first, 0, count * sizeof( float ) );
+		break;
+	case HALF: memset( data + first * 8, 0, count * 8 ); break;
+	case RGB9E5: memset( (uint*)data + first, 0, count * sizeof( uint ) ); break;
+	default: memset( (float4*)data + first, 0, count * sizeof( float4 ) ); break;
+	}
+}
+
+// -----------------------------------------------------------
+// Storage size for a layout
+// -----------------------------------------------------------
+size_t Accumulator::Bytes( const Format f ) const
+{
+	switch (f)
+	{
+	case FLOAT_SOA: return (size_t)planeSize * 3 * sizeof( float );
+	case HALF: return (size_t)planeSize * 8;
+	case RGB9E5: return (size_t)planeSize * sizeof( uint );
+	default: return (size_t)planeSize * sizeof( float4 );
+	}
+}
+
+// -----------------------------------------------------------
+// Single pixel access
+// -----------------------------------------------------------
+float3 Accumulator::Load( const int pixel ) const
+{
+	switch (format)
+	{
+	case FLOAT_SOA:
+	{
+		const float* r = (const float*)data;
+		return float3( r[pixel], r[pixel + planeSize], r[pixel + 2 * planeSize] );
+	}
+	case HALF:
+	{
+		ALIGN( 16 ) float4 v;
+		HalfToFloat( data + pixel * 8, &v, 1 );
+		return make_float3( v );
+	}
+	case RGB9E5: return DecodeRGB9E5( ((const uint*)data)[pixel] );
+	default: return make_float3( ((const float4*)data)[pixel] );
+	}
+}
+void Accumulator::Store( const int pixel, const float3& c )
+{
+	switch (format)
+	{
+	case FLOAT_SOA:
+	{
+		float* r = (float*)data;
+		r[pixel] = c.x, r[pixel + planeSize] = c.y, r[pixel + 2 * planeSize] = c.z;
+		break;
+	}
+	case HALF:
+	{
+		ALIGN( 16 ) const float4 v( c, 0 );
+		FloatToHalf( &v, data + pixel * 8, 1 );
+		break;
+	}
+	case RGB9E5: ((uint*)data)[pixel] = EncodeRGB9E5( c ); break;
+	default: ((float4*)data)[pixel] = float4( c, 0 ); break;
+	}
+}
+
+// -----------------------------------------------------------
+// Expand a span of pixels in layout f to float4
+// -----------------------------------------------------------
+static void DecodeSpan( const Accumulator::Format f, const uchar* data, const int planeSize, const int first, const int count, float4* out )
+{
+	int i = 0;
+	switch (f)
+	{
+	case Accumulator::FLOAT_SOA:
+	{
+		// four pixels at a time: transpose rrrr gggg bbbb into rgb0 quads
+		const float* r = (const float*)data + first, * g = r + planeSize, * b = g + planeSize;
+		for (; i < (count & ~3); i += 4)
+		{
+			__m128 r4 = _mm_loadu_ps( r + i ), g4 = _mm_loadu_ps( g + i );
+			__m128 b4 = _mm_loadu_ps( b + i ), z4 = _mm_setzero_ps();
+			_MM_TRANSPOSE4_PS( r4, g4, b4, z4 );
+			_mm_store_ps( &out[i].x, r4 ), _mm_store_ps( &out[i + 1].x, g4 );
+			_mm_store_ps( &out[i + 2].x, b4 ), _mm_store_ps( &out[i + 3].x, z4 );
+		}
+		for (; i < count; i++) out[i] = float4( r[i], g[i], b[i], 0 );
+		return;
+	}
+	case Accumulator::HALF:
+	{
+		HalfToFloat( data + first * 8, out, count );
+		return;
+	}
+	case Accumulator::RGB9E5:
+	{
+		// four pixels at a time; the scale is built directly as float bits
+		const uint* src = (const uint*)data + first;
+		const __m128i mask4 = _mm_set1_epi32( 511 ), bias4 = _mm_set1_epi32( 127 - 24 );
+		for (; i < (count & ~3); i += 4)
+		{
+			const __m128i v4 = _mm_loadu_si128( (const __m128i*)(src + i) );
+			const __m128 scale4 = _mm_castsi128_ps( _mm_slli_epi32( _mm_add_epi32( _mm_srli_epi32( v4, 27 ), bias4 ), 23 ) );
+			__m128 r4 = _mm_mul_ps( _mm_cvtepi32_ps( _mm_and_si128( v4, mask4 ) ), scale4 );
+			__m128 g4 = _mm_mul_ps( _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( v4, 9 ), mask4 ) ), scale4 );
+			__m128 b4 = _mm_mul_ps( _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( v4, 18 ), mask4 ) ), scale4 );
+			__m128 z4 = _mm_setzero_ps();
+			_MM_TRANSPOSE4_PS( r4, g4, b4, z4 );
+			_mm_store_ps( &out[i].x, r4 ), _mm_store_ps( &out[i + 1].x, g4 );
+			_mm_store_ps( &out[i + 2].x, b4 ), _mm_store_ps( &out[i + 3].x, z4 );
+		}
+		for (; i < count; i++) out[i] = float4( DecodeRGB9E5( src[i] ), 0 );
+		return;
+	}
+	default: memcpy( out, (const float4*)data + first, count * sizeof( float4 ) ); return;
+	}
+}
+
+// -----------------------------------------------------------
+// Compress a span of float4 pixels into layout f
+// -----------------------------------------------------------
+static void EncodeSpan( const Accumulator::Format f, uchar* data, const int planeSize, const int first, const int count, const float4* in )
+{
+	switch (f)
+	{
+	case Accumulator::FLOAT_SOA: StorePlanes( (float*)data + first, planeSize, count, in ); break;
+	case Accumulator::HALF: FloatToHalf( in, data + first * 8, count ); break;
+	case Accumulator::RGB9E5: for (int i = 0; i < count; i++) ((uint*)data)[first + i] = EncodeRGB9E5( make_float3( in[i] ) ); break;
+	default: memcpy( (float4*)data + first, in, count * sizeof( float4 ) ); break;
+	}
+}
+
+// -----------------------------------------------------------
+// Span access in the current layout
+// -----------------------------------------------------------
+void Accumulator::Decode( const int first, const int count, float4* out ) const
+{
+	DecodeSpan( format, data, planeSize, first, count, out );
+}
+void Accumulator::Encode( const int first, const int count, const float4* in )
+{
+	EncodeSpan( format, data, planeSize, first, count, in );
+}
+
+// -----------------------------------------------------------
+// Copy the whole buffer to or from Bytes( f ) of storage in
+// layout f, through a small float4 scratch buffer
+// -----------------------------------------------------------
+void Accumulator::Export( const Format f, uchar* out ) const
+{
+	ALIGN( 64 ) float4 tmp[64];
+	for (int i = 0; i < pixelCount; i += 64)
+	{
+		const int n = min( 64, pixelCount - i );
+		Decode( i, n, tmp );
+		EncodeSpan( f, out, planeSize, i, n, tmp );
+	}
+}
+void Accumulator::Import( const Format f, const uchar* in )
+{
+	ALIGN( 64 ) float4 tmp[64];
+	for (int i = 0; i < pixelCount; i += 64)
+	{
+		const int n = min( 64, pixelCount - i );
+		DecodeSpan( f, in, planeSize, i, n, tmp );
+		Encode( i, n, tmp );
+	}
+}
+
+// -----------------------------------------------------------
+// Translate a span of pixels to rgb32; the float layouts are
+// converted by the SIMD kernels without a decode step
+// -----------------------------------------------------------
+void Accumulator::Convert( const int first, const int count, uint* out ) const
+{
+	if (format == FLOAT4)
+	{
+		Kernels().ConvertPacked( (const float*)data + first * 4, count, out );
+		return;
+	}
+	if (format == FLOAT_SOA)
+	{
+		const float* r = (const float*)data + first;
+		Kernels().ConvertPlanar( r, r + planeSize, r + 2 * planeSize, count, out );
+		return;
+	}
+	// other layouts go through a small float4 scratch buffer
+	ALIGN( 64 ) float4 tmp[64];
+	for (int i = 0; i < count; i += 64)
+	{
+		const int n = min( 64, count - i );
+		Decode( first + i, n, tmp );
+		for (int j = 0; j < n; j++) out[i + j] = RGBF32_to_RGB8( tmp + j );
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+// -----------------------------------------------------------
+// Accumulator
+// Linear rgb frame buffer in a selectable layout:
+// FLOAT4     16 bytes per pixel, alpha unused
+// FLOAT_SOA  12 bytes per pixel, separate r, g and b planes
+// HALF        8 bytes per pixel, fp16 via F16C
+// RGB9E5      4 bytes per pixel, shared exponent, >= 0 only
+// Single pixels go through Load / Store; passes that stream
+// over the buffer decode a span to float4 scratch, work on
+// that, and encode the result back.
+// HALF and RGB9E5 are for buffers that are written once per
+// frame: the denoised output, checkpoints and video. A running
+// average kept in them stalls once the blend weight of a new
+// frame drops below their precision, so a buffer that frames
+// are blended into uses a float layout, see Blended.
+// -----------------------------------------------------------
+class Accumulator
+{
+public:
+	enum Format { FLOAT4 = 0, FLOAT_SOA, HALF, RGB9E5, FORMATS };
+	static const char* formatName[FORMATS];
+	~Accumulator() { Memory::FreeLarge( data ); }
+	// layout of a buffer that is blended into, for a given output layout
+	static Format Blended( const Format f ) { return f == FLOAT_SOA ? FLOAT_SOA : FLOAT4; }
+	void Init( const int pixels, Format f, const bool clear = true );
+	void Clear() { Clear( 0, pixelCount ); }
+	void Clear( const int first, const int count );
+	size_t Bytes() const { return Bytes( format ); }
+	size_t Bytes( const Format f ) const;
+	float3 Load( const int pixel ) const;
+	void Store( const int pixel, const float3& c );
+	void Decode( const int first, const int count, float4* out ) const;
+	void Encode( const int first, const int count, const float4* in );
+	void Convert( const int first, const int count, uint* out ) const;
+	// the whole buffer in another layout, e.g. for a checkpoint
+	void Export( const Format f, uchar* out ) const;
+	void Import( const Format f, const uchar* in );
+	// float4 access without decoding; 0 for other formats
+	const float4* Direct( const int first ) const { return format == FLOAT4 ? (const float4*)data + first : 0; }
+	// data members
+	Format format = FLOAT4;
+	int pixelCount = 0, planeSize = 0;
+	uchar* data = 0;
+};
+
+} // namespace Tmpl8
@@ -0,0 +1,234 @@
+#include "precomp.h"
+
+// file layout: one page with the file header, then two slots of
+// slotBytes each: a page with the slot header, then the payload
+// (accumulator data, followed by the per-tile quality levels)
+#define PAGE		4096
+#define PAGEALIGN( x ) (((x) + PAGE - 1) & ~(size_t)(PAGE - 1))
+
+static const char checkpointMagic[4] = { 'T', '8', 'C', 'P' };
+static const uint checkpointVersion = 1;
+
+struct CheckpointFile
+{
+	char magic[4];
+	uint version;
+	uint64_t slotBytes;
+};
+
+struct CheckpointSlot
+{
+	uint64_t sequence;		// 0: incomplete
+	uint64_t sceneHash;
+	Camera camera;
+	float animTime;
+	uint frame;
+	int accumulated;
+	int2 historyRes;
+	int format, pixelCount;
+	uint64_t accumulatorBytes;
+	int tileCount, resolutionLevel;
+	bool resolutionGovernor, qualityGovernor, accumulate, animating;
+};
+static_assert(sizeof( CheckpointFile ) <= PAGE && sizeof( CheckpointSlot ) <= PAGE, "checkpoint header too large");
+
+// -----------------------------------------------------------
+// FNV-1a over the packed scene description: geometry at the
+// current time, transforms, lights and materials
+// -----------------------------------------------------------
+static uint64_t Fnv( uint64_t hash, const void* data, const size_t size )
+{
+	const uchar* bytes = (const uchar*)data;
+	for (size_t i = 0; i < size; i++) hash = (hash ^ bytes[i]) * 1099511628211ull;
+	return hash;
+}
+uint64_t Checkpoint::SceneHash( Scene& scene )
+{
+	CLScene packed = {};
+	packed.Pack( scene );
+	return Fnv( 14695981039346656037ull, &packed, sizeof( CLScene ) );
+}
+
+// -----------------------------------------------------------
+// Everything a stored accumulator depends on: the scene hash,
+// plus what the packed scene leaves out (the SDF objects and
+// the stress scene parameters) and the accumulator layout
+// -----------------------------------------------------------
+uint64_t Checkpoint::StateHash( Renderer& r, const int format )
+{
+	uint64_t hash = SceneHash( r.scene );
+	hash = Fnv( hash, &r.scene.sdfCount, sizeof( int ) );
+	for (int i = 0; i < r.scene.sdfCount; i++)
+	{
+		const SDF& sdf = r.scene.sdf[i];
+		const int shape = sdf.shape;
+		hash = Fnv( hash, &shape, sizeof( int ) ), hash = Fnv( hash, &sdf.param, sizeof( float ) );
+		hash = Fnv( hash, &sdf.pos, sizeof( float3 ) ), hash = Fnv( hash, &sdf.size, sizeof( float3 ) );
+		hash = Fnv( hash, &sdf.albedo, sizeof( float3 ) );
+	}
+	if (r.scene.stress)
+	{
+		// generation is deterministic, so the parameters and seed identify the objects
+		hash = Fnv( hash, &r.scene.stress->count, sizeof( int ) );
+		hash = Fnv( hash, &r.stressParams, sizeof( StressParams ) );
+	}
+	return Fnv( hash, &format, sizeof( int ) );
+}
+
+// -----------------------------------------------------------
+// Restore the newest complete slot, if it was written by this
+// version for the same scene; called from Renderer::Init
+// -----------------------------------------------------------
+bool Checkpoint::Resume( Renderer& r )
+{
+	MappedFile f;
+	if (!f.Open( file )) return false;
+	const CheckpointFile& header = *(const CheckpointFile*)f.data;
+	if (f.size < PAGE || memcmp( header.magic, checkpointMagic, 4 ) || header.version != checkpointVersion) return false;
+	const CheckpointSlot* best = 0;
+	for (int i = 0; i < 2; i++)
+	{
+		const size_t offset = PAGE + i * header.slotBytes;
+		if (header.slotBytes < PAGE || offset + header.slotBytes > f.size) break;
+		const CheckpointSlot* slot = (const CheckpointSlot*)(f.data + offset);
+		if (slot->sequence == 0 || (best && best->sequence > slot->sequence)) continue;
+		if (PAGE + slot->accumulatorBytes + slot->tileCount * sizeof( int ) > header.slotBytes) continue;
+		if (slot->pixelCount != SCRWIDTH * SCRHEIGHT) /* other build */ continue;
+		best = slot;
+	}
+	if (!best) return false;
+	r.scene.SetTime( best->animTime );
+	if (StateHash( r, best->format ) != best->sceneHash)
+	{
+		printf( "Checkpoint was written for another scene; starting over.\n" );
+		r.scene.SetTime( r.anim_time );
+		return false;
+	}
+	// the accumulator is stored in the output layout, which must be available here
+	const Accumulator::Format format = (Accumulator::Format)best->format;
+	r.denoised.Init( best->pixelCount, format );
+	if (r.denoised.format != best->format || r.denoised.Bytes() != best->accumulatorBytes)
+	{
+		printf( "Checkpoint accumulator format is not available; starting over.\n" );
+		r.denoised.Init( SCRWIDTH * SCRHEIGHT, Accumulator::FLOAT4 );
+		r.scene.SetTime( r.anim_time );
+		return false;
+	}
+	r.accumulator.Init( best->pixelCount, Accumulator::Blended( format ), false );
+	const uchar* payload = (const uchar*)best + PAGE;
+	r.accumulator.Import( format, payload );
+	r.quality.Resize( best->tileCount );
+	memcpy( r.quality.level, payload + best->accumulatorBytes, best->tileCount * sizeof( int ) );
+	r.camera = best->camera;
+	r.anim_time = best->animTime, r.frame = best->frame;
+	r.accumulated = best->accumulated, r.historyRes = best->historyRes;
+	r.accumulate = best->accumulate, r.animating = best->animating;
+	r.governor.enabled = best->resolutionGovernor, r.governor.level = best->resolutionLevel;
+	r.quality.enabled = best->qualityGovernor;
+	sequence = best->sequence;
+	resumed = true;
+	printf( "Resumed from checkpoint %llu: %i samples per pixel.\n", (unsigned long long)sequence, r.accumulated );
+	return true;
+}
+
+// -----------------------------------------------------------
+// Replace a file by another in one step; a crash leaves one
+// of the two complete
+// -----------------------------------------------------------
+static bool ReplaceWith( const char* file, const char* replacement )
+{
+#ifdef _WIN32
+	return MoveFileExA( replacement, file, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH ) != 0;
+#else
+	return rename( replacement, file ) == 0;
+#endif
+}
+
+// -----------------------------------------------------------
+// Overwrite the older slot. An existing file with the current
+// layout is mapped as it is, as its slots may hold the state
+// we resumed from. When the payload size changes, the new file
+// is built under a private name, gets its first slot, and only
+// then replaces the old one.
+// -----------------------------------------------------------
+bool Checkpoint::Write( Renderer& r )
+{
+	Timer t;
+	// the accumulator goes out in the output layout, e.g. RGB9E5 at 4 bytes per pixel
+	const Accumulator::Format format = r.denoised.format;
+	const size_t accumulatorBytes = r.accumulator.Bytes( format ), levelBytes = r.quality.tileCount * sizeof( int );
+	const size_t slot = PAGE + PAGEALIGN( accumulatorBytes + levelBytes );
+	char tmp[1024] = {};
+	if (!mapped.data || slot != slotBytes)
+	{
+		mapped.Close();
+		slotBytes = 0;
+		MappedFile existing;
+		bool keep = existing.Open( file ) && existing.size == PAGE + 2 * slot;
+		if (keep)
+		{
+			const CheckpointFile& header = *(const CheckpointFile*)existing.data;
+			keep = !memcmp( header.magic, checkpointMagic, 4 ) && header.version == checkpointVersion && header.slotBytes == slot;
+		}
+		existing.Close();
+		if (!keep) sprintf( tmp, "%s.%u", file, ProcessId() );
+		if (!mapped.Create( keep ? file : tmp, PAGE + 2 * slot )) return false;
+		if (!keep)
+		{
+			CheckpointFile& header = *(CheckpointFile*)mapped.data;
+			memcpy( header.magic, checkpointMagic, 4 );
+			header.version = checkpointVersion, header.slotBytes = slot;
+			for (int i = 0; i < 2; i++) ((CheckpointSlot*)(mapped.data + PAGE + i * slot))->sequence = 0;
+			mapped.Flush();
+		}
+		slotBytes = slot;
+	}
+	CheckpointSlot* slots[2] = { (CheckpointSlot*)(mapped.data + PAGE), (CheckpointSlot*)(mapped.data + PAGE + slot) };
+	const int target = slots[0]->sequence <= slots[1]->sequence ? 0 : 1;
+	// stay ahead of slots we did not resume from, e.g. for another scene
+	sequence = max( sequence, max( slots[0]->sequence, slots[1]->sequence ) );
+	const size_t offset = PAGE + target * slot;
+	CheckpointSlot& s = *slots[target];
+	// invalidate, fill, flush, and only then mark complete
+	s.sequence = 0;
+	mapped.Flush( offset, sizeof( CheckpointSlot ) );
+	s.sceneHash = StateHash( r, format );
+	s.camera = r.camera;
+	s.animTime = r.anim_time, s.frame = r.frame;
+	s.accumulated = r.accumulated, s.historyRes = r.historyRes;
+	s.format = format, s.pixelCount = r.accumulator.pixelCount;
+	s.accumulatorBytes = accumulatorBytes;
+	s.tileCount = r.quality.tileCount, s.resolutionLevel = r.governor.level;
+	s.resolutionGovernor = r.governor.enabled, s.qualityGovernor = r.quality.enabled;
+	s.accumulate = r.accumulate, s.animating = r.animating;
+	uchar* payload = mapped.data + offset + PAGE;
+	r.accumulator.Export( format, payload );
+	memcpy( payload + accumulatorBytes, r.quality.level, levelBytes );
+	mapped.Flush( offset, slot );
+	s.sequence = ++sequence;
+	mapped.Flush( offset, sizeof( CheckpointSlot ) );
+	if (tmp[0])
+	{
+		// the new file is complete: put it in place, and map it there
+		mapped.Close();
+		slotBytes = 0;
+		if (!ReplaceWith( file, tmp ) || !mapped.Create( file, PAGE + 2 * slot ))
+		{
+			remove( tmp );
+			return false;
+		}
+		slotBytes = slot;
+	}
+	sinceWrite.reset();
+	writeMs = t.elapsed() * 1000;
+	return true;
+}
+
+// -----------------------------------------------------------
+// Periodic checkpoint, called at the end of every frame
+// -----------------------------------------------------------
+void Checkpoint::Update( Renderer& r )
+{
+	if (!enabled || !r.accumulate || r.accumulated == 0 || sinceWrite.elapsed() < interval) return;
+	if (!Write( r )) enabled = false, printf( "Could not write %s; checkpoints disabled.\n", file );
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+class Renderer;
+
+// -----------------------------------------------------------
+// Checkpoint
+// Keeps the state of a progressive render in a memory-mapped
+// file, so that a long render survives a crash or a restart:
+// the accumulator, its sample count, the per-tile quality
+// levels, the frame counter that seeds the samplers, camera,
+// animation time and a hash of the scene at that time,
+// including SDF and stress objects and the accumulator layout.
+// The accumulator is stored in the layout of the output buffer,
+// so a compact output format also makes the file compact.
+// The file holds two slots that are written in turns. A slot
+// is marked complete only after its contents reached the
+// disk, so an interrupted write leaves the other one intact.
+// -----------------------------------------------------------
+class Checkpoint
+{
+public:
+	bool Resume( Renderer& renderer );
+	bool Write( Renderer& renderer );
+	// write when the interval passed and there is a history worth keeping
+	void Update( Renderer& renderer );
+	// the scene at its current time; render workers are matched on this too
+	static uint64_t SceneHash( Scene& scene );
+	static uint64_t StateHash( Renderer& renderer, const int format );
+	// settings
+	bool enabled = true;
+	float interval = 30; // seconds
+	const char* file = "checkpoint.dat";
+	// state
+	Timer sinceWrite;
+	float writeMs = 0;
+	uint64_t sequence = 0;
+	bool resumed = false;
+private:
+	MappedFile mapped;
+	size_t slotBytes = 0;
+};
+
+} // namespace Tmpl8
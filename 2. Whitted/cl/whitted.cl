@@ -0,0 +1,542 @@
+// -----------------------------------------------------------
+// whitted.cl
+// OpenCL port of Renderer::Trace. The recursion is replaced by
+// a small explicit stack of pending rays, each carrying the
+// weight that the recursive version applies on the way back.
+// The scene is not described here: the primitives, transforms
+// and materials arrive in SceneData, which CLTracer packs from
+// the C++ Scene every frame. Only the plane textures and the
+// shape of the quartic solver are code.
+// Plain OpenCL C 1.2 without required extensions, so that CPU
+// runtimes such as PoCL can run it; double precision for the
+// torus is used when the device has it.
+// -----------------------------------------------------------
+
+#ifdef cl_khr_fp64
+#pragma OPENCL EXTENSION cl_khr_fp64 : enable
+typedef double real;
+#else
+typedef float real;
+#endif
+
+#define EPSILON		0.0001f
+#define INVPI		0.31830988618379f
+#define STACKSIZE	16
+#define LIGHTRADIUS	0.1f
+
+// must match CLScene in cltracer.h
+struct SceneData
+{
+	float4 sphere[2];			// xyz: center, w: squared radius
+	float4 cubeM[3], cubeInvM[3];	// rows of the cube transform and its inverse
+	float4 cubeMin, cubeMax;
+	float4 torusT[3], torusInvT[3];
+	float4 torus;				// x: rc2, y: rt2, z: squared bounding radius
+	float4 plane[6];			// xyz: normal, w: distance
+	float4 quadInvT[12];		// three rows per light quad
+	float4 quadN;				// xyz: light quad normal, w: half size
+	float4 light;				// xyz: point light position, w: quad count
+	float4 lightColor;
+	float4 albedo[11];			// constant albedo per object
+	float4 material[11];		// x: reflectivity, y: refractivity
+	float4 absorption;
+};
+
+// -----------------------------------------------------------
+// Specialization: CLTracer compiles a variant per scene and
+// quality level with these defined, so loops over lights and
+// samples unroll and unused materials drop out; without them
+// the runtime values are used.
+//   LIGHTCOUNT               number of light quads
+//   MAXDEPTH, SHADOWSAMPLES, SPP
+//   REFLECTIVE, REFRACTIVE   bit masks over objIdx
+// -----------------------------------------------------------
+#ifdef LIGHTCOUNT
+#define LIGHTS(s)	LIGHTCOUNT
+#else
+#define LIGHTS(s)	((int)(s)->light.w)
+#endif
+
+// texture layout in the texture buffer: logo, red wall, blue wall
+#define LOGO	0
+#define RED		(128 * 64)
+#define BLUE	(128 * 64 + 512 * 512)
+
+// -----------------------------------------------------------
+// Helpers, matching tmplmath
+// -----------------------------------------------------------
+uint WangHash( uint s )
+{
+	s = (s ^ 61) ^ (s >> 16);
+	s *= 9, s = s ^ (s >> 4);
+	s *= 0x27d4eb2d;
+	s = s ^ (s >> 15);
+	return s;
+}
+uint InitSeed( uint seedBase ) { return WangHash( (seedBase + 1) * 17 ); }
+float RandomFloat( uint* seed )
+{
+	*seed ^= *seed << 13;
+	*seed ^= *seed >> 17;
+	*seed ^= *seed << 5;
+	return *seed * 2.3283064365387e-10f;
+}
+float3 TransformPosition( const float3 p, __global const float4* M )
+{
+	return (float3)(dot( M[0].xyz, p ) + M[0].w, dot( M[1].xyz, p ) + M[1].w, dot( M[2].xyz, p ) + M[2].w);
+}
+float3 TransformVector( const float3 v, __global const float4* M )
+{
+	return (float3)(dot( M[0].xyz, v ), dot( M[1].xyz, v ), dot( M[2].xyz, v ));
+}
+float3 reflect( const float3 D, const float3 N ) { return D - 2 * N * dot( N, D ); }
+
+// -----------------------------------------------------------
+// Primitives; see the classes in scene.h
+// -----------------------------------------------------------
+void IntersectSphere( const float4 sphere, const int idx, const float3 O, const float3 D, float* t, int* objIdx )
+{
+	const float3 oc = O - sphere.xyz;
+	const float b = dot( oc, D ), c = dot( oc, oc ) - sphere.w;
+	float d = b * b - c;
+	if (d <= 0) return;
+	d = sqrt( d );
+	float h = -b - d;
+	if (h < *t && h > 0) { *t = h, *objIdx = idx; return; }
+	if (c > 0) return; // we're outside; safe to skip option 2
+	h = d - b;
+	if (h < *t && h > 0) *t = h, *objIdx = idx;
+}
+
+float2 CubeSlabs( __global const struct SceneData* s, const float3 O, const float3 D )
+{
+	// 'rotate' the cube by transforming the ray into object space
+	const float3 o = TransformPosition( O, s->cubeInvM ), d = TransformVector( D, s->cubeInvM );
+	const float3 rd = (float3)(1.0f / d.x, 1.0f / d.y, 1.0f / d.z);
+	const float3 t1 = (s->cubeMin.xyz - o) * rd, t2 = (s->cubeMax.xyz - o) * rd;
+	const float3 vmin = fmin( t1, t2 ), vmax = fmax( t1, t2 );
+	return (float2)(fmax( vmin.x, fmax( vmin.y, vmin.z ) ), fmin( vmax.x, fmin( vmax.y, vmax.z ) ));
+}
+
+void IntersectQuads( __global const struct SceneData* s, const float3 O, const float3 D, float* t, int* objIdx )
+{
+	const float size = s->quadN.w;
+	for (int i = 0; i < LIGHTS( s ); i++)
+	{
+		__global const float4* invT = s->quadInvT + i * 3;
+		const float h = (dot( invT[1].xyz, O ) + invT[1].w) / -dot( invT[1].xyz, D );
+		if (h >= *t || h <= 0) continue;
+		const float Ix = dot( invT[0].xyz, O ) + invT[0].w + h * dot( invT[0].xyz, D );
+		const float Iz = dot( invT[2].xyz, O ) + invT[2].w + h * dot( invT[2].xyz, D );
+		if (Ix > -size && Ix < size && Iz > -size && Iz < size) *t = h, *objIdx = 0;
+	}
+}
+
+// torus via: https://www.shadertoy.com/view/4sBGDy
+void IntersectTorus( __global const struct SceneData* s, const float3 Of, const float3 Df, float* ft, int* objIdx )
+{
+	const float3 Ot = TransformPosition( Of, s->torusInvT ), Dt = TransformVector( Df, s->torusInvT );
+	// extension rays need double precision for the quadratic solver!
+	const real Ox = Ot.x, Oy = Ot.y, Oz = Ot.z, Dx = Dt.x, Dy = Dt.y, Dz = Dt.z;
+	const real rc2 = s->torus.x, rt2 = s->torus.y;
+	real po = 1;
+	real m = Ox * Ox + Oy * Oy + Oz * Oz;
+	real k3 = Ox * Dx + Oy * Dy + Oz * Dz;
+	real k32 = k3 * k3;
+	// bounding sphere test
+	if (k32 < m - s->torus.z) return;
+	// setup torus intersection
+	real k = (m - rt2 - rc2) * 0.5f;
+	real k2 = k32 + rc2 * Dz * Dz + k;
+	real k1 = k * k3 + rc2 * Oz * Dz;
+	real k0 = k * k + rc2 * Oz * Oz - rc2 * rt2;
+	// solve quadratic equation
+	if (fabs( k3 * (k32 - k2) + k1 ) < 0.0001f)
+	{
+		const real tmp = k1; k1 = k3, k3 = tmp;
+		po = -1;
+		k0 = 1 / k0;
+		k1 = k1 * k0;
+		k2 = k2 * k0;
+		k3 = k3 * k0;
+		k32 = k3 * k3;
+	}
+	real c2 = 2 * k2 - 3 * k32;
+	real c1 = k3 * (k32 - k2) + k1;
+	real c0 = k3 * (k3 * (-3 * k32 + 4 * k2) - 8 * k1) + 4 * k0;
+	c2 *= 0.33333333333f;
+	c1 *= 2;
+	c0 *= 0.33333333333f;
+	real Q = c2 * c2 + c0;
+	real R = 3 * c0 * c2 - c2 * c2 * c2 - c1 * c1;
+	real h = R * R - Q * Q * Q;
+	real z;
+	if (h < 0)
+	{
+		const real sQ = sqrt( Q );
+		z = 2 * sQ * cos( acos( R / (sQ * Q) ) * 0.33333333333f );
+	}
+	else
+	{
+		const real sQ = cbrt( sqrt( h ) + fabs( R ) );
+		z = copysign( fabs( sQ + Q / sQ ), R );
+	}
+	z = c2 - z;
+	real d1 = z - 3 * c2;
+	real d2 = z * z - 3 * c0;
+	if (fabs( d1 ) < 1.0e-8f)
+	{
+		if (d2 < 0) return;
+		d2 = sqrt( d2 );
+	}
+	else
+	{
+		if (d1 < 0) return;
+		d1 = sqrt( d1 * 0.5f );
+		d2 = c1 / d1;
+	}
+	real t = 1e20f;
+	h = d1 * d1 - z + d2;
+	if (h > 0)
+	{
+		h = sqrt( h );
+		real t1 = -d1 - h - k3, t2 = -d1 + h - k3;
+		t1 = (po < 0) ? 2 / t1 : t1;
+		t2 = (po < 0) ? 2 / t2 : t2;
+		if (t1 > 0) t = t1;
+		if (t2 > 0) t = fmin( t, t2 );
+	}
+	h = d1 * d1 - z - d2;
+	if (h > 0)
+	{
+		h = sqrt( h );
+		real t1 = d1 - h - k3, t2 = d1 + h - k3;
+		t1 = (po < 0) ? 2 / t1 : t1;
+		t2 = (po < 0) ? 2 / t2 : t2;
+		if (t1 > 0) t = fmin( t, t1 );
+		if (t2 > 0) t = fmin( t, t2 );
+	}
+	const float tf = (float)t;
+	if (tf > 0 && tf < *ft) *ft = tf, *objIdx = 10;
+}
+
+bool TorusOccludes( __global const struct SceneData* s, const float3 Of, const float3 Df, const float tmax )
+{
+	const float3 O = TransformPosition( Of, s->torusInvT ), D = TransformVector( Df, s->torusInvT );
+	const float rc2 = s->torus.x, rt2 = s->torus.y;
+	float po = 1;
+	float m = dot( O, O );
+	float k3 = dot( O, D );
+	float k32 = k3 * k3;
+	// bounding sphere test
+	if (k32 < m - s->torus.z) return false;
+	// setup torus intersection
+	float k = (m - rt2 - rc2) * 0.5f;
+	float k2 = k32 + rc2 * D.z * D.z + k;
+	float k1 = k * k3 + rc2 * O.z * D.z;
+	float k0 = k * k + rc2 * O.z * O.z - rc2 * rt2;
+	// solve quadratic equation
+	if (fabs( k3 * (k32 - k2) + k1 ) < 0.01f)
+	{
+		const float tmp = k1; k1 = k3, k3 = tmp;
+		po = -1;
+		k0 = 1 / k0;
+		k1 = k1 * k0;
+		k2 = k2 * k0;
+		k3 = k3 * k0;
+		k32 = k3 * k3;
+	}
+	float c2 = (2 * k2 - 3 * k32) * 0.33333333333f;
+	float c1 = (k3 * (k32 - k2) + k1) * 2;
+	float c0 = (k3 * (k3 * (-3 * k32 + 4 * k2) - 8 * k1) + 4 * k0) * 0.33333333333f;
+	float Q = c2 * c2 + c0;
+	float R = 3 * c0 * c2 - c2 * c2 * c2 - c1 * c1;
+	float h = R * R - Q * Q * Q;
+	float z;
+	if (h < 0)
+	{
+		const float sQ = sqrt( Q );
+		z = 2 * sQ * cos( acos( R / (sQ * Q) ) * 0.3333333f );
+	}
+	else
+	{
+		const float sQ = cbrt( sqrt( h ) + fabs( R ) );
+		z = copysign( fabs( sQ + Q / sQ ), R );
+	}
+	z = c2 - z;
+	float d1 = z - 3 * c2;
+	float d2 = z * z - 3 * c0;
+	if (fabs( d1 ) < 1.0e-4f)
+	{
+		if (d2 < 0) return false;
+		d2 = sqrt( d2 );
+	}
+	else
+	{
+		if (d1 < 0) return false;
+		d1 = sqrt( d1 * 0.5f );
+		d2 = c1 / d1;
+	}
+	h = d1 * d1 - z + d2;
+	if (h > 0)
+	{
+		float t1 = -d1 - sqrt( h ) - k3;
+		t1 = (po < 0) ? 2 / t1 : t1;
+		if (t1 > 0 && t1 < tmax) return true;
+	}
+	h = d1 * d1 - z - d2;
+	if (h > 0)
+	{
+		float t1 = d1 - sqrt( h ) - k3;
+		t1 = (po < 0) ? 2 / t1 : t1;
+		if (t1 > 0 && t1 < tmax) return true;
+	}
+	return false;
+}
+
+// -----------------------------------------------------------
+// Scene queries, as Scene::FindNearest / IsOccluded
+// -----------------------------------------------------------
+int FindNearest( __global const struct SceneData* s, const float3 O, const float3 D, float* t )
+{
+	int objIdx = -1;
+	for (int i = 0; i < 6; i++)
+	{
+		const float h = -(dot( O, s->plane[i].xyz ) + s->plane[i].w) / dot( D, s->plane[i].xyz );
+		if (h < *t && h > 0) *t = h, objIdx = i + 4;
+	}
+	IntersectQuads( s, O, D, t, &objIdx );
+	IntersectSphere( s->sphere[0], 1, O, D, t, &objIdx );
+	IntersectSphere( s->sphere[1], 2, O, D, t, &objIdx );
+	const float2 slabs = CubeSlabs( s, O, D );
+	if (slabs.x < slabs.y)
+	{
+		if (slabs.x > 0) { if (slabs.x < *t) *t = slabs.x, objIdx = 3; }
+		else if (slabs.y > 0 && slabs.y < *t) *t = slabs.y, objIdx = 3;
+	}
+	IntersectTorus( s, O, D, t, &objIdx );
+	return objIdx;
+}
+
+bool IsOccluded( __global const struct SceneData* s, const float3 O, const float3 D, const float tmax )
+{
+	const float2 slabs = CubeSlabs( s, O, D );
+	if (slabs.y > 0 && slabs.x < slabs.y && slabs.x < tmax) return true;
+	const float3 oc = O - s->sphere[0].xyz;
+	const float b = dot( oc, D ), d = b * b - (dot( oc, oc ) - s->sphere[0].w);
+	if (d > 0)
+	{
+		const float h = -b - sqrt( d );
+		if (h < tmax && h > 0) return true;
+	}
+	float t = tmax;
+	int objIdx = -1;
+	IntersectQuads( s, O, D, &t, &objIdx );
+	if (objIdx == 0) return true;
+	return TorusOccludes( s, O, D, tmax ); // skip planes and rounded corners
+}
+
+float3 GetNormal( __global const struct SceneData* s, const int objIdx, const float3 I, const float3 wo )
+{
+	float3 N;
+	if (objIdx == 0) N = s->quadN.xyz;
+	else if (objIdx < 3) N = (I - s->sphere[objIdx - 1].xyz) * rsqrt( s->sphere[objIdx - 1].w );
+	else if (objIdx == 3)
+	{
+		// nearest face in object space
+		const float3 objI = TransformPosition( I, s->cubeInvM );
+		const float3 d0 = fabs( objI - s->cubeMin.xyz ), d1 = fabs( objI - s->cubeMax.xyz );
+		float minDist = d0.x;
+		N = (float3)(-1, 0, 0);
+		if (d1.x < minDist) minDist = d1.x, N = (float3)(1, 0, 0);
+		if (d0.y < minDist) minDist = d0.y, N = (float3)(0, -1, 0);
+		if (d1.y < minDist) minDist = d1.y, N = (float3)(0, 1, 0);
+		if (d0.z < minDist) minDist = d0.z, N = (float3)(0, 0, -1);
+		if (d1.z < minDist) minDist = d1.z, N = (float3)(0, 0, 1);
+		N = TransformVector( N, s->cubeM );
+	}
+	else if (objIdx == 10)
+	{
+		const float3 L = TransformPosition( I, s->torusInvT );
+		N = normalize( L * (dot( L, L ) - s->torus.y - s->torus.x * (float3)(1, 1, -1)) );
+		N = TransformVector( N, s->torusT );
+	}
+	else N = s->plane[objIdx - 4].xyz;
+	return dot( N, wo ) > 0 ? -N : N; // hit backside / inside
+}
+
+float3 Texel( __global const uint* textures, const int index )
+{
+	const uint p = textures[index];
+	return (float3)((p >> 16) & 255, (p >> 8) & 255, p & 255) * (1.0f / 255.0f);
+}
+
+float3 GetAlbedo( __global const struct SceneData* s, __global const uint* textures, const int objIdx, const float3 I )
+{
+	if (objIdx < 4 || objIdx > 9) return s->albedo[objIdx].xyz;
+	const float3 N = s->plane[objIdx - 4].xyz;
+	if (N.y == 1)
+	{
+		// floor albedo: checkerboard
+		int ix = (int)(I.x * 2 + 96.01f), iz = (int)(I.z * 2 + 96.01f);
+		// add deliberate aliasing to two tile
+		if (ix == 98 && iz == 98) ix = (int)(I.x * 32.01f), iz = (int)(I.z * 32.01f);
+		if (ix == 94 && iz == 98) ix = (int)(I.x * 64.01f), iz = (int)(I.z * 64.01f);
+		return (float3)(((ix + iz) & 1) ? 1 : 0.3f);
+	}
+	if (N.z == -1)
+	{
+		// back wall: logo
+		const int ix = (int)((I.x + 4) * (128.0f / 8)), iy = (int)((2 - I.y) * (64.0f / 3));
+		return Texel( textures, LOGO + (ix & 127) + (iy & 63) * 128 );
+	}
+	if (N.x == 1 || N.x == -1)
+	{
+		// left wall: red, right wall: blue
+		const int ix = (int)((I.z - 4) * (512.0f / 7)), iy = (int)((2 - I.y) * (512.0f / 3));
+		return Texel( textures, (N.x == 1 ? RED : BLUE) + (ix & 511) + (iy & 511) * 512 );
+	}
+	return s->albedo[objIdx].xyz;
+}
+
+// -----------------------------------------------------------
+// Renderer::DirectIllumination, without the lightmap
+// -----------------------------------------------------------
+float3 DirectIllumination( __global const struct SceneData* s, const float3 I, const float3 N, const int samples, uint* seed )
+{
+	float3 irradiance = (float3)(0);
+	for (int i = 0; i < samples; i++)
+	{
+		float3 pointOnLight = s->light.xyz;
+		if (samples > 1)
+		{
+			float3 offset;
+			do offset = (float3)(RandomFloat( seed ), RandomFloat( seed ), RandomFloat( seed )) * 2 - 1;
+			while (dot( offset, offset ) > 1);
+			pointOnLight += offset * LIGHTRADIUS;
+		}
+		float3 L = pointOnLight - I;
+		const float distance = length( L );
+		L *= 1 / distance;
+		const float ndotl = dot( N, L );
+		if (ndotl < EPSILON) /* we don't face the light */ continue;
+		if (!IsOccluded( s, I + L * EPSILON, L, distance - 2 * EPSILON ))
+			irradiance += s->lightColor.xyz * (ndotl / (distance * distance));
+	}
+	return irradiance * (1.0f / samples);
+}
+
+// -----------------------------------------------------------
+// Iterative Whitted: every pending ray carries the product of
+// the reflectivity, Fresnel and absorption factors above it
+// -----------------------------------------------------------
+struct PendingRay { float3 O, D, weight; int depth, inside; };
+
+float3 Trace( __global const struct SceneData* s, __global const uint* textures, const float3 O, const float3 D,
+	const int maxDepth, const int shadowSamples, uint* seed, float4* guide )
+{
+	struct PendingRay stack[STACKSIZE];
+	int sp = 0;
+	stack[sp].O = O, stack[sp].D = D, stack[sp].weight = (float3)(1);
+	stack[sp].depth = 0, stack[sp++].inside = 0;
+	float3 color = (float3)(0);
+	while (sp > 0)
+	{
+		const struct PendingRay ray = stack[--sp];
+		float t = 1e34f;
+		const int objIdx = FindNearest( s, ray.O, ray.D, &t );
+		if (ray.depth == 0) *guide = objIdx == -1 ? (float4)(0, 0, 0, 1e34f) : (float4)(GetNormal( s, objIdx, ray.O + t * ray.D, ray.D ), t);
+		if (objIdx == -1) /* ray left the scene */ continue;
+		if (ray.depth > maxDepth) /* bounced too many times */ continue;
+		// gather shading data
+		const float3 I = ray.O + t * ray.D;
+		const float3 N = GetNormal( s, objIdx, I, ray.D );
+		const float3 albedo = GetAlbedo( s, textures, objIdx, I );
+#ifdef REFLECTIVE
+		const float reflectivity = ((REFLECTIVE >> objIdx) & 1) ? s->material[objIdx].x : 0;
+		const float refractivity = ((REFRACTIVE >> objIdx) & 1) ? s->material[objIdx].y : 0;
+#else
+		const float reflectivity = s->material[objIdx].x, refractivity = s->material[objIdx].y;
+#endif
+		const float diffuseness = 1 - (reflectivity + refractivity);
+		// apply absorption if we travelled through a medium
+		float3 weight = ray.weight;
+		if (ray.inside) weight *= exp( s->absorption.xyz * -t );
+		// handle pure speculars such as mirrors
+		const float3 R = reflect( ray.D, N );
+		if (reflectivity > 0 && sp < STACKSIZE)
+		{
+			stack[sp].O = I + R * EPSILON, stack[sp].D = R, stack[sp].weight = weight * reflectivity * albedo;
+			stack[sp].depth = ray.depth + 1, stack[sp++].inside = 0;
+		}
+		// handle dielectrics such as glass / water
+		if (refractivity > 0)
+		{
+			const float n1 = ray.inside ? 1.2f : 1, n2 = ray.inside ? 1 : 1.2f;
+			const float eta = n1 / n2, cosi = dot( -ray.D, N );
+			const float cost2 = 1.0f - eta * eta * (1 - cosi * cosi);
+			float Fr = 1;
+			if (cost2 > 0)
+			{
+				const float a = n1 - n2, b = n1 + n2, R0 = (a * a) / (b * b), c = 1 - cosi;
+				Fr = R0 + (1 - R0) * (c * c * c * c * c);
+				const float3 T = eta * ray.D + ((eta * cosi - sqrt( fabs( cost2 ) )) * N);
+				if (sp < STACKSIZE)
+				{
+					stack[sp].O = I + T * EPSILON, stack[sp].D = T, stack[sp].weight = weight * albedo * (1 - Fr);
+					stack[sp].depth = ray.depth + 1, stack[sp++].inside = !ray.inside;
+				}
+			}
+			if (sp < STACKSIZE)
+			{
+				stack[sp].O = I + R * EPSILON, stack[sp].D = R, stack[sp].weight = weight * albedo * Fr;
+				stack[sp].depth = ray.depth + 1, stack[sp++].inside = 0;
+			}
+		}
+		// handle diffuse surfaces; no diffuse interreflections: approximate
+		if (diffuseness > 0)
+		{
+			const float3 irradiance = DirectIllumination( s, I, N, shadowSamples, seed );
+			color += weight * diffuseness * albedo * INVPI * (irradiance + (float3)(0.2f));
+		}
+	}
+	return color;
+}
+
+// -----------------------------------------------------------
+// One work item per pixel at the internal resolution; writes
+// the accumulator like the tile loop in Renderer::Tick
+// -----------------------------------------------------------
+__kernel void render( __global float4* accumulator, __global float4* guide, __global const struct SceneData* scene, __global const uint* textures,
+	const float3 camPos, const float3 topLeft, const float3 topRight, const float3 bottomLeft,
+	const int width, const int height, const float sx, const float sy, const uint seedBase,
+	const int maxDepth, const int shadowSamples, const int spp, const int accumulated, const float blend )
+{
+#ifdef MAXDEPTH
+	const int depthLimit = MAXDEPTH, shadowRays = SHADOWSAMPLES, samples = SPP;
+#else
+	const int depthLimit = maxDepth, shadowRays = shadowSamples, samples = spp;
+#endif
+	// sx, sy: the size of one pixel in camera-plane units, where u, v are in [0..1]
+	const int pixel = get_global_id( 0 );
+	if (pixel >= width * height) return;
+	const int x = pixel % width, y = pixel / width;
+	uint seed = InitSeed( pixel + seedBase );
+	float3 sum = (float3)(0);
+	float4 primary;
+	for (int i = 0; i < samples; i++)
+	{
+		// the first ray is not jittered unless we are refining an accumulated image
+		const float jx = (i > 0 || accumulated) ? RandomFloat( &seed ) : 0;
+		const float jy = (i > 0 || accumulated) ? RandomFloat( &seed ) : 0;
+		const float u = (x + jx) * sx, v = (y + jy) * sy;
+		const float3 P = topLeft + u * (topRight - topLeft) + v * (bottomLeft - topLeft);
+		float4 hit;
+		sum += Trace( scene, textures, camPos, normalize( P - camPos ), depthLimit, shadowRays, &seed, &hit );
+		if (i == 0) primary = hit;
+	}
+	float3 color = sum * (1.0f / samples);
+	if (accumulated) color = accumulator[pixel].xyz * (1 - blend) + color * blend;
+	accumulator[pixel] = (float4)(color, 0);
+	guide[pixel] = primary;
+}
@@ -0,0 +1,152 @@
+#include "precomp.h"
+
+// -----------------------------------------------------------
+// Copy the top three rows of a transform
+// -----------------------------------------------------------
+static void Rows( const mat4& M, float4* rows )
+{
+	for (int i = 0; i < 3; i++) rows[i] = float4( M.cell[i * 4], M.cell[i * 4 + 1], M.cell[i * 4 + 2], M.cell[i * 4 + 3] );
+}
+
+// -----------------------------------------------------------
+// Gather the primitives, lights and materials of the scene
+// -----------------------------------------------------------
+void CLScene::Pack( Scene& scene )
+{
+	sphere[0] = float4( scene.sphere.pos, scene.sphere.r2 );
+	sphere[1] = float4( scene.sphere2.pos, scene.sphere2.r2 );
+	Rows( scene.cube.M, cubeM ), Rows( scene.cube.invM, cubeInvM );
+	cubeMin = float4( scene.cube.b[0].x, scene.cube.b[0].y, scene.cube.b[0].z, 0 );
+	cubeMax = float4( scene.cube.b[1].x, scene.cube.b[1].y, scene.cube.b[1].z, 0 );
+	Rows( scene.torus.T, torusT ), Rows( scene.torus.invT, torusInvT );
+	torus = float4( scene.torus.rc2, scene.torus.rt2, scene.torus.r2, 0 );
+	for (int i = 0; i < 6; i++) plane[i] = float4( scene.plane[i].N, scene.plane[i].d );
+	const int lights = (int)scene.GetLightCount();
+	for (int i = 0; i < lights; i++)
+	{
+#ifdef FOURLIGHTS
+		// the four quads are hardcoded in FindNearest, their transforms are unused
+		Rows( mat4::Translate( -scene.GetLightPos( (uint)i ) ), quadInvT + i * 3 );
+		const Quad& q = scene.quad[0];
+#else
+		Rows( scene.quad.invT, quadInvT + i * 3 );
+		const Quad& q = scene.quad;
+#endif
+		quadN = float4( q.GetNormal( float3( 0 ) ), q.size );
+	}
+	light = float4( scene.GetLightPos(), (float)lights );
+	lightColor = float4( scene.GetLightColor(), 0 );
+	for (int i = 0; i < 11; i++)
+	{
+		// the kernel samples the textured planes itself, this is used for the others
+		albedo[i] = float4( scene.GetAlbedo( i, float3( 0 ) ), 0 );
+		material[i] = float4( scene.GetReflectivity( i, float3( 0 ) ), scene.GetRefractivity( i, float3( 0 ) ), 0, 0 );
+	}
+	absorption = float4( scene.GetAbsorption( 3 ), 0 );
+}
+
+// -----------------------------------------------------------
+// Scene and quality constants for a specialized kernel; the
+// variant for each combination is compiled once
+// -----------------------------------------------------------
+KernelDefines CLTracer::Specialization( const CLScene& data, const QualitySettings& q )
+{
+	int reflective = 0, refractive = 0;
+	for (int i = 0; i < 11; i++)
+	{
+		if (data.material[i].x > 0) reflective |= 1 << i;
+		if (data.material[i].y > 0) refractive |= 1 << i;
+	}
+	KernelDefines defines;
+	defines.Set( "LIGHTCOUNT", (int)data.light.w ).Set( "REFLECTIVE", reflective ).Set( "REFRACTIVE", refractive );
+	defines.Set( "MAXDEPTH", q.maxDepth ).Set( "SHADOWSAMPLES", q.shadowSamples ).Set( "SPP", q.spp );
+	return defines;
+}
+
+// -----------------------------------------------------------
+// Cleanup
+// -----------------------------------------------------------
+CLTracer::~CLTracer()
+{
+	delete sceneUpload;
+	delete textureBuffer;
+	delete pixelBuffer;
+	delete guideBuffer;
+	FREE64( texels );
+	FREE64( pixels );
+	FREE64( guides );
+}
+
+// -----------------------------------------------------------
+// Compile the kernel and create the device buffers; the wall
+// textures are uploaded once. On devices that share host
+// memory, the frame buffers are zero-copy and Resolve reads
+// them without a transfer.
+// -----------------------------------------------------------
+bool CLTracer::Init()
+{
+	if (ready) return true;
+	if (failed || (!Kernel::clStarted && !Kernel::InitCL())) { failed = true; return false; }
+	// the generic variant, so that build errors show up here
+	kernel = Kernel::Specialized( "cl/whitted.cl", "render", KernelDefines() );
+	sceneUpload = new DoubleBuffer( sizeof( CLScene ), Buffer::READONLY );
+	// textures in the order that the kernel expects: logo, red, blue
+	const Surface* surface[3] = { &Plane::Logo(), &Plane::Red(), &Plane::Blue() };
+	const int texelCount[3] = { 128 * 64, 512 * 512, 512 * 512 };
+	texels = (uint*)MALLOC64( (texelCount[0] + texelCount[1] + texelCount[2]) * sizeof( uint ) );
+	for (int i = 0, offset = 0; i < 3; offset += texelCount[i++])
+		memcpy( texels + offset, surface[i]->pixels, texelCount[i] * sizeof( uint ) );
+	textureBuffer = new Buffer( (texelCount[0] + texelCount[1] + texelCount[2]) * sizeof( uint ), texels, Buffer::READONLY );
+	textureBuffer->CopyToDevice();
+	// accumulator and guide at full resolution; lower resolutions use the top rows
+	pixels = (float4*)MALLOC64( SCRWIDTH * SCRHEIGHT * sizeof( float4 ) );
+	guides = (float4*)MALLOC64( SCRWIDTH * SCRHEIGHT * sizeof( float4 ) );
+	const uint zeroCopy = Kernel::unifiedMemory ? Buffer::ZEROCOPY : 0;
+	pixelBuffer = new Buffer( SCRWIDTH * SCRHEIGHT * sizeof( float4 ), pixels, zeroCopy );
+	guideBuffer = new Buffer( SCRWIDTH * SCRHEIGHT * sizeof( float4 ), guides, Buffer::WRITEONLY | zeroCopy );
+	pixelBuffer->Clear();
+	ready = true;
+	return true;
+}
+
+// -----------------------------------------------------------
+// Upload the scene and enqueue one frame; the upload goes
+// through the second queue into the scene buffer that the
+// previous frame did not use
+// -----------------------------------------------------------
+void CLTracer::Render( Scene& scene, const Camera& camera, const int2 res, const QualitySettings& q, const uint frame, const int accumulated, const float blend )
+{
+	CLScene* data = (CLScene*)sceneUpload->HostPtr();
+	data->Pack( scene );
+	sceneUpload->Upload();
+	kernel = Kernel::Specialized( "cl/whitted.cl", "render", specialize ? Specialization( *data, q ) : KernelDefines() );
+	// sx, sy map internal pixels to [0..1] on the camera plane
+	const float sx = 1.0f / res.x, sy = 1.0f / res.y;
+	kernel->SetArguments( pixelBuffer, guideBuffer, sceneUpload->Device(), textureBuffer, camera.camPos, camera.topLeft, camera.topRight, camera.bottomLeft,
+		res.x, res.y, sx, sy, (int)(frame * SCRWIDTH * SCRHEIGHT), q.maxDepth, q.shadowSamples, q.spp, accumulated, blend );
+	kernel->Run( (size_t)(res.x * res.y), 0, sceneUpload->Ready(), sceneUpload->Done() );
+	sceneUpload->Flip();
+}
+
+// -----------------------------------------------------------
+// Wait for the frame and read it back into the host buffers;
+// guide may be null when neither upscaler nor denoiser run
+// -----------------------------------------------------------
+void CLTracer::Resolve( const int2 res, Accumulator& accumulator, float4* guide )
+{
+	Timer t;
+	clFinish( Kernel::GetQueue() );
+	renderMs = t.elapsed() * 1000;
+	t.reset();
+	pixelBuffer->CopyFromDevice();
+	if (guide) guideBuffer->CopyFromDevice();
+	readbackMs = t.elapsed() * 1000;
+	Kernel::CollectProfile();
+	const int count = res.x * res.y, chunk = 16384;
+#pragma omp parallel for schedule(static)
+	for (int first = 0; first < count; first += chunk)
+	{
+		accumulator.Encode( first, min( chunk, count - first ), pixels + first );
+		if (guide) memcpy( guide + first, guides + first, min( chunk, count - first ) * sizeof( float4 ) );
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+struct QualitySettings;
+
+// -----------------------------------------------------------
+// Scene data for the OpenCL kernel; layout must match struct
+// SceneData in cl/whitted.cl. Packed from the C++ Scene every
+// frame, so there is only one scene description.
+// -----------------------------------------------------------
+struct CLScene
+{
+	void Pack( Scene& scene );
+	float4 sphere[2];			// xyz: center, w: squared radius
+	float4 cubeM[3], cubeInvM[3];	// rows of the cube transform and its inverse
+	float4 cubeMin, cubeMax;
+	float4 torusT[3], torusInvT[3];
+	float4 torus;				// x: rc2, y: rt2, z: squared bounding radius
+	float4 plane[6];			// xyz: normal, w: distance
+	float4 quadInvT[12];		// three rows per light quad
+	float4 quadN;				// xyz: light quad normal, w: half size
+	float4 light;				// xyz: point light position, w: quad count
+	float4 lightColor;
+	float4 albedo[11];			// constant albedo per object
+	float4 material[11];		// x: reflectivity, y: refractivity
+	float4 absorption;
+};
+
+// -----------------------------------------------------------
+// CLTracer
+// Runs the Whitted integrator on an OpenCL device. The kernel
+// renders into a device-side float4 accumulator, which keeps
+// the history for progressive refinement; Resolve reads it
+// back into the host accumulator, so denoising, upscaling and
+// the conversion to the screen work as for the C++ path.
+// Lightmap and radiance cache are not available on the device;
+// diffuse hits use the constant ambient term.
+// -----------------------------------------------------------
+class CLTracer
+{
+public:
+	~CLTracer();
+	bool Init();
+	void Render( Scene& scene, const Camera& camera, const int2 res, const QualitySettings& q, const uint frame, const int accumulated, const float blend );
+	void Resolve( const int2 res, Accumulator& accumulator, float4* guide );
+	bool ready = false, failed = false;
+	// compile a kernel variant per scene and quality level
+	bool specialize = true;
+	// timing of the last frame
+	float renderMs = 0, readbackMs = 0;
+private:
+	static KernelDefines Specialization( const CLScene& data, const QualitySettings& q );
+	Kernel* kernel = 0; // variant used by the last frame; owned by Kernel
+	DoubleBuffer* sceneUpload = 0;
+	Buffer* textureBuffer = 0, * pixelBuffer = 0, * guideBuffer = 0;
+	uint* texels = 0;
+	float4* pixels = 0, * guides = 0;
+};
+
+} // namespace Tmpl8
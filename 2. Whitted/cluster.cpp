@@ -0,0 +1,441 @@
+#include "precomp.h"
+
+// messages: a header, then the payload; HELLO goes from worker to coordinator
+// once, FRAME and TILES from coordinator to worker, RESULT back for each tile
+enum MessageType { HELLO = 1, FRAME, TILES, RESULT };
+struct MessageHeader { uint type, bytes; };
+struct HelloMessage { char magic[4]; uint version; uint64_t sceneHash; int threads; };
+struct TileRequest { int tile; QualitySettings q; };		// TILES: frame id, then the requests
+struct TileResult { uint frameId; int tile; float ms; uint rawBytes, packedBytes; }; // then the packed data
+
+static const char clusterMagic[4] = { 'T', '8', 'R', 'T' };
+static const uint clusterVersion = 3;
+
+struct TileCoordinator::Worker
+{
+	Socket socket;
+	thread server;
+	int threads = 1, tiles = 0;
+	uint sentFrame = 0;		// frame whose setup the worker has
+	vector<int> pending;	// tiles sent, without a result yet
+	bool done = false;		// connection lost; joined by the next Render
+};
+
+// -----------------------------------------------------------
+// Pixel rectangle of a tile
+// -----------------------------------------------------------
+static void TileBounds( const int tile, const int tilesX, const int2 res, int2& p0, int2& p1 )
+{
+	p0 = int2( (tile % tilesX) * TILESIZE, (tile / tilesX) * TILESIZE );
+	p1 = int2( min( p0.x + TILESIZE, res.x ), min( p0.y + TILESIZE, res.y ) );
+}
+
+// -----------------------------------------------------------
+// Header and payload in a single send, so that a message does
+// not straddle packets needlessly
+// -----------------------------------------------------------
+static bool SendMessage( Socket& s, const uint type, const void* data, const uint bytes, const void* extra = 0, const uint extraBytes = 0 )
+{
+	vector<uchar> message( sizeof( MessageHeader ) + bytes + extraBytes );
+	const MessageHeader header = { type, bytes + extraBytes };
+	memcpy( message.data(), &header, sizeof( header ) );
+	memcpy( message.data() + sizeof( header ), data, bytes );
+	if (extraBytes) memcpy( message.data() + sizeof( header ) + bytes, extra, extraBytes );
+	return s.Send( message.data(), message.size() );
+}
+
+// scratch for the floats of one tile, or their byte planes; a worker
+// packs, and the coordinator unpacks, tiles on all its threads at once
+static Pool tileScratch( TILESIZE * TILESIZE * 7 * sizeof( float ), 16 );
+
+// -----------------------------------------------------------
+// New samples of a tile (rgb, then the guide if requested),
+// deflated. Floats compress far better with their bytes split
+// into four planes: sign and exponent end up together.
+// -----------------------------------------------------------
+static void PackTile( Renderer& r, const FrameSetup& f, const int tile, const float ms, vector<uchar>& message )
+{
+	int2 p0, p1;
+	TileBounds( tile, f.tilesX, f.res, p0, p1 );
+	const int w = p1.x - p0.x, pixels = w * (p1.y - p0.y), floats = pixels * (f.keepGuide ? 7 : 3);
+	float* raw = (float*)tileScratch.Alloc();
+	uchar* planes = (uchar*)tileScratch.Alloc();
+	for (int i = 0; i < pixels; i++)
+	{
+		const int pixel = p0.x + i % w + (p0.y + i / w) * f.res.x;
+		const float3 c = r.accumulator.Load( pixel );
+		raw[i * 3] = c.x, raw[i * 3 + 1] = c.y, raw[i * 3 + 2] = c.z;
+		if (f.keepGuide) memcpy( &raw[pixels * 3 + i * 4], &r.guide[pixel], sizeof( float4 ) );
+	}
+	const uchar* bytes = (const uchar*)raw;
+	const uint planeBytes = floats * 4;
+	for (int i = 0; i < floats; i++) for (int b = 0; b < 4; b++) planes[b * floats + i] = bytes[i * 4 + b];
+	const size_t offset = sizeof( MessageHeader ) + sizeof( TileResult );
+	uLongf packedBytes = compressBound( planeBytes );
+	message.resize( offset + packedBytes );
+	compress2( message.data() + offset, &packedBytes, planes, planeBytes, 1 );
+	message.resize( offset + packedBytes );
+	tileScratch.Free( raw ), tileScratch.Free( planes );
+	const MessageHeader header = { RESULT, (uint)(sizeof( TileResult ) + packedBytes) };
+	const TileResult result = { f.frameId, tile, ms, planeBytes, (uint)packedBytes };
+	memcpy( message.data(), &header, sizeof( header ) );
+	memcpy( message.data() + sizeof( header ), &result, sizeof( result ) );
+}
+
+// -----------------------------------------------------------
+// Inflate a tile and blend it into the accumulator, exactly as
+// the local tile loop would have
+// -----------------------------------------------------------
+static bool UnpackTile( Renderer& r, const FrameSetup& f, const float blend, const TileResult& result, const uchar* packed )
+{
+	int2 p0, p1;
+	TileBounds( result.tile, f.tilesX, f.res, p0, p1 );
+	const int w = p1.x - p0.x, pixels = w * (p1.y - p0.y), floats = pixels * (f.keepGuide ? 7 : 3);
+	if (result.rawBytes != (uint)floats * 4) return false;
+	uchar* planes = (uchar*)tileScratch.Alloc();
+	uLongf rawBytes = result.rawBytes;
+	const bool inflated = uncompress( planes, &rawBytes, packed, result.packedBytes ) == Z_OK && rawBytes == result.rawBytes;
+	float* raw = (float*)tileScratch.Alloc();
+	uchar* bytes = (uchar*)raw;
+	if (inflated) for (int i = 0; i < floats; i++) for (int b = 0; b < 4; b++) bytes[i * 4 + b] = planes[b * floats + i];
+	tileScratch.Free( planes );
+	if (!inflated)
+	{
+		tileScratch.Free( raw );
+		return false;
+	}
+	for (int i = 0; i < pixels; i++)
+	{
+		const int pixel = p0.x + i % w + (p0.y + i / w) * f.res.x;
+		float3 c( raw[i * 3], raw[i * 3 + 1], raw[i * 3 + 2] );
+		if (f.accumulated) c = r.accumulator.Load( pixel ) * (1 - blend) + c * blend;
+		r.accumulator.Store( pixel, c );
+		if (f.keepGuide) memcpy( &r.guide[pixel], &raw[pixels * 3 + i * 4], sizeof( float4 ) );
+	}
+	tileScratch.Free( raw );
+	r.quality.tileMs[result.tile] = result.ms;
+	return true;
+}
+
+// -----------------------------------------------------------
+// Listen for workers; they must render the same scene, which
+// is compared at animation time zero
+// -----------------------------------------------------------
+bool TileCoordinator::Start( Renderer& r )
+{
+	Stop();
+	renderer = &r;
+	r.scene.SetTime( 0 );
+	sceneHash = Checkpoint::SceneHash( r.scene );
+	r.scene.SetTime( r.anim_time );
+	if (!listener.Listen( port )) return false;
+	acceptor = thread( &TileCoordinator::AcceptLoop, this );
+	printf( "Waiting for render workers on port %i\n", port );
+	return true;
+}
+
+// -----------------------------------------------------------
+// Disconnect all workers; the worker processes reconnect when
+// the coordinator starts again
+// -----------------------------------------------------------
+void TileCoordinator::Stop()
+{
+	listener.Close();
+	if (acceptor.joinable()) acceptor.join();
+	{
+		lock_guard<mutex> l( lock );
+		stopping = true;
+		for (Worker* w : worker) w->socket.Close();
+	}
+	changed.notify_all();
+	for (Worker* w : worker) w->server.join(), delete w;
+	worker.clear();
+	queue.clear();
+	live = remaining = 0;
+	stopping = false;
+}
+
+// -----------------------------------------------------------
+// Accept thread: check the HELLO of each new connection, then
+// give the worker its own thread; ends when Stop closes the
+// listening socket
+// -----------------------------------------------------------
+void TileCoordinator::AcceptLoop()
+{
+	for (;;)
+	{
+		Worker* w = new Worker();
+		if (!listener.Accept( w->socket )) { delete w; return; }
+		MessageHeader header;
+		HelloMessage hello;
+		w->socket.SetTimeout( 5 );
+		if (!w->socket.Receive( &header, sizeof( header ) ) || header.type != HELLO || header.bytes != sizeof( hello ) ||
+			!w->socket.Receive( &hello, sizeof( hello ) ) || memcmp( hello.magic, clusterMagic, 4 ) || hello.version != clusterVersion)
+		{
+			printf( "Rejected %s: not a render worker of this version\n", w->socket.peer );
+			delete w;
+			continue;
+		}
+		if (hello.sceneHash != sceneHash)
+		{
+			printf( "Rejected %s: worker renders a different scene\n", w->socket.peer );
+			delete w;
+			continue;
+		}
+		w->socket.SetTimeout( timeout );
+		w->threads = max( 1, hello.threads );
+		lock_guard<mutex> l( lock );
+		worker.push_back( w );
+		live++;
+		w->server = thread( &TileCoordinator::Serve, this, w );
+		printf( "Render worker %s joined with %i threads\n", w->socket.peer, w->threads );
+	}
+}
+
+// -----------------------------------------------------------
+// Wait until the worker can take more tiles or has tiles out;
+// a batch is at most as many tiles as the worker has threads,
+// and smaller towards the end of the frame. Returns false when
+// the coordinator stops.
+// -----------------------------------------------------------
+bool TileCoordinator::TakeBatch( Worker* w, vector<int>& batch, FrameSetup& frame )
+{
+	batch.clear();
+	unique_lock<mutex> l( lock );
+	const int inFlight = 2 * w->threads;
+	changed.wait( l, [&]() { return stopping || !w->pending.empty() || !queue.empty(); } );
+	if (stopping) return false;
+	if (queue.empty() || (int)w->pending.size() >= inFlight) return true;
+	const int size = clamp( (int)queue.size() / (2 * live), 1, min( w->threads, inFlight - (int)w->pending.size() ) );
+	for (int i = 0; i < size && !queue.empty(); i++) batch.push_back( queue.back() ), queue.pop_back();
+	w->pending.insert( w->pending.end(), batch.begin(), batch.end() );
+	frame = setup;
+	return true;
+}
+
+// -----------------------------------------------------------
+// Hand the tiles of a lost worker to the others
+// -----------------------------------------------------------
+void TileCoordinator::Requeue( Worker* w )
+{
+	w->socket.Close();
+	{
+		lock_guard<mutex> l( lock );
+		if (!stopping)
+		{
+			printf( "Render worker %s lost, %i tiles reissued\n", w->socket.peer, (int)w->pending.size() );
+			lost++;
+		}
+		reissued += (int)w->pending.size();
+		queue.insert( queue.end(), w->pending.begin(), w->pending.end() );
+		w->pending.clear();
+		w->done = true;
+		live--;
+	}
+	changed.notify_all();
+}
+
+// -----------------------------------------------------------
+// Worker thread: send batches, collect results
+// -----------------------------------------------------------
+void TileCoordinator::Serve( Worker* w )
+{
+	vector<int> batch;
+	vector<TileRequest> request;
+	vector<uchar> packed;
+	FrameSetup f;
+	while (TakeBatch( w, batch, f ))
+	{
+		if (!batch.empty())
+		{
+			// the frame setup first, if the worker does not have it yet
+			if (w->sentFrame != f.frameId && !SendMessage( w->socket, FRAME, &f, sizeof( f ) )) break;
+			w->sentFrame = f.frameId;
+			request.resize( batch.size() );
+			for (size_t i = 0; i < batch.size(); i++) request[i] = { batch[i], renderer->quality.GetSettings( batch[i] ) };
+			if (!SendMessage( w->socket, TILES, &f.frameId, sizeof( uint ), request.data(), (uint)(request.size() * sizeof( TileRequest )) )) break;
+			continue;
+		}
+		MessageHeader header;
+		TileResult result;
+		if (!w->socket.Receive( &header, sizeof( header ) ) || header.type != RESULT || header.bytes < sizeof( result )) break;
+		if (!w->socket.Receive( &result, sizeof( result ) ) || result.packedBytes != header.bytes - sizeof( result )) break;
+		packed.resize( result.packedBytes );
+		if (!w->socket.Receive( packed.data(), packed.size() )) break;
+		{
+			// claim the tile, so it cannot be reissued once it is in the accumulator
+			lock_guard<mutex> l( lock );
+			auto p = find( w->pending.begin(), w->pending.end(), result.tile );
+			if (result.frameId != setup.frameId || p == w->pending.end()) break;
+			w->pending.erase( p );
+		}
+		if (!UnpackTile( *renderer, setup, blend, result, packed.data() ))
+		{
+			// corrupt data: render it again elsewhere
+			lock_guard<mutex> l( lock );
+			w->pending.push_back( result.tile );
+			break;
+		}
+		rawBytes += result.rawBytes, packedBytes += result.packedBytes;
+		{
+			lock_guard<mutex> l( lock );
+			w->tiles++;
+			remaining--;
+		}
+		changed.notify_all();
+	}
+	Requeue( w );
+}
+
+// -----------------------------------------------------------
+// No workers left: render the remaining tiles here
+// -----------------------------------------------------------
+void TileCoordinator::RenderLocally()
+{
+	vector<int> tiles;
+	{
+		lock_guard<mutex> l( lock );
+		tiles.swap( queue );
+	}
+	Renderer& r = *renderer;
+	const FrameTarget view = r.View();
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < (int)tiles.size(); i++)
+	{
+		Timer t;
+		r.RenderTile( view, tiles[i], setup.tilesX, setup.res, r.quality.GetSettings( tiles[i] ), blend, setup.keepGuide );
+		r.quality.tileMs[tiles[i]] = t.elapsed() * 1000;
+	}
+	localTiles += (int)tiles.size();
+	lock_guard<mutex> l( lock );
+	remaining -= (int)tiles.size();
+}
+
+// -----------------------------------------------------------
+// Render a frame on the workers and wait for all tiles
+// -----------------------------------------------------------
+bool TileCoordinator::Render( const int2 res, const int tilesX, const int tilesY, const float blend, const bool keepGuide )
+{
+	unique_lock<mutex> l( lock );
+	// clean up after lost workers; their threads have finished
+	for (int i = 0; i < (int)worker.size(); i++) if (worker[i]->done)
+	{
+		worker[i]->server.join();
+		delete worker[i];
+		worker.erase( worker.begin() + i-- );
+	}
+	if (live == 0) return false;
+	const Renderer& r = *renderer;
+	setup.frameId++;
+	setup.camera = r.camera, setup.animTime = r.anim_time;
+	setup.frame = r.frame, setup.accumulated = r.accumulated;
+	setup.res = res, setup.tilesX = tilesX;
+	setup.wavefront = r.wavefront, setup.sortRays = r.sortRays, setup.deferShadows = r.deferShadows;
+	setup.useLightmap = r.useLightmap, setup.keepGuide = keepGuide, setup.sdfObjects = r.sdfObjects;
+	setup.stress = r.stressParams;
+	if (!r.stressScene) setup.stress.count = 0;
+	this->blend = blend;
+	// taken from the back: top rows first
+	queue.clear();
+	for (int i = tilesX * tilesY - 1; i >= 0; i--) queue.push_back( i );
+	remaining = tilesX * tilesY;
+	changed.notify_all();
+	while (remaining > 0)
+	{
+		if (live > 0) { changed.wait( l ); continue; }
+		l.unlock();
+		RenderLocally();
+		l.lock();
+	}
+	return true;
+}
+
+// -----------------------------------------------------------
+// Connected workers, for the user interface
+// -----------------------------------------------------------
+vector<TileCoordinator::WorkerInfo> TileCoordinator::Workers()
+{
+	lock_guard<mutex> l( lock );
+	vector<WorkerInfo> info;
+	for (const Worker* w : worker) if (!w->done)
+	{
+		WorkerInfo i = {};
+		snprintf( i.name, sizeof( i.name ), "%s", w->socket.peer );
+		i.threads = w->threads, i.tiles = w->tiles;
+		info.push_back( i );
+	}
+	return info;
+}
+
+// -----------------------------------------------------------
+// Take over the state of a frame
+// -----------------------------------------------------------
+static void ApplySetup( Renderer& r, const FrameSetup& f )
+{
+	r.camera = f.camera;
+	r.scene.SetTime( r.anim_time = f.animTime );
+	if (r.sdfObjects != f.sdfObjects) r.scene.ShowSDFs( r.sdfObjects = f.sdfObjects );
+	// a stress scene is regenerated here from its parameters and seed
+	if (memcmp( &r.stressParams, &f.stress, sizeof( StressParams ) ))
+		r.stressParams = f.stress, r.stressScene = f.stress.count > 0, r.UpdateStress();
+	r.frame = f.frame, r.accumulated = f.accumulated;
+	// the wavefront path gathers texels with AVX2
+	r.wavefront = f.wavefront && SIMD::level >= SIMD::AVX2;
+	r.sortRays = f.sortRays, r.deferShadows = f.deferShadows;
+	r.useLightmap = f.useLightmap, r.useRadianceCache = false;
+	if (r.useLightmap) r.UpdateLightmap();
+}
+
+// -----------------------------------------------------------
+// Serve a coordinator; tiles of a batch render in parallel and
+// go back as soon as each one is done
+// -----------------------------------------------------------
+void TileWorker::Run( Renderer& r, const char* host, const int port )
+{
+	r.scene.SetTime( 0 );
+	HelloMessage hello = { {}, clusterVersion, Checkpoint::SceneHash( r.scene ), omp_get_max_threads() };
+	memcpy( hello.magic, clusterMagic, 4 );
+	Socket s;
+	for (bool waiting = false;; waiting = true)
+	{
+		if (waiting && !reconnect) return;
+		if (waiting) this_thread::sleep_for( chrono::seconds( 1 ) );
+		if (!s.Connect( host, port ) || !SendMessage( s, HELLO, &hello, sizeof( hello ) )) continue;
+		printf( "Rendering tiles for %s with %i threads\n", s.peer, hello.threads );
+		FrameSetup f = {};
+		vector<uchar> payload;
+		for (MessageHeader header; s.Receive( &header, sizeof( header ) );)
+		{
+			payload.resize( header.bytes );
+			if (header.bytes && !s.Receive( payload.data(), header.bytes )) break;
+			if (header.type == FRAME && header.bytes == sizeof( FrameSetup ))
+			{
+				memcpy( &f, payload.data(), sizeof( FrameSetup ) );
+				ApplySetup( r, f );
+				continue;
+			}
+			if (header.type != TILES || header.bytes < sizeof( uint ) || *(uint*)payload.data() != f.frameId) break;
+			const TileRequest* request = (const TileRequest*)(payload.data() + sizeof( uint ));
+			const int count = (int)((header.bytes - sizeof( uint )) / sizeof( TileRequest ));
+			const FrameTarget view = r.View();
+			// tiles rewind their scratch; this merges blocks the arenas spilled into
+			Memory::NewFrame();
+			mutex sending;
+			bool failed = false;
+#pragma omp parallel for schedule(dynamic)
+			for (int i = 0; i < count; i++)
+			{
+				// blend 1: the accumulator of the worker only holds new samples
+				Timer t;
+				r.RenderTile( view, request[i].tile, f.tilesX, f.res, request[i].q, 1, f.keepGuide );
+				vector<uchar> message;
+				PackTile( r, f, request[i].tile, t.elapsed() * 1000, message );
+				lock_guard<mutex> l( sending );
+				if (!failed) failed = !s.Send( message.data(), message.size() );
+			}
+			if (failed) break;
+		}
+		s.Close();
+		printf( "Connection to %s lost\n", s.peer );
+	}
+}
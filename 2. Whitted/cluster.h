@@ -0,0 +1,92 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+class Renderer;
+
+// -----------------------------------------------------------
+// Everything a worker needs to reproduce a local frame
+// -----------------------------------------------------------
+struct FrameSetup
+{
+	uint frameId;
+	Camera camera;
+	float animTime;
+	uint frame;				// seeds the samplers
+	int accumulated;		// jitter is on for a refined image
+	int2 res;
+	int tilesX;
+	bool wavefront, sortRays, deferShadows, useLightmap, keepGuide, sdfObjects;
+	StressParams stress;	// count 0: no stress scene
+};
+
+// -----------------------------------------------------------
+// Tile coordinator
+// Farms the tiles of a frame out to worker processes: copies
+// of this renderer, started with --worker host:port, that
+// connect over TCP, on this machine or on other nodes. Every
+// frame the workers receive the camera, animation time, frame
+// counter and shading options; they then render tiles with
+// exactly the code and seeds of a local frame and return the
+// new samples as deflated float tiles, which are blended into
+// the accumulator here. One thread per worker keeps up to two
+// batches in flight, so fast workers take more tiles, and
+// batches shrink towards the end of a frame. When a worker
+// disconnects or misses the timeout, its tiles go back into
+// the queue; with no workers left, the rest is rendered here.
+// -----------------------------------------------------------
+class TileCoordinator
+{
+public:
+	struct WorkerInfo { char name[64]; int threads, tiles; };
+	~TileCoordinator() { Stop(); }
+	bool Start( Renderer& renderer );
+	void Stop();
+	// false when no worker is connected: render locally instead
+	bool Render( const int2 res, const int tilesX, const int tilesY, const float blend, const bool keepGuide );
+	vector<WorkerInfo> Workers();
+	bool IsRunning() const { return listener.IsOpen(); }
+	// settings
+	int port = 7878;
+	float timeout = 30; // seconds without a result before a worker counts as lost
+	// statistics
+	atomic<int> lost = 0, reissued = 0, localTiles = 0;
+	atomic<uint64_t> rawBytes = 0, packedBytes = 0;
+private:
+	struct Worker;
+	void AcceptLoop();
+	void Serve( Worker* w );
+	bool TakeBatch( Worker* w, vector<int>& batch, FrameSetup& frame );
+	void Requeue( Worker* w );
+	void RenderLocally();
+	Renderer* renderer = 0;
+	Socket listener;
+	thread acceptor;
+	uint64_t sceneHash = 0;
+	// shared with the worker threads
+	mutex lock;
+	condition_variable changed;
+	vector<Worker*> worker;
+	vector<int> queue;	// tiles not yet handed out; taken from the back
+	int remaining = 0;	// tiles of the frame without a result
+	int live = 0;		// connected workers
+	bool stopping = false;
+	FrameSetup setup = {};
+	float blend = 1;
+};
+
+// -----------------------------------------------------------
+// Tile worker
+// The headless side: connects to a coordinator, renders the
+// tiles it is sent and returns them. Reconnects when the
+// connection drops, so workers can be started first.
+// -----------------------------------------------------------
+class TileWorker
+{
+public:
+	void Run( Renderer& renderer, const char* host, const int port );
+	bool reconnect = true; // false: return when the connection drops
+};
+
+} // namespace Tmpl8
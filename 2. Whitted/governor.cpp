@@ -0,0 +1,131 @@
+#include "precomp.h"
+
+// -----------------------------------------------------------
+// Setup the resolution steps
+// -----------------------------------------------------------
+ResolutionGovernor::ResolutionGovernor()
+{
+	// each step removes roughly a quarter of the pixels; widths are
+	// kept at a multiple of 8 so SIMD passes never see a partial tail
+	static const float steps[STEPS] = { 1, 0.875f, 0.75f, 0.667f, 0.583f, 0.5f, 0.417f, 0.333f };
+	for (int i = 0; i < STEPS; i++)
+	{
+		scale[i] = steps[i];
+		res[i].x = max( 8, (int)(SCRWIDTH * steps[i]) & ~7 );
+		res[i].y = max( 2, (int)(SCRHEIGHT * steps[i]) & ~1 );
+	}
+}
+
+// -----------------------------------------------------------
+// Feed the governor the cost of the last frame
+// -----------------------------------------------------------
+void ResolutionGovernor::Update( const float renderMs )
+{
+	if (!enabled) { level = 0, cooldown = 0, smoothMs = 0; return; }
+	smoothMs = smoothMs == 0 ? renderMs : (0.8f * smoothMs + 0.2f * renderMs);
+	if (cooldown > 0) { cooldown--; return; }
+	const float area = (float)(res[level].x * res[level].y);
+	int next = level;
+	if (smoothMs > targetMs * 1.05f)
+	{
+		// over budget: drop to the first step that is predicted to fit
+		while (next < STEPS - 1 && smoothMs * (res[next].x * res[next].y) / area > targetMs * 0.95f) next++;
+	}
+	else if (level > 0)
+	{
+		// under budget: go up one step, with some headroom to prevent oscillation
+		const float predicted = smoothMs * (res[level - 1].x * res[level - 1].y) / area;
+		if (predicted < targetMs * 0.85f) next = level - 1;
+	}
+	if (next == level) return;
+	// judge the new level on its own timings
+	smoothMs *= (res[next].x * res[next].y) / area;
+	level = next, cooldown = 8;
+}
+
+// -----------------------------------------------------------
+// Quality ladder; the default level matches MAXDEPTH with a
+// single shadow ray and a single sample per pixel
+// -----------------------------------------------------------
+const QualitySettings QualityGovernor::ladder[LEVELS] = {
+	{ MAXDEPTH, 4, 4 }, { MAXDEPTH, 4, 2 }, { MAXDEPTH, 2, 1 }, { MAXDEPTH, 1, 1 },
+	{ 5, 1, 1 }, { 4, 1, 1 }, { 3, 1, 1 }, { 2, 1, 1 }, { 1, 1, 1 }
+};
+
+// -----------------------------------------------------------
+// Cleanup
+// -----------------------------------------------------------
+QualityGovernor::~QualityGovernor()
+{
+	delete[] level;
+	delete[] order;
+	delete[] tileMs;
+}
+
+// -----------------------------------------------------------
+// Match the tile count of the current render resolution
+// -----------------------------------------------------------
+void QualityGovernor::Resize( const int tiles )
+{
+	if (tiles == tileCount) return;
+	delete[] level;
+	delete[] order;
+	delete[] tileMs;
+	level = new int[tiles], order = new int[tiles], tileMs = new float[tiles];
+	for (int i = 0; i < tiles; i++) level[i] = DEFAULT_LEVEL, tileMs[i] = 0;
+	tileCount = tiles, cooldown = 0, smoothMs = 0;
+}
+
+// -----------------------------------------------------------
+// Feed the governor the cost of the last frame; per-tile costs
+// are read from tileMs
+// -----------------------------------------------------------
+void QualityGovernor::Update( const float renderMs )
+{
+	if (!enabled)
+	{
+		for (int i = 0; i < tileCount; i++) level[i] = DEFAULT_LEVEL;
+		cooldown = 0, smoothMs = 0;
+		return;
+	}
+	smoothMs = smoothMs == 0 ? renderMs : (0.8f * smoothMs + 0.2f * renderMs);
+	if (cooldown > 0) { cooldown--; return; }
+	// tiles are rendered in parallel; relate their summed cost to wall clock time
+	float tileSum = 0;
+	for (int i = 0; i < tileCount; i++) tileSum += tileMs[i], order[i] = i;
+	if (tileSum <= 0 || renderMs <= 0) return;
+	const float parallelism = tileSum / renderMs;
+	bool changed = false;
+	if (smoothMs > targetMs * 1.05f)
+	{
+		// over budget: cheapen the most expensive tiles first; a
+		// step is assumed to save about a quarter of a tile's cost
+		float excess = (smoothMs - targetMs * 0.95f) * parallelism;
+		sort( order, order + tileCount, [this]( int a, int b ) { return tileMs[a] > tileMs[b]; } );
+		for (int i = 0; i < tileCount && excess > 0; i++)
+		{
+			const int tile = order[i];
+			if (level[tile] == LEVELS - 1) continue;
+			excess -= tileMs[tile] * 0.25f;
+			level[tile]++, changed = true;
+		}
+	}
+	else if (smoothMs < targetMs * 0.8f)
+	{
+		// under budget: improve the cheapest tiles first; a step up
+		// may double a tile's cost when it adds samples
+		float headroom = (targetMs * 0.9f - smoothMs) * parallelism;
+		sort( order, order + tileCount, [this]( int a, int b ) { return tileMs[a] < tileMs[b]; } );
+		for (int i = 0; i < tileCount; i++)
+		{
+			const int tile = order[i];
+			if (level[tile] == 0) continue;
+			const float cost = tileMs[tile] * (ladder[level[tile] - 1].spp > ladder[level[tile]].spp ? 1.0f : 0.25f);
+			if (cost > headroom) break;
+			headroom -= cost;
+			level[tile]--, changed = true;
+		}
+	}
+	// judge the new levels on their own timings
+	if (changed) cooldown = 4, smoothMs = 0;
+}
\ No newline at end of file
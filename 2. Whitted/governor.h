@@ -0,0 +1,70 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+// -----------------------------------------------------------
+// Resolution governor
+// Tracks render time against a budget and picks the internal
+// render resolution from a fixed list of steps. Cost is
+// assumed to scale with pixel count, which lets the governor
+// jump straight to the step that fits instead of creeping
+// down one step per frame.
+// -----------------------------------------------------------
+class ResolutionGovernor
+{
+public:
+	enum { STEPS = 8 };
+	ResolutionGovernor();
+	void Update( const float renderMs );
+	int2 GetResolution() const { return res[enabled ? level : 0]; }
+	// settings
+	bool enabled = false;
+	float targetMs = 33.3f;
+	// state
+	float scale[STEPS];
+	int2 res[STEPS];
+	int level = 0, cooldown = 0;
+	float smoothMs = 0;
+};
+
+// -----------------------------------------------------------
+// Render settings for a single tile
+// -----------------------------------------------------------
+struct QualitySettings
+{
+	int maxDepth;		// recursion limit for reflection and refraction
+	int shadowSamples;	// 1: hard shadows from the point light
+	int spp;			// primary rays per pixel
+};
+
+// -----------------------------------------------------------
+// Quality governor
+// Holds the render budget by changing what each tile computes
+// rather than how many pixels there are. Levels run from best
+// to cheapest; below the default level only recursion depth is
+// cut, so the expensive tiles (deep glass and mirror paths)
+// lose their last bounces while cheap tiles keep full quality.
+// -----------------------------------------------------------
+class QualityGovernor
+{
+public:
+	enum { LEVELS = 9, DEFAULT_LEVEL = 3 };
+	~QualityGovernor();
+	void Resize( const int tiles );
+	void Update( const float renderMs );
+	const QualitySettings& GetSettings( const int tile ) const { return ladder[enabled ? level[tile] : DEFAULT_LEVEL]; }
+	static const QualitySettings ladder[LEVELS];
+	// settings
+	bool enabled = false;
+	float targetMs = 33.3f;
+	// state; tileMs is written by the render threads
+	int tileCount = 0;
+	int* level = 0;
+	int* order = 0;
+	float* tileMs = 0;
+	int cooldown = 0;
+	float smoothMs = 0;
+};
+
+} // namespace Tmpl8
\ No newline at end of file
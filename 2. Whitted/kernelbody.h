@@ -0,0 +1,194 @@
+// Kernel implementations; included by kernels_sse42.cpp, kernels_avx2.cpp
+// and kernels_avx512.cpp after they define SIMD_LEVEL, so this file is
+// compiled once per instruction set. No include guard, no precompiled
+// header: see simdvec.h for why nothing but intrinsics is used here.
+
+#include "simdvec.h"
+#include "kernels.h"
+
+namespace Tmpl8
+{
+namespace SIMD_NAMESPACE
+{
+
+// -----------------------------------------------------------
+// Colour conversion; truncation matches RGBF32_to_RGB8
+// -----------------------------------------------------------
+VFN unsigned PackRGB( const float r, const float g, const float b )
+{
+	return ((unsigned)(Saturate( r ) * 255.0f) << 16) + ((unsigned)(Saturate( g ) * 255.0f) << 8) + (unsigned)(Saturate( b ) * 255.0f);
+}
+VFN vint Quantize( const vfloat a )
+{
+	return Truncate( Mul( Max( Set1( 0 ), Min( Set1( 1 ), a ) ), Set1( 255.0f ) ) );
+}
+SIMD_KERNEL static void ConvertPlanar( const float* r, const float* g, const float* b, const int count, unsigned* out )
+{
+	int i = 0;
+	for (; i + W <= count; i += W)
+		Store( out + i, Or( Or( Shl( Quantize( Load( r + i ) ), 16 ), Shl( Quantize( Load( g + i ) ), 8 ) ), Quantize( Load( b + i ) ) ) );
+	for (; i < count; i++) out[i] = PackRGB( r[i], g[i], b[i] );
+}
+SIMD_KERNEL static void ConvertPacked( const float* rgba, const int count, unsigned* out )
+{
+	int i = 0;
+	for (; i + W <= count; i += W)
+	{
+		vfloat r, g, b, a;
+		LoadPacked( rgba + i * 4, r, g, b, a );
+		Store( out + i, Or( Or( Shl( Quantize( r ), 16 ), Shl( Quantize( g ), 8 ) ), Quantize( b ) ) );
+	}
+	for (; i < count; i++) out[i] = PackRGB( rgba[i * 4], rgba[i * 4 + 1], rgba[i * 4 + 2] );
+}
+
+// -----------------------------------------------------------
+// Edge-aware 3x3 filter, W pixels at a time; taps outside the
+// row are clamped to the edge, as in the scalar version it
+// replaces. Guides hold the normal and the distance.
+// -----------------------------------------------------------
+SIMD_KERNEL static void DenoiseRow( const float* const rows[3], const float* const guides[3], const int width, float* out )
+{
+	const vfloat zero = Set1( 0 ), one = Set1( 1 );
+	const vint last = Set1i( width - 1 ), first = Set1i( 0 );
+	for (int x = 0; x < width; x += W)
+	{
+		const vint X = Min( Add( Set1i( x ), Seq() ), last ), center = Shl( X, 2 );
+		const vfloat cr = Gather( rows[1], center ), cg = Gather( rows[1] + 1, center ), cb = Gather( rows[1] + 2, center );
+		const vfloat gx = Gather( guides[1], center ), gy = Gather( guides[1] + 1, center ), gz = Gather( guides[1] + 2, center );
+		const vfloat gw = Gather( guides[1] + 3, center ), depthScale = Div( Set1( 10 ), Add( gw, Set1( 1e-4f ) ) );
+		vfloat sr = cr, sg = cg, sb = cb, wsum = one;
+		for (int v = 0; v < 3; v++) for (int u = -1; u <= 1; u++) if (u != 0 || v != 1)
+		{
+			const vint tap = Shl( Max( first, Min( last, Add( X, Set1i( u ) ) ) ), 2 );
+			const float* row = rows[v], * guide = guides[v];
+			// reject taps across creases, silhouettes and texture edges
+			vfloat wn = Max( zero, Dot( gx, gy, gz, Gather( guide, tap ), Gather( guide + 1, tap ), Gather( guide + 2, tap ) ) );
+			wn = Mul( wn, wn ), wn = Mul( wn, wn ), wn = Mul( wn, wn );
+			const vfloat wd = Max( zero, Sub( one, Mul( Abs( Sub( Gather( guide + 3, tap ), gw ) ), depthScale ) ) );
+			const vfloat tr = Gather( row, tap ), tg = Gather( row + 1, tap ), tb = Gather( row + 2, tap );
+			const vfloat dr = Sub( tr, cr ), dg = Sub( tg, cg ), db = Sub( tb, cb );
+			const vfloat wc = Div( one, Madd( Set1( 16 ), Dot( dr, dg, db, dr, dg, db ), one ) );
+			const vfloat w = Mul( Mul( wn, wd ), wc );
+			sr = Madd( w, tr, sr ), sg = Madd( w, tg, sg ), sb = Madd( w, tb, sb ), wsum = Add( wsum, w );
+		}
+		const vfloat scale = Div( one, wsum );
+		alignas( 64 ) float r[W], g[W], b[W];
+		Store( r, Mul( sr, scale ) ), Store( g, Mul( sg, scale ) ), Store( b, Mul( sb, scale ) );
+		for (int j = 0; j < W && x + j < width; j++)
+		{
+			float* o = out + (x + j) * 4;
+			o[0] = r[j], o[1] = g[j], o[2] = b[j], o[3] = 0;
+		}
+	}
+}
+
+// -----------------------------------------------------------
+// Any-hit test for the shadow rays of each hit. Rays that share
+// a hit share its origin, so the terms that only depend on the
+// origin are computed once per hit: the origin in the frame of
+// the cube and of the torus, and the ball's c. A hit with at
+// least W rays has these computed for W hits at a time and
+// broadcast over its packets. Narrower hits share a packet;
+// the origins of its hits are permuted into their lanes and
+// the terms are computed per lane.
+// -----------------------------------------------------------
+enum { SLABMIN = 0, SLABMAX = 3, TORUS = 6, TORUSC = 9, BALLC = 10, TERMS = 11 };
+VFN void OccludedPacket( const ShadowOccluders& s, const ShadowPackets& p, const int i,
+	const vfloat Ox, const vfloat Oy, const vfloat Oz, const float* term, unsigned char* result )
+{
+	// term: the terms of the single hit of this packet, W floats apart; 0: per lane
+	const vfloat zero = Set1( 0 ), one = Set1( 1 );
+	const vfloat Dx = Load( p.D[0] + i ), Dy = Load( p.D[1] + i ), Dz = Load( p.D[2] + i ), t = Load( p.t + i );
+	// cube: slab test in object space
+	vfloat tmin = Set1( -1e34f ), tmax = t;
+	for (int a = 0; a < 3; a++)
+	{
+		const float* m = s.cubeInvM + a * 4;
+		const vfloat m0 = Set1( m[0] ), m1 = Set1( m[1] ), m2 = Set1( m[2] );
+		const vfloat rd = Div( one, Madd( m2, Dz, Madd( m1, Dy, Mul( m0, Dx ) ) ) );
+		vfloat t1, t2;
+		if (term) t1 = Mul( Set1( term[(SLABMIN + a) * W] ), rd ), t2 = Mul( Set1( term[(SLABMAX + a) * W] ), rd );
+		else
+		{
+			const vfloat o = Madd( m2, Oz, Madd( m1, Oy, Madd( m0, Ox, Set1( m[3] ) ) ) );
+			t1 = Mul( Sub( Set1( s.cubeMin[a] ), o ), rd ), t2 = Mul( Sub( Set1( s.cubeMax[a] ), o ), rd );
+		}
+		tmin = Max( tmin, Min( t1, t2 ) ), tmax = Min( tmax, Max( t1, t2 ) );
+	}
+	vmask blocked = And( Gt( tmax, zero ), Lt( tmin, tmax ) );
+	// ball
+	const vfloat ox = Sub( Ox, Set1( s.ballPos[0] ) ), oy = Sub( Oy, Set1( s.ballPos[1] ) ), oz = Sub( Oz, Set1( s.ballPos[2] ) );
+	const vfloat b = Dot( ox, oy, oz, Dx, Dy, Dz ), c = term ? Set1( term[BALLC * W] ) : Sub( Dot( ox, oy, oz, ox, oy, oz ), Set1( s.ballR2 ) );
+	const vfloat d = Sub( Mul( b, b ), c ), tb = Sub( Sub( zero, b ), Sqrt( Max( d, zero ) ) );
+	blocked = Or( blocked, And( Gt( d, zero ), And( Lt( tb, t ), Gt( tb, zero ) ) ) );
+	// light quads: a single plane, so each ray has a single t
+	if (s.lights)
+	{
+		const vfloat tq = Div( Sub( Set1( s.lightY ), Oy ), Dy ), size = Set1( s.lightSize );
+		const vfloat Ix = Madd( tq, Dx, Ox ), Iz = Madd( tq, Dz, Oz );
+		vmask inQuad = None();
+		for (int l = 0; l < s.lights; l++)
+			inQuad = Or( inQuad, And( Lt( Abs( Sub( Ix, Set1( s.lightX[l] ) ) ), size ), Lt( Abs( Sub( Iz, Set1( s.lightZ[l] ) ) ), size ) ) );
+		blocked = Or( blocked, And( inQuad, And( Lt( tq, t ), Gt( tq, zero ) ) ) );
+	}
+	// torus: its bounding sphere, in the frame of the torus
+	vfloat to[3], td[3];
+	for (int a = 0; a < 3; a++)
+	{
+		const float* m = s.torusInvM + a * 4;
+		const vfloat m0 = Set1( m[0] ), m1 = Set1( m[1] ), m2 = Set1( m[2] );
+		to[a] = term ? Set1( term[(TORUS + a) * W] ) : Madd( m2, Oz, Madd( m1, Oy, Madd( m0, Ox, Set1( m[3] ) ) ) );
+		td[a] = Madd( m2, Dz, Madd( m1, Dy, Mul( m0, Dx ) ) );
+	}
+	const vfloat k = Dot( to[0], to[1], to[2], td[0], td[1], td[2] );
+	const vfloat torusC = term ? Set1( term[TORUSC * W] ) : Sub( Dot( to[0], to[1], to[2], to[0], to[1], to[2] ), Set1( s.torusR2 ) );
+	const int blockedBits = Bits( blocked ), candidateBits = Bits( Ge( Mul( k, k ), torusC ) );
+	for (int l = 0; l < W; l++) result[i + l] = (blockedBits >> l) & 1 ? 1 : (candidateBits >> l) & 1 ? 2 : 0;
+}
+SIMD_KERNEL static void Occluded( const ShadowOccluders& s, const ShadowPackets& p, unsigned char* result )
+{
+	if (p.stride < W)
+	{
+		// W / stride hits per packet; the stride is a power of two here
+		int shift = 0;
+		while ((1 << shift) < p.stride) shift++;
+		const vint lane = Shr( Seq(), shift );
+		for (int i = 0; i < p.hits * p.stride; i += W)
+		{
+			const int first = i >> shift;
+			const vfloat Ox = Permute( Load( p.O[0] + first ), lane ), Oy = Permute( Load( p.O[1] + first ), lane ), Oz = Permute( Load( p.O[2] + first ), lane );
+			OccludedPacket( s, p, i, Ox, Oy, Oz, 0, result );
+		}
+		return;
+	}
+	for (int first = 0; first < p.hits; first += W)
+	{
+		// the terms of W hits, in SIMD; the origin arrays are padded to W
+		alignas( 64 ) float term[TERMS][W];
+		const vfloat Ox = Load( p.O[0] + first ), Oy = Load( p.O[1] + first ), Oz = Load( p.O[2] + first );
+		vfloat to2 = Set1( 0 );
+		for (int a = 0; a < 3; a++)
+		{
+			const float* m = s.cubeInvM + a * 4, * n = s.torusInvM + a * 4;
+			const vfloat o = Madd( Set1( m[2] ), Oz, Madd( Set1( m[1] ), Oy, Madd( Set1( m[0] ), Ox, Set1( m[3] ) ) ) );
+			const vfloat q = Madd( Set1( n[2] ), Oz, Madd( Set1( n[1] ), Oy, Madd( Set1( n[0] ), Ox, Set1( n[3] ) ) ) );
+			Store( term[SLABMIN + a], Sub( Set1( s.cubeMin[a] ), o ) ), Store( term[SLABMAX + a], Sub( Set1( s.cubeMax[a] ), o ) );
+			Store( term[TORUS + a], q ), to2 = Madd( q, q, to2 );
+		}
+		Store( term[TORUSC], Sub( to2, Set1( s.torusR2 ) ) );
+		const vfloat bx = Sub( Ox, Set1( s.ballPos[0] ) ), by = Sub( Oy, Set1( s.ballPos[1] ) ), bz = Sub( Oz, Set1( s.ballPos[2] ) );
+		Store( term[BALLC], Sub( Dot( bx, by, bz, bx, by, bz ), Set1( s.ballR2 ) ) );
+		// then broadcast them over the packets of each hit
+		for (int h = first; h < first + W && h < p.hits; h++)
+		{
+			const vfloat Ox1 = Set1( p.O[0][h] ), Oy1 = Set1( p.O[1][h] ), Oz1 = Set1( p.O[2][h] );
+			for (int j = 0, i = h * p.stride; j < p.rays; j += W, i += W)
+				OccludedPacket( s, p, i, Ox1, Oy1, Oz1, &term[0][h - first], result );
+		}
+	}
+}
+
+extern const KernelTable kernels = { ConvertPlanar, ConvertPacked, DenoiseRow, Occluded };
+
+} // namespace SIMD_NAMESPACE
+} // namespace Tmpl8
@@ -0,0 +1,75 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+// -----------------------------------------------------------
+// Shadow rays in packets that share their origin: the rays of
+// one hit, to every light and for every sample. The rays of
+// hit h start at h * stride, where stride is the next power
+// of two up to 16, or rays rounded up to 16 beyond that, so a
+// packet of 16 lanes never straddles two strides unevenly.
+// Unused and padding rays have t = 0 and never hit; the ray
+// and origin arrays are padded with 16 unused entries.
+// -----------------------------------------------------------
+struct ShadowPackets
+{
+	float* O[3];	// per hit
+	float* D[3];	// per ray
+	float* t;
+	int hits, rays, stride;
+};
+
+// -----------------------------------------------------------
+// The occluders that the shadow kernel tests, as in
+// Scene::IsOccluded: the cube in object space, the ball, the
+// light quads in the plane y = lightY, and the bounding sphere
+// of the torus, whose rays are left to the scalar test.
+// -----------------------------------------------------------
+struct ShadowOccluders
+{
+	float cubeInvM[12];		// rows 0..2 of the inverse transform
+	float cubeMin[3], cubeMax[3];
+	float ballPos[3], ballR2;
+	float lightX[4], lightZ[4], lightY, lightSize;
+	int lights;				// 0: the quads are tested by the caller
+	float torusInvM[12];	// rows 0..2 of the inverse transform
+	float torusR2;			// bounding sphere, centered in object space
+};
+
+// -----------------------------------------------------------
+// Kernels
+// The hot loops that benefit from wider registers are written
+// once against simdvec.h and compiled for SSE4.2, AVX2 + FMA
+// and AVX-512, in kernels_sse42.cpp, kernels_avx2.cpp and
+// kernels_avx512.cpp (see kernelbody.h). Kernels() returns the
+// table of the level selected at startup, SIMD::level.
+// ConvertPlanar  r, g and b planes to 0x00RRGGBB
+// ConvertPacked  float4 pixels to 0x00RRGGBB
+// DenoiseRow     edge-aware 3x3 filter of one row (see
+//                Renderer::Denoise); rows and guides are the
+//                float4 rows above, at and below the output row
+// Occluded       per ray: 0 free, 1 blocked, 2 passes through
+//                the bounding sphere of the torus; the rays of
+//                a hit are tested W at a time from its origin
+// -----------------------------------------------------------
+struct KernelTable
+{
+	void (*ConvertPlanar)( const float* r, const float* g, const float* b, const int count, unsigned* out );
+	void (*ConvertPacked)( const float* rgba, const int count, unsigned* out );
+	void (*DenoiseRow)( const float* const rows[3], const float* const guides[3], const int width, float* out );
+	void (*Occluded)( const ShadowOccluders& scene, const ShadowPackets& packets, unsigned char* result );
+};
+namespace sse42 { extern const KernelTable kernels; }
+namespace avx2 { extern const KernelTable kernels; }
+namespace avx512 { extern const KernelTable kernels; }
+
+#ifndef SIMD_LEVEL
+inline const KernelTable& Kernels()
+{
+	static const KernelTable* table[SIMD::LEVELS] = { &sse42::kernels, &avx2::kernels, &avx512::kernels };
+	return *table[SIMD::level];
+}
+#endif
+
+} // namespace Tmpl8
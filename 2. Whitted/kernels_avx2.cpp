@@ -0,0 +1,3 @@
+// Kernels for AVX2 and FMA; built with /arch:AVX2
+#define SIMD_LEVEL 1
+#include "kernelbody.h"
@@ -0,0 +1,3 @@
+// Kernels for AVX-512 (F, VL, BW, DQ); built with /arch:AVX512
+#define SIMD_LEVEL 2
+#include "kernelbody.h"
@@ -0,0 +1,3 @@
+// Kernels for SSE4.2; built without /arch, the x64 baseline plus SSE4.1/4.2 intrinsics
+#define SIMD_LEVEL 0
+#include "kernelbody.h"
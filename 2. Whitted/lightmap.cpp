@@ -0,0 +1,194 @@
+#include "precomp.h"
+
+#define LIGHTMAP_VERSION	1
+
+// -----------------------------------------------------------
+// Shadow test against the geometry that never moves: the torus
+// and the four light quads. Planes and the rounded corners are
+// not occluders, like in Scene::IsOccluded.
+// -----------------------------------------------------------
+static bool StaticOccluded( const Scene& scene, const Ray& ray )
+{
+	if (scene.torus.IsOccluded( ray )) return true;
+#ifdef FOURLIGHTS
+	const float t = (1.5f - ray.O.y) / ray.D.y;
+	if (t <= 0 || t >= ray.t) return false;
+	const float Ix = ray.O.x + t * ray.D.x, Iz = ray.O.z + t * ray.D.z;
+	for (uint i = 0; i < 4; i++)
+	{
+		const float3 L = scene.GetLightPos( i );
+		if (fabs( Ix - L.x ) < 0.25f && fabs( Iz - L.z ) < 0.25f) return true;
+	}
+#endif
+	return false;
+}
+
+// -----------------------------------------------------------
+// Texel grids for the planes, packed in one array
+// -----------------------------------------------------------
+void Lightmap::Layout( const Scene& scene )
+{
+	scene.GetRoomBounds( roomMin, roomMax );
+	texelCount = 0;
+	for (int i = 0; i < 6; i++)
+	{
+		const Plane& p = scene.plane[i];
+		Chart& c = chart[i];
+		c.axis = i / 2, c.u = (c.axis + 1) % 3, c.v = (c.axis + 2) % 3;
+		c.normal = p.N[c.axis], c.position = -p.d / c.normal;
+		c.width = (int)ceilf( (roomMax[c.u] - roomMin[c.u]) * TEXELS_PER_UNIT );
+		c.height = (int)ceilf( (roomMax[c.v] - roomMin[c.v]) * TEXELS_PER_UNIT );
+		c.offset = texelCount, texelCount += c.width * c.height;
+	}
+}
+
+// -----------------------------------------------------------
+// Direct irradiance factor of every light at a texel center
+// -----------------------------------------------------------
+float4 Lightmap::BakeTexel( const Scene& scene, const Chart& c, const int x, const int y ) const
+{
+	float3 P, N( 0 );
+	P[c.axis] = c.position, N[c.axis] = c.normal;
+	P[c.u] = roomMin[c.u] + (x + 0.5f) / TEXELS_PER_UNIT;
+	P[c.v] = roomMin[c.v] + (y + 0.5f) / TEXELS_PER_UNIT;
+	float4 E( 0 );
+	for (int i = 0; i < lightCount; i++)
+	{
+		float3 L = light[i] - P;
+		const float distance = length( L );
+		L *= 1 / distance;
+		const float ndotl = dot( N, L );
+		if (ndotl < EPSILON) continue;
+		Ray s( P + L * EPSILON, L, distance - 2 * EPSILON );
+		if (!StaticOccluded( scene, s )) E[i] = ndotl / (distance * distance);
+	}
+	return E;
+}
+
+// -----------------------------------------------------------
+// Cache key: everything the baked values depend on
+// -----------------------------------------------------------
+uint Lightmap::Hash( const Scene& scene ) const
+{
+	// FNV-1a over the light set and the static occluders
+	uint h = 2166136261u;
+	auto add = [&h]( const void* data, const size_t bytes ) { for (size_t i = 0; i < bytes; i++) h = (h ^ ((const uchar*)data)[i]) * 16777619u; };
+	const int header[3] = { LIGHTMAP_VERSION, TEXELS_PER_UNIT, lightCount };
+	add( header, sizeof( header ) );
+	add( light, lightCount * sizeof( float3 ) );
+	add( &scene.torus.T, sizeof( mat4 ) );
+	for (int i = 0; i < 6; i++) add( &scene.plane[i].N, sizeof( float3 ) ), add( &scene.plane[i].d, sizeof( float ) );
+	return h;
+}
+
+// -----------------------------------------------------------
+// Bake for a set of lights, or load an earlier bake
+// -----------------------------------------------------------
+void Lightmap::Bake( const Scene& scene, const float3* lights, const int count, const float3& color )
+{
+	Timer t;
+	lightCount = min( count, (int)MAXLIGHTS ), lightColor = color;
+	for (int i = 0; i < lightCount; i++) light[i] = lights[i];
+	Layout( scene );
+	FREE64( texel );
+	texel = (float4*)MALLOC64( texelCount * sizeof( float4 ) );
+	char file[64];
+	sprintf( file, "lightmap_%08x.bin", Hash( scene ) );
+	FILE* f = fopen( file, "rb" );
+	fromCache = false;
+	if (f)
+	{
+		int stored = 0;
+		fread( &stored, sizeof( int ), 1, f );
+		if (stored == texelCount) fromCache = fread( texel, sizeof( float4 ), texelCount, f ) == (size_t)texelCount;
+		fclose( f );
+	}
+	if (!fromCache)
+	{
+		// all texel rows of all planes
+		int rows = 0;
+		for (int i = 0; i < 6; i++) rows += chart[i].height;
+#pragma omp parallel for schedule(dynamic)
+		for (int row = 0; row < rows; row++)
+		{
+			int i = 0, y = row;
+			while (y >= chart[i].height) y -= chart[i++].height;
+			const Chart& c = chart[i];
+			for (int x = 0; x < c.width; x++) texel[c.offset + x + y * c.width] = BakeTexel( scene, c, x, y );
+		}
+		// write a private copy first: a concurrent run may be reading the cache
+		char tmp[sizeof( file ) + 16];
+		snprintf( tmp, sizeof( tmp ), "%s.%u", file, ProcessId() );
+		f = fopen( tmp, "wb" );
+		const bool written = f && fwrite( &texelCount, sizeof( int ), 1, f ) == 1 && fwrite( texel, sizeof( float4 ), texelCount, f ) == (size_t)texelCount;
+		if (f) fclose( f );
+		if (written) remove( file ), rename( tmp, file ); else remove( tmp );
+	}
+	bakeMs = t.elapsed() * 1000;
+}
+
+// -----------------------------------------------------------
+// Check if the current bake is for this light set
+// -----------------------------------------------------------
+bool Lightmap::Matches( const float3* lights, const int count, const float3& color ) const
+{
+	if (!texel || count != lightCount || color.x != lightColor.x || color.y != lightColor.y || color.z != lightColor.z) return false;
+	for (int i = 0; i < count; i++) if (lights[i].x != light[i].x || lights[i].y != light[i].y || lights[i].z != light[i].z) return false;
+	return true;
+}
+
+// -----------------------------------------------------------
+// Bilinear lookup, with shadows from the objects that are not
+// in the bake: the moving ones, SDF objects and the stress
+// scene. Like Renderer::DirectIllumination, several samples
+// aim at points spread over a small sphere around each light,
+// so these shadows are soft; the baked ones stay hard.
+// -----------------------------------------------------------
+float3 Lightmap::Irradiance( const Scene& scene, const int objIdx, const float3& I, const int samples, uint& seed ) const
+{
+	const Chart& c = chart[objIdx - 4];
+	const float fx = clamp( (I[c.u] - roomMin[c.u]) * TEXELS_PER_UNIT - 0.5f, 0.0f, (float)(c.width - 1) );
+	const float fy = clamp( (I[c.v] - roomMin[c.v]) * TEXELS_PER_UNIT - 0.5f, 0.0f, (float)(c.height - 1) );
+	const int x0 = min( (int)fx, c.width - 2 ), y0 = min( (int)fy, c.height - 2 );
+	const float wx = fx - x0, wy = fy - y0;
+	const float4* t = texel + c.offset + x0 + y0 * c.width;
+	const float4 E = (t[0] * (1 - wx) + t[1] * wx) * (1 - wy) + (t[c.width] * (1 - wx) + t[c.width + 1] * wx) * wy;
+	// cube bounding sphere: half the diagonal of the box
+	const float3 cubePos( scene.cube.M.cell[3], scene.cube.M.cell[7], scene.cube.M.cell[11] );
+	const float3 cubeSize = make_float3( scene.cube.b[1] ) - make_float3( scene.cube.b[0] );
+	const float cubeR2 = dot( cubeSize, cubeSize ) * 0.25f;
+	float3 N( 0 );
+	N[c.axis] = c.normal;
+	const float3 O = I + N * EPSILON;
+	float irradiance = 0;
+	for (int i = 0; i < lightCount; i++) if (E[i] > 0)
+	{
+		int visible = 0;
+		for (int j = 0; j < samples; j++)
+		{
+			float3 pointOnLight = light[i];
+			if (samples > 1)
+			{
+				float3 offset;
+				do offset = float3( RandomFloat( seed ), RandomFloat( seed ), RandomFloat( seed ) ) * 2 - 1;
+				while (dot( offset, offset ) > 1);
+				pointOnLight += offset * LIGHTRADIUS;
+			}
+			float3 L = pointOnLight - O;
+			const float distance = length( L );
+			L *= 1 / distance;
+			Ray s( O, L, distance - EPSILON );
+			if (scene.sphere.IsOccluded( s )) continue;
+			const float3 oc = O - cubePos;
+			const float b = dot( oc, L ), d = b * b - (dot( oc, oc ) - cubeR2);
+			if (d > 0 && b < sqrtf( d ) && scene.cube.IsOccluded( s )) continue;
+			// March skips rays that miss the bounding box of the SDF
+			bool blocked = false;
+			for (int k = 0; k < scene.sdfCount && !blocked; k++) blocked = scene.sdf[k].March( s.O, s.D, s.t ) < s.t;
+			if (blocked || (scene.stress && scene.stress->IsOccluded( s, scene.animTime ))) continue;
+			visible++;
+		}
+		irradiance += E[i] * visible / samples;
+	}
+	return lightColor * irradiance;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+// -----------------------------------------------------------
+// Lightmap
+// Direct irradiance on the six room planes, baked on a texel
+// grid for up to four point lights. Each texel stores one
+// channel per light: n.l / d^2 with shadows from the static
+// occluders (torus, light quads) already applied. At runtime
+// a lookup only traces shadow rays against the moving objects
+// (ball and cube, the latter behind a bounding sphere) and
+// scales the channel of each light by the fraction of its
+// shadow rays that they leave unblocked.
+// Bakes are cached on disk, keyed by the light set and the
+// static geometry, so a second run starts instantly.
+// Only the four fixed lights can be baked: the single light
+// quad swings with the animation.
+// -----------------------------------------------------------
+class Lightmap
+{
+public:
+	enum { TEXELS_PER_UNIT = 32, MAXLIGHTS = 4 };
+#ifdef FOURLIGHTS
+	static constexpr bool available = true;
+#else
+	static constexpr bool available = false;
+#endif
+	~Lightmap() { FREE64( texel ); }
+	void Bake( const Scene& scene, const float3* lights, const int count, const float3& color );
+	bool Matches( const float3* lights, const int count, const float3& color ) const;
+	bool Covers( const int objIdx ) const { return texel && objIdx >= 4 && objIdx <= 9; }
+	float3 Irradiance( const Scene& scene, const int objIdx, const float3& I, const int samples, uint& seed ) const;
+	// bake statistics
+	float bakeMs = 0;
+	bool fromCache = false;
+	int texelCount = 0;
+private:
+	// texel grid of one plane; u and v are the world axes in the plane
+	struct Chart { int axis, u, v, width, height, offset; float position, normal; };
+	void Layout( const Scene& scene );
+	float4 BakeTexel( const Scene& scene, const Chart& c, const int x, const int y ) const;
+	uint Hash( const Scene& scene ) const;
+	Chart chart[6];
+	float3 roomMin, roomMax;	// the box enclosed by the planes
+	float4* texel = 0;
+	float3 light[MAXLIGHTS], lightColor = 0;
+	int lightCount = 0;
+};
+
+} // namespace Tmpl8
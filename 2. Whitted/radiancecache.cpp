@@ -0,0 +1,138 @@
+#include "precomp.h"
+
+// samples are summed as integers with this many steps per unit
+#define FIXEDPOINT	1024.0f
+
+// -----------------------------------------------------------
+// Allocate the table: at least two slots per cell on the room
+// surfaces at the current cell size, so probe sequences stay
+// short even when every wall is in view
+// -----------------------------------------------------------
+void RadianceCache::Init( const Scene& scene )
+{
+	float3 bmin, bmax;
+	scene.GetRoomBounds( bmin, bmax );
+	const float3 e = bmax - bmin;
+	const float cells = 2 * (e.x * e.y + e.y * e.z + e.z * e.x) / (cellSize * cellSize);
+	tableBits = MIN_TABLE_BITS;
+	while (tableBits < MAX_TABLE_BITS && (float)(1 << tableBits) < 2 * cells) tableBits++;
+	Memory::FreeLarge( cell );
+	cell = (Cell*)Memory::AllocLarge( sizeof( Cell ) << tableBits );
+	Clear();
+}
+
+// -----------------------------------------------------------
+// Forget everything
+// -----------------------------------------------------------
+void RadianceCache::Clear()
+{
+	memset( (void*)cell, 0, sizeof( Cell ) << tableBits );
+	usedCells = resolvedCells = evictedCells = 0;
+}
+
+// -----------------------------------------------------------
+// Cell key: the quantized position, 20 bits per axis, and one
+// of six normal directions; the top bit keeps it apart from
+// EMPTY and EVICTED. The hash of the same fields picks the
+// first slot, so cells that share a hash are still told apart.
+// -----------------------------------------------------------
+uint64_t RadianceCache::Key( const float3& P, const float3& N, uint& hash ) const
+{
+	const float s = 1 / cellSize;
+	const int x = (int)floorf( P.x * s ), y = (int)floorf( P.y * s ), z = (int)floorf( P.z * s );
+	const float3 a( fabs( N.x ), fabs( N.y ), fabs( N.z ) );
+	const int axis = a.x > a.y ? (a.x > a.z ? 0 : 2) : (a.y > a.z ? 1 : 2);
+	const int side = axis * 2 + (N[axis] < 0 ? 1 : 0);
+	hash = WangHash( (uint)x * 73856093u ^ (uint)y * 19349663u ^ (uint)z * 83492791u ^ (uint)side * 2654435761u );
+	const uint64_t bias = 1 << 19, bits = (1 << 20) - 1;
+	return (1ull << 63) | (((x + bias) & bits) << 43) | (((y + bias) & bits) << 23) | (((z + bias) & bits) << 3) | (uint64_t)side;
+}
+
+// -----------------------------------------------------------
+// Add a sample; claims the first free slot of the probe
+// sequence with a compare-and-swap if the cell is new. Drops
+// the sample if the probe sequence is full.
+// -----------------------------------------------------------
+void RadianceCache::Add( const float3& P, const float3& N, const float3& irradiance )
+{
+	uint hash;
+	const uint64_t key = Key( P, N, hash );
+	const uint mask = (1u << tableBits) - 1;
+	Cell* c = 0;
+	while (!c)
+	{
+		// the cell, or else the first empty or evicted slot
+		Cell* free = 0;
+		uint64_t freeKey = EMPTY;
+		for (uint i = 0; i < PROBES; i++)
+		{
+			Cell& s = cell[(hash + i) & mask];
+			const uint64_t stored = s.key.load( memory_order_relaxed );
+			if (stored == key) { c = &s; break; }
+			if (stored <= EVICTED && !free) free = &s, freeKey = stored;
+			if (stored == EMPTY) break;
+		}
+		if (c) break;
+		if (!free) return;
+		// slots only fill up between resolves: if another thread claimed this
+		// one, scanning again finds the cell if it was this one
+		if (free->key.compare_exchange_strong( freeKey, key )) c = free;
+	}
+	// clamp to keep fireflies from overflowing the fixed point sums
+	for (int j = 0; j < 3; j++) c->sum[j].fetch_add( (int)(min( irradiance[j], 1000.0f ) * FIXEDPOINT), memory_order_relaxed );
+	c->count.fetch_add( 1, memory_order_relaxed );
+}
+
+// -----------------------------------------------------------
+// O(1) lookup; fails for cells that have not been resolved yet.
+// Evicted slots do not end the probe sequence.
+// -----------------------------------------------------------
+bool RadianceCache::Lookup( const float3& P, const float3& N, float3& irradiance ) const
+{
+	uint hash;
+	const uint64_t key = Key( P, N, hash );
+	const uint mask = (1u << tableBits) - 1;
+	for (uint i = 0; i < PROBES; i++)
+	{
+		const Cell& c = cell[(hash + i) & mask];
+		const uint64_t stored = c.key.load( memory_order_relaxed );
+		if (stored == EMPTY) return false;
+		if (stored != key) continue;
+		if (c.frames == 0) return false;
+		irradiance = c.value;
+		return true;
+	}
+	return false;
+}
+
+// -----------------------------------------------------------
+// Fold this frame's samples into the cell values. The weight
+// of new samples drops to 5%, so the cache converges for a
+// static scene but still follows moving objects. Cells that
+// got no samples for MAX_IDLE frames are evicted; their slot
+// goes to the next new cell that probes it.
+// -----------------------------------------------------------
+void RadianceCache::Resolve()
+{
+	int used = 0, resolved = 0, evicted = 0;
+#pragma omp parallel for reduction(+: used, resolved, evicted)
+	for (int i = 0; i < (1 << tableBits); i++)
+	{
+		Cell& c = cell[i];
+		if (c.key.load( memory_order_relaxed ) <= EVICTED) continue;
+		const int count = c.count.exchange( 0, memory_order_relaxed );
+		if (count == 0)
+		{
+			if (++c.idle <= MAX_IDLE) used++;
+			else c.key.store( EVICTED, memory_order_relaxed ), c.value = 0, c.frames = c.idle = 0, evicted++;
+			continue;
+		}
+		used++;
+		float3 mean;
+		for (int j = 0; j < 3; j++) mean[j] = c.sum[j].exchange( 0, memory_order_relaxed ) * (1 / (FIXEDPOINT * count));
+		const float alpha = max( 0.05f, 1.0f / (c.frames + 1) );
+		c.value = c.frames ? c.value * (1 - alpha) + mean * alpha : mean;
+		c.frames++, c.idle = 0, resolved++;
+	}
+	usedCells = used, resolvedCells = resolved, evictedCells = evicted;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+// -----------------------------------------------------------
+// Radiance cache
+// World-space cache of indirect irradiance at diffuse surfaces,
+// used instead of a constant ambient term. Cells are keyed by
+// a quantized position and the dominant axis of the normal,
+// and live in an open-addressing hash table that threads can
+// insert into and add samples to without locks. Samples are
+// summed in fixed point during a frame; Resolve folds them
+// into the cell value between frames, so lookups never see a
+// cell that is being written to. The table is sized for the
+// surface area of the room at the current cell size, and
+// Resolve evicts cells that went without samples for a while,
+// so cells of surfaces that went out of view are reused.
+// -----------------------------------------------------------
+class RadianceCache
+{
+public:
+	enum { MIN_TABLE_BITS = 17, MAX_TABLE_BITS = 22, PROBES = 16, MAX_IDLE = 64 };
+	~RadianceCache() { Memory::FreeLarge( cell ); }
+	void Init( const Scene& scene );
+	void Clear();
+	void Add( const float3& P, const float3& N, const float3& irradiance );
+	bool Lookup( const float3& P, const float3& N, float3& irradiance ) const;
+	void Resolve();
+	// settings; Init applies a new cell size
+	float cellSize = 0.1f;
+	// statistics
+	int usedCells = 0, resolvedCells = 0, evictedCells = 0, tableBits = 0;
+private:
+	enum : uint64_t { EMPTY = 0, EVICTED = 1 };
+	struct Cell
+	{
+		atomic<uint64_t> key;	// EMPTY, EVICTED or the cell coordinates, see Key
+		atomic<int> sum[3];		// fixed point, since the last Resolve
+		atomic<int> count;
+		float3 value;			// running average of resolved frames
+		int frames, idle;		// frames with samples; resolves without samples since
+	};
+	uint64_t Key( const float3& P, const float3& N, uint& hash ) const;
+	Cell* cell = 0;
+};
+
+} // namespace Tmpl8
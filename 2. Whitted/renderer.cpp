@@ -5,9 +5,15 @@
 // -----------------------------------------------------------
 void Renderer::Init()
 {
-	// create fp32 rgb pixel buffer to render to
-	accumulator = (float4*)MALLOC64( SCRWIDTH * SCRHEIGHT * 16 );
-	memset( accumulator, 0, SCRWIDTH * SCRHEIGHT * 16 );
+	// create fp32 rgb pixel buffers to render to
+	accumulator.Init( SCRWIDTH * SCRHEIGHT, Accumulator::FLOAT4 );
+	denoised.Init( SCRWIDTH * SCRHEIGHT, Accumulator::FLOAT4 );
+	guide = (float4*)Memory::AllocLarge( SCRWIDTH * SCRHEIGHT * 16 );
+	radianceCache.Init( scene );
+	// textures now, rather than on the first shading call of a worker
+	Plane::Preload();
+	// unpinned workers, one per logical processor
+	scheduler.Configure( TileScheduler::FLOATING, false );
 	// retrieve cam
 	FILE* f = fopen( "appstate.dat", "rb" );
 	if (f)
@@ -15,43 +21,249 @@ void Renderer::Init()
 		fread( &camera, 1, sizeof( Camera ), f );
 		fclose( f );
 	}
+	// continue an interrupted progressive render
+	if (checkpoint.enabled) checkpoint.Resume( *this );
+}
+
+// -----------------------------------------------------------
+// Command line modes: --worker host[:port] renders tiles for a
+// coordinator (see TileCoordinator) until it is stopped;
+// --sequence frames target [--format n] renders an animation
+// into a video file, stdout ("-") or a pipe ("|command");
+// --stress-benchmark objects file.json [--stress-seed n] sweeps
+// the size of a stress scene, see BenchmarkStress
+// -----------------------------------------------------------
+bool Renderer::RunHeadless( int argc, char** argv )
+{
+	const char* worker = 0, * target = 0, * report = 0;
+	int stressMax = 0;
+	for (int i = 1; i < argc - 1; i++)
+	{
+		if (!strcmp( argv[i], "--worker" )) worker = argv[i + 1];
+		if (!strcmp( argv[i], "--format" )) videoFormat = clamp( atoi( argv[i + 1] ), 0, VideoSink::FORMATS - 1 );
+		if (!strcmp( argv[i], "--sequence" ) && i < argc - 2) sequenceFrames = max( 1, atoi( argv[i + 1] ) ), target = argv[i + 2];
+		if (!strcmp( argv[i], "--stress-benchmark" ) && i < argc - 2) stressMax = clamp( atoi( argv[i + 1] ), 10, 10000000 ), report = argv[i + 2];
+		if (!strcmp( argv[i], "--stress-seed" )) stressParams.seed = (uint)atoi( argv[i + 1] );
+	}
+	if (stressMax)
+	{
+		BenchmarkStress( stressMax, report );
+		return true;
+	}
+	if (!worker && !target) return false;
+	// neither mode has a progressive render of its own
+	checkpoint.enabled = false;
+	Init();
+	if (target)
+	{
+		strncpy( videoTarget, target, sizeof( videoTarget ) - 1 );
+		RenderSequence();
+		return true;
+	}
+	char host[256];
+	strncpy( host, worker, sizeof( host ) - 1 ), host[sizeof( host ) - 1] = 0;
+	int port = cluster.port;
+	char* colon = strrchr( host, ':' );
+	if (colon) *colon = 0, port = atoi( colon + 1 );
+	TileWorker().Run( *this, host, port );
+	return true;
+}
+
+// -----------------------------------------------------------
+// Generate the stress scene from its parameters, or drop it
+// -----------------------------------------------------------
+void Renderer::UpdateStress()
+{
+	if (stressScene) stress.Generate( stressParams ); else stress.Clear();
+	scene.stress = stressScene ? &stress : 0;
+	accumulated = 0;
+}
+
+// -----------------------------------------------------------
+// Scaling benchmark: stress scenes of 10, 30, 100, 300 ..
+// objects, up to maxCount, with the other stress parameters
+// as set. Per size: generation and BVH build time, memory,
+// and the speed of the primary rays of the default view and
+// of a shadow ray per hit. Then, if a device is available,
+// a few frames of the OpenCL backend with its commands
+// profiled (see Kernel::WriteProfile); the device does not
+// trace stress objects, so these render the base scene.
+// Prints a table and writes JSON.
+// -----------------------------------------------------------
+void Renderer::BenchmarkStress( const int maxCount, const char* target )
+{
+	const int pixels = SCRWIDTH * SCRHEIGHT;
+	Camera view;
+	Ray* rays = (Ray*)Memory::AllocLarge( pixels * sizeof( Ray ) );
+	StressScene bench;
+	Scene s = scene;
+	s.stress = &bench, s.SetTime( 0 );
+	FILE* f = target ? fopen( target, "w" ) : 0;
+	if (f) fprintf( f, "{\n\"threads\": %i, \"simd\": \"%s\", \"seed\": %u, \"density\": %g, \"sizeSpread\": %g,\n"
+		"\"mix\": [%g, %g, %g, %g], \"mirror\": %g, \"glass\": %g, \"animated\": %g,\n\"results\": [\n",
+		omp_get_max_threads(), SIMD::name[SIMD::level], stressParams.seed, stressParams.density, stressParams.sizeSpread,
+		stressParams.mix[0], stressParams.mix[1], stressParams.mix[2], stressParams.mix[3], stressParams.mirror, stressParams.glass, stressParams.animated );
+	printf( "%9s %10s %10s %10s %9s %13s %13s %6s\n", "objects", "generate", "build", "nodes", "MB", "primary", "shadow", "hits" );
+	for (int n = 10, step = 0; n <= maxCount; n = step++ & 1 ? n * 10 / 3 : n * 3)
+	{
+		StressParams p = stressParams;
+		p.count = n;
+		bench.Generate( p );
+#pragma omp parallel for schedule(static)
+		for (int i = 0; i < pixels; i++) rays[i] = view.GetPrimaryRay( (float)(i % SCRWIDTH), (float)(i / SCRWIDTH) );
+		Timer t;
+#pragma omp parallel for schedule(dynamic, 256)
+		for (int i = 0; i < pixels; i++) s.FindNearest( rays[i] );
+		const float primaryMs = t.elapsed() * 1000;
+		// a shadow ray per hit, to one of the four lights
+		int shadowRays = 0, hits = 0;
+		t.reset();
+#pragma omp parallel for schedule(dynamic, 256) reduction(+: shadowRays, hits)
+		for (int i = 0; i < pixels; i++) if (rays[i].objIdx >= 0)
+		{
+			const float3 I = rays[i].IntersectionPoint(), L = s.GetLightPos( (uint)(i & 3) ) - I;
+			const float distance = length( L );
+			const Ray shadow( I + L * (EPSILON / distance), L * (1 / distance), distance - 2 * EPSILON );
+			hits += rays[i].objIdx >= Scene::STRESSBASE, shadowRays++;
+			s.IsOccluded( shadow );
+		}
+		const float shadowMs = t.elapsed() * 1000;
+		const float primaryRate = pixels / (primaryMs * 1000), shadowRate = shadowRays / (shadowMs * 1000);
+		printf( "%9i %8.1fms %8.1fms %10i %9.1f %7.2fMrays/s %7.2fMrays/s %5.1f%%\n", n, bench.generateMs, bench.buildMs,
+			bench.nodesUsed, bench.Bytes() / 1048576.0f, primaryRate, shadowRate, 100.0f * hits / pixels );
+		if (f) fprintf( f, "%s{\"objects\": %i, \"generateMs\": %.3f, \"buildMs\": %.3f, \"bvhNodes\": %i, \"bytes\": %llu, "
+			"\"primaryMrays\": %.3f, \"shadowMrays\": %.3f, \"stressHits\": %.4f}", n > 10 ? ",\n" : "", n, bench.generateMs, bench.buildMs,
+			bench.nodesUsed, (unsigned long long)bench.Bytes(), primaryRate, shadowRate, (float)hits / pixels );
+	}
+	Memory::FreeLarge( rays );
+	// the OpenCL backend, at the default quality and accumulating
+	const int clFrames = 16;
+	const bool cl = clTracer.Init();
+	if (cl)
+	{
+		const bool profilingWas = Kernel::profiling;
+		Kernel::profiling = true;
+		Kernel::ResetProfile();
+		Accumulator device;
+		device.Init( pixels, Accumulator::FLOAT4 );
+		for (int i = 0; i < clFrames; i++)
+		{
+			clTracer.Render( scene, view, int2( SCRWIDTH, SCRHEIGHT ), QualityGovernor::ladder[QualityGovernor::DEFAULT_LEVEL], i, i, 1.0f / (i + 1) );
+			clTracer.Resolve( int2( SCRWIDTH, SCRHEIGHT ), device, 0 );
+		}
+		Kernel::CollectProfile();
+		Kernel::profiling = profilingWas;
+		printf( "\nOpenCL on %s, %i frames, per call:\n", Kernel::deviceName, clFrames );
+		for (const CLProfile& p : Kernel::profile) if (p.count) printf( "%-10s %6u: device %.3fms, queued %.3fms, driver %.3fms, host %.3fms\n",
+			p.name, p.count, p.executed / p.count, p.queued / p.count, p.submitted / p.count, p.host / p.count );
+	}
+	if (!f) return;
+	fprintf( f, "\n],\n\"opencl\": " );
+	if (cl) fprintf( f, "{\"device\": \"%s\", \"frames\": %i, \"profile\": ", Kernel::deviceName, clFrames ), Kernel::WriteProfile( f ), fprintf( f, "}\n" );
+	else fprintf( f, "null\n" );
+	fprintf( f, "}\n" ), fclose( f );
 }
 
 // -----------------------------------------------------------
 // Gather direct illumination for a point
 // -----------------------------------------------------------
-float3 Renderer::DirectIllumination( const float3& I, const float3& N )
+float3 Renderer::DirectIllumination( const Scene& scene, const int objIdx, const float3& I, const float3& N, const int samples, uint& seed )
 {
+	// static surfaces: baked, only the moving objects need shadow rays
+	if (useLightmap && lightmap.Covers( objIdx )) return lightmap.Irradiance( scene, objIdx, I, samples, seed );
 	// sum irradiance from light sources
 	float3 irradiance( 0 );
-	// query the (only) scene light
-	float3 pointOnLight = scene.GetLightPos();
-	float3 L = pointOnLight - I;
-	float distance = length( L );
-	L *= 1 / distance;
-	float ndotl = dot( N, L );
-	if (ndotl < EPSILON) /* we don't face the light */ return 0;
-	// cast a shadow ray
-	Ray s( I + L * EPSILON, L, distance - 2 * EPSILON );
-	if (!scene.IsOccluded( s ))
+	for (int i = 0; i < samples; i++)
+	{
+		// query the (only) scene light; extra samples spread it over a small sphere
+		float3 pointOnLight = scene.GetLightPos();
+		if (samples > 1)
+		{
+			float3 offset;
+			do offset = float3( RandomFloat( seed ), RandomFloat( seed ), RandomFloat( seed ) ) * 2 - 1;
+			while (dot( offset, offset ) > 1);
+			pointOnLight += offset * LIGHTRADIUS;
+		}
+		float3 L = pointOnLight - I;
+		float distance = length( L );
+		L *= 1 / distance;
+		float ndotl = dot( N, L );
+		if (ndotl < EPSILON) /* we don't face the light */ continue;
+		// cast a shadow ray
+		Ray s( I + L * EPSILON, L, distance - 2 * EPSILON );
+		if (!scene.IsOccluded( s ))
+		{
+			// light is visible; calculate irradiance (= projected radiance)
+			float attenuation = 1 / (distance * distance);
+			float3 in_radiance = scene.GetLightColor() * attenuation;
+			irradiance += in_radiance * dot( N, L );
+		}
+	}
+	return irradiance * (1.0f / samples);
+}
+
+// -----------------------------------------------------------
+// Indirect irradiance for a diffuse hit: from the radiance
+// cache when enabled, a constant otherwise
+// -----------------------------------------------------------
+float3 Renderer::Ambient( const float3& I, const float3& N ) const
+{
+	float3 irradiance;
+	if (useRadianceCache && radianceCache.Lookup( I, N, irradiance )) return irradiance;
+	// we don't account for diffuse interreflections: approximate
+	return float3( 0.2f, 0.2f, 0.2f );
+}
+
+// -----------------------------------------------------------
+// Cosine-weighted direction around a normal
+// -----------------------------------------------------------
+static float3 CosineWeightedDirection( const float3& N, uint& seed )
+{
+	const float r0 = RandomFloat( seed ), r1 = RandomFloat( seed );
+	const float r = sqrtf( r0 ), phi = 2 * PI * r1;
+	const float3 T = normalize( fabs( N.x ) > 0.9f ? cross( N, float3( 0, 1, 0 ) ) : cross( N, float3( 1, 0, 0 ) ) );
+	const float3 B = cross( N, T );
+	return normalize( T * (r * cosf( phi )) + B * (r * sinf( phi )) + N * sqrtf( 1 - r0 ) );
+}
+
+// -----------------------------------------------------------
+// Train the radiance cache with a sparse set of paths: one
+// diffuse bounce from random primary hits, evaluated with a
+// short Trace. That Trace reads the cache at its own diffuse
+// hits, so over frames the cache picks up multiple bounces.
+// -----------------------------------------------------------
+void Renderer::TrainRadianceCache()
+{
+	Timer t;
+	const QualitySettings training = { 2, 1, 1 };
+#pragma omp parallel for schedule(dynamic, 64)
+	for (int i = 0; i < trainingPaths; i++)
 	{
-		// light is visible; calculate irradiance (= projected radiance)
-		float attenuation = 1 / (distance * distance);
-		float3 in_radiance = scene.GetLightColor() * attenuation;
-		irradiance = in_radiance * dot( N, L );
+		uint seed = InitSeed( i + frame * trainingPaths );
+		Ray r = camera.GetPrimaryRay( RandomFloat( seed ) * SCRWIDTH, RandomFloat( seed ) * SCRHEIGHT );
+		scene.FindNearest( r );
+		if (r.objIdx == -1) continue;
+		const float3 I = r.IntersectionPoint();
+		if (scene.GetReflectivity( r.objIdx, I ) + scene.GetRefractivity( r.objIdx, I ) >= 1) continue;
+		const float3 N = scene.GetNormal( r.objIdx, I, r.D );
+		const float3 D = CosineWeightedDirection( N, seed );
+		Ray bounce( I + D * EPSILON, D );
+		// pdf is cos / pi, so irradiance is estimated as pi times the radiance
+		radianceCache.Add( I, N, Trace( scene, bounce, training, seed, 1 ) * PI );
 	}
-	return irradiance;
+	radianceCache.Resolve();
+	trainingMs = t.elapsed() * 1000;
 }
 
 // -----------------------------------------------------------
 // Evaluate light transport
 // -----------------------------------------------------------
-float3 Renderer::Trace( Ray& ray, int depth )
+float3 Renderer::Trace( const Scene& scene, Ray& ray, const QualitySettings& q, uint& seed, int depth )
 {
 	// intersect the ray with the scene
 	scene.FindNearest( ray );
 	if (ray.objIdx == -1) /* ray left the scene */ return 0;
-	if (depth > MAXDEPTH) /* bouned too many times */ return 0;
+	if (depth > q.maxDepth) /* bouned too many times */ return 0;
 	// gather shading data
 	float3 I = ray.O + ray.t * ray.D;
 	float3 N = scene.GetNormal( ray.objIdx, I, ray.D );
@@ -66,7 +278,7 @@ float3 Renderer::Trace( Ray& ray, int depth )
 	{
 		float3 R = reflect( ray.D, N );
 		Ray r( I + R * EPSILON, R );
-		out_radiance += reflectivity * albedo * Trace( r, depth + 1 );
+		out_radiance += reflectivity * albedo * Trace( scene, r, q, seed, depth + 1 );
 	}
 	// handle dielectrics such as glass / water
 	if (refractivity > 0)
@@ -84,17 +296,17 @@ float3 Renderer::Trace( Ray& ray, int depth )
 			float3 T = eta * ray.D + ((eta * cosi - sqrtf( fabs( cost2 ) )) * N);
 			Ray t( I + T * EPSILON, T );
 			t.inside = !ray.inside;
-			out_radiance += albedo * (1 - Fr) * Trace( t, depth + 1 );
+			out_radiance += albedo * (1 - Fr) * Trace( scene, t, q, seed, depth + 1 );
 		}
-		out_radiance += albedo * Fr * Trace( r, depth + 1 );
+		out_radiance += albedo * Fr * Trace( scene, r, q, seed, depth + 1 );
 	}
 	// handle diffuse surfaces
 	if (diffuseness > 0)
 	{
 		// calculate illumination
-		float3 irradiance = DirectIllumination( I, N );
-		// we don't account for diffuse interreflections: approximate
-		float3 ambient = float3( 0.2f, 0.2f, 0.2f );
+		float3 irradiance = DirectIllumination( scene, ray.objIdx, I, N, q.shadowSamples, seed );
+		// diffuse interreflections
+		float3 ambient = Ambient( I, N );
 		// calculate reflected radiance using Lambert brdf
 		float3 brdf = albedo * INVPI;
 		out_radiance += diffuseness * brdf * (irradiance + ambient);
@@ -111,6 +323,319 @@ float3 Renderer::Trace( Ray& ray, int depth )
 	return medium_scale * out_radiance;
 }
 
+// -----------------------------------------------------------
+// Render a tile breadth-first: all rays of one depth are
+// intersected, then their hits are sorted by primitive and
+// shaded in 8-wide batches (see HitBatch). The bounces that
+// Trace handles recursively become the next wavefront; their
+// weight is carried in the throughput of each ray.
+// -----------------------------------------------------------
+void Renderer::TraceTile( const FrameTarget& f, const int2 p0, const int2 p1, const int2 res, const QualitySettings& q, const float blend, const bool keepGuide )
+{
+	// wavefront state of this tile; its buffers live in the frame arena of
+	// this thread until the tile is done, so warm threads do not allocate
+	Arena& arena = Memory::FrameArena();
+	const Arena::Marker mark = arena.Mark();
+	RayQueue queue[3];
+	RaySorter sorter;
+	HitBatch batch;
+	ShadowBatch shadows;
+	thread_local float3 color[TILESIZE * TILESIZE];
+	const float sx = (float)SCRWIDTH / res.x, sy = (float)SCRHEIGHT / res.y;
+	RayQueue* current = &queue[0], * next = &queue[1], * spare = &queue[2];
+	current->Clear();
+	// primary rays; jitter matches the recursive path
+	for (int y = p0.y; y < p1.y; y++) for (int x = p0.x; x < p1.x; x++)
+	{
+		const int pixel = x + y * res.x, local = (x - p0.x) + (y - p0.y) * TILESIZE;
+		uint seed = InitSeed( pixel + f.frame * SCRWIDTH * SCRHEIGHT );
+		color[local] = 0;
+		for (int s = 0; s < q.spp; s++)
+		{
+			const float jx = (s > 0 || f.accumulated) ? RandomFloat( seed ) : 0;
+			const float jy = (s > 0 || f.accumulated) ? RandomFloat( seed ) : 0;
+			WaveRay& w = current->Add();
+			w.ray = f.camera->GetPrimaryRay( (x + jx) * sx, (y + jy) * sy );
+			w.throughput = 1.0f / q.spp;
+			w.pixel = local, w.depth = 0, w.seed = WangHash( seed + s );
+		}
+	}
+	shadows.Clear();
+	for (int depth = 0; current->count > 0; depth++)
+	{
+		if (depth == 0) f.scene->FindNearest( &current->ray[0].ray, current->count, sizeof( WaveRay ) );
+		else
+		{
+			// secondary rays: optionally reorder for coherence, and keep statistics
+			if (sortRays)
+			{
+				Timer sorting;
+				sorter.Sort( *f.scene, *current, *spare ), Swap( current, spare );
+				secondary.sortNanoseconds += (long long)(sorting.elapsed() * 1e9f);
+			}
+			Timer traversal;
+			f.scene->FindNearest( &current->ray[0].ray, current->count, sizeof( WaveRay ) );
+			const float elapsed = traversal.elapsed();
+			int coherent = 0;
+			for (int i = 1; i < current->count; i++) coherent += current->ray[i].ray.objIdx == current->ray[i - 1].ray.objIdx;
+			secondary.rays += current->count, secondary.coherent += coherent;
+			secondary.nanoseconds += (long long)(elapsed * 1e9f);
+		}
+		if (depth == 0 && keepGuide) for (int i = 0; i < current->count; i += q.spp)
+		{
+			// keep the first primary hit as a guide for the upscaler and denoiser
+			const Ray& r = current->ray[i].ray;
+			const int local = current->ray[i].pixel;
+			const int pixel = p0.x + local % TILESIZE + (p0.y + local / TILESIZE) * res.x;
+			f.guide[pixel] = r.objIdx == -1 ? float4( 0, 0, 0, 1e34f ) :
+				float4( f.scene->GetNormal( r.objIdx, r.IntersectionPoint(), r.D ), r.t );
+		}
+		batch.Build( *f.scene, current->ray, current->count );
+		batch.Shade( *f.scene );
+		// scalar continuation per hit: direct light and the next wavefront
+		next->Clear();
+		for (int b = 0; b < HitBatch::BINS; b++)
+		{
+			const float reflectivity = batch.reflectivity[b], refractivity = batch.refractivity[b];
+			const float diffuseness = 1 - (reflectivity + refractivity);
+			for (int j = batch.binStart[b]; j < batch.binEnd[b]; j++)
+			{
+				WaveRay& w = current->ray[batch.ray[j]];
+				const float3 I( batch.I[0][j], batch.I[1][j], batch.I[2][j] ), D( batch.D[0][j], batch.D[1][j], batch.D[2][j] );
+				const float3 N( batch.N[0][j], batch.N[1][j], batch.N[2][j] );
+				const float3 albedo( batch.albedo[0][j], batch.albedo[1][j], batch.albedo[2][j] );
+				// apply absorption if we travelled through a medium
+				float3 throughput = w.throughput;
+				if (w.ray.inside) throughput *= float3( expf( 0.5f * -w.ray.t ), 1, expf( 0.5f * -w.ray.t ) );
+				if (diffuseness > 0 && deferShadows && !(useLightmap && lightmap.Covers( b )))
+				{
+					// direct light is added once all hits of the tile are known
+					ShadowHit& h = shadows.Add();
+					h.I = I, h.N = N, h.weight = throughput * diffuseness * (albedo * INVPI);
+					h.pixel = w.pixel, h.seed = w.seed;
+					color[w.pixel] += h.weight * Ambient( I, N );
+				}
+				else if (diffuseness > 0)
+				{
+					const float3 irradiance = DirectIllumination( *f.scene, b, I, N, q.shadowSamples, w.seed );
+					color[w.pixel] += throughput * diffuseness * (albedo * INVPI) * (irradiance + Ambient( I, N ));
+				}
+				// rays beyond the depth limit would contribute nothing
+				if (w.depth == q.maxDepth) continue;
+				if (reflectivity > 0 || refractivity > 0)
+				{
+					const float3 R = reflect( D, N );
+					WaveRay& r = next->Add();
+					r.ray = Ray( I + R * EPSILON, R );
+					r.throughput = throughput * albedo * (refractivity > 0 ? batch.Fr[j] : reflectivity);
+					r.pixel = w.pixel, r.depth = w.depth + 1, r.seed = WangHash( w.seed );
+				}
+				if (refractivity > 0 && batch.Fr[j] < 1)
+				{
+					const float3 T( batch.T[0][j], batch.T[1][j], batch.T[2][j] );
+					WaveRay& t = next->Add();
+					t.ray = Ray( I + T * EPSILON, T );
+					t.ray.inside = !w.ray.inside;
+					t.throughput = throughput * albedo * (1 - batch.Fr[j]);
+					t.pixel = w.pixel, t.depth = w.depth + 1, t.seed = WangHash( w.seed + 1 );
+				}
+			}
+		}
+		Swap( current, next );
+	}
+	if (deferShadows) shadows.Trace( *f.scene, q.shadowSamples, color );
+	for (int y = p0.y; y < p1.y; y++) for (int x = p0.x; x < p1.x; x++)
+	{
+		const int pixel = x + y * res.x;
+		float3 c = color[(x - p0.x) + (y - p0.y) * TILESIZE];
+		if (f.accumulated) c = f.accumulator->Load( pixel ) * (1 - blend) + c * blend;
+		f.accumulator->Store( pixel, c );
+	}
+	arena.Rewind( mark );
+}
+
+// -----------------------------------------------------------
+// Render one tile of a frame with the recursive or the
+// wavefront path; shared by the local tile loop, the tile
+// coordinator and its workers, and the sequence renderer
+// -----------------------------------------------------------
+void Renderer::RenderTile( const FrameTarget& f, const int tile, const int tilesX, const int2 res, const QualitySettings& q, const float blend, const bool keepGuide )
+{
+	const int x0 = (tile % tilesX) * TILESIZE, x1 = min( x0 + TILESIZE, res.x );
+	const int y0 = (tile / tilesX) * TILESIZE, y1 = min( y0 + TILESIZE, res.y );
+	if (wavefront)
+	{
+		TraceTile( f, int2( x0, y0 ), int2( x1, y1 ), res, q, blend, keepGuide );
+		return;
+	}
+	const float sx = (float)SCRWIDTH / res.x, sy = (float)SCRHEIGHT / res.y;
+	for (int y = y0; y < y1; y++) for (int x = x0; x < x1; x++)
+	{
+		// trace primary rays for the pixel; the first one is not jittered
+		// unless we are refining an accumulated image
+		const int pixel = x + y * res.x;
+		uint seed = InitSeed( pixel + f.frame * SCRWIDTH * SCRHEIGHT );
+		const float jx = f.accumulated ? RandomFloat( seed ) : 0, jy = f.accumulated ? RandomFloat( seed ) : 0;
+		Ray r = f.camera->GetPrimaryRay( (x + jx) * sx, (y + jy) * sy );
+		float3 sum = Trace( *f.scene, r, q, seed );
+		for (int s = 1; s < q.spp; s++)
+		{
+			Ray j = f.camera->GetPrimaryRay( (x + RandomFloat( seed )) * sx, (y + RandomFloat( seed )) * sy );
+			sum += Trace( *f.scene, j, q, seed );
+		}
+		float3 color = sum * (1.0f / q.spp);
+		if (f.accumulated) color = f.accumulator->Load( pixel ) * (1 - blend) + color * blend;
+		f.accumulator->Store( pixel, color );
+		if (!keepGuide) continue;
+		// keep the primary hit as a guide for the upscaler and denoiser
+		f.guide[pixel] = r.objIdx == -1 ? float4( 0, 0, 0, 1e34f ) :
+			float4( f.scene->GetNormal( r.objIdx, r.IntersectionPoint(), r.D ), r.t );
+	}
+}
+
+// -----------------------------------------------------------
+// Rebake the lightmap when the lights of the active shading
+// path changed; without static lights it stays off, rather
+// than being rebaked and cached to disk every frame
+// -----------------------------------------------------------
+void Renderer::UpdateLightmap()
+{
+	if (!Lightmap::available) { useLightmap = false; return; }
+	// the lightmap must hold the lights of the active shading path
+	float3 lights[Lightmap::MAXLIGHTS];
+	const bool fourLights = wavefront && deferShadows;
+	const int count = fourLights ? (int)scene.GetLightCount() : 1;
+	for (int i = 0; i < count; i++) lights[i] = fourLights ? scene.GetLightPos( (uint)i ) : scene.GetLightPos();
+	const float3 color = scene.GetLightColor() * (1.0f / count);
+	if (!lightmap.Matches( lights, count, color )) lightmap.Bake( scene, lights, count, color );
+}
+
+// -----------------------------------------------------------
+// Render the current view with both backends, at the default
+// quality and without jitter, lightmap or radiance cache, and
+// measure how far the OpenCL result is from the C++ one. The
+// device does not trace SDF or stress objects, so both are
+// hidden while comparing.
+// -----------------------------------------------------------
+void Renderer::CompareBackends()
+{
+	if (!clTracer.Init()) return;
+	const QualitySettings& q = QualityGovernor::ladder[QualityGovernor::DEFAULT_LEVEL];
+	const bool lightmapWas = useLightmap, cacheWas = useRadianceCache;
+	useLightmap = useRadianceCache = false;
+	scene.ShowSDFs( false ), scene.stress = 0;
+	Accumulator device;
+	device.Init( SCRWIDTH * SCRHEIGHT, Accumulator::FLOAT4 );
+	clTracer.Render( scene, camera, int2( SCRWIDTH, SCRHEIGHT ), q, frame, 0, 1 );
+	clTracer.Resolve( int2( SCRWIDTH, SCRHEIGHT ), device, 0 );
+	// per-row sums; MSVC's OpenMP has no max reduction
+	float rowMax[SCRHEIGHT], rowSum[SCRHEIGHT];
+	int rowMismatch[SCRHEIGHT];
+#pragma omp parallel for schedule(dynamic)
+	for (int y = 0; y < SCRHEIGHT; y++)
+	{
+		rowMax[y] = rowSum[y] = 0, rowMismatch[y] = 0;
+		for (int x = 0; x < SCRWIDTH; x++)
+		{
+			uint seed = InitSeed( x + y * SCRWIDTH + frame * SCRWIDTH * SCRHEIGHT );
+			Ray r = camera.GetPrimaryRay( (float)x, (float)y );
+			const float3 d = Trace( scene, r, q, seed ) - device.Load( x + y * SCRWIDTH );
+			const float error = max( fabs( d.x ), max( fabs( d.y ), fabs( d.z ) ) );
+			rowMax[y] = max( rowMax[y], error ), rowSum[y] += error;
+			rowMismatch[y] += error > 1.0f / 255; // visible after conversion to 8 bit
+		}
+	}
+	float maxError = 0;
+	double sumError = 0;
+	int mismatch = 0;
+	for (int y = 0; y < SCRHEIGHT; y++) maxError = max( maxError, rowMax[y] ), sumError += rowSum[y], mismatch += rowMismatch[y];
+	backendMaxError = maxError;
+	backendMeanError = (float)(sumError / (SCRWIDTH * SCRHEIGHT));
+	backendMismatch = 100.0f * mismatch / (SCRWIDTH * SCRHEIGHT);
+	useLightmap = lightmapWas, useRadianceCache = cacheWas;
+	scene.ShowSDFs( sdfObjects ), scene.stress = stressScene ? &stress : 0;
+	accumulated = 0; // the device accumulator was overwritten
+}
+
+// -----------------------------------------------------------
+// Edge-aware 3x3 filter from accumulator to denoised; works on
+// any accumulator format by decoding rows to scratch. The row
+// filter is a SIMD kernel (see kernels.h).
+// -----------------------------------------------------------
+void Renderer::Denoise( const int2 res )
+{
+#pragma omp parallel
+	{
+		// per-thread row scratch, from the frame arena; released at the end,
+		// as the headless modes have no frame to reset the arena
+		Arena& arena = Memory::FrameArena();
+		const Arena::Marker mark = arena.Mark();
+		float4* row[3], * out = arena.Alloc<float4>( res.x );
+		for (int i = 0; i < 3; i++) row[i] = arena.Alloc<float4>( res.x );
+#pragma omp for schedule(dynamic)
+		for (int y = 0; y < res.y; y++)
+		{
+			const float* rows[3], * guides[3];
+			for (int i = 0; i < 3; i++)
+			{
+				const int rowY = clamp( y + i - 1, 0, res.y - 1 );
+				accumulator.Decode( rowY * res.x, res.x, row[i] );
+				rows[i] = &row[i]->x, guides[i] = &guide[rowY * res.x].x;
+			}
+			Kernels().DenoiseRow( rows, guides, res.x, &out->x );
+			denoised.Encode( y * res.x, res.x, out );
+		}
+		arena.Rewind( mark );
+	}
+}
+
+// -----------------------------------------------------------
+// Reallocate the large buffers and let every worker touch its
+// own rows first, so pages end up on the NUMA node that uses
+// them; also applies a change of page size
+// -----------------------------------------------------------
+void Renderer::PlaceBuffers()
+{
+	accumulator.Init( SCRWIDTH * SCRHEIGHT, accumulator.format, false );
+	denoised.Init( SCRWIDTH * SCRHEIGHT, denoised.format, false );
+	Memory::FreeLarge( guide );
+	guide = (float4*)Memory::AllocLarge( SCRWIDTH * SCRHEIGHT * 16 );
+	FREE64( screen->pixels );
+	screen->pixels = (uint*)MALLOC64( SCRWIDTH * SCRHEIGHT * sizeof( uint ) );
+	// the team may be smaller than Workers(); every band is cleared regardless
+	const int workers = scheduler.Workers();
+#pragma omp parallel for schedule(static, 1)
+	for (int worker = 0; worker < workers; worker++)
+	{
+		scheduler.Pin( worker );
+		const int2 rows = scheduler.WorkerRows( worker, SCRHEIGHT, TILESIZE );
+		const int first = rows.x * SCRWIDTH, count = (rows.y - rows.x) * SCRWIDTH;
+		accumulator.Clear( first, count );
+		denoised.Clear( first, count );
+		memset( guide + first, 0, count * sizeof( float4 ) );
+		memset( screen->pixels + first, 0, count * sizeof( uint ) );
+	}
+	accumulated = 0;
+}
+
+// -----------------------------------------------------------
+// Render the animation from the current time on, streaming it
+// to videoTarget if set; the last frame stays on screen
+// -----------------------------------------------------------
+void Renderer::RenderSequence()
+{
+	recording = false;
+	if (videoTarget[0] && !video.Open( videoTarget, (VideoSink::Format)videoFormat, SCRWIDTH, SCRHEIGHT, sequence.fps ))
+		fprintf( stderr, "could not open video output %s\n", videoTarget );
+	sequence.Render( *this, sequenceFrames, [&]( const int index, const Accumulator& pixels )
+	{
+		video.Push( pixels );
+		if (screen && index == sequenceFrames - 1) pixels.Convert( 0, SCRWIDTH * SCRHEIGHT, screen->pixels );
+	} );
+	video.Close();
+	accumulated = 0;
+}
+
 // -----------------------------------------------------------
 // Main application tick function - Executed once per frame
 // -----------------------------------------------------------
@@ -118,28 +643,81 @@ void Renderer::Tick( float deltaTime )
 {
 	// animation
 	if (animating) scene.SetTime( anim_time += deltaTime * 0.002f );
-	// pixel loop
+	// internal resolution for this frame; pixels map to the full screen
+	const int2 res = governor.GetResolution();
+	const bool upscale = res.x != SCRWIDTH || res.y != SCRHEIGHT;
+	// history is only valid for a static view at a fixed resolution
+	if (!accumulate || animating || res.x != historyRes.x || res.y != historyRes.y) accumulated = 0;
+	historyRes = res;
+	const float blend = 1.0f / (accumulated + 1);
+	// tiles, each with its own quality settings
+	const int tilesX = (res.x + TILESIZE - 1) / TILESIZE, tilesY = (res.y + TILESIZE - 1) / TILESIZE;
+	quality.Resize( tilesX * tilesY );
+	frame++;
+	secondary.Reset();
+	if (useLightmap) UpdateLightmap();
+	if (useRadianceCache) TrainRadianceCache();
+	// tile loop
 	Timer t;
-	// lines are executed as OpenMP parallel tasks (disabled in DEBUG)
-#pragma omp parallel for schedule(dynamic)
-	for (int y = 0; y < SCRHEIGHT; y++)
+	if (useOpenCL)
 	{
-		// trace a primary ray for each pixel on the line
-		for (int x = 0; x < SCRWIDTH; x++)
-			accumulator[x + y * SCRWIDTH] =
-			float4( Trace( camera.GetPrimaryRay( (float)x, (float)y ) ), 0 );
-		// translate accumulator contents to rgb32 pixels
-		for (int dest = y * SCRWIDTH, x = 0; x < SCRWIDTH; x++)
-			screen->pixels[dest + x] =
-			RGBF32_to_RGB8( &accumulator[x + y * SCRWIDTH] );	
+		// one work item per pixel on the compute device, at the default quality
+		clTracer.Render( scene, camera, res, QualityGovernor::ladder[QualityGovernor::DEFAULT_LEVEL], frame, accumulated, blend );
+		clTracer.Resolve( res, accumulator, upscale || denoise ? guide : 0 );
+	}
+	else if (!distributed || !cluster.Render( res, tilesX, tilesY, blend, upscale || denoise ))
+	{
+		scheduler.Begin( tilesX, tilesY );
+		const FrameTarget view = View();
+		// tiles are executed by OpenMP workers (disabled in DEBUG)
+#pragma omp parallel
+		{
+			const int worker = omp_get_thread_num();
+			scheduler.Pin( worker );
+			for (int tile; (tile = scheduler.Next( worker )) >= 0;)
+			{
+				Timer tileTimer;
+				RenderTile( view, tile, tilesX, res, quality.GetSettings( tile ), blend, upscale || denoise );
+				quality.tileMs[tile] = tileTimer.elapsed() * 1000;
+			}
+		}
+	}
+	if (accumulate) accumulated++;
+	// post processing
+	if (denoise) Denoise( res );
+	const Accumulator& result = denoise ? denoised : accumulator;
+	// translate accumulator contents to rgb32 pixels
+	if (upscale) upscaler.Upscale( result, guide, res, screen );
+	else
+	{
+		// each worker converts the rows it touched first; with a full team,
+		// band w goes to thread w, a smaller team still covers all bands
+		const int workers = scheduler.Workers();
+#pragma omp parallel for schedule(static, 1)
+		for (int worker = 0; worker < workers; worker++)
+		{
+			const int2 rows = scheduler.WorkerRows( worker, SCRHEIGHT, TILESIZE );
+			result.Convert( rows.x * SCRWIDTH, (rows.y - rows.x) * SCRWIDTH, screen->pixels + rows.x * SCRWIDTH );
+		}
 	}
+	// adapt resolution and quality to the render budget
+	const float elapsed = t.elapsed() * 1000;
+	governor.Update( elapsed );
+	// the OpenCL tracer renders at the default quality and has no tile timings
+	if (!useOpenCL) quality.Update( elapsed );
 	// performance report - running average - ms, MRays/s
-	avg = (1 - alpha) * avg + alpha * t.elapsed() * 1000;
-	float fps = 1000.0f / avg, rps = ( SCRWIDTH * SCRHEIGHT ) / avg;
+	avg = (1 - alpha) * avg + alpha * elapsed;
+	float fps = 1000.0f / avg, rps = (res.x * res.y) / avg;
 	printf( "%5.2fms (%.1ffps) - %.1fMrays/s\n", avg, fps, rps / 1000 );
 	if (alpha > 0.05f) alpha *= 0.75f;
+	// screen recording: the accumulator keeps the range for 16-bit and float output
+	if (recording)
+	{
+		if (upscale) video.Push( screen->pixels ); else video.Push( result );
+	}
 	// handle user input
-	camera.HandleInput( deltaTime );
+	if (camera.HandleInput( deltaTime )) accumulated = 0;
+	checkpoint.Update( *this );
 }
 
 // -----------------------------------------------------------
@@ -149,9 +727,169 @@ void Renderer::UI()
 {
 	// animation toggle
 	ImGui::Checkbox( "Animate scene", &animating );
+	// signed distance field objects; not in the OpenCL scene
+	if (ImGui::Checkbox( "SDF objects", &sdfObjects )) scene.ShowSDFs( sdfObjects ), accumulated = 0;
+	// randomized objects for scaling tests; not in the OpenCL scene
+	if (ImGui::Checkbox( "Stress scene", &stressScene )) UpdateStress();
+	if (stressScene)
+	{
+		StressParams& p = stressParams;
+		ImGui::SliderInt( "Objects", &p.count, 10, 10000000, "%d", ImGuiSliderFlags_Logarithmic );
+		ImGui::SliderFloat( "Density", &p.density, 0.001f, 0.5f, "%.3f", ImGuiSliderFlags_Logarithmic );
+		ImGui::SliderFloat( "Size spread", &p.sizeSpread, 1, 100, "%.1f", ImGuiSliderFlags_Logarithmic );
+		ImGui::SliderFloat4( "Spheres, cubes, tori, triangles", p.mix, 0, 1 );
+		ImGui::SliderFloat( "Mirrors", &p.mirror, 0, 1 );
+		ImGui::SliderFloat( "Glass", &p.glass, 0, 1 );
+		ImGui::SliderFloat( "Animated", &p.animated, 0, 1 );
+		ImGui::InputInt( "Seed", (int*)&p.seed );
+		if (ImGui::Button( "Generate" )) UpdateStress();
+		ImGui::Text( "Stress: %i objects, %i nodes, %.1fMB; generated in %.1fms, BVH built in %.1fms",
+			stress.count, stress.nodesUsed, stress.Bytes() / 1048576.0f, stress.generateMs, stress.buildMs );
+	}
+	// offline animation with several frames in flight
+	ImGui::SliderInt( "Sequence frames", &sequenceFrames, 1, 1000 );
+	ImGui::SliderInt( "Frames in flight", &sequence.inFlight, 1, 8 );
+	if (ImGui::Button( "Render sequence" )) RenderSequence();
+	if (sequence.framesDone) ImGui::Text( "Sequence: %i frames in %.1fs, threads %.1f%% busy", sequence.framesDone, sequence.renderMs / 1000, sequence.busy * 100 );
+	// video output for sequences and screen recording
+	ImGui::InputText( "Video output", videoTarget, sizeof( videoTarget ) );
+	ImGui::Combo( "Video format", &videoFormat, VideoSink::formatName, VideoSink::FORMATS );
+	if (ImGui::Checkbox( "Record screen", &recording ))
+	{
+		if (!recording) video.Close();
+		else recording = video.Open( videoTarget, (VideoSink::Format)videoFormat, SCRWIDTH, SCRHEIGHT, 1000 / avg );
+	}
+	if (video.framesWritten) ImGui::Text( "Video: %i frames, %.1fMB; %.1fms converting, %.1fms writing, %.1fms waiting",
+		video.framesWritten, video.bytesWritten / 1048576.0f, video.convertMs, video.writeMs, video.waitMs );
 	// ray query on mouse
 	Ray r = camera.GetPrimaryRay( (float)mousePos.x, (float)mousePos.y );
 	scene.FindNearest( r );
 	ImGui::Text( "Object id %i", r.objIdx );
 	ImGui::Text( "Frame: %5.2fms (%.1ffps)", avg, 1000 / avg );
+	// dynamic resolution
+	ImGui::Checkbox( "Dynamic resolution", &governor.enabled );
+	ImGui::SliderFloat( "Render budget (ms)", &governor.targetMs, 4, 100 );
+	const int2 res = governor.GetResolution();
+	ImGui::Text( "Render resolution: %ix%i", res.x, res.y );
+	// output layout (denoised, checkpoints); the accumulator blends in float
+	int format = denoised.format;
+	if (ImGui::Combo( "Output format", &format, Accumulator::formatName, Accumulator::FORMATS ))
+	{
+		denoised.Init( SCRWIDTH * SCRHEIGHT, (Accumulator::Format)format );
+		accumulator.Init( SCRWIDTH * SCRHEIGHT, Accumulator::Blended( denoised.format ) );
+		accumulated = 0;
+	}
+	ImGui::Text( "Accumulator: %.1fMB, output: %.1fMB", accumulator.Bytes() / 1048576.0f, denoised.Bytes() / 1048576.0f );
+	ImGui::Checkbox( "Accumulate", &accumulate );
+	ImGui::Text( "Accumulated frames: %i", accumulated );
+	ImGui::Checkbox( "Checkpoint", &checkpoint.enabled );
+	ImGui::SliderFloat( "Checkpoint interval (s)", &checkpoint.interval, 5, 600 );
+	if (checkpoint.sequence) ImGui::Text( "Checkpoint %llu: %.0fs ago, %.1fms%s", (unsigned long long)checkpoint.sequence,
+		checkpoint.sinceWrite.elapsed(), checkpoint.writeMs, checkpoint.resumed ? ", resumed" : "" );
+	ImGui::Checkbox( "Denoise", &denoise );
+	// instruction set of the SIMD kernels; lower levels are there for comparison
+	int simdLevel = SIMD::level;
+	if (ImGui::Combo( "SIMD kernels", &simdLevel, SIMD::name, SIMD::supported + 1 ))
+	{
+		SIMD::Use( simdLevel );
+		if (SIMD::level < SIMD::AVX2) wavefront = false;
+	}
+	// wavefront tiles; the shading kernels gather texels with AVX2
+	if (SIMD::level >= SIMD::AVX2) ImGui::Checkbox( "Wavefront shading", &wavefront );
+	else ImGui::Text( "Wavefront shading requires AVX2" );
+	if (wavefront)
+	{
+		ImGui::Checkbox( "Sort secondary rays", &sortRays );
+		ImGui::Checkbox( "Deferred shadows (four lights)", &deferShadows );
+		const int rays = secondary.rays;
+		if (rays) ImGui::Text( "Secondary: %i rays, %.1f%% coherent, %.1fns/ray + %.1fns/ray sorting", rays,
+			100.0f * secondary.coherent / rays, (float)secondary.nanoseconds / rays, (float)secondary.sortNanoseconds / rays );
+	}
+	// baked direct light on the room planes
+	if (Lightmap::available) ImGui::Checkbox( "Lightmap for walls", &useLightmap );
+	else ImGui::Text( "Lightmap: needs the static lights of FOURLIGHTS" );
+	if (useLightmap) ImGui::Text( "Lightmap: %i texels, %s in %.1fms", lightmap.texelCount, lightmap.fromCache ? "loaded" : "baked", lightmap.bakeMs );
+	// indirect light
+	ImGui::Checkbox( "Radiance cache", &useRadianceCache );
+	if (useRadianceCache)
+	{
+		ImGui::SliderInt( "Training paths", &trainingPaths, 1024, 65536 );
+		if (ImGui::SliderFloat( "Cache cell size", &radianceCache.cellSize, 0.02f, 0.5f )) radianceCache.Init( scene );
+		ImGui::Text( "Cache: %i of %i cells, %i updated, %i evicted, %.2fms training", radianceCache.usedCells,
+			1 << radianceCache.tableBits, radianceCache.resolvedCells, radianceCache.evictedCells, trainingMs );
+	}
+	// OpenCL backend; compiled on first use
+	if (ImGui::Checkbox( "OpenCL", &useOpenCL ))
+	{
+		if (useOpenCL && !clTracer.Init()) useOpenCL = false;
+		accumulated = 0;
+	}
+	if (clTracer.failed) ImGui::Text( "No usable OpenCL device" );
+	if (useOpenCL)
+	{
+		ImGui::Text( "Device: %s (%s)", Kernel::deviceName, Kernel::candoInterop ? "GL sharing" : "compute only" );
+		ImGui::Text( "OpenCL: %.2fms kernel, %.2fms readback; no lightmap or radiance cache", clTracer.renderMs, clTracer.readbackMs );
+		if (ImGui::Checkbox( "Specialized kernel", &clTracer.specialize )) accumulated = 0;
+		ImGui::SameLine();
+		ImGui::Text( "%i variants", Kernel::VariantCount() );
+		if (ImGui::Button( "Compare with C++" )) CompareBackends();
+		if (backendMaxError >= 0) ImGui::Text( "Difference: max %.4f, mean %.6f, %.3f%% of pixels visible", backendMaxError, backendMeanError, backendMismatch );
+		if (sdfObjects || stressScene) ImGui::Text( "(compared without SDF and stress objects)" );
+		// device timestamps per command, averaged per call since the last reset
+		ImGui::Checkbox( "Profile OpenCL", &Kernel::profiling );
+		if (Kernel::profiling)
+		{
+			for (const CLProfile& p : Kernel::profile) if (p.count) ImGui::Text( "%-10s %6u: device %.3fms, queued %.3fms, driver %.3fms, host %.3fms",
+				p.name, p.count, p.executed / p.count, p.queued / p.count, p.submitted / p.count, p.host / p.count );
+			if (ImGui::Button( "Reset profile" )) Kernel::ResetProfile();
+			if (ImGui::Button( "Save profile" ))
+			{
+				FILE* f = fopen( "clprofile.json", "w" );
+				if (f) Kernel::WriteProfile( f ), fclose( f );
+			}
+		}
+	}
+	// tiles on worker processes, started with --worker host:port
+	if (ImGui::Checkbox( "Distributed tiles", &distributed ))
+	{
+		if (distributed && !cluster.Start( *this )) distributed = false;
+		if (!distributed) cluster.Stop();
+	}
+	if (distributed)
+	{
+		useRadianceCache = false; // not available on the workers
+		const vector<TileCoordinator::WorkerInfo> workers = cluster.Workers();
+		ImGui::Text( "Port %i: %i workers, %i lost, %i tiles reissued, %i rendered here", cluster.port,
+			(int)workers.size(), (int)cluster.lost, (int)cluster.reissued, (int)cluster.localTiles );
+		for (const TileCoordinator::WorkerInfo& w : workers) ImGui::Text( "%s: %i threads, %i tiles", w.name, w.threads, w.tiles );
+		if (cluster.rawBytes) ImGui::Text( "Tiles deflated to %.1f%%", 100.0f * cluster.packedBytes / cluster.rawBytes );
+	}
+	// thread placement
+	int policy = scheduler.policy;
+	bool numa = scheduler.numaLocal;
+	bool placementChanged = ImGui::Combo( "Threads", &policy, TileScheduler::policyName, TileScheduler::POLICIES );
+	placementChanged |= ImGui::Checkbox( "NUMA-local tiles", &numa );
+	if (placementChanged)
+	{
+		scheduler.Configure( (TileScheduler::Policy)policy, numa );
+		if (numa) PlaceBuffers();
+	}
+	const Topology& topology = Topology::Get();
+	ImGui::Text( "%i workers; %u cores, %i logical, %u nodes", scheduler.Workers(), topology.coreCount, (int)topology.processors.size(), topology.nodeCount );
+	// memory
+	if (ImGui::Checkbox( "Huge pages for large buffers", &Memory::hugePages )) PlaceBuffers();
+	ImGui::Text( "Large buffers: %.1fMB, %.1fMB in huge pages", Memory::largeBytes / 1048576.0f, Memory::hugeBytes / 1048576.0f );
+	const vector<Arena*> arenas = Memory::FrameArenas();
+	for (size_t i = 0; i < arenas.size(); i++)
+		ImGui::Text( "Frame arena %i: peak %.1fKB of %.1fKB, %i heap allocs", (int)i, arenas[i]->peak / 1024.0f, arenas[i]->Capacity() / 1024.0f, arenas[i]->heapAllocs );
+	// adaptive quality
+	ImGui::Checkbox( "Adaptive quality", &quality.enabled );
+	ImGui::SliderFloat( "Quality budget (ms)", &quality.targetMs, 4, 100 );
+	int tilesPerLevel[QualityGovernor::LEVELS] = {};
+	for (int i = 0; i < quality.tileCount; i++) tilesPerLevel[quality.enabled ? quality.level[i] : QualityGovernor::DEFAULT_LEVEL]++;
+	for (int i = 0; i < QualityGovernor::LEVELS; i++) if (tilesPerLevel[i])
+	{
+		const QualitySettings& q = QualityGovernor::ladder[i];
+		ImGui::Text( "depth %i, %i shadow, %i spp: %i tiles", q.maxDepth, q.shadowSamples, q.spp, tilesPerLevel[i] );
+	}
 }
\ No newline at end of file
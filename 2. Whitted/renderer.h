@@ -2,23 +2,73 @@
 
 #define EPSILON		0.0001f
 #define MAXDEPTH	7 // live wild
+#define TILESIZE	32
+#define LIGHTRADIUS	0.1f // for soft shadows when using several shadow samples
+
+#include "accumulator.h"
+#include "checkpoint.h"
+#include "cltracer.h"
+#include "cluster.h"
+#include "governor.h"
+#include "kernels.h"
+#include "lightmap.h"
+#include "radiancecache.h"
+#include "scheduler.h"
+#include "sequence.h"
+#include "shading.h"
+#include "upscaler.h"
+#include "video.h"
 
 namespace Tmpl8
 {
 
+// -----------------------------------------------------------
+// What the tile functions read and write: the scene at the
+// time of the frame, the view, the sampler seed and the
+// buffers. The interactive view renders into the members of
+// Renderer (see View); a sequence has several frames in
+// flight, each with a scene of its own.
+// -----------------------------------------------------------
+struct FrameTarget
+{
+	const Scene* scene;
+	Camera* camera;
+	uint frame;			// seeds the samplers
+	int accumulated;	// jitter is on for a refined image
+	Accumulator* accumulator;
+	float4* guide;
+};
+
 class Renderer : public TheApp
 {
 public:
 	// game flow methods
 	void Init();
-	float3 Trace( Ray& ray, int depth = 0 );
-	float3 DirectIllumination( const float3& I, const float3& N );
+	float3 Trace( const Scene& scene, Ray& ray, const QualitySettings& q, uint& seed, int depth = 0 );
+	float3 DirectIllumination( const Scene& scene, const int objIdx, const float3& I, const float3& N, const int samples, uint& seed );
+	float3 Ambient( const float3& I, const float3& N ) const;
+	void TrainRadianceCache();
+	void TraceTile( const FrameTarget& f, const int2 p0, const int2 p1, const int2 res, const QualitySettings& q, const float blend, const bool keepGuide );
+	void RenderTile( const FrameTarget& f, const int tile, const int tilesX, const int2 res, const QualitySettings& q, const float blend, const bool keepGuide );
+	void UpdateLightmap();
+	FrameTarget View() { return { &scene, &camera, frame, accumulated, &accumulator, guide }; }
+	void CompareBackends();
+	void Denoise( const int2 res );
+	void PlaceBuffers();
+	void RenderSequence();
+	void UpdateStress();
+	void BenchmarkStress( const int maxCount, const char* target );
 	void Tick( float deltaTime );
 	void UI();
+	bool RunHeadless( int argc, char** argv );
 	void Shutdown()
 	{		
 		FILE* f = fopen( "appstate.dat", "wb" ); // serialize cam
 		fwrite( &camera, 1, sizeof( Camera ), f );
+		// keep the progressive render for the next run
+		if (checkpoint.enabled && accumulate && accumulated > 0) checkpoint.Write( *this );
+		cluster.Stop();
+		video.Close();
 	}
 	// input handling
 	void MouseUp( int button ) { /* implement if you want to detect mouse button presses */ }
@@ -29,13 +79,57 @@ public:
 	void KeyDown( int key ) { /* implement if you want to handle keys */ }
 	// data members
 	int2 mousePos;
-	float4* accumulator;
+	Accumulator accumulator, denoised;
+	float4* guide; // primary hit normal and distance, for upscaling
 	Scene scene;
 	Camera camera;
-	bool animating = true;
+	bool animating = true, sdfObjects = false;
 	float anim_time = 0;
+	uint frame = 0;
+	// randomized objects for scaling tests
+	StressScene stress;
+	StressParams stressParams;
+	bool stressScene = false;
+	// offline animation
+	SequenceRenderer sequence;
+	int sequenceFrames = 60;
+	// video output of sequences and of the interactive view
+	VideoSink video;
+	char videoTarget[256] = "sequence.y4m"; // file, "-" (stdout) or "|command"
+	int videoFormat = VideoSink::Y4M;
+	bool recording = false;
+	// progressive accumulation and denoising
+	bool accumulate = false, denoise = false;
+	int accumulated = 0;
+	int2 historyRes = int2( 0, 0 );
+	Checkpoint checkpoint;
 	// fps smoothing
 	float avg = 10, alpha = 1;
+	// dynamic resolution
+	ResolutionGovernor governor;
+	Upscaler upscaler;
+	// adaptive quality
+	QualityGovernor quality;
+	// thread placement
+	TileScheduler scheduler;
+	// breadth-first tiles with material-sorted SIMD shading
+	bool wavefront = false, sortRays = true, deferShadows = false;
+	WavefrontStats secondary;
+	// baked direct light for the room planes
+	Lightmap lightmap;
+	bool useLightmap = false;
+	// indirect light
+	RadianceCache radianceCache;
+	bool useRadianceCache = false;
+	int trainingPaths = 16384;
+	float trainingMs = 0;
+	// OpenCL backend, and how far it is from the C++ path
+	CLTracer clTracer;
+	bool useOpenCL = false;
+	float backendMaxError = -1, backendMeanError = 0, backendMismatch = 0;
+	// tiles rendered by worker processes
+	TileCoordinator cluster;
+	bool distributed = false;
 };
 
 } // namespace Tmpl8
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include "precomp.h"
+
+const char* TileScheduler::policyName[POLICIES] = { "floating", "pin to logical processors", "pin to cores, SMT idle", "pin SMT pairs, adjacent tiles" };
+
+// -----------------------------------------------------------
+// Cleanup
+// -----------------------------------------------------------
+TileScheduler::~TileScheduler()
+{
+	delete[] band;
+	delete[] pair;
+}
+
+// -----------------------------------------------------------
+// Build the worker list for a placement policy
+// -----------------------------------------------------------
+void TileScheduler::Configure( const Policy p, const bool numa )
+{
+	// NUMA placement only makes sense for pinned workers
+	policy = (numa && p == FLOATING) ? PIN_ALL : p, numaLocal = numa;
+	const Topology& topology = Topology::Get();
+	nodeCount = numa ? topology.nodeCount : 1;
+	vector<int> nodeWorkers( nodeCount, 0 );
+	slot.clear();
+	if (policy == FLOATING)
+	{
+		for (int i = 0; i < omp_get_num_procs(); i++) slot.push_back( { 0, 0, i, nodeWorkers[0]++ } );
+		coreCount = Workers();
+	}
+	else
+	{
+		// processors are sorted by node and core, so siblings end up next to each other
+		for (const LogicalProcessor& lp : topology.processors)
+		{
+			if (policy == PIN_CORES && lp.sibling > 0) continue;
+			if (policy == PIN_PAIRS && lp.sibling > 1) continue;
+			const int node = numa ? (int)lp.node : 0;
+			slot.push_back( { &lp, node, (int)lp.core, nodeWorkers[node]++ } );
+		}
+		coreCount = topology.coreCount;
+	}
+	delete[] band;
+	delete[] pair;
+	band = new NodeBand[nodeCount];
+	pair = new CorePair[coreCount];
+	for (int i = 0; i < nodeCount; i++) band[i].workers = nodeWorkers[i], band[i].begin = band[i].end = 0, band[i].next = 0;
+	for (int i = 0; i < coreCount; i++) pair[i].pending = -1;
+	// from now on, parallel regions use exactly one thread per worker
+	omp_set_num_threads( Workers() );
+	generation++;
+}
+
+// -----------------------------------------------------------
+// Bind the calling OpenMP thread to its processor; cheap when
+// the thread is already pinned, which is the common case since
+// the runtime reuses its threads between parallel regions
+// -----------------------------------------------------------
+void TileScheduler::Pin( const int worker ) const
+{
+	static thread_local int pinnedWorker = -1, pinnedGeneration = 0;
+	if (pinnedWorker == worker && pinnedGeneration == generation) return;
+	Topology::PinCurrentThread( worker < Workers() ? slot[worker].lp : 0 );
+	pinnedWorker = worker, pinnedGeneration = generation;
+}
+
+// -----------------------------------------------------------
+// Prepare for a new frame: give each node a band of tile rows,
+// sized by its number of workers
+// -----------------------------------------------------------
+void TileScheduler::Begin( const int tilesX, const int tilesY )
+{
+	const int total = Workers();
+	for (int i = 0, before = 0; i < nodeCount; before += band[i++].workers)
+	{
+		band[i].begin = tilesX * (tilesY * before / total);
+		band[i].end = tilesX * (tilesY * (before + band[i].workers) / total);
+		band[i].next = band[i].begin;
+	}
+	for (int i = 0; i < coreCount; i++) pair[i].pending = -1;
+}
+
+// -----------------------------------------------------------
+// Take count consecutive tiles, from the own band if possible
+// -----------------------------------------------------------
+int TileScheduler::Claim( const int node, const int count, int& end )
+{
+	for (int i = 0; i < nodeCount; i++)
+	{
+		NodeBand& b = band[(node + i) % nodeCount];
+		if (b.next >= b.end) continue;
+		const int tile = b.next.fetch_add( count );
+		if (tile < b.end) { end = b.end; return tile; }
+	}
+	return -1;
+}
+
+// -----------------------------------------------------------
+// Get the next tile for a worker; -1 when the frame is done
+// -----------------------------------------------------------
+int TileScheduler::Next( const int worker )
+{
+	const Slot& s = slot[min( worker, Workers() - 1 )];
+	int end;
+	if (policy != PIN_PAIRS) return Claim( s.node, 1, end );
+	// SMT pairs: the first sibling to ask claims two adjacent tiles
+	// and leaves the second one for the other sibling
+	CorePair& p = pair[s.core];
+	lock_guard<mutex> lock( p.lock );
+	if (p.pending >= 0)
+	{
+		const int tile = p.pending;
+		p.pending = -1;
+		return tile;
+	}
+	const int tile = Claim( s.node, 2, end );
+	if (tile >= 0 && tile + 1 < end) p.pending = tile + 1;
+	return tile;
+}
+
+// -----------------------------------------------------------
+// Rows of a full-screen buffer that a worker touches first and
+// converts; bands follow the tile bands of Begin
+// -----------------------------------------------------------
+int2 TileScheduler::WorkerRows( const int worker, const int rows, const int granularity ) const
+{
+	if (worker >= Workers()) return int2( 0, 0 );
+	const Slot& s = slot[worker];
+	int before = 0;
+	for (int i = 0; i < s.node; i++) before += band[i].workers;
+	const int total = Workers(), units = (rows + granularity - 1) / granularity;
+	const int first = min( rows, granularity * (units * before / total) );
+	const int last = min( rows, granularity * (units * (before + band[s.node].workers) / total) );
+	const NodeBand& b = band[s.node];
+	return int2( first + (last - first) * s.local / b.workers, first + (last - first) * (s.local + 1) / b.workers );
+}
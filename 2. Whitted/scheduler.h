@@ -0,0 +1,44 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+// -----------------------------------------------------------
+// Tile scheduler
+// Hands out tiles to the OpenMP workers. Workers either float
+// freely or are pinned: one per logical processor, one per
+// core with the SMT siblings left idle, or one per sibling
+// where both siblings of a core take horizontally adjacent
+// tiles, so they share most of the scene data they touch.
+// With NUMA placement every node owns a band of tile rows
+// and first touches the matching rows of the big buffers;
+// a node only steals tiles from other bands once its own
+// band is done.
+// -----------------------------------------------------------
+class TileScheduler
+{
+public:
+	enum Policy { FLOATING = 0, PIN_ALL, PIN_CORES, PIN_PAIRS, POLICIES };
+	static const char* policyName[POLICIES];
+	~TileScheduler();
+	void Configure( const Policy p, const bool numa );
+	void Pin( const int worker ) const;
+	void Begin( const int tilesX, const int tilesY );
+	int Next( const int worker );
+	int2 WorkerRows( const int worker, const int rows, const int granularity ) const;
+	int Workers() const { return (int)slot.size(); }
+	// settings; change through Configure
+	Policy policy = FLOATING;
+	bool numaLocal = false;
+private:
+	int Claim( const int node, const int count, int& end );
+	struct Slot { const LogicalProcessor* lp; int node, core, local; };
+	struct ALIGN( 64 ) NodeBand { atomic<int> next; int begin, end, workers; };
+	struct ALIGN( 64 ) CorePair { mutex lock; int pending; };
+	vector<Slot> slot;
+	NodeBand* band = 0;
+	CorePair* pair = 0;
+	int nodeCount = 0, coreCount = 0, generation = 0;
+};
+
+} // namespace Tmpl8
@@ -0,0 +1,67 @@
+#include "precomp.h"
+
+// -----------------------------------------------------------
+// Render frames 0..frames-1, starting at the current animation
+// time and view; done receives each frame, in order
+// -----------------------------------------------------------
+void SequenceRenderer::Render( Renderer& r, const int frames, const FrameDone& done )
+{
+	const int2 res( SCRWIDTH, SCRHEIGHT );
+	const int tilesX = (res.x + TILESIZE - 1) / TILESIZE, tilesY = (res.y + TILESIZE - 1) / TILESIZE, tiles = tilesX * tilesY;
+	const QualitySettings& q = QualityGovernor::ladder[clamp( qualityLevel, 0, QualityGovernor::LEVELS - 1 )];
+	const int slots = max( 1, inFlight );
+	unique_ptr<Slot[]> slot( new Slot[slots] );
+	for (int i = 0; i < slots; i++) slot[i].pixels.Init( res.x * res.y, Accumulator::FLOAT4, false );
+	// the lightmap and the radiance cache hold the state of one frame
+	const bool lightmapWas = r.useLightmap, cacheWas = r.useRadianceCache;
+	r.useLightmap = r.useRadianceCache = false;
+	const float startTime = r.anim_time, step = 2.0f / fps;
+	const uint seed = r.frame;
+	atomic<int> next = 0;
+	atomic<long long> tileNanoseconds = 0;
+	int nextOut = 0;
+	mutex output;
+	Timer t;
+#pragma omp parallel
+	{
+		const int worker = omp_get_thread_num();
+		r.scheduler.Pin( worker );
+		for (;;)
+		{
+			const int item = next++, f = item / tiles, tile = item % tiles;
+			if (f >= frames) break;
+			Slot& s = slot[f % slots];
+			if (tile == 0)
+			{
+				// the first tile of a frame takes over the slot once the previous frame in it went out
+				while (s.frame != -1) this_thread::yield();
+				s.scene = r.scene;
+				s.scene.SetTime( startTime + f * step );
+				s.tilesLeft = tiles;
+				s.frame = f;
+			}
+			else while (s.frame != f) this_thread::yield();
+			Timer tileTimer;
+			const FrameTarget target = { &s.scene, &r.camera, seed + f, 0, &s.pixels, 0 };
+			r.RenderTile( target, tile, tilesX, res, q, 1, false );
+			tileNanoseconds += (long long)(tileTimer.elapsed() * 1e9f);
+			if (--s.tilesLeft > 0) continue;
+			// last tile of the frame: hand out all frames that are complete, in order
+			lock_guard<mutex> lock( output );
+			s.finished = true;
+			for (Slot* o = &slot[nextOut % slots]; nextOut < frames && o->frame == nextOut && o->finished; o = &slot[nextOut % slots])
+			{
+				done( nextOut++, o->pixels );
+				o->finished = false;
+				o->frame = -1;
+			}
+		}
+	}
+	renderMs = t.elapsed() * 1000;
+	busy = (float)(tileNanoseconds * 1e-6 / (renderMs * omp_get_max_threads()));
+	framesDone = nextOut;
+	r.useLightmap = lightmapWas, r.useRadianceCache = cacheWas;
+	r.anim_time = startTime + frames * step;
+	r.scene.SetTime( r.anim_time );
+	r.frame += frames;
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+class Renderer;
+
+// -----------------------------------------------------------
+// Sequence renderer
+// Renders an animation offline with several frames in flight.
+// All tiles of all frames form one stream that the threads
+// claim in order, so while the last tiles of a frame finish,
+// the other threads already work on the next frames instead
+// of idling in the tail. Each frame in flight has a copy of
+// the scene at its own time; the copy only holds transforms
+// and the few primitives, the static data (wall textures) is
+// shared. Frames are handed out in order, from the thread
+// that completes them.
+// -----------------------------------------------------------
+class SequenceRenderer
+{
+public:
+	typedef function<void( const int index, const Accumulator& pixels )> FrameDone;
+	void Render( Renderer& renderer, const int frames, const FrameDone& done );
+	// settings
+	int inFlight = 3;
+	float fps = 30;			// anim_time advances by 2 per second, as in Tick
+	int qualityLevel = 0;	// QualityGovernor ladder
+	// statistics of the last sequence
+	float renderMs = 0, busy = 0; // busy: fraction of thread time spent in tiles
+	int framesDone = 0;
+private:
+	struct Slot
+	{
+		Scene scene;
+		Accumulator pixels;
+		atomic<int> frame = -1; // frame the slot holds; -1: free
+		atomic<int> tilesLeft = 0;
+		bool finished = false;
+	};
+};
+
+} // namespace Tmpl8
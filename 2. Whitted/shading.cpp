@@ -0,0 +1,469 @@
+#include "precomp.h"
+
+// -----------------------------------------------------------
+// Make room for n sort keys
+// -----------------------------------------------------------
+void RaySorter::Reserve( const int n )
+{
+	if (n <= capacity) return;
+	capacity = max( n, capacity * 2 );
+	const size_t stride = ((capacity + 15) & ~15) * sizeof( uint );
+	uchar* block = Memory::FrameArena().Alloc<uchar>( stride * 4 );
+	for (int i = 0; i < 2; i++) key[i] = (uint*)(block + i * stride), index[i] = (int*)(block + (i + 2) * stride);
+}
+
+// -----------------------------------------------------------
+// Sort key: 3 bits of direction octant, then 7 bits per axis
+// of the origin, interleaved
+// -----------------------------------------------------------
+static inline uint SpreadBits( uint v )
+{
+	// 7 bits to every third bit of 21
+	v = (v | (v << 8)) & 0x0f00f;
+	v = (v | (v << 4)) & 0xc30c3;
+	v = (v | (v << 2)) & 0x249249;
+	return v;
+}
+uint RaySorter::Key( const Ray& ray, const float3& bmin, const float3& scale )
+{
+	const float3 q = (ray.O - bmin) * scale;
+	const uint qx = (uint)clamp( q.x, 0.0f, 127.0f ), qy = (uint)clamp( q.y, 0.0f, 127.0f ), qz = (uint)clamp( q.z, 0.0f, 127.0f );
+	const uint octant = (ray.D.x < 0 ? 1 : 0) + (ray.D.y < 0 ? 2 : 0) + (ray.D.z < 0 ? 4 : 0);
+	return (octant << 21) + (SpreadBits( qx ) << 2) + (SpreadBits( qy ) << 1) + SpreadBits( qz );
+}
+
+// -----------------------------------------------------------
+// Radix sort on 8-bit digits; a pass is skipped when all rays
+// share the digit, which is common for small wavefronts
+// -----------------------------------------------------------
+void RaySorter::Sort( const Scene& scene, const RayQueue& rays, RayQueue& sorted )
+{
+	const int n = rays.count;
+	Reserve( n );
+	// origins are quantized to the room
+	float3 bmin, bmax;
+	scene.GetRoomBounds( bmin, bmax );
+	const float3 scale = 127.99f / (bmax - bmin);
+	for (int i = 0; i < n; i++) key[0][i] = Key( rays.ray[i].ray, bmin, scale ), index[0][i] = i;
+	int src = 0;
+	for (int shift = 0; shift < 24; shift += 8)
+	{
+		uint offset[256] = {};
+		for (int i = 0; i < n; i++) offset[(key[src][i] >> shift) & 255]++;
+		if (n == 0 || offset[(key[src][0] >> shift) & 255] == (uint)n) continue;
+		for (uint i = 0, sum = 0; i < 256; i++) { const uint c = offset[i]; offset[i] = sum, sum += c; }
+		for (int i = 0; i < n; i++)
+		{
+			const uint j = offset[(key[src][i] >> shift) & 255]++;
+			key[1 - src][j] = key[src][i], index[1 - src][j] = index[src][i];
+		}
+		src = 1 - src;
+	}
+	sorted.Clear();
+	for (int i = 0; i < n; i++) sorted.Add() = rays.ray[index[src][i]];
+}
+
+// -----------------------------------------------------------
+// Make room for n hits
+// -----------------------------------------------------------
+void HitBatch::Reserve( const int n )
+{
+	if (n <= capacity) return;
+	capacity = max( n, capacity * 2 );
+	const size_t stride = ((capacity + 15) & ~15) * sizeof( float );
+	float* f = (float*)Memory::FrameArena().Alloc<uchar>( stride * 19 );
+	const size_t n4 = stride / sizeof( float );
+	ray = (int*)f, inside = (int*)(f + n4), objIdx = (int*)(f + 2 * n4), f += 3 * n4;
+	for (int i = 0; i < 3; i++) I[i] = f, D[i] = f + n4, N[i] = f + 2 * n4, albedo[i] = f + 3 * n4, T[i] = f + 4 * n4, f += 5 * n4;
+	Fr = f;
+}
+
+// -----------------------------------------------------------
+// Counting sort of the hits of a wavefront into the bins. Bins
+// start at a multiple of 8, so the kernels use aligned loads;
+// the padding at the end of a bin holds copies of its last hit.
+// -----------------------------------------------------------
+static inline int Bin( const Scene& scene, const int objIdx )
+{
+	return objIdx < Scene::STRESSBASE ? objIdx : Scene::STRESSBASE + scene.stress->GetMaterial( objIdx - Scene::STRESSBASE );
+}
+void HitBatch::Build( const Scene& scene, const WaveRay* rays, const int rayCount )
+{
+	Reserve( rayCount + BINS * 7 );
+	int cursor[BINS] = {};
+	count = 0;
+	for (int i = 0; i < rayCount; i++) if (rays[i].ray.objIdx >= 0) cursor[Bin( scene, rays[i].ray.objIdx )]++, count++;
+	for (int b = 0, start = 0; b < BINS; b++)
+	{
+		binStart[b] = start, binEnd[b] = start + cursor[b], cursor[b] = start;
+		start = (binEnd[b] + 7) & ~7;
+	}
+	for (int i = 0; i < rayCount; i++)
+	{
+		const Ray& r = rays[i].ray;
+		if (r.objIdx < 0) continue;
+		const int j = cursor[Bin( scene, r.objIdx )]++;
+		const float3 P = r.IntersectionPoint();
+		ray[j] = i, objIdx[j] = r.objIdx, inside[j] = r.inside ? ~0 : 0;
+		I[0][j] = P.x, I[1][j] = P.y, I[2][j] = P.z;
+		D[0][j] = r.D.x, D[1][j] = r.D.y, D[2][j] = r.D.z;
+	}
+	for (int b = 0; b < BINS; b++) if (binEnd[b] > binStart[b]) for (int j = binEnd[b]; j & 7; j++)
+	{
+		const int last = binEnd[b] - 1;
+		objIdx[j] = objIdx[last], inside[j] = inside[last];
+		for (int a = 0; a < 3; a++) I[a][j] = I[a][last], D[a][j] = D[a][last];
+	}
+}
+
+// -----------------------------------------------------------
+// AVX helpers; like Shade, only called when the cpu has AVX2
+// -----------------------------------------------------------
+SIMD_AVX2 static inline __m256 Abs8( const __m256 a ) { return _mm256_andnot_ps( _mm256_set1_ps( -0.0f ), a ); }
+SIMD_AVX2 static inline __m256 Dot8( const __m256 ax, const __m256 ay, const __m256 az, const __m256 bx, const __m256 by, const __m256 bz )
+{
+	return _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( ax, bx ), _mm256_mul_ps( ay, by ) ), _mm256_mul_ps( az, bz ) );
+}
+SIMD_AVX2 static inline void Transform8( const mat4& M, const __m256 x, const __m256 y, const __m256 z, const float w, __m256& ox, __m256& oy, __m256& oz )
+{
+	// same term order as TransformPosition / TransformVector
+	__m256* out[3] = { &ox, &oy, &oz };
+	for (int i = 0; i < 3; i++)
+	{
+		const float* c = &M.cell[i * 4];
+		*out[i] = _mm256_add_ps( _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( _mm256_set1_ps( c[0] ), x ),
+			_mm256_mul_ps( _mm256_set1_ps( c[1] ), y ) ), _mm256_mul_ps( _mm256_set1_ps( c[2] ), z ) ), _mm256_set1_ps( c[3] * w ) );
+	}
+}
+SIMD_AVX2 static inline __m256 Checker8( const __m256 Ix, const __m256 Iz )
+{
+	// floor: checkerboard, with two deliberately aliased tiles; follows Plane::GetAlbedo
+	const __m256i ix = _mm256_cvttps_epi32( _mm256_add_ps( _mm256_mul_ps( Ix, _mm256_set1_ps( 2 ) ), _mm256_set1_ps( 96.01f ) ) );
+	const __m256i iz = _mm256_cvttps_epi32( _mm256_add_ps( _mm256_mul_ps( Iz, _mm256_set1_ps( 2 ) ), _mm256_set1_ps( 96.01f ) ) );
+	const __m256i row98 = _mm256_cmpeq_epi32( iz, _mm256_set1_epi32( 98 ) );
+	const __m256i tile32 = _mm256_and_si256( row98, _mm256_cmpeq_epi32( ix, _mm256_set1_epi32( 98 ) ) );
+	const __m256i tile64 = _mm256_and_si256( row98, _mm256_cmpeq_epi32( ix, _mm256_set1_epi32( 94 ) ) );
+	const __m256 s8 = _mm256_blendv_ps( _mm256_blendv_ps( _mm256_set1_ps( 1 ), _mm256_set1_ps( 32.01f ), _mm256_castsi256_ps( tile32 ) ),
+		_mm256_set1_ps( 64.01f ), _mm256_castsi256_ps( tile64 ) );
+	const __m256i fine = _mm256_or_si256( tile32, tile64 );
+	const __m256i fx = _mm256_blendv_epi8( ix, _mm256_cvttps_epi32( _mm256_mul_ps( Ix, s8 ) ), fine );
+	const __m256i fz = _mm256_blendv_epi8( iz, _mm256_cvttps_epi32( _mm256_mul_ps( Iz, s8 ) ), fine );
+	const __m256i odd = _mm256_and_si256( _mm256_add_epi32( fx, fz ), _mm256_set1_epi32( 1 ) );
+	return _mm256_blendv_ps( _mm256_set1_ps( 0.3f ), _mm256_set1_ps( 1 ), _mm256_castsi256_ps( _mm256_cmpeq_epi32( odd, _mm256_set1_epi32( 1 ) ) ) );
+}
+SIMD_AVX2 static inline void Texel8( const Plane::Texturing& t, const __m256 u, const __m256 Iy, __m256& r, __m256& g, __m256& b )
+{
+	// textured walls, with the mapping of Plane::GetTexturing
+	const Surface& tex = *t.surface;
+	const __m256i ix = _mm256_cvttps_epi32( _mm256_mul_ps( _mm256_add_ps( u, _mm256_set1_ps( t.offset ) ), _mm256_set1_ps( t.scale ) ) );
+	const __m256i iy = _mm256_cvttps_epi32( _mm256_mul_ps( _mm256_sub_ps( _mm256_set1_ps( 2 ), Iy ), _mm256_set1_ps( t.yScale ) ) );
+	const __m256i wmask = _mm256_set1_epi32( tex.width - 1 ), hmask = _mm256_set1_epi32( tex.height - 1 );
+	const __m256i idx = _mm256_add_epi32( _mm256_and_si256( ix, wmask ), _mm256_mullo_epi32( _mm256_and_si256( iy, hmask ), _mm256_set1_epi32( tex.width ) ) );
+	const __m256i p = _mm256_i32gather_epi32( (const int*)tex.pixels, idx, 4 );
+	const __m256i c255 = _mm256_set1_epi32( 255 );
+	const __m256 scale8 = _mm256_set1_ps( 1.0f / 255.0f );
+	r = _mm256_mul_ps( _mm256_cvtepi32_ps( _mm256_and_si256( _mm256_srli_epi32( p, 16 ), c255 ) ), scale8 );
+	g = _mm256_mul_ps( _mm256_cvtepi32_ps( _mm256_and_si256( _mm256_srli_epi32( p, 8 ), c255 ) ), scale8 );
+	b = _mm256_mul_ps( _mm256_cvtepi32_ps( _mm256_and_si256( p, c255 ) ), scale8 );
+}
+
+// -----------------------------------------------------------
+// Evaluate normals, albedo and Fresnel terms, 8 hits at a time.
+// Each bin holds a single primitive, so all branching on the
+// primitive type happens once per bin.
+// -----------------------------------------------------------
+SIMD_AVX2 void HitBatch::Shade( const Scene& scene )
+{
+	const __m256 zero8 = _mm256_setzero_ps(), one8 = _mm256_set1_ps( 1 ), signMask8 = _mm256_set1_ps( -0.0f );
+	for (int b = 0; b < BINS; b++)
+	{
+		const float3 dummy( 0 );
+		const bool stress = b >= Scene::STRESSBASE;
+		reflectivity[b] = stress ? StressScene::reflectivity[b - Scene::STRESSBASE] : scene.GetReflectivity( b, dummy );
+		refractivity[b] = stress ? StressScene::refractivity[b - Scene::STRESSBASE] : scene.GetRefractivity( b, dummy );
+		if (binStart[b] == binEnd[b]) continue;
+		// albedo is constant per bin, except on the floor, the textured walls
+		// and the stress objects
+		const Plane* plane = b >= 4 && b < 10 ? &scene.plane[b - 4] : 0;
+		Plane::Texturing tex;
+		const bool checker = plane && plane->N.y == 1, textured = plane && plane->GetTexturing( tex );
+		const float3 flat = stress || checker || textured ? float3( 0 ) : scene.GetAlbedo( b, dummy );
+		for (int i = binStart[b]; i < binEnd[b]; i += 8)
+		{
+			const __m256 Ix = _mm256_load_ps( I[0] + i ), Iy = _mm256_load_ps( I[1] + i ), Iz = _mm256_load_ps( I[2] + i );
+			const __m256 Dx = _mm256_load_ps( D[0] + i ), Dy = _mm256_load_ps( D[1] + i ), Dz = _mm256_load_ps( D[2] + i );
+			__m256 Nx, Ny, Nz, Ar, Ag, Ab;
+			if (b == 0)
+			{
+				// light quads: all oriented the same
+				const float3 n = scene.GetNormal( 0, dummy, dummy );
+				Nx = _mm256_set1_ps( n.x ), Ny = _mm256_set1_ps( n.y ), Nz = _mm256_set1_ps( n.z );
+			}
+			else if (b == 1 || b == 2)
+			{
+				// spheres
+				const Sphere& s = b == 1 ? scene.sphere : scene.sphere2;
+				const __m256 invr8 = _mm256_set1_ps( s.invr );
+				Nx = _mm256_mul_ps( _mm256_sub_ps( Ix, _mm256_set1_ps( s.pos.x ) ), invr8 );
+				Ny = _mm256_mul_ps( _mm256_sub_ps( Iy, _mm256_set1_ps( s.pos.y ) ), invr8 );
+				Nz = _mm256_mul_ps( _mm256_sub_ps( Iz, _mm256_set1_ps( s.pos.z ) ), invr8 );
+			}
+			else if (b == 3)
+			{
+				// cube: nearest face in object space, back to world space
+				const Cube& c = scene.cube;
+				__m256 ox, oy, oz;
+				Transform8( c.invM, Ix, Iy, Iz, 1, ox, oy, oz );
+				const __m256 d[6] = {
+					Abs8( _mm256_sub_ps( ox, _mm256_set1_ps( c.b[0].x ) ) ), Abs8( _mm256_sub_ps( ox, _mm256_set1_ps( c.b[1].x ) ) ),
+					Abs8( _mm256_sub_ps( oy, _mm256_set1_ps( c.b[0].y ) ) ), Abs8( _mm256_sub_ps( oy, _mm256_set1_ps( c.b[1].y ) ) ),
+					Abs8( _mm256_sub_ps( oz, _mm256_set1_ps( c.b[0].z ) ) ), Abs8( _mm256_sub_ps( oz, _mm256_set1_ps( c.b[1].z ) ) )
+				};
+				static const float face[6][3] = { { -1, 0, 0 }, { 1, 0, 0 }, { 0, -1, 0 }, { 0, 1, 0 }, { 0, 0, -1 }, { 0, 0, 1 } };
+				__m256 minDist = d[0], lx = _mm256_set1_ps( -1 ), ly = zero8, lz = zero8;
+				for (int f = 1; f < 6; f++)
+				{
+					const __m256 closer = _mm256_cmp_ps( d[f], minDist, _CMP_LT_OQ );
+					minDist = _mm256_blendv_ps( minDist, d[f], closer );
+					lx = _mm256_blendv_ps( lx, _mm256_set1_ps( face[f][0] ), closer );
+					ly = _mm256_blendv_ps( ly, _mm256_set1_ps( face[f][1] ), closer );
+					lz = _mm256_blendv_ps( lz, _mm256_set1_ps( face[f][2] ), closer );
+				}
+				Transform8( c.M, lx, ly, lz, 0, Nx, Ny, Nz );
+			}
+			else if (b == 10)
+			{
+				// torus: gradient of the implicit surface in object space
+				const Torus& t = scene.torus;
+				__m256 lx, ly, lz;
+				Transform8( t.invT, Ix, Iy, Iz, 1, lx, ly, lz );
+				const __m256 k8 = _mm256_sub_ps( Dot8( lx, ly, lz, lx, ly, lz ), _mm256_set1_ps( t.rt2 ) );
+				const __m256 kxy8 = _mm256_sub_ps( k8, _mm256_set1_ps( t.rc2 ) ), kz8 = _mm256_add_ps( k8, _mm256_set1_ps( t.rc2 ) );
+				lx = _mm256_mul_ps( lx, kxy8 ), ly = _mm256_mul_ps( ly, kxy8 ), lz = _mm256_mul_ps( lz, kz8 );
+				const __m256 invLen8 = _mm256_div_ps( one8, _mm256_sqrt_ps( Dot8( lx, ly, lz, lx, ly, lz ) ) );
+				Transform8( t.T, _mm256_mul_ps( lx, invLen8 ), _mm256_mul_ps( ly, invLen8 ), _mm256_mul_ps( lz, invLen8 ), 0, Nx, Ny, Nz );
+			}
+			else if (stress)
+			{
+				// stress objects of one material, of mixed shapes
+				alignas( 32 ) float n[3][8];
+				for (int j = 0; j < 8; j++)
+				{
+					const float3 g = scene.stress->GetNormal( objIdx[i + j] - Scene::STRESSBASE, float3( I[0][i + j], I[1][i + j], I[2][i + j] ), scene.animTime );
+					n[0][j] = g.x, n[1][j] = g.y, n[2][j] = g.z;
+				}
+				Nx = _mm256_load_ps( n[0] ), Ny = _mm256_load_ps( n[1] ), Nz = _mm256_load_ps( n[2] );
+			}
+			else if (b >= Scene::SDFBASE)
+			{
+				// SDF objects: analytic gradients are not worth vectorizing per shape
+				const SDF& sdf = scene.sdf[b - Scene::SDFBASE];
+				alignas( 32 ) float n[3][8];
+				for (int j = 0; j < 8; j++)
+				{
+					const float3 g = sdf.GetNormal( float3( I[0][i + j], I[1][i + j], I[2][i + j] ) );
+					n[0][j] = g.x, n[1][j] = g.y, n[2][j] = g.z;
+				}
+				Nx = _mm256_load_ps( n[0] ), Ny = _mm256_load_ps( n[1] ), Nz = _mm256_load_ps( n[2] );
+			}
+			else
+			{
+				// planes
+				Nx = _mm256_set1_ps( plane->N.x ), Ny = _mm256_set1_ps( plane->N.y ), Nz = _mm256_set1_ps( plane->N.z );
+			}
+			if (stress)
+			{
+				// each stress object has its own albedo
+				alignas( 32 ) float c[3][8];
+				for (int j = 0; j < 8; j++)
+				{
+					const float3 col = scene.stress->GetAlbedo( objIdx[i + j] - Scene::STRESSBASE );
+					c[0][j] = col.x, c[1][j] = col.y, c[2][j] = col.z;
+				}
+				Ar = _mm256_load_ps( c[0] ), Ag = _mm256_load_ps( c[1] ), Ab = _mm256_load_ps( c[2] );
+			}
+			else if (checker) Ar = Ag = Ab = Checker8( Ix, Iz );
+			else if (textured) Texel8( tex, tex.axis == 0 ? Ix : Iz, Iy, Ar, Ag, Ab );
+			else Ar = _mm256_set1_ps( flat.x ), Ag = _mm256_set1_ps( flat.y ), Ab = _mm256_set1_ps( flat.z );
+			// face the incoming ray
+			const __m256 flip = _mm256_and_ps( _mm256_cmp_ps( Dot8( Nx, Ny, Nz, Dx, Dy, Dz ), zero8, _CMP_GT_OQ ), signMask8 );
+			Nx = _mm256_xor_ps( Nx, flip ), Ny = _mm256_xor_ps( Ny, flip ), Nz = _mm256_xor_ps( Nz, flip );
+			_mm256_store_ps( N[0] + i, Nx ), _mm256_store_ps( N[1] + i, Ny ), _mm256_store_ps( N[2] + i, Nz );
+			_mm256_store_ps( albedo[0] + i, Ar ), _mm256_store_ps( albedo[1] + i, Ag ), _mm256_store_ps( albedo[2] + i, Ab );
+			if (refractivity[b] == 0) continue;
+			// dielectrics: Schlick's Fresnel and the refracted direction
+			const __m256 in8 = _mm256_castsi256_ps( _mm256_load_si256( (const __m256i*)(inside + i) ) );
+			const __m256 n1 = _mm256_blendv_ps( one8, _mm256_set1_ps( 1.2f ), in8 ), n2 = _mm256_blendv_ps( _mm256_set1_ps( 1.2f ), one8, in8 );
+			const __m256 eta = _mm256_div_ps( n1, n2 );
+			const __m256 cosi = _mm256_xor_ps( Dot8( Dx, Dy, Dz, Nx, Ny, Nz ), signMask8 );
+			const __m256 cost2 = _mm256_sub_ps( one8, _mm256_mul_ps( _mm256_mul_ps( eta, eta ), _mm256_sub_ps( one8, _mm256_mul_ps( cosi, cosi ) ) ) );
+			const __m256 a = _mm256_sub_ps( n1, n2 ), bb = _mm256_add_ps( n1, n2 );
+			const __m256 R0 = _mm256_div_ps( _mm256_mul_ps( a, a ), _mm256_mul_ps( bb, bb ) );
+			const __m256 c = _mm256_sub_ps( one8, cosi ), c2 = _mm256_mul_ps( c, c );
+			const __m256 c5 = _mm256_mul_ps( _mm256_mul_ps( c2, c2 ), c );
+			const __m256 fr = _mm256_add_ps( R0, _mm256_mul_ps( _mm256_sub_ps( one8, R0 ), c5 ) );
+			_mm256_store_ps( Fr + i, _mm256_blendv_ps( one8, fr, _mm256_cmp_ps( cost2, zero8, _CMP_GT_OQ ) ) );
+			const __m256 k = _mm256_sub_ps( _mm256_mul_ps( eta, cosi ), _mm256_sqrt_ps( Abs8( cost2 ) ) );
+			_mm256_store_ps( T[0] + i, _mm256_add_ps( _mm256_mul_ps( eta, Dx ), _mm256_mul_ps( k, Nx ) ) );
+			_mm256_store_ps( T[1] + i, _mm256_add_ps( _mm256_mul_ps( eta, Dy ), _mm256_mul_ps( k, Ny ) ) );
+			_mm256_store_ps( T[2] + i, _mm256_add_ps( _mm256_mul_ps( eta, Dz ), _mm256_mul_ps( k, Nz ) ) );
+		}
+	}
+}
+
+// -----------------------------------------------------------
+// Make room for the packets of all hits, with the given number
+// of rays per hit. The stride between hits is a power of two up
+// to 16, and a multiple of 16 beyond, so that a packet never
+// straddles a hit unless it holds several whole ones.
+// -----------------------------------------------------------
+void ShadowBatch::ReserveRays( const int rays )
+{
+	int stride = 1;
+	while (stride < rays && stride < 16) stride *= 2;
+	if (rays > 16) stride = (rays + 15) & ~15;
+	packets.hits = count, packets.rays = rays, packets.stride = stride;
+	// the kernels read whole packets of up to 16 rays, and as many origins
+	const int n = (count * stride + 15) & ~15;
+	if (n <= rayCapacity && count + 16 <= hitCapacity) return;
+	rayCapacity = max( n, rayCapacity * 2 ), hitCapacity = max( count + 16, hitCapacity * 2 );
+	float* f = Memory::FrameArena().Alloc<float>( rayCapacity * 6 + hitCapacity * 3 );
+	for (int i = 0; i < 3; i++) packets.D[i] = f + i * rayCapacity, packets.O[i] = f + 6 * rayCapacity + i * hitCapacity;
+	packets.t = f + 3 * rayCapacity, contribution = f + 4 * rayCapacity, result = (uchar*)(f + 5 * rayCapacity);
+}
+
+// -----------------------------------------------------------
+// Shadow rays against the SDF objects, 8 at a time; rays that
+// the kernel found blocked or that are not traced are idle.
+// Marks blockers with 1.
+// -----------------------------------------------------------
+SIMD_AVX2 static void OccludedSDFs( const Scene& scene, const ShadowPackets& p, uchar* result )
+{
+	// the origin of each lane, as in the Occluded kernel
+	int shift = 0;
+	while ((1 << shift) < p.stride && shift < 3) shift++;
+	const __m256i lane = _mm256_srli_epi32( _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 ), shift );
+	for (int i = 0; i < p.hits * p.stride; i += 8)
+	{
+		alignas( 32 ) float t[8];
+		int blocked = 0;
+		for (int j = 0; j < 8; j++)
+		{
+			const bool idle = p.t[i + j] == 0 || result[i + j] == 1;
+			t[j] = idle ? 0 : p.t[i + j], blocked |= idle << j;
+		}
+		if (blocked == 255) continue;
+		const int h = i / p.stride;
+		const __m256 Ox = _mm256_permutevar8x32_ps( _mm256_loadu_ps( p.O[0] + h ), lane );
+		const __m256 Oy = _mm256_permutevar8x32_ps( _mm256_loadu_ps( p.O[1] + h ), lane );
+		const __m256 Oz = _mm256_permutevar8x32_ps( _mm256_loadu_ps( p.O[2] + h ), lane );
+		const __m256 Dx = _mm256_load_ps( p.D[0] + i ), Dy = _mm256_load_ps( p.D[1] + i ), Dz = _mm256_load_ps( p.D[2] + i );
+		const __m256 t8 = _mm256_load_ps( t );
+		for (int s = 0; s < scene.sdfCount && blocked != 255; s++)
+			blocked |= _mm256_movemask_ps( _mm256_cmp_ps( scene.sdf[s].March8( Ox, Oy, Oz, Dx, Dy, Dz, t8 ), t8, _CMP_LT_OQ ) );
+		for (int j = 0; j < 8; j++) if ((blocked >> j) & 1 && t[j] > 0) result[i + j] = 1;
+	}
+}
+
+// -----------------------------------------------------------
+// Light all collected hits and add the result to the tile
+// -----------------------------------------------------------
+void ShadowBatch::Trace( const Scene& scene, const int samples, float3* color )
+{
+	const int lights = (int)scene.GetLightCount();
+	// lights share the power of the single point light of the immediate path
+	const float3 lightColor = scene.GetLightColor() * (1.0f / (lights * samples));
+	float3 center[4];
+	for (int i = 0; i < 4; i++) center[i] = scene.GetLightPos( (uint)min( i, lights - 1 ) );
+	// the occluders that Scene::IsOccluded considers
+	ShadowOccluders occluders;
+	const Cube& cube = scene.cube;
+	memcpy( occluders.cubeInvM, cube.invM.cell, sizeof( occluders.cubeInvM ) );
+	for (int a = 0; a < 3; a++)
+		occluders.cubeMin[a] = cube.b[0][a], occluders.cubeMax[a] = cube.b[1][a], occluders.ballPos[a] = scene.sphere.pos[a];
+	occluders.ballR2 = scene.sphere.r2;
+#ifdef FOURLIGHTS
+	// light quads: all in the plane y = 1.5
+	occluders.lights = 4, occluders.lightY = 1.5f, occluders.lightSize = 0.25f;
+	for (int i = 0; i < 4; i++)
+	{
+		const float3 L = scene.GetLightPos( (uint)i );
+		occluders.lightX[i] = L.x, occluders.lightZ[i] = L.z;
+	}
+#else
+	occluders.lights = 0;
+#endif
+	memcpy( occluders.torusInvM, scene.torus.invT.cell, sizeof( occluders.torusInvM ) );
+	occluders.torusR2 = scene.torus.r2;
+	// one packet per hit: its rays to each light, for each sample
+	const int rays = samples * lights;
+	ReserveRays( rays );
+	for (int h = 0; h < count; h++)
+	{
+		ShadowHit& s = hit[h];
+		const float3 O = s.I + s.N * EPSILON;
+		packets.O[0][h] = O.x, packets.O[1][h] = O.y, packets.O[2][h] = O.z;
+		const int first = h * packets.stride;
+		int r = first;
+		for (int sample = 0; sample < samples; sample++) for (int i = 0; i < 4; i++)
+		{
+			float3 p = center[i];
+			if (samples > 1)
+			{
+#ifdef FOURLIGHTS
+				// extra samples spread each light over a square of its quad; a point
+				// off the quad plane would be seen through the quad, which occludes
+				p += float3( RandomFloat( s.seed ) * 2 - 1, 0, RandomFloat( s.seed ) * 2 - 1 ) * min( LIGHTRADIUS, occluders.lightSize );
+#else
+				// extra samples spread the light over a small sphere
+				float3 offset;
+				do offset = float3( RandomFloat( s.seed ), RandomFloat( s.seed ), RandomFloat( s.seed ) ) * 2 - 1;
+				while (dot( offset, offset ) > 1);
+				p += offset * LIGHTRADIUS;
+#endif
+			}
+			if (i >= lights) continue;
+			float3 L = p - O;
+			const float dist2 = dot( L, L ), dist = sqrtf( dist2 );
+			L *= 1 / dist;
+			// rays from back-facing lights keep their slot, but are not traced
+			const float ndotl = dot( s.N, L );
+			const bool facing = ndotl >= EPSILON;
+			packets.D[0][r] = L.x, packets.D[1][r] = L.y, packets.D[2][r] = L.z;
+			packets.t[r] = facing ? dist - EPSILON : 0, contribution[r] = facing ? ndotl / dist2 : 0, r++;
+		}
+		for (; r < first + packets.stride; r++)
+		{
+			packets.D[0][r] = packets.D[2][r] = 0, packets.D[1][r] = 1;
+			packets.t[r] = 0;
+		}
+	}
+	// padding up to whole packets
+	for (int r = count * packets.stride; r & 15; r++)
+	{
+		packets.D[0][r] = packets.D[2][r] = 0, packets.D[1][r] = 1;
+		packets.t[r] = 0;
+	}
+	for (int h = count; h < count + 16; h++) packets.O[0][h] = packets.O[1][h] = packets.O[2][h] = 0;
+	Kernels().Occluded( occluders, packets, result );
+	if (scene.sdfCount) OccludedSDFs( scene, packets, result );
+	// sum the unblocked rays per hit; rays near the torus get the exact test,
+	// and the stress scene is traversed per ray
+	for (int h = 0; h < count; h++)
+	{
+		const float3 O( packets.O[0][h], packets.O[1][h], packets.O[2][h] );
+		float irradiance = 0;
+		for (int r = h * packets.stride, end = r + rays; r < end; r++)
+		{
+			if (contribution[r] == 0 || result[r] == 1) continue;
+			const Ray ray( O, float3( packets.D[0][r], packets.D[1][r], packets.D[2][r] ), packets.t[r] );
+			if (result[r] == 2 && scene.torus.IsOccluded( ray )) continue;
+			if (scene.stress && scene.stress->IsOccluded( ray, scene.animTime )) continue;
+#ifndef FOURLIGHTS
+			if (scene.quad.IsOccluded( ray )) continue;
+#endif
+			irradiance += contribution[r];
+		}
+		color[hit[h].pixel] += hit[h].weight * lightColor * irradiance;
+	}
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+// -----------------------------------------------------------
+// Wavefront ray: a ray plus the state that the recursive
+// tracer keeps on its stack
+// -----------------------------------------------------------
+struct WaveRay
+{
+	Ray ray;
+	float3 throughput;	// weight of the radiance found along this ray
+	int pixel, depth;	// pixel index within the tile, recursion depth
+	uint seed;
+};
+
+// -----------------------------------------------------------
+// Growable array of wavefront rays. Like the other wavefront
+// buffers below, its storage comes from the frame arena of the
+// calling thread (see Memory::FrameArena) and is released when
+// the tile that created it rewinds the arena.
+// -----------------------------------------------------------
+class RayQueue
+{
+public:
+	void Clear() { count = 0; }
+	WaveRay& Add()
+	{
+		if (count == capacity)
+		{
+			capacity = max( 1024, capacity * 2 );
+			WaveRay* grown = Memory::FrameArena().Alloc<WaveRay>( capacity );
+			if (count) memcpy( grown, ray, count * sizeof( WaveRay ) );
+			ray = grown;
+		}
+		return ray[count++];
+	}
+	WaveRay* ray = 0;
+	int count = 0, capacity = 0;
+};
+
+// -----------------------------------------------------------
+// Ray sorter
+// Reorders a wavefront of secondary rays so that rays with a
+// similar direction and a nearby origin are traced one after
+// another. The key holds the direction octant in its top bits
+// and the Morton code of the origin, quantized to the room,
+// below it; a 24-bit LSD radix sort then needs three passes.
+// Each render thread sorts its own wavefronts, so the sort
+// itself is serial.
+// -----------------------------------------------------------
+class RaySorter
+{
+public:
+	void Sort( const Scene& scene, const RayQueue& rays, RayQueue& sorted );
+private:
+	static uint Key( const Ray& ray, const float3& bmin, const float3& scale );
+	void Reserve( const int n );
+	uint* key[2];
+	int* index[2];
+	int capacity = 0;
+};
+
+// -----------------------------------------------------------
+// Secondary ray statistics, summed over all wavefront tiles of
+// a frame. Rays that hit the same primitive as the ray traced
+// before them are counted as coherent: those find its data,
+// and the texels near their hit, still in cache.
+// -----------------------------------------------------------
+struct WavefrontStats
+{
+	void Reset() { rays = 0, coherent = 0, nanoseconds = 0, sortNanoseconds = 0; }
+	atomic<int> rays = 0, coherent = 0;
+	atomic<long long> nanoseconds = 0, sortNanoseconds = 0; // FindNearest, RaySorter
+};
+
+// -----------------------------------------------------------
+// Shadow batch
+// Deferred direct illumination for the diffuse hits of a tile.
+// Each hit is lit by every light; the shadow rays of a hit
+// share its origin and are tested as packets by the Occluded
+// kernel (see kernels.h), as wide as the cpu allows, so the
+// origin-dependent setup of each occluder is done once per
+// hit instead of once per ray. The few rays that pass near the
+// torus get the exact scalar test afterwards; SDF objects are
+// marched 8 rays at a time.
+// -----------------------------------------------------------
+struct ShadowHit
+{
+	float3 I, N;
+	float3 weight;		// brdf times throughput; irradiance is added to the pixel with this weight
+	int pixel;
+	uint seed;			// for soft shadows
+};
+class ShadowBatch
+{
+public:
+	void Clear() { count = 0; }
+	ShadowHit& Add()
+	{
+		if (count == capacity)
+		{
+			capacity = max( 1024, capacity * 2 );
+			ShadowHit* grown = Memory::FrameArena().Alloc<ShadowHit>( capacity );
+			if (count) memcpy( grown, hit, count * sizeof( ShadowHit ) );
+			hit = grown;
+		}
+		return hit[count++];
+	}
+	void Trace( const Scene& scene, const int samples, float3* color );
+	ShadowHit* hit = 0;
+	int count = 0, capacity = 0;
+private:
+	void ReserveRays( const int rays );
+	ShadowPackets packets = {};
+	float* contribution = 0;	// n.l / d^2 of each ray; 0 if it is not traced
+	uchar* result = 0;			// see KernelTable::Occluded
+	int rayCapacity = 0, hitCapacity = 0;
+};
+
+// -----------------------------------------------------------
+// Hit batch
+// The hits of one wavefront, regrouped per primitive and
+// stored SoA, so that the shading kernels process 8 hits of
+// the same material per AVX register instead of branching on
+// objIdx for every hit. Shade fills the normal (facing the
+// ray), albedo and, for dielectrics, Fresnel reflectance and
+// the transmitted direction.
+// -----------------------------------------------------------
+class HitBatch
+{
+public:
+	enum { BINS = Scene::STRESSBASE + StressScene::MATERIALS }; // one bin per objIdx; stress objects per material
+	void Build( const Scene& scene, const WaveRay* rays, const int rayCount );
+	void Shade( const Scene& scene );
+	int count = 0;
+	int binStart[BINS], binEnd[BINS]; // hits of a bin; starts are multiples of 8
+	float reflectivity[BINS], refractivity[BINS];
+	// per hit, in bin order
+	int* ray;			// index in the wavefront
+	int* objIdx;
+	int* inside;		// ~0 if the ray travelled through a medium
+	float* I[3], * D[3];
+	float* N[3], * albedo[3];
+	float* Fr, * T[3];	// dielectrics only; Fr is 1 for total internal reflection
+private:
+	void Reserve( const int n );
+	int capacity = 0;
+};
+
+} // namespace Tmpl8
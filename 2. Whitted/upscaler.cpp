@@ -0,0 +1,120 @@
+#include "precomp.h"
+
+// -----------------------------------------------------------
+// Cleanup
+// -----------------------------------------------------------
+Upscaler::~Upscaler()
+{
+	FREE64( col );
+	FREE64( colWeight );
+}
+
+// -----------------------------------------------------------
+// Precalculate horizontal taps; these are the same for every
+// output row, so we only redo this when a resolution changes.
+// Source pixel x is rendered at output position x * (dst /
+// src), the top-left of its block (see Renderer::RenderTile),
+// so output pixel X reads source position X * (src / dst).
+// -----------------------------------------------------------
+void Upscaler::Prepare( const int2 src, const int dstWidth )
+{
+	if (src.x == preparedSrc.x && src.y == preparedSrc.y && dstWidth == preparedWidth) return;
+	if (dstWidth != preparedWidth)
+	{
+		FREE64( col );
+		FREE64( colWeight );
+		col = (int*)MALLOC64( dstWidth * sizeof( int ) );
+		colWeight = (float*)MALLOC64( dstWidth * sizeof( float ) );
+	}
+	const float s = (float)src.x / dstWidth;
+	for (int x = 0; x < dstWidth; x++)
+	{
+		const float sx = min( x * s, (float)(src.x - 1) );
+		const int x0 = min( (int)sx, src.x - 2 );
+		col[x] = x0, colWeight[x] = sx - x0;
+	}
+	preparedSrc = src, preparedWidth = dstWidth;
+}
+
+// -----------------------------------------------------------
+// Upscale a render to the output surface, converting to rgb8.
+// SIMD lanes hold the four taps of an output pixel: top-left,
+// top-right, bottom-left, bottom-right.
+// -----------------------------------------------------------
+void Upscaler::Upscale( const Accumulator& color, const float4* guide, const int2 src, Surface* dst )
+{
+	Prepare( src, dst->width );
+	ALIGN( 16 ) static const uint refMask[4][4] = {
+		{ ~0u, 0, 0, 0 }, { 0, ~0u, 0, 0 }, { 0, 0, ~0u, 0 }, { 0, 0, 0, ~0u }
+	};
+	const __m128 zero4 = _mm_setzero_ps(), one4 = _mm_set1_ps( 1 ), scale4 = _mm_set1_ps( 255.0f );
+	const __m128 signMask4 = _mm_set1_ps( -0.0f ), depthSharpness4 = _mm_set1_ps( 10.0f );
+	const float s = (float)src.y / dst->height;
+#pragma omp parallel
+	{
+		// per-thread decode scratch, from the frame arena
+		Arena& arena = Memory::FrameArena();
+		const Arena::Marker mark = arena.Mark();
+		float4* row0 = arena.Alloc<float4>( src.x );
+		float4* row1 = arena.Alloc<float4>( src.x );
+#pragma omp for schedule(dynamic)
+		for (int y = 0; y < dst->height; y++)
+		{
+			const float sy = min( y * s, (float)(src.y - 1) );
+			const int y0 = min( (int)sy, src.y - 2 );
+			const float wy = sy - y0;
+			const __m128 wy4 = _mm_setr_ps( 1 - wy, 1 - wy, wy, wy );
+			// compact accumulator formats are decoded to scratch first
+			const float4* c0 = color.Direct( y0 * src.x ), * c1 = color.Direct( (y0 + 1) * src.x );
+			if (!c0)
+			{
+				color.Decode( y0 * src.x, src.x, row0 ), c0 = row0;
+				color.Decode( (y0 + 1) * src.x, src.x, row1 ), c1 = row1;
+			}
+			const float4* g0 = guide ? guide + y0 * src.x : 0, * g1 = guide ? g0 + src.x : 0;
+			uint* out = dst->pixels + y * dst->width;
+			for (int x = 0; x < dst->width; x++)
+			{
+				const int x0 = col[x];
+				const float wx = colWeight[x];
+				__m128 w4 = _mm_mul_ps( _mm_setr_ps( 1 - wx, wx, 1 - wx, wx ), wy4 );
+				if (guide)
+				{
+					// transpose the tap guides so that each lane holds one tap
+					const float4* tap[4] = { g0 + x0, g0 + x0 + 1, g1 + x0, g1 + x0 + 1 };
+					__m128 nx4 = _mm_load_ps( &tap[0]->x ), ny4 = _mm_load_ps( &tap[1]->x );
+					__m128 nz4 = _mm_load_ps( &tap[2]->x ), d4 = _mm_load_ps( &tap[3]->x );
+					_MM_TRANSPOSE4_PS( nx4, ny4, nz4, d4 );
+					// the tap closest to the output pixel is the reference
+					const int ref = (wx >= 0.5f ? 1 : 0) + (wy >= 0.5f ? 2 : 0);
+					const float4& r = *tap[ref];
+					// normal similarity, sharpened to reject creases
+					__m128 wn4 = _mm_add_ps( _mm_add_ps( _mm_mul_ps( nx4, _mm_set1_ps( r.x ) ),
+						_mm_mul_ps( ny4, _mm_set1_ps( r.y ) ) ), _mm_mul_ps( nz4, _mm_set1_ps( r.z ) ) );
+					wn4 = _mm_max_ps( zero4, wn4 );
+					wn4 = _mm_mul_ps( wn4, wn4 ), wn4 = _mm_mul_ps( wn4, wn4 ), wn4 = _mm_mul_ps( wn4, wn4 );
+					// relative depth similarity, rejects taps across silhouettes
+					const __m128 rd4 = _mm_set1_ps( r.w );
+					const __m128 rel4 = _mm_div_ps( _mm_andnot_ps( signMask4, _mm_sub_ps( d4, rd4 ) ), _mm_add_ps( rd4, _mm_set1_ps( 1e-4f ) ) );
+					const __m128 wd4 = _mm_max_ps( zero4, _mm_sub_ps( one4, _mm_mul_ps( rel4, depthSharpness4 ) ) );
+					// the reference tap is always trusted, also for background pixels without a normal
+					const __m128 mask4 = _mm_load_ps( (const float*)refMask[ref] );
+					const __m128 wg4 = _mm_or_ps( _mm_andnot_ps( mask4, _mm_mul_ps( wn4, wd4 ) ), _mm_and_ps( mask4, one4 ) );
+					w4 = _mm_mul_ps( w4, wg4 );
+				}
+				// weighted sum of the four taps
+				__m128 sum4 = _mm_mul_ps( _mm_load_ps( &c0[x0].x ), _mm_shuffle_ps( w4, w4, _MM_SHUFFLE( 0, 0, 0, 0 ) ) );
+				sum4 = _mm_add_ps( sum4, _mm_mul_ps( _mm_load_ps( &c0[x0 + 1].x ), _mm_shuffle_ps( w4, w4, _MM_SHUFFLE( 1, 1, 1, 1 ) ) ) );
+				sum4 = _mm_add_ps( sum4, _mm_mul_ps( _mm_load_ps( &c1[x0].x ), _mm_shuffle_ps( w4, w4, _MM_SHUFFLE( 2, 2, 2, 2 ) ) ) );
+				sum4 = _mm_add_ps( sum4, _mm_mul_ps( _mm_load_ps( &c1[x0 + 1].x ), _mm_shuffle_ps( w4, w4, _MM_SHUFFLE( 3, 3, 3, 3 ) ) ) );
+				__m128 wsum4 = _mm_hadd_ps( w4, w4 );
+				wsum4 = _mm_hadd_ps( wsum4, wsum4 );
+				// translate to rgb32; truncation matches RGBF32_to_RGB8
+				const __m128 rgb4 = _mm_mul_ps( _mm_min_ps( _mm_div_ps( sum4, wsum4 ), one4 ), scale4 );
+				const __m128i i4 = _mm_cvttps_epi32( rgb4 );
+				out[x] = (_mm_cvtsi128_si32( i4 ) << 16) + (_mm_extract_epi32( i4, 1 ) << 8) + _mm_extract_epi32( i4, 2 );
+			}
+		}
+		arena.Rewind( mark );
+	}
+}
\ No newline at end of file
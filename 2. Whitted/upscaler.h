@@ -0,0 +1,30 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+// -----------------------------------------------------------
+// Edge-aware upscaler
+// Brings a reduced-resolution render up to the size of the
+// output surface. Each output pixel blends its four nearest
+// source pixels bilinearly, but taps whose depth or normal
+// disagree with the closest tap are rejected, so silhouettes
+// stay sharp instead of bleeding into the background.
+// The guide buffer stores the primary hit normal in xyz and
+// its distance in w; pass 0 for plain bilinear filtering.
+// -----------------------------------------------------------
+class Upscaler
+{
+public:
+	~Upscaler();
+	void Upscale( const Accumulator& color, const float4* guide, const int2 src, Surface* dst );
+private:
+	void Prepare( const int2 src, const int dstWidth );
+	// per output column: left source column and horizontal weight
+	int* col = 0;
+	float* colWeight = 0;
+	int2 preparedSrc = int2( 0, 0 );
+	int preparedWidth = 0;
+};
+
+} // namespace Tmpl8
\ No newline at end of file
@@ -0,0 +1,214 @@
+#include "precomp.h"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#define popen _popen
+#define pclose _pclose
+#define dup _dup
+#define dup2 _dup2
+#define fdopen _fdopen
+static const char* pipeMode = "wb";
+#else
+#include <unistd.h>
+static const char* pipeMode = "w"; // glibc: binary is implied
+#endif
+
+const char* VideoSink::formatName[FORMATS] = { "Y4M 8-bit 4:2:0", "Y4M 16-bit 4:4:4", "raw rgb24", "raw rgb48le", "raw float rgb" };
+
+// -----------------------------------------------------------
+// Open the output and start the writer; target is a file name,
+// "-" for stdout or "|command" to pipe into a program
+// -----------------------------------------------------------
+bool VideoSink::Open( const char* target, const Format f, const int w, const int h, const float fps )
+{
+	Close();
+	if (target[0] == '|') file = popen( target + 1, pipeMode ), pipe = true;
+	else if (!strcmp( target, "-" ))
+	{
+		// the video takes over stdout; text output goes to stderr from now on
+		fflush( stdout );
+		const int fd = dup( 1 );
+		dup2( 2, 1 );
+#ifdef _WIN32
+		_setmode( fd, _O_BINARY );
+#endif
+		file = fdopen( fd, "wb" );
+	}
+	else file = fopen( target, "wb" );
+	if (!file) return false;
+	setvbuf( file, 0, _IOFBF, 1 << 22 );
+	format = f, width = w, height = h;
+	const size_t pixels = (size_t)w * h, chroma = (size_t)((w + 1) / 2) * ((h + 1) / 2);
+	static const char* y4mHeader = "YUV4MPEG2 W%i H%i F%i:1000 Ip A1:1 %s XCOLORRANGE=LIMITED\n";
+	if (f == Y4M) fprintf( file, y4mHeader, w, h, (int)(fps * 1000), "C420jpeg" ), frameBytes = 6 + pixels + chroma * 2;
+	if (f == Y4M16) fprintf( file, y4mHeader, w, h, (int)(fps * 1000), "C444p16" ), frameBytes = 6 + pixels * 6;
+	if (f == RGB8) frameBytes = pixels * 3;
+	if (f == RGB16) frameBytes = pixels * 6;
+	if (f == RGBF32) frameBytes = pixels * 12;
+	framesWritten = 0, waitMs = convertMs = writeMs = 0, bytesWritten = 0;
+	nextPush = 0, closing = false;
+	writer = thread( &VideoSink::WriterLoop, this );
+	return true;
+}
+
+// -----------------------------------------------------------
+// Write what is still queued and close the output
+// -----------------------------------------------------------
+void VideoSink::Close()
+{
+	if (!file) return;
+	{
+		lock_guard<mutex> l( lock );
+		closing = true;
+	}
+	changed.notify_all();
+	writer.join();
+	if (pipe) pclose( file ); else fclose( file );
+	file = 0, pipe = false;
+	for (Frame& f : frame)
+	{
+		FREE64( f.linear );
+		FREE64( f.rgb );
+		f = Frame();
+	}
+}
+
+// -----------------------------------------------------------
+// Wait for a free buffer; only blocks when the writer is two
+// frames behind
+// -----------------------------------------------------------
+VideoSink::Frame& VideoSink::Acquire()
+{
+	Frame& f = frame[nextPush];
+	Timer t;
+	unique_lock<mutex> l( lock );
+	changed.wait( l, [&]() { return !f.full; } );
+	waitMs += t.elapsed() * 1000;
+	return f;
+}
+
+void VideoSink::Release( Frame& f )
+{
+	{
+		lock_guard<mutex> l( lock );
+		f.full = true;
+		nextPush ^= 1;
+	}
+	changed.notify_all();
+}
+
+void VideoSink::Push( const uint* pixels )
+{
+	if (!file) return;
+	Frame& f = Acquire();
+	if (!f.rgb) f.rgb = (uint*)MALLOC64( (size_t)width * height * sizeof( uint ) );
+	memcpy( f.rgb, pixels, (size_t)width * height * sizeof( uint ) );
+	f.fromScreen = true;
+	Release( f );
+}
+
+void VideoSink::Push( const Accumulator& a )
+{
+	if (!file) return;
+	Frame& f = Acquire();
+	if (!f.linear) f.linear = (float4*)MALLOC64( (size_t)width * height * sizeof( float4 ) );
+	a.Decode( 0, width * height, f.linear );
+	f.fromScreen = false;
+	Release( f );
+}
+
+// -----------------------------------------------------------
+// Writer thread: frames go out in the order they came in
+// -----------------------------------------------------------
+void VideoSink::WriterLoop()
+{
+	vector<uchar> out( frameBytes );
+	for (int next = 0;; next ^= 1)
+	{
+		Frame& f = frame[next];
+		{
+			unique_lock<mutex> l( lock );
+			changed.wait( l, [&]() { return f.full || closing; } );
+			if (!f.full) break;
+		}
+		Timer t;
+		Encode( f, out.data() );
+		convertMs += t.elapsed() * 1000;
+		t.reset();
+		const size_t written = fwrite( out.data(), 1, frameBytes, file );
+		writeMs += t.elapsed() * 1000;
+		{
+			lock_guard<mutex> l( lock );
+			f.full = false;
+			framesWritten++, bytesWritten += written;
+		}
+		changed.notify_all();
+	}
+	fflush( file );
+}
+
+// -----------------------------------------------------------
+// Colour conversion for one frame. The values are those that
+// the screen shows, without a transfer curve; YUV uses BT.709
+// in limited range, 4:2:0 chroma is the mean of 2x2 pixels.
+// -----------------------------------------------------------
+void VideoSink::Encode( const Frame& f, uchar* out ) const
+{
+	const int pixels = width * height;
+	const auto Pixel = [&]( const int i ) -> float3
+	{
+		if (!f.fromScreen) return make_float3( f.linear[i] );
+		const uint c = f.rgb[i];
+		return float3( (float)((c >> 16) & 255), (float)((c >> 8) & 255), (float)(c & 255) ) * (1.0f / 255);
+	};
+	const auto Clamp = []( const float3& c ) { return float3( clamp( c.x, 0.0f, 1.0f ), clamp( c.y, 0.0f, 1.0f ), clamp( c.z, 0.0f, 1.0f ) ); };
+	const auto Luma = []( const float3& c ) { return 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z; };
+	if (format == Y4M || format == Y4M16) memcpy( out, "FRAME\n", 6 ), out += 6;
+	if (format == Y4M)
+	{
+		const int cw = (width + 1) / 2, ch = (height + 1) / 2;
+		uchar* Y = out, * U = out + pixels, * V = U + cw * ch;
+		for (int y = 0; y < ch; y++) for (int x = 0; x < cw; x++)
+		{
+			float cb = 0, cr = 0;
+			int count = 0;
+			for (int v = 2 * y; v < min( 2 * y + 2, height ); v++) for (int u = 2 * x; u < min( 2 * x + 2, width ); u++)
+			{
+				const float3 c = Clamp( Pixel( u + v * width ) );
+				const float l = Luma( c );
+				Y[u + v * width] = (uchar)(16 + 219 * l + 0.5f);
+				cb += (c.z - l) * (1 / 1.8556f), cr += (c.x - l) * (1 / 1.5748f), count++;
+			}
+			U[x + y * cw] = (uchar)(128 + 224 * cb / count + 0.5f);
+			V[x + y * cw] = (uchar)(128 + 224 * cr / count + 0.5f);
+		}
+	}
+	else if (format == Y4M16)
+	{
+		ushort* Y = (ushort*)out, * U = Y + pixels, * V = U + pixels;
+		for (int i = 0; i < pixels; i++)
+		{
+			const float3 c = Clamp( Pixel( i ) );
+			const float l = Luma( c );
+			Y[i] = (ushort)((16 + 219 * l) * 256 + 0.5f);
+			U[i] = (ushort)((128 + 224 * (c.z - l) * (1 / 1.8556f)) * 256 + 0.5f);
+			V[i] = (ushort)((128 + 224 * (c.x - l) * (1 / 1.5748f)) * 256 + 0.5f);
+		}
+	}
+	else if (format == RGB8) for (int i = 0; i < pixels; i++)
+	{
+		const float3 c = Clamp( Pixel( i ) ) * 255 + 0.5f;
+		out[i * 3] = (uchar)c.x, out[i * 3 + 1] = (uchar)c.y, out[i * 3 + 2] = (uchar)c.z;
+	}
+	else if (format == RGB16) for (int i = 0; i < pixels; i++)
+	{
+		const float3 c = Clamp( Pixel( i ) ) * 65535 + 0.5f;
+		ushort* o = (ushort*)out + i * 3;
+		o[0] = (ushort)c.x, o[1] = (ushort)c.y, o[2] = (ushort)c.z;
+	}
+	else for (int i = 0; i < pixels; i++)
+	{
+		const float3 c = Pixel( i ); // unclamped, little endian as the hosts we run on
+		memcpy( out + i * 12, &c, 12 );
+	}
+}
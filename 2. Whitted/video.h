@@ -0,0 +1,58 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+// -----------------------------------------------------------
+// Video sink
+// Streams frames to a file, to stdout ("-") or into a command
+// ("|ffmpeg -i - out.mp4"), without intermediate images:
+// Y4M       8-bit YUV 4:2:0, BT.709, for encoders and players
+// Y4M16     16-bit YUV 4:4:4
+// RGB8      raw rgb24
+// RGB16     raw rgb48le
+// RGBF32    raw linear float rgb, unclamped
+// Push copies the frame into one of two buffers and returns;
+// a writer thread converts and writes the other one, so the
+// render loop only waits when the disk falls two frames
+// behind. Accumulator frames keep their range for the 16-bit
+// and float formats; screen pixels are 8-bit to begin with.
+// -----------------------------------------------------------
+class VideoSink
+{
+public:
+	enum Format { Y4M = 0, Y4M16, RGB8, RGB16, RGBF32, FORMATS };
+	static const char* formatName[FORMATS];
+	~VideoSink() { Close(); }
+	bool Open( const char* target, const Format f, const int width, const int height, const float fps );
+	void Push( const uint* pixels );			// 0x00RRGGBB, as in Surface
+	void Push( const Accumulator& frame );		// linear rgb
+	void Close();
+	bool IsOpen() const { return file != 0; }
+	// statistics
+	int framesWritten = 0;
+	float waitMs = 0, convertMs = 0, writeMs = 0; // totals
+	uint64_t bytesWritten = 0;
+private:
+	struct Frame
+	{
+		float4* linear = 0;	// from an accumulator
+		uint* rgb = 0;		// from the screen
+		bool full = false, fromScreen = false;
+	};
+	Frame& Acquire();
+	void Release( Frame& f );
+	void WriterLoop();
+	void Encode( const Frame& f, uchar* out ) const;
+	FILE* file = 0;
+	bool pipe = false, closing = false;
+	Format format = Y4M;
+	int width = 0, height = 0, nextPush = 0;
+	size_t frameBytes = 0;
+	Frame frame[2];
+	thread writer;
+	mutex lock;
+	condition_variable changed;
+};
+
+} // namespace Tmpl8
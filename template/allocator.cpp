@@ -0,0 +1,301 @@
+#include "precomp.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Arena implementation
+Arena::~Arena()
+{
+	for (Block& b : blocks) FREE64( b.data );
+}
+
+void* Arena::Alloc( const size_t bytes, const size_t align )
+{
+	// blocks are 64-byte aligned, so offsets only need to respect the requested alignment
+	assert( align <= 64 && (align & (align - 1)) == 0 );
+	size_t start = (offset + align - 1) & ~(align - 1);
+	if (current < 0 || start + bytes > blocks[current].size)
+	{
+		// move to the next block, inserting one if it is missing or too small
+		current++, start = offset = 0;
+		if (current == (int)blocks.size() || blocks[current].size < bytes)
+		{
+			const size_t size = max( blockSize, (bytes + 63) & ~(size_t)63 );
+			blocks.insert( blocks.begin() + current, { (uchar*)MALLOC64( size ), size } );
+			heapAllocs++;
+		}
+	}
+	used += start - offset + bytes, peak = max( peak, used );
+	offset = start + bytes;
+	return blocks[current].data + start;
+}
+
+void Arena::Reset()
+{
+	if (current > 0)
+	{
+		// the last cycle spilled: merge everything into a single block
+		const size_t size = Capacity();
+		for (Block& b : blocks) FREE64( b.data );
+		blocks.clear();
+		blocks.push_back( { (uchar*)MALLOC64( size ), size } );
+		heapAllocs++;
+	}
+	current = blocks.size() ? 0 : -1, offset = 0, used = 0;
+}
+
+size_t Arena::Capacity() const
+{
+	size_t size = 0;
+	for (const Block& b : blocks) size += b.size;
+	return size;
+}
+
+// Pool implementation
+Pool::Pool( const size_t size, const int blocksPerChunk ) : blocksPerChunk( blocksPerChunk )
+{
+	blockSize = (max( size, sizeof( FreeBlock ) ) + 63) & ~(size_t)63;
+}
+
+Pool::~Pool()
+{
+	for (uchar* c : chunks) FREE64( c );
+}
+
+void* Pool::Alloc()
+{
+	lock_guard<mutex> guard( lock );
+	if (!freeList)
+	{
+		// grow by one chunk and thread its blocks onto the free list
+		uchar* chunk = (uchar*)MALLOC64( blockSize * blocksPerChunk );
+		chunks.push_back( chunk );
+		for (int i = blocksPerChunk - 1; i >= 0; i--)
+		{
+			FreeBlock* b = (FreeBlock*)(chunk + i * blockSize);
+			b->next = freeList, freeList = b;
+		}
+		capacity += blocksPerChunk;
+	}
+	FreeBlock* b = freeList;
+	freeList = b->next;
+	peak = max( peak, ++inUse );
+	return b;
+}
+
+void Pool::Free( void* p )
+{
+	if (!p) return;
+	lock_guard<mutex> guard( lock );
+	FreeBlock* b = (FreeBlock*)p;
+	b->next = freeList, freeList = b;
+	inUse--;
+}
+
+// Memory implementation
+static mutex memoryLock;
+static vector<Arena*> arenas;
+struct LargeBlock { void* p; size_t size; bool huge; };
+static vector<LargeBlock> largeBlocks;
+
+Arena& Memory::FrameArena()
+{
+	// one arena per thread, registered on first use and released when the
+	// thread exits, e.g. when the OpenMP team shrinks or a worker restarts
+	struct ThreadArena
+	{
+		ThreadArena()
+		{
+			lock_guard<mutex> guard( memoryLock );
+			arenas.push_back( &arena );
+		}
+		~ThreadArena()
+		{
+			lock_guard<mutex> guard( memoryLock );
+			arenas.erase( find( arenas.begin(), arenas.end(), &arena ) );
+		}
+		Arena arena;
+	};
+	static thread_local ThreadArena local;
+	return local.arena;
+}
+
+void Memory::NewFrame()
+{
+	lock_guard<mutex> guard( memoryLock );
+	for (Arena* a : arenas) a->Reset();
+}
+
+vector<Arena*> Memory::FrameArenas()
+{
+	lock_guard<mutex> guard( memoryLock );
+	return arenas;
+}
+
+void* Memory::AllocLarge( const size_t bytes )
+{
+	if (bytes == 0) return 0;
+	void* p = 0;
+	size_t size = bytes;
+	bool huge = false;
+#ifdef _WIN32
+	if (hugePages && bytes >= hugeMinBytes)
+	{
+		// large pages come in multiples of GetLargePageMinimum, typically 2MB
+		const size_t page = GetLargePageMinimum();
+		if (page)
+		{
+			size = (bytes + page - 1) & ~(page - 1);
+			p = VirtualAlloc( 0, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE );
+			huge = p != 0;
+		}
+	}
+	if (!p) size = bytes, p = VirtualAlloc( 0, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE );
+#else
+	if (hugePages && bytes >= hugeMinBytes)
+	{
+		// explicit huge pages first; these need a reserved hugetlbfs pool
+		size = (bytes + (1 << 21) - 1) & ~(size_t)((1 << 21) - 1);
+		p = mmap( 0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0 );
+		if (p == MAP_FAILED)
+		{
+			// fall back to transparent huge pages
+			p = mmap( 0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+			if (p != MAP_FAILED) madvise( p, size, MADV_HUGEPAGE );
+		}
+		else huge = true;
+	}
+	else
+	{
+		p = mmap( 0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+	}
+	if (p == MAP_FAILED) p = 0;
+#endif
+	FATALERROR_IF( !p, "Failed to allocate %zu bytes", bytes );
+	lock_guard<mutex> guard( memoryLock );
+	largeBlocks.push_back( { p, size, huge } );
+	largeBytes += size;
+	if (huge) hugeBytes += size;
+	return p;
+}
+
+void Memory::FreeLarge( void* p )
+{
+	if (!p) return;
+	lock_guard<mutex> guard( memoryLock );
+	for (size_t i = 0; i < largeBlocks.size(); i++) if (largeBlocks[i].p == p)
+	{
+		const LargeBlock& b = largeBlocks[i];
+#ifdef _WIN32
+		VirtualFree( b.p, 0, MEM_RELEASE );
+#else
+		munmap( b.p, b.size );
+#endif
+		largeBytes -= b.size;
+		if (b.huge) hugeBytes -= b.size;
+		largeBlocks[i] = largeBlocks.back();
+		largeBlocks.pop_back();
+		return;
+	}
+	FATALERROR( "FreeLarge: unknown pointer" );
+}
+
+// MappedFile implementation
+bool MappedFile::Open( const char* file )
+{
+	Close();
+#ifdef _WIN32
+	HANDLE f = CreateFileA( file, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0 );
+	if (f == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER bytes;
+	GetFileSizeEx( f, &bytes );
+	HANDLE m = bytes.QuadPart ? CreateFileMappingA( f, 0, PAGE_READONLY, 0, 0, 0 ) : 0;
+	void* p = m ? MapViewOfFile( m, FILE_MAP_READ, 0, 0, 0 ) : 0;
+	if (!p)
+	{
+		if (m) CloseHandle( m );
+		CloseHandle( f );
+		return false;
+	}
+	fileHandle = f, mappingHandle = m, size = (size_t)bytes.QuadPart;
+#else
+	const int f = open( file, O_RDONLY );
+	if (f < 0) return false;
+	struct stat st;
+	void* p = fstat( f, &st ) == 0 && st.st_size > 0 ? mmap( 0, st.st_size, PROT_READ, MAP_SHARED, f, 0 ) : MAP_FAILED;
+	if (p == MAP_FAILED)
+	{
+		close( f );
+		return false;
+	}
+	fd = f, size = (size_t)st.st_size;
+#endif
+	data = (uchar*)p;
+	return true;
+}
+
+bool MappedFile::Create( const char* file, const size_t bytes )
+{
+	Close();
+	if (bytes == 0) return false;
+#ifdef _WIN32
+	HANDLE f = CreateFileA( file, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, 0, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0 );
+	if (f == INVALID_HANDLE_VALUE) return false;
+	// the mapping sets the file size
+	HANDLE m = CreateFileMappingA( f, 0, PAGE_READWRITE, (DWORD)((uint64_t)bytes >> 32), (DWORD)bytes, 0 );
+	void* p = m ? MapViewOfFile( m, FILE_MAP_WRITE, 0, 0, bytes ) : 0;
+	if (!p)
+	{
+		if (m) CloseHandle( m );
+		CloseHandle( f );
+		return false;
+	}
+	fileHandle = f, mappingHandle = m;
+#else
+	const int f = open( file, O_RDWR | O_CREAT, 0644 );
+	if (f < 0) return false;
+	void* p = ftruncate( f, (off_t)bytes ) == 0 ? mmap( 0, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, f, 0 ) : MAP_FAILED;
+	if (p == MAP_FAILED)
+	{
+		close( f );
+		return false;
+	}
+	fd = f;
+#endif
+	data = (uchar*)p, size = bytes;
+	return true;
+}
+
+void MappedFile::Flush( const size_t offset, const size_t bytes )
+{
+	if (!data || offset >= size) return;
+	const size_t count = bytes ? min( bytes, size - offset ) : size - offset;
+#ifdef _WIN32
+	FlushViewOfFile( data + offset, count );
+	FlushFileBuffers( (HANDLE)fileHandle );
+#else
+	// msync wants a page-aligned start
+	const size_t page = (size_t)sysconf( _SC_PAGESIZE ), first = offset & ~(page - 1);
+	msync( data + first, count + offset - first, MS_SYNC );
+#endif
+}
+
+void MappedFile::Close()
+{
+	if (!data) return;
+#ifdef _WIN32
+	UnmapViewOfFile( data );
+	CloseHandle( (HANDLE)mappingHandle );
+	CloseHandle( (HANDLE)fileHandle );
+	fileHandle = mappingHandle = 0;
+#else
+	munmap( data, size );
+	close( fd );
+	fd = -1;
+#endif
+	data = 0, size = 0;
+}
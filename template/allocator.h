@@ -0,0 +1,90 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+// bump allocator: memory is handed out linearly and released all at once.
+// When a reset finds that the arena spilled into extra blocks, the blocks
+// are merged into one, so a stable workload stops touching the heap.
+// Rewinding to a mark releases everything allocated since, e.g. the
+// scratch of one tile; blocks added meanwhile are kept for reuse.
+class Arena
+{
+public:
+	struct Marker { int block; size_t offset, used; };
+	Arena( const size_t blockSize = 1 << 20 ) : blockSize( blockSize ) {}
+	~Arena();
+	void* Alloc( const size_t bytes, const size_t align = 64 );
+	template <class T> T* Alloc( const size_t count ) { return (T*)Alloc( count * sizeof( T ) ); }
+	Marker Mark() const { return { current, offset, used }; }
+	void Rewind( const Marker& m ) { current = m.block, offset = m.offset, used = m.used; }
+	void Reset();
+	size_t Capacity() const;
+	size_t used = 0, peak = 0;	// bytes in use now, and the most ever in use
+	int heapAllocs = 0;			// block allocations since construction
+private:
+	struct Block { uchar* data; size_t size; };
+	vector<Block> blocks;
+	size_t blockSize, offset = 0;
+	int current = -1;
+};
+
+// pool of fixed-size blocks, e.g. the cluster tile buffers; freed
+// blocks are reused before the pool grows. Thread-safe.
+class Pool
+{
+public:
+	Pool( const size_t size, const int blocksPerChunk = 64 );
+	~Pool();
+	void* Alloc();
+	void Free( void* p );
+	int inUse = 0, peak = 0, capacity = 0;
+private:
+	struct FreeBlock { FreeBlock* next; };
+	FreeBlock* freeList = 0;
+	vector<uchar*> chunks;
+	size_t blockSize;
+	int blocksPerChunk;
+	mutex lock;
+};
+
+// memory subsystem: per-thread frame arenas, reset at the start of every
+// frame, and page-granular allocations for large long-lived buffers such
+// as accumulators, BVHs and textures, optionally backed by 2MB pages to
+// reduce TLB misses. Only allocations of at least hugeMinBytes use them,
+// so rounding up to whole pages wastes at most a quarter. On Windows,
+// large pages require the 'Lock pages in memory' privilege; without it
+// we silently fall back to 4KB pages.
+class Memory
+{
+public:
+	static Arena& FrameArena();	// arena of the calling thread
+	static void NewFrame();		// reset all frame arenas; call while workers are idle
+	static vector<Arena*> FrameArenas(); // valid while no thread exits
+	static void* AllocLarge( const size_t bytes );
+	static void FreeLarge( void* p );
+	static inline bool hugePages = true;
+	static inline size_t hugeMinBytes = 8 << 20;
+	static inline size_t largeBytes = 0, hugeBytes = 0; // currently allocated
+};
+
+// file mapped into memory: read-only, or read-write at a given size, in
+// which case the file is created or resized. Writes reach the file when the
+// OS flushes the pages, or on Flush.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	~MappedFile() { Close(); }
+	bool Open( const char* file );
+	bool Create( const char* file, const size_t bytes );
+	void Flush( const size_t offset = 0, const size_t bytes = 0 ); // bytes = 0: to the end
+	void Close();
+	uchar* data = 0;
+	size_t size = 0;
+private:
+	void* fileHandle = 0, * mappingHandle = 0; // Windows
+	int fd = -1; // elsewhere
+};
+
+} // namespace Tmpl8
@@ -0,0 +1,122 @@
+#include "precomp.h"
+
+// cache file layout: header, then the levels at the given byte offsets
+struct TextureHeader { char magic[4]; uint version, width, height, levels, offset[16]; };
+static const char textureMagic[4] = { 'T', '8', 'T', 'X' };
+static const uint textureVersion = 1, textureDataStart = 128;
+static_assert(sizeof( TextureHeader ) <= textureDataStart, "texture header too large");
+
+static mutex cacheLock;
+static vector<pair<string, TextureCache::Texture*>> textures;
+
+// -----------------------------------------------------------
+// Find or load a texture; loading happens outside the lock,
+// so that Plane::Preload decodes its textures in parallel
+// -----------------------------------------------------------
+const TextureCache::Texture& TextureCache::Get( const char* file )
+{
+	{
+		lock_guard<mutex> guard( cacheLock );
+		for (const auto& t : textures) if (t.first == file) return *t.second;
+	}
+	Texture* texture = new Texture();
+	const string cacheFile = string( file ) + ".tex";
+	if (FileIsNewer( file, cacheFile.c_str() ) || !texture->file.Open( cacheFile.c_str() ) ||
+		!Attach( *texture, texture->file.data, texture->file.size ))
+	{
+		// no usable cache file: decode, and store the result for the next run; the
+		// file is written under a private name first, so that concurrent runs never
+		// map a partial file
+		texture->file.Close();
+		texture->memory = Decode( file );
+		char tmp[1024];
+		sprintf( tmp, "%s.%u", cacheFile.c_str(), ProcessId() );
+		FILE* f = fopen( tmp, "wb" );
+		const bool written = f && fwrite( texture->memory.data(), 1, texture->memory.size(), f ) == texture->memory.size();
+		if (f) fclose( f );
+		if (written) remove( cacheFile.c_str() ), rename( tmp, cacheFile.c_str() ); else remove( tmp );
+		if (written && texture->file.Open( cacheFile.c_str() ) && Attach( *texture, texture->file.data, texture->file.size ))
+			texture->memory = vector<uchar>();
+		else
+			texture->file.Close(), Attach( *texture, texture->memory.data(), texture->memory.size() );
+	}
+	else mapped++;
+	lock_guard<mutex> guard( cacheLock );
+	// another thread may have loaded the same file in the meantime
+	for (const auto& t : textures) if (t.first == file) { delete texture; return *t.second; }
+	textures.push_back( make_pair( string( file ), texture ) );
+	return *texture;
+}
+
+// -----------------------------------------------------------
+// Decode an image into the cache file layout, with its mip
+// chain if requested; each level halves the previous one
+// with a 2x2 box filter per channel
+// -----------------------------------------------------------
+vector<uchar> TextureCache::Decode( const char* file )
+{
+	Surface image( file );
+	FATALERROR_IF( !image.pixels, "Could not decode %s", file );
+	decoded++;
+	TextureHeader header = {};
+	memcpy( header.magic, textureMagic, 4 );
+	header.version = textureVersion, header.width = image.width, header.height = image.height;
+	// level sizes and offsets
+	uint w = image.width, h = image.height, offset = textureDataStart;
+	for (header.levels = 0; header.levels < 16; header.levels++)
+	{
+		header.offset[header.levels] = offset;
+		offset += (w * h * sizeof( uint ) + 63) & ~63u;
+		if (!mips || (w == 1 && h == 1)) { header.levels++; break; }
+		w = max( 1u, w >> 1 ), h = max( 1u, h >> 1 );
+	}
+	vector<uchar> result( offset );
+	memcpy( result.data(), &header, sizeof( header ) );
+	memcpy( result.data() + textureDataStart, image.pixels, image.width * image.height * sizeof( uint ) );
+	w = image.width, h = image.height;
+	for (uint l = 1; l < header.levels; l++)
+	{
+		const uint* src = (const uint*)(result.data() + header.offset[l - 1]);
+		uint* dst = (uint*)(result.data() + header.offset[l]);
+		const uint dw = max( 1u, w >> 1 ), dh = max( 1u, h >> 1 );
+		for (uint y = 0; y < dh; y++) for (uint x = 0; x < dw; x++)
+		{
+			// odd sizes: the last row or column is used twice
+			const uint x0 = min( x * 2, w - 1 ), x1 = min( x * 2 + 1, w - 1 );
+			const uint y0 = min( y * 2, h - 1 ), y1 = min( y * 2 + 1, h - 1 );
+			const uint p[4] = { src[x0 + y0 * w], src[x1 + y0 * w], src[x0 + y1 * w], src[x1 + y1 * w] };
+			uint c = 0;
+			for (int shift = 0; shift < 32; shift += 8)
+			{
+				const uint sum = ((p[0] >> shift) & 255) + ((p[1] >> shift) & 255) + ((p[2] >> shift) & 255) + ((p[3] >> shift) & 255);
+				c |= ((sum + 2) >> 2) << shift;
+			}
+			dst[x + y * dw] = c;
+		}
+		w = dw, h = dh;
+	}
+	return result;
+}
+
+// -----------------------------------------------------------
+// Point a texture at a cache image, after checking that the
+// image is complete
+// -----------------------------------------------------------
+bool TextureCache::Attach( Texture& texture, const uchar* image, const size_t bytes )
+{
+	if (bytes < textureDataStart) return false;
+	const TextureHeader& header = *(const TextureHeader*)image;
+	if (memcmp( header.magic, textureMagic, 4 ) || header.version != textureVersion) return false;
+	if (header.levels < 1 || header.levels > 16 || header.width == 0 || header.height == 0) return false;
+	uint w = header.width, h = header.height;
+	for (uint l = 0; l < header.levels; l++)
+	{
+		if (header.offset[l] & 63 || (size_t)header.offset[l] + w * h * sizeof( uint ) > bytes) return false;
+		texture.level[l] = (const uint*)(image + header.offset[l]);
+		w = max( 1u, w >> 1 ), h = max( 1u, h >> 1 );
+	}
+	texture.levels = header.levels;
+	texture.surface.pixels = (uint*)texture.level[0];
+	texture.surface.width = header.width, texture.surface.height = header.height;
+	return true;
+}
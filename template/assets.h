@@ -0,0 +1,33 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+// Texture cache: image assets are decoded once into a raw file next to the
+// source ("logo.png" -> "logo.png.tex"), which later runs map into memory
+// instead of decoding. A cache file holds a header and the 32-bit pixels,
+// optionally followed by a box-filtered mip chain; every level starts on a
+// 64-byte boundary. A cache file older than its source is rebuilt; if it
+// cannot be written, the decoded image is kept in memory instead.
+class TextureCache
+{
+public:
+	struct Texture
+	{
+		Surface surface;				// level 0; does not own its pixels
+		int levels = 0;
+		const uint* level[16] = {};		// level i is max( 1, w >> i ) x max( 1, h >> i )
+		MappedFile file;
+		vector<uchar> memory;			// used when the cache file is unavailable
+	};
+	// thread-safe; textures stay valid until the application ends
+	static const Texture& Get( const char* file );
+	static const Surface& GetSurface( const char* file ) { return Get( file ).surface; }
+	static inline bool mips = true;		// include mip chains in new cache files
+	static inline atomic<int> decoded{ 0 }, mapped{ 0 };
+private:
+	static vector<uchar> Decode( const char* file );
+	static bool Attach( Texture& texture, const uchar* image, const size_t bytes );
+};
+
+} // namespace Tmpl8
@@ -0,0 +1,153 @@
+#include "precomp.h"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment( lib, "ws2_32.lib" )
+typedef int socklen_t;
+#define CLOSESOCKET closesocket
+#define SHUT_RDWR SD_BOTH
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <unistd.h>
+typedef int SOCKET;
+#define INVALID_SOCKET -1
+#define CLOSESOCKET close
+#endif
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0 // elsewhere: a closed peer is an error, not a signal
+#endif
+
+// Socket implementation
+bool Socket::Startup()
+{
+#ifdef _WIN32
+	static const bool started = []() { WSADATA data; return WSAStartup( MAKEWORD( 2, 2 ), &data ) == 0; }();
+	return started;
+#else
+	return true;
+#endif
+}
+
+// tiles are small and latency matters more than packet count
+static void NoDelay( SOCKET s )
+{
+	int on = 1;
+	setsockopt( s, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof( on ) );
+}
+
+bool Socket::Listen( const int port )
+{
+	Close();
+	if (!Startup()) return false;
+	SOCKET s = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+	if (s == INVALID_SOCKET) return false;
+	int on = 1;
+	setsockopt( s, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof( on ) );
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl( INADDR_ANY );
+	address.sin_port = htons( (ushort)port );
+	if (::bind( s, (sockaddr*)&address, sizeof( address ) ) != 0 || listen( s, 16 ) != 0)
+	{
+		CLOSESOCKET( s );
+		return false;
+	}
+	handle = (uint64_t)s;
+	return true;
+}
+
+bool Socket::Accept( Socket& client )
+{
+	const uint64_t h = handle;
+	if (h == INVALID) return false;
+	sockaddr_in address = {};
+	socklen_t size = sizeof( address );
+	SOCKET s = accept( (SOCKET)h, (sockaddr*)&address, &size );
+	if (s == INVALID_SOCKET) return false;
+	NoDelay( s );
+	client.Close();
+	client.handle = (uint64_t)s;
+	char ip[INET_ADDRSTRLEN] = "?";
+	inet_ntop( AF_INET, &address.sin_addr, ip, sizeof( ip ) );
+	snprintf( client.peer, sizeof( client.peer ), "%s:%i", ip, (int)ntohs( address.sin_port ) );
+	return true;
+}
+
+bool Socket::Connect( const char* host, const int port )
+{
+	Close();
+	if (!Startup()) return false;
+	addrinfo hints = {}, * found = 0;
+	hints.ai_family = AF_INET, hints.ai_socktype = SOCK_STREAM, hints.ai_protocol = IPPROTO_TCP;
+	char service[16];
+	snprintf( service, sizeof( service ), "%i", port );
+	if (getaddrinfo( host, service, &hints, &found ) != 0) return false;
+	SOCKET s = INVALID_SOCKET;
+	for (addrinfo* a = found; a && s == INVALID_SOCKET; a = a->ai_next)
+	{
+		s = socket( a->ai_family, a->ai_socktype, a->ai_protocol );
+		if (s != INVALID_SOCKET && connect( s, a->ai_addr, (int)a->ai_addrlen ) != 0) CLOSESOCKET( s ), s = INVALID_SOCKET;
+	}
+	freeaddrinfo( found );
+	if (s == INVALID_SOCKET) return false;
+	NoDelay( s );
+	handle = (uint64_t)s;
+	snprintf( peer, sizeof( peer ), "%s:%i", host, port );
+	return true;
+}
+
+bool Socket::Send( const void* data, const size_t bytes )
+{
+	const char* p = (const char*)data;
+	for (size_t sent = 0; sent < bytes;)
+	{
+		const uint64_t h = handle;
+		if (h == INVALID) return false;
+		const int n = send( (SOCKET)h, p + sent, (int)min( bytes - sent, (size_t)1 << 30 ), MSG_NOSIGNAL );
+		if (n <= 0) return false;
+		sent += n;
+	}
+	return true;
+}
+
+bool Socket::Receive( void* data, const size_t bytes )
+{
+	char* p = (char*)data;
+	for (size_t received = 0; received < bytes;)
+	{
+		const uint64_t h = handle;
+		if (h == INVALID) return false;
+		// 0: the peer closed the connection; negative: error or timeout
+		const int n = recv( (SOCKET)h, p + received, (int)min( bytes - received, (size_t)1 << 30 ), 0 );
+		if (n <= 0) return false;
+		received += n;
+	}
+	return true;
+}
+
+void Socket::SetTimeout( const float seconds )
+{
+	const uint64_t h = handle;
+	if (h == INVALID) return;
+#ifdef _WIN32
+	const DWORD t = (DWORD)(seconds * 1000);
+#else
+	timeval t = { (time_t)seconds, (suseconds_t)((seconds - (int)seconds) * 1e6f) };
+#endif
+	setsockopt( (SOCKET)h, SOL_SOCKET, SO_RCVTIMEO, (const char*)&t, sizeof( t ) );
+	setsockopt( (SOCKET)h, SOL_SOCKET, SO_SNDTIMEO, (const char*)&t, sizeof( t ) );
+}
+
+void Socket::Close()
+{
+	const uint64_t h = handle.exchange( INVALID );
+	if (h == INVALID) return;
+	// shutdown first: on Linux, only that wakes up a thread blocked in accept
+	shutdown( (SOCKET)h, SHUT_RDWR );
+	CLOSESOCKET( (SOCKET)h );
+}
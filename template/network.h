@@ -0,0 +1,31 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+// TCP stream socket with whole-buffer sends and receives: Windows sockets or
+// BSD sockets. Listen and Accept are meant for a thread that waits for peers;
+// Close from another thread wakes up a blocked Accept or Receive.
+class Socket
+{
+public:
+	Socket() = default;
+	~Socket() { Close(); }
+	Socket( const Socket& ) = delete;
+	Socket& operator=( const Socket& ) = delete;
+	bool Listen( const int port );
+	bool Accept( Socket& client );
+	bool Connect( const char* host, const int port );
+	bool Send( const void* data, const size_t bytes );
+	bool Receive( void* data, const size_t bytes );
+	void SetTimeout( const float seconds ); // for Send and Receive; 0: wait forever
+	void Close();
+	bool IsOpen() const { return handle != INVALID; }
+	char peer[64] = {}; // address of the other side
+private:
+	static bool Startup();
+	static const uint64_t INVALID = ~0ull;
+	atomic<uint64_t> handle = INVALID;
+};
+
+} // namespace Tmpl8
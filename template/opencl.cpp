@@ -104,6 +104,104 @@ static cl_device_id getFirstDevice( cl_context context )
 	return first;
 }
 
+// programKey
+// Identifies a compiled program: FNV-1a over the expanded source, the build
+// options and the device and driver strings, so that a driver update or a
+// different GPU never picks up a stale binary.
+// ----------------------------------------------------------------------------
+static uint64_t programKey( const string& source, const char* options, cl_device_id dev )
+{
+	char name[1024] = "", driver[1024] = "", version[1024] = "";
+	clGetDeviceInfo( dev, CL_DEVICE_NAME, sizeof( name ), name, NULL );
+	clGetDeviceInfo( dev, CL_DRIVER_VERSION, sizeof( driver ), driver, NULL );
+	clGetDeviceInfo( dev, CL_DEVICE_VERSION, sizeof( version ), version, NULL );
+	const char* part[5] = { source.c_str(), options, name, driver, version };
+	uint64_t hash = 14695981039346656037ull;
+	for (int i = 0; i < 5; i++)
+	{
+		for (const char* c = part[i]; *c; c++) hash = (hash ^ (unsigned char)*c) * 1099511628211ull;
+		hash = (hash ^ 0xff) * 1099511628211ull; // separator, so that parts can't shift
+	}
+	return hash;
+}
+
+// program cache file layout: header, followed by the device binary
+struct ProgramCacheHeader { char magic[4]; uint version; uint64_t key, size; };
+static const char programCacheMagic[4] = { 'T', '8', 'P', 'B' };
+static const uint programCacheVersion = 1;
+
+// loadProgramBinary
+// Returns 0 if the file is absent, truncated, written for another key, or
+// rejected by the driver; the caller then compiles from source.
+// ----------------------------------------------------------------------------
+static cl_program loadProgramBinary( const char* file, const uint64_t key, cl_context context, cl_device_id dev )
+{
+	FILE* f = fopen( file, "rb" );
+	if (!f) return 0;
+	ProgramCacheHeader header;
+	vector<unsigned char> binary;
+	bool valid = fread( &header, sizeof( header ), 1, f ) == 1 && memcmp( header.magic, programCacheMagic, 4 ) == 0 &&
+		header.version == programCacheVersion && header.key == key && header.size > 0 && header.size < (1ull << 30);
+	if (valid) binary.resize( header.size ), valid = fread( binary.data(), 1, header.size, f ) == header.size;
+	fclose( f );
+	if (!valid) return 0;
+	const unsigned char* data = binary.data();
+	size_t size = header.size;
+	cl_int status = CL_SUCCESS, error;
+	cl_program program = clCreateProgramWithBinary( context, 1, &dev, &size, &data, &status, &error );
+	if (error == CL_SUCCESS && status == CL_SUCCESS) return program;
+	if (program) clReleaseProgram( program );
+	return 0;
+}
+
+// saveProgramBinary
+// Writes to a file private to this process first and renames it afterwards,
+// so that nodes sharing a cache directory never read a partial binary.
+// ----------------------------------------------------------------------------
+static void saveProgramBinary( const char* file, const uint64_t key, const unsigned char* binary, const size_t size )
+{
+	CreateDir( Kernel::programCacheDir );
+	char tmp[1024];
+	sprintf( tmp, "%s.%u", file, ProcessId() );
+	FILE* f = fopen( tmp, "wb" );
+	if (!f) return;
+	ProgramCacheHeader header;
+	memcpy( header.magic, programCacheMagic, 4 );
+	header.version = programCacheVersion, header.key = key, header.size = size;
+	const bool written = fwrite( &header, sizeof( header ), 1, f ) == 1 && fwrite( binary, 1, size, f ) == size;
+	fclose( f );
+	if (written) remove( file ), rename( tmp, file ); else remove( tmp );
+}
+
+// storeProgram
+// Dumps the binaries of a freshly built program to buildlog.txt and, if a
+// cache file is given, keeps the device binary for the next launch.
+// ----------------------------------------------------------------------------
+static void storeProgram( cl_program program, const char* cacheFile, const uint64_t key )
+{
+	// dump PTX via: https://forums.developer.nvidia.com/t/pre-compiling-opencl-kernels-tutorial/17089
+	// and: https://stackoverflow.com/questions/12868889/clgetprograminfo-cl-program-binary-sizes-incorrect-results
+	cl_uint devCount;
+	CHECKCL( clGetProgramInfo( program, CL_PROGRAM_NUM_DEVICES, sizeof( cl_uint ), &devCount, NULL ) );
+	size_t* sizes = new size_t[devCount];
+	sizes[0] = 0;
+	size_t received;
+	CHECKCL( clGetProgramInfo( program, CL_PROGRAM_BINARY_SIZES /* wrong data... */, devCount * sizeof( size_t ), sizes, &received ) );
+	char** binaries = new char* [devCount];
+	for (uint i = 0; i < devCount; i++)
+		binaries[i] = new char[sizes[i] + 1];
+	CHECKCL( clGetProgramInfo( program, CL_PROGRAM_BINARIES, devCount * sizeof( char* ), binaries, NULL ) );
+	FILE* f = fopen( "buildlog.txt", "wb" );
+	for (uint i = 0; i < devCount; i++)
+		fwrite( binaries[i], 1, sizes[i] + 1, f );
+	fclose( f );
+	// one device per context, so the first binary is the one to keep
+	if (cacheFile && sizes[0] > 0) saveProgramBinary( cacheFile, key, (unsigned char*)binaries[0], sizes[0] );
+	for (uint i = 0; i < devCount; i++) delete[] binaries[i];
+	delete[] binaries;
+	delete[] sizes;
+}
+
 // getPlatformID
 // ----------------------------------------------------------------------------
 static cl_int getPlatformID( cl_platform_id* platform )
@@ -154,13 +252,18 @@ Buffer::Buffer( unsigned int N, void* ptr, unsigned int t )
 	{
 		size = N;
 		textureID = 0; // not representing a texture
-		deviceBuffer = clCreateBuffer( Kernel::GetContext(), rwFlags, size, 0, 0 );
+		// zero-copy: use the host memory we got, or let the runtime allocate
+		// memory that host and device can both reach
+		if (t & ZEROCOPY) rwFlags |= ptr ? CL_MEM_USE_HOST_PTR : CL_MEM_ALLOC_HOST_PTR;
+		cl_int error;
+		deviceBuffer = clCreateBuffer( Kernel::GetContext(), rwFlags, size, (t & ZEROCOPY) ? ptr : 0, &error );
+		CHECKCL( error );
 		hostBuffer = (uint*)ptr;
 	}
 	else
 	{
 		textureID = N; // representing texture N
-		if (!Kernel::candoInterop) FatalError( "didn't expect to get here." );
+		if (!Kernel::candoInterop) FatalError( "GL texture buffers need a GL sharing context;\nuse a plain Buffer and read it back on a compute-only device." );
 		int error = 0;
 		if (t == TARGET) deviceBuffer = clCreateFromGLTexture( Kernel::GetContext(), CL_MEM_WRITE_ONLY, GL_TEXTURE_2D, 0, N, &error );
 		else deviceBuffer = clCreateFromGLTexture( Kernel::GetContext(), CL_MEM_READ_ONLY, GL_TEXTURE_2D, 0, N, &error );
@@ -185,8 +288,7 @@ Buffer::~Buffer()
 // ----------------------------------------------------------------------------
 void Buffer::CopyToDevice( bool blocking )
 {
-	cl_int error;
-	CHECKCL( error = clEnqueueWriteBuffer( Kernel::GetQueue(), deviceBuffer, blocking, 0, size, hostBuffer, 0, 0, 0 ) );
+	CopyRangeToDevice( 0, size, blocking );
 }
 
 // CopyToDevice2 method (uses 2nd queue)
@@ -194,7 +296,8 @@ void Buffer::CopyToDevice( bool blocking )
 void Buffer::CopyToDevice2( bool blocking, cl_event* eventToSet, const size_t s )
 {
 	cl_int error;
-	CHECKCL( error = clEnqueueWriteBuffer( Kernel::GetQueue2(), deviceBuffer, blocking ? CL_TRUE : CL_FALSE, 0, s == 0 ? size : s, hostBuffer, 0, 0, eventToSet ) );
+	ProfileScope scope( "write (queue 2)", eventToSet );
+	CHECKCL( error = clEnqueueWriteBuffer( Kernel::GetQueue2(), deviceBuffer, blocking ? CL_TRUE : CL_FALSE, 0, s == 0 ? size : s, hostBuffer, 0, 0, scope.Event() ) );
 }
 
 // CopyFromDevice method
@@ -208,7 +311,142 @@ void Buffer::CopyFromDevice( bool blocking )
 		ownData = true;
 		aligned = true;
 	}
-	CHECKCL( error = clEnqueueReadBuffer( Kernel::GetQueue(), deviceBuffer, blocking, 0, size, hostBuffer, 0, 0, 0 ) );
+	CopyRangeFromDevice( 0, size, blocking );
+}
+
+// CopyRangeToDevice method
+// A zero-copy buffer has no separate device copy: mapping and unmapping the
+// range is enough to make host writes visible, and costs nothing on devices
+// with unified memory.
+// ----------------------------------------------------------------------------
+void Buffer::CopyRangeToDevice( const size_t offset, const size_t bytes, bool blocking, cl_event* eventToSet )
+{
+	cl_int error;
+	ProfileScope scope( "write", eventToSet );
+	if (type & ZEROCOPY)
+	{
+		void* mapped = clEnqueueMapBuffer( Kernel::GetQueue(), deviceBuffer, CL_FALSE, CL_MAP_WRITE_INVALIDATE_REGION, offset, bytes, 0, 0, 0, &error );
+		CHECKCL( error );
+		CHECKCL( error = clEnqueueUnmapMemObject( Kernel::GetQueue(), deviceBuffer, mapped, 0, 0, scope.Event() ) );
+		if (blocking) clFinish( Kernel::GetQueue() );
+	}
+	else CHECKCL( error = clEnqueueWriteBuffer( Kernel::GetQueue(), deviceBuffer, blocking, offset, bytes, (unsigned char*)hostBuffer + offset, 0, 0, scope.Event() ) );
+}
+
+// CopyRangeFromDevice method
+// For a zero-copy buffer, a map brings the host memory up to date. The map
+// is always blocking: the range must stay mapped until the host has the
+// data, so a zero-copy read cannot be left in flight.
+// ----------------------------------------------------------------------------
+void Buffer::CopyRangeFromDevice( const size_t offset, const size_t bytes, bool blocking, cl_event* eventToSet )
+{
+	cl_int error;
+	ProfileScope scope( "read", eventToSet );
+	if (type & ZEROCOPY)
+	{
+		void* mapped = clEnqueueMapBuffer( Kernel::GetQueue(), deviceBuffer, CL_TRUE, CL_MAP_READ, offset, bytes, 0, 0, scope.Event(), &error );
+		CHECKCL( error );
+		// runtime-allocated memory maps elsewhere; copy it to the host buffer
+		unsigned char* host = hostBuffer ? (unsigned char*)hostBuffer + offset : 0;
+		if (host && host != mapped) memcpy( host, mapped, bytes );
+		CHECKCL( error = clEnqueueUnmapMemObject( Kernel::GetQueue(), deviceBuffer, mapped, 0, 0, 0 ) );
+	}
+	else CHECKCL( error = clEnqueueReadBuffer( Kernel::GetQueue(), deviceBuffer, blocking, offset, bytes, (unsigned char*)hostBuffer + offset, 0, 0, scope.Event() ) );
+}
+
+// Map method
+// Blocking; the pointer stays valid until Unmap. The only way to reach the
+// contents of a zero-copy buffer that was created without host memory.
+// ----------------------------------------------------------------------------
+void* Buffer::Map( cl_map_flags flags, const size_t offset, const size_t bytes )
+{
+	cl_int error;
+	void* mapped = clEnqueueMapBuffer( Kernel::GetQueue(), deviceBuffer, CL_TRUE, flags, offset, bytes ? bytes : size - offset, 0, 0, 0, &error );
+	CHECKCL( error );
+	return mapped;
+}
+
+// Unmap method
+// ----------------------------------------------------------------------------
+void Buffer::Unmap( void* mapped )
+{
+	cl_int error;
+	CHECKCL( error = clEnqueueUnmapMemObject( Kernel::GetQueue(), deviceBuffer, mapped, 0, 0, 0 ) );
+}
+
+// DoubleBuffer constructor
+// Zero-copy makes no sense here: there is no transfer to hide.
+// ----------------------------------------------------------------------------
+DoubleBuffer::DoubleBuffer( unsigned int N, unsigned int t )
+{
+	for (int i = 0; i < 2; i++)
+	{
+		host[i] = MALLOC64( N );
+		buffer[i] = new Buffer( N, host[i], t & ~Buffer::ZEROCOPY );
+	}
+}
+
+// DoubleBuffer destructor
+// ----------------------------------------------------------------------------
+DoubleBuffer::~DoubleBuffer()
+{
+	clFinish( Kernel::GetQueue() );
+	clFinish( Kernel::GetQueue2() );
+	for (int i = 0; i < 2; i++)
+	{
+		if (transfer[i]) clReleaseEvent( transfer[i] );
+		if (done[i]) clReleaseEvent( done[i] );
+		delete buffer[i];
+		FREE64( host[i] );
+	}
+}
+
+// DoubleBuffer::Host method
+// ----------------------------------------------------------------------------
+void* DoubleBuffer::Host( const int slot )
+{
+	if (transfer[slot]) clWaitForEvents( 1, &transfer[slot] );
+	return host[slot];
+}
+
+// DoubleBuffer::Upload method
+// Sends the current slot on the second queue, after the last kernel that
+// used this slot completed; returns at once.
+// ----------------------------------------------------------------------------
+void DoubleBuffer::Upload( const size_t bytes )
+{
+	cl_int error;
+	cl_event previous = transfer[current];
+	ProfileScope scope( "upload", &transfer[current] );
+	CHECKCL( error = clEnqueueWriteBuffer( Kernel::GetQueue2(), buffer[current]->deviceBuffer, CL_FALSE, 0, bytes ? bytes : buffer[current]->size,
+		host[current], done[current] ? 1 : 0, done[current] ? &done[current] : 0, scope.Event() ) );
+	if (previous) clReleaseEvent( previous );
+	clFlush( Kernel::GetQueue2() );
+}
+
+// DoubleBuffer::Download method
+// Reads the current slot back on the second queue once the kernel that
+// writes it completed; returns at once.
+// ----------------------------------------------------------------------------
+void DoubleBuffer::Download( const size_t bytes )
+{
+	cl_int error;
+	cl_event previous = transfer[current];
+	ProfileScope scope( "download", &transfer[current] );
+	CHECKCL( error = clEnqueueReadBuffer( Kernel::GetQueue2(), buffer[current]->deviceBuffer, CL_FALSE, 0, bytes ? bytes : buffer[current]->size,
+		host[current], done[current] ? 1 : 0, done[current] ? &done[current] : 0, scope.Event() ) );
+	if (previous) clReleaseEvent( previous );
+	clFlush( Kernel::GetQueue() );
+	clFlush( Kernel::GetQueue2() );
+}
+
+// DoubleBuffer::Done method
+// Event slot for the kernel run on the current slot.
+// ----------------------------------------------------------------------------
+cl_event* DoubleBuffer::Done()
+{
+	if (done[current]) clReleaseEvent( done[current] ), done[current] = 0;
+	return &done[current];
 }
 
 // CopyTo
@@ -234,7 +472,7 @@ void Buffer::Clear()
 
 // Kernel constructor
 // ----------------------------------------------------------------------------
-Kernel::Kernel( char* file, char* entryPoint )
+Kernel::Kernel( char* file, char* entryPoint, const KernelDefines* defines )
 {
 	if (!clStarted) InitCL();
 	// load a cl file
@@ -249,6 +487,8 @@ Kernel::Kernel( char* file, char* entryPoint )
 	if (isAmpere) csText = "#define ISAMPERE\n" + csText, vendorLines++;
 	if (isTuring) csText = "#define ISTURING\n" + csText, vendorLines++;
 	if (isPascal) csText = "#define ISPASCAL\n" + csText, vendorLines++;
+	// add specialization constants
+	if (defines) csText = defines->text + csText, vendorLines += defines->lines;
 	// expand #include directives: cl compiler doesn't support these natively
 	// warning: this simple system does not handle nested includes.
 	struct Include { int start, end; string file; } includes[64];
@@ -287,41 +527,38 @@ Kernel::Kernel( char* file, char* entryPoint )
 		csText = tmp;
 	}
 #endif
-	// attempt to compile the loaded and expanded source text
-	const char* source = csText.c_str();
-	size_t size = strlen( source );
-	cl_int error;
-	program = clCreateProgramWithSource( context, 1, (const char**)&source, &size, &error );
-	CHECKCL( error );
 	// why does the nvidia compiler not support these:
 	// -cl-nv-maxrregcount=64 not faster than leaving it out (same for 128)
 	// -cl-no-subgroup-ifp ? fails on nvidia.
 #if 1
 	// AMD compatible compilation, thanks Jasper the Winther
-	error = clBuildProgram( program, 0, NULL, "-cl-fast-relaxed-math -cl-mad-enable -cl-single-precision-constant", NULL, NULL );
-
+	const char* options = "-cl-fast-relaxed-math -cl-mad-enable -cl-single-precision-constant";
 #else
-	error = clBuildProgram( program, 0, NULL, "-cl-nv-verbose -cl-fast-relaxed-math -cl-mad-enable -cl-single-precision-constant", NULL, NULL );
+	const char* options = "-cl-nv-verbose -cl-fast-relaxed-math -cl-mad-enable -cl-single-precision-constant";
 #endif
+	// try the program cache first; a binary still needs clBuildProgram, and if
+	// that fails (e.g. the driver no longer accepts it) we compile from source
+	cl_int error = CL_SUCCESS;
+	const uint64_t key = programCache ? programKey( csText, options, device ) : 0;
+	char cacheFile[1024] = "";
+	if (programCache) sprintf( cacheFile, "%s/%016llx.bin", programCacheDir, (unsigned long long)key );
+	program = programCache ? loadProgramBinary( cacheFile, key, context, device ) : 0;
+	if (program && clBuildProgram( program, 0, NULL, options, NULL, NULL ) != CL_SUCCESS) clReleaseProgram( program ), program = 0;
+	const bool fromCache = program != 0;
+	// attempt to compile the loaded and expanded source text
+	const char* source = csText.c_str();
+	size_t size = strlen( source );
+	if (!fromCache)
+	{
+		program = clCreateProgramWithSource( context, 1, (const char**)&source, &size, &error );
+		CHECKCL( error );
+		error = clBuildProgram( program, 0, NULL, options, NULL, NULL );
+	}
 	// handle errors
 	if (error == CL_SUCCESS)
 	{
-		// dump PTX via: https://forums.developer.nvidia.com/t/pre-compiling-opencl-kernels-tutorial/17089
-		// and: https://stackoverflow.com/questions/12868889/clgetprograminfo-cl-program-binary-sizes-incorrect-results
-		cl_uint devCount;
-		CHECKCL( clGetProgramInfo( program, CL_PROGRAM_NUM_DEVICES, sizeof( cl_uint ), &devCount, NULL ) );
-		size_t* sizes = new size_t[devCount];
-		sizes[0] = 0;
-		size_t received;
-		CHECKCL( clGetProgramInfo( program, CL_PROGRAM_BINARY_SIZES /* wrong data... */, devCount * sizeof( size_t ), sizes, &received ) );
-		char** binaries = new char* [devCount];
-		for (uint i = 0; i < devCount; i++)
-			binaries[i] = new char[sizes[i] + 1];
-		CHECKCL( clGetProgramInfo( program, CL_PROGRAM_BINARIES, devCount * sizeof( size_t ), binaries, NULL ) );
-		FILE* f = fopen( "buildlog.txt", "wb" );
-		for (uint i = 0; i < devCount; i++)
-			fwrite( binaries[i], 1, sizes[i] + 1, f );
-		fclose( f );
+		// keep the binary of a fresh build; a cached one is already on disk
+		if (!fromCache) storeProgram( program, programCache ? cacheFile : 0, key );
 	}
 	else
 	{
@@ -389,6 +626,7 @@ Kernel::Kernel( char* file, char* entryPoint )
 	kernel = clCreateKernel( program, entryPoint, &error );
 	if (kernel == 0) FatalError( "clCreateKernel failed: entry point not found." );
 	CHECKCL( error );
+	strncpy( entry, entryPoint, sizeof( entry ) - 1 );
 }
 
 Kernel::Kernel( cl_program& existingProgram, char* entryPoint )
@@ -399,6 +637,41 @@ Kernel::Kernel( cl_program& existingProgram, char* entryPoint )
 	kernel = clCreateKernel( program, entryPoint, &error );
 	if (kernel == 0) FatalError( "clCreateKernel failed: entry point not found." );
 	CHECKCL( error );
+	strncpy( entry, entryPoint, sizeof( entry ) - 1 );
+}
+
+// Specialized method
+// Variants are keyed by file, entry point and the exact define text; the
+// program cache keeps their binaries across launches.
+// ----------------------------------------------------------------------------
+Kernel* Kernel::Specialized( const char* file, const char* entryPoint, const KernelDefines& defines )
+{
+	const string key = string( file ) + "\n" + entryPoint + "\n" + defines.text;
+	for (const Variant& variant : variants) if (variant.key == key) return variant.kernel;
+	Kernel* kernel = new Kernel( (char*)file, (char*)entryPoint, &defines );
+	variants.push_back( { key, kernel } );
+	return kernel;
+}
+
+// KernelDefines methods
+// ----------------------------------------------------------------------------
+KernelDefines& KernelDefines::Set( const char* name )
+{
+	text += string( "#define " ) + name + "\n", lines++;
+	return *this;
+}
+KernelDefines& KernelDefines::Set( const char* name, const int value )
+{
+	text += string( "#define " ) + name + " " + to_string( value ) + "\n", lines++;
+	return *this;
+}
+KernelDefines& KernelDefines::Set( const char* name, const float value )
+{
+	// hex float: exact, and no locale surprises
+	char t[64];
+	sprintf( t, "#define %s (%af)\n", name, value );
+	text += t, lines++;
+	return *this;
 }
 
 // Kernel destructor
@@ -419,6 +692,15 @@ bool Kernel::InitCL()
 	cl_device_id* devices;
 	cl_uint devCount;
 	cl_int error;
+	// an explicit device choice, in code or in the environment, skips GL sharing
+	const char* spec = getenv( "TMPL8_CL_DEVICE" );
+	if (spec) SelectDevice( spec );
+	if (deviceFilter.type != CL_DEVICE_TYPE_ALL || deviceFilter.vendor[0] || deviceFilter.name[0]) return InitComputeCL();
+	// no window in the headless modes, so nothing to share with
+	if (!window) return InitComputeCL();
+	// no platform at all is not an error; the application can run without OpenCL
+	cl_uint platformCount = 0;
+	if (clGetPlatformIDs( 0, NULL, &platformCount ) != CL_SUCCESS || platformCount == 0) return false;
 	if (!CHECKCL( error = getPlatformID( &platform ) )) return false;
 	if (!CHECKCL( error = clGetDeviceIDs( platform, CL_DEVICE_TYPE_ALL, 0, NULL, &devCount ) )) return false;
 	devices = new cl_device_id[devCount];
@@ -459,8 +741,13 @@ bool Kernel::InitCL()
 			{
 				cl_context_properties props[] =
 				{
+				#ifdef _WIN32
 					CL_GL_CONTEXT_KHR, (cl_context_properties)glfwGetWGLContext( window ),
 					CL_WGL_HDC_KHR, (cl_context_properties)wglGetCurrentDC(),
+				#else
+					CL_GL_CONTEXT_KHR, (cl_context_properties)glfwGetGLXContext( window ),
+					CL_GLX_DISPLAY_KHR, (cl_context_properties)glfwGetX11Display(),
+				#endif
 					CL_CONTEXT_PLATFORM, (cl_context_properties)platform, 0
 				};
 				// attempt to create a context with the requested features
@@ -475,13 +762,116 @@ bool Kernel::InitCL()
 			if (deviceUsed > -1) break;
 		}
 	}
-	if (deviceUsed == -1) FatalError( "No capable OpenCL device found." );
-	device = getFirstDevice( context );
+	// no device can share with OpenGL (headless nodes, CPU runtimes): compute only
+	if (deviceUsed == -1)
+	{
+		delete[] devices;
+		return InitComputeCL();
+	}
 	if (!CHECKCL( error )) return false;
+	const cl_device_id used = devices[deviceUsed];
+	delete[] devices;
+	return InitDevice( used );
+}
+
+// InitComputeCL method
+// Context without OpenGL sharing, for headless nodes and CPU runtimes such as
+// PoCL. Takes the first device that passes the filter (see SelectDevice); if
+// the filter has no type, GPUs go first, then accelerators, then CPUs.
+// Results reach the screen by reading buffers back to host memory.
+// ----------------------------------------------------------------------------
+bool Kernel::InitComputeCL()
+{
+	cl_uint platformCount = 0;
+	if (clGetPlatformIDs( 0, NULL, &platformCount ) != CL_SUCCESS || platformCount == 0) return false;
+	cl_platform_id* platforms = new cl_platform_id[platformCount];
+	clGetPlatformIDs( platformCount, platforms, NULL );
+	const cl_device_type order[3] = { CL_DEVICE_TYPE_GPU, CL_DEVICE_TYPE_ACCELERATOR, CL_DEVICE_TYPE_CPU };
+	cl_platform_id platform = 0;
+	cl_device_id chosen = 0;
+	for (int j = 0; j < 3 && !chosen; j++) if (deviceFilter.type & order[j]) for (cl_uint i = 0; i < platformCount && !chosen; i++)
+	{
+		// clGetDeviceIDs fails with CL_DEVICE_NOT_FOUND for an empty type; skip silently
+		cl_uint devCount = 0;
+		if (clGetDeviceIDs( platforms[i], order[j], 0, NULL, &devCount ) != CL_SUCCESS || devCount == 0) continue;
+		cl_device_id* devices = new cl_device_id[devCount];
+		clGetDeviceIDs( platforms[i], order[j], devCount, devices, NULL );
+		for (cl_uint d = 0; d < devCount && !chosen; d++) if (MatchesFilter( devices[d] )) chosen = devices[d], platform = platforms[i];
+		delete[] devices;
+	}
+	delete[] platforms;
+	if (!chosen)
+	{
+		printf( "No OpenCL device matches the selection.\n" );
+		return false;
+	}
+	cl_context_properties props[] = { CL_CONTEXT_PLATFORM, (cl_context_properties)platform, 0 };
+	cl_int error;
+	context = clCreateContext( props, 1, &chosen, NULL, NULL, &error );
+	if (error != CL_SUCCESS) return false;
+	candoInterop = false;
+	return InitDevice( chosen );
+}
+
+// SelectDevice method
+// Filter for the compute-only path: comma-separated terms, each a device type
+// (gpu, cpu, accelerator), vendor:<text> or name:<text>; text matches are
+// case-insensitive substrings. Example: "cpu,vendor:pocl". Also read from the
+// TMPL8_CL_DEVICE environment variable by InitCL.
+// ----------------------------------------------------------------------------
+void Kernel::SelectDevice( const char* spec )
+{
+	deviceFilter = DeviceFilter();
+	string terms( spec );
+	for (size_t start = 0; start < terms.size();)
+	{
+		size_t end = terms.find( ',', start );
+		if (end == string::npos) end = terms.size();
+		string term = terms.substr( start, end - start );
+		start = end + 1;
+		for (char& c : term) c = (char)tolower( c );
+		if (term == "gpu") deviceFilter.type = CL_DEVICE_TYPE_GPU;
+		else if (term == "cpu") deviceFilter.type = CL_DEVICE_TYPE_CPU;
+		else if (term == "accelerator") deviceFilter.type = CL_DEVICE_TYPE_ACCELERATOR;
+		else if (term.compare( 0, 7, "vendor:" ) == 0) strncpy( deviceFilter.vendor, term.c_str() + 7, sizeof( deviceFilter.vendor ) - 1 );
+		else if (term.compare( 0, 5, "name:" ) == 0) strncpy( deviceFilter.name, term.c_str() + 5, sizeof( deviceFilter.name ) - 1 );
+		else if (term.size()) printf( "SelectDevice: ignoring '%s'\n", term.c_str() );
+	}
+}
+
+// MatchesFilter method
+// ----------------------------------------------------------------------------
+bool Kernel::MatchesFilter( cl_device_id dev )
+{
+	char vendor[1024] = "", name[1024] = "";
+	clGetDeviceInfo( dev, CL_DEVICE_VENDOR, sizeof( vendor ), vendor, NULL );
+	clGetDeviceInfo( dev, CL_DEVICE_NAME, sizeof( name ), name, NULL );
+	for (char* c = vendor; *c; c++) *c = (char)tolower( *c );
+	for (char* c = name; *c; c++) *c = (char)tolower( *c );
+	if (deviceFilter.vendor[0] && !strstr( vendor, deviceFilter.vendor )) return false;
+	if (deviceFilter.name[0] && !strstr( name, deviceFilter.name )) return false;
+	return true;
+}
+
+// InitDevice method
+// Shared by both context types: vendor detection and command queues.
+// ----------------------------------------------------------------------------
+bool Kernel::InitDevice( cl_device_id dev )
+{
+	cl_int error;
+	char device_string[1024], device_platform[1024];
+	device = getFirstDevice( context );
 	// print device name
-	clGetDeviceInfo( devices[deviceUsed], CL_DEVICE_NAME, 1024, &device_string, NULL );
-	clGetDeviceInfo( devices[deviceUsed], CL_DEVICE_VERSION, 1024, &device_platform, NULL );
-	printf( "Device # %u, %s (%s)\n", deviceUsed, device_string, device_platform );
+	clGetDeviceInfo( dev, CL_DEVICE_NAME, 1024, &device_string, NULL );
+	clGetDeviceInfo( dev, CL_DEVICE_VERSION, 1024, &device_platform, NULL );
+	printf( "Device: %s (%s)%s\n", device_string, device_platform, candoInterop ? "" : ", compute only" );
+	snprintf( deviceName, sizeof( deviceName ), "%.*s", (int)sizeof( deviceName ) - 1, device_string );
+	// zero-copy buffers avoid transfers on devices that share host memory
+	cl_bool unified = CL_FALSE;
+	cl_device_type deviceType = 0;
+	clGetDeviceInfo( dev, CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof( cl_bool ), &unified, NULL );
+	clGetDeviceInfo( dev, CL_DEVICE_TYPE, sizeof( cl_device_type ), &deviceType, NULL );
+	unifiedMemory = unified == CL_TRUE || (deviceType & CL_DEVICE_TYPE_CPU) != 0;
 	// digest device string
 	char* d = device_string;
 	for (int i = 0; i < strlen( d ); i++) if (d[i] >= 'A' && d[i] <= 'Z') d[i] -= 'A' - 'a';
@@ -556,13 +946,11 @@ bool Kernel::InitCL()
 		printf( "identification failed.\n" );
 	}
 	// create a command-queue
-	queue = clCreateCommandQueue( context, devices[deviceUsed], CL_QUEUE_PROFILING_ENABLE, &error );
+	queue = clCreateCommandQueue( context, dev, CL_QUEUE_PROFILING_ENABLE, &error );
 	if (!CHECKCL( error )) return false;
 	// create a second command queue for asynchronous copies
-	queue2 = clCreateCommandQueue( context, devices[deviceUsed], CL_QUEUE_PROFILING_ENABLE, &error );
+	queue2 = clCreateCommandQueue( context, dev, CL_QUEUE_PROFILING_ENABLE, &error );
 	if (!CHECKCL( error )) return false;
-	// cleanup
-	delete devices;
 	clStarted = true;
 	return true;
 }
@@ -609,23 +997,25 @@ void Kernel::SetArgument( int idx, float4 value ) { CheckCLStarted(); clSetKerne
 void Kernel::Run( const size_t count, const size_t localSize, cl_event* eventToWaitFor, cl_event* eventToSet )
 {
 	CheckCLStarted();
+	ProfileScope scope( entry, eventToSet );
 	cl_int error;
 	if (acqBuffer)
 	{
 		if (!Kernel::candoInterop) FatalError( "OpenGL interop functionality required but not available." );
 		CHECKCL( error = clEnqueueAcquireGLObjects( queue, 1, acqBuffer->GetDevicePtr(), 0, 0, 0 ) );
-		CHECKCL( error = clEnqueueNDRangeKernel( queue, kernel, 1, 0, &count, localSize == 0 ? 0 : &localSize, eventToWaitFor ? 1 : 0, eventToWaitFor, eventToSet ) );
+		CHECKCL( error = clEnqueueNDRangeKernel( queue, kernel, 1, 0, &count, localSize == 0 ? 0 : &localSize, eventToWaitFor ? 1 : 0, eventToWaitFor, scope.Event() ) );
 		CHECKCL( error = clEnqueueReleaseGLObjects( queue, 1, acqBuffer->GetDevicePtr(), 0, 0, 0 ) );
 	}
 	else
 	{
-		CHECKCL( error = clEnqueueNDRangeKernel( queue, kernel, 1, 0, &count, localSize == 0 ? 0 : &localSize, eventToWaitFor ? 1 : 0, eventToWaitFor, eventToSet ) );
+		CHECKCL( error = clEnqueueNDRangeKernel( queue, kernel, 1, 0, &count, localSize == 0 ? 0 : &localSize, eventToWaitFor ? 1 : 0, eventToWaitFor, scope.Event() ) );
 	}
 }
 
 void Kernel::Run2D( const int2 count, const int2 lsize, cl_event* eventToWaitFor, cl_event* eventToSet )
 {
 	CheckCLStarted();
+	ProfileScope scope( entry, eventToSet );
 	size_t workSize[2] = { (size_t)count.x, (size_t)count.y };
 	size_t localSize[2];
 	if (lsize.x > 0 && lsize.y > 0)
@@ -645,11 +1035,93 @@ void Kernel::Run2D( const int2 count, const int2 lsize, cl_event* eventToWaitFor
 	{
 		if (!Kernel::candoInterop) FatalError( "OpenGL interop functionality required but not available." );
 		CHECKCL( error = clEnqueueAcquireGLObjects( queue, 1, acqBuffer->GetDevicePtr(), 0, 0, 0 ) );
-		CHECKCL( error = clEnqueueNDRangeKernel( queue, kernel, 2, 0, workSize, localSize, eventToWaitFor ? 1 : 0, eventToWaitFor, eventToSet ) );
+		CHECKCL( error = clEnqueueNDRangeKernel( queue, kernel, 2, 0, workSize, localSize, eventToWaitFor ? 1 : 0, eventToWaitFor, scope.Event() ) );
 		CHECKCL( error = clEnqueueReleaseGLObjects( queue, 1, acqBuffer->GetDevicePtr(), 0, 0, 0 ) );
 	}
 	else
 	{
-		CHECKCL( error = clEnqueueNDRangeKernel( queue, kernel, 2, 0, workSize, localSize, eventToWaitFor ? 1 : 0, eventToWaitFor, eventToSet ) );
+		CHECKCL( error = clEnqueueNDRangeKernel( queue, kernel, 2, 0, workSize, localSize, eventToWaitFor ? 1 : 0, eventToWaitFor, scope.Event() ) );
+	}
+}
+
+// ProfileScope destructor
+// ----------------------------------------------------------------------------
+ProfileScope::~ProfileScope()
+{
+	if (!Kernel::profiling) return;
+	cl_event e = user ? *user : local;
+	if (!e) return;
+	if (user) clRetainEvent( e ); // the caller releases its own reference
+	Kernel::Track( name, e, chrono::duration<float, milli>( chrono::high_resolution_clock::now() - start ).count() );
+}
+
+// Track method
+// Takes ownership of the event.
+// ----------------------------------------------------------------------------
+void Kernel::Track( const char* name, cl_event e, const float hostMs )
+{
+	int entry = 0;
+	while (entry < (int)profile.size() && strcmp( profile[entry].name, name )) entry++;
+	if (entry == (int)profile.size())
+	{
+		profile.push_back( CLProfile() );
+		strncpy( profile.back().name, name, sizeof( profile.back().name ) - 1 );
+	}
+	pendingEvents.push_back( { e, entry, hostMs } );
+}
+
+// CollectProfile method
+// Non-blocking: events of commands that did not complete yet are kept for
+// the next call. Failed commands are dropped.
+// ----------------------------------------------------------------------------
+void Kernel::CollectProfile()
+{
+	size_t kept = 0;
+	for (size_t i = 0; i < pendingEvents.size(); i++)
+	{
+		const TrackedEvent& tracked = pendingEvents[i];
+		cl_int status = CL_COMPLETE;
+		clGetEventInfo( tracked.e, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof( cl_int ), &status, NULL );
+		if (status > CL_COMPLETE) { pendingEvents[kept++] = tracked; continue; }
+		if (status == CL_COMPLETE)
+		{
+			const cl_profiling_info info[4] = { CL_PROFILING_COMMAND_QUEUED, CL_PROFILING_COMMAND_SUBMIT, CL_PROFILING_COMMAND_START, CL_PROFILING_COMMAND_END };
+			cl_ulong stamp[4] = {};
+			bool valid = true;
+			for (int j = 0; j < 4; j++) valid &= clGetEventProfilingInfo( tracked.e, info[j], sizeof( cl_ulong ), &stamp[j], NULL ) == CL_SUCCESS;
+			// some drivers report equal or slightly out of order stamps for short commands
+			double span[3] = {};
+			if (valid) for (int j = 0; j < 3; j++) span[j] = stamp[j + 1] > stamp[j] ? (stamp[j + 1] - stamp[j]) * 1e-6 : 0;
+			CLProfile& p = profile[tracked.entry];
+			p.count++, p.host += tracked.hostMs;
+			p.queued += span[0], p.submitted += span[1], p.executed += span[2];
+		}
+		clReleaseEvent( tracked.e );
+	}
+	pendingEvents.resize( kept );
+}
+
+// ResetProfile method
+// Keeps the names: pending events refer to them.
+// ----------------------------------------------------------------------------
+void Kernel::ResetProfile()
+{
+	for (CLProfile& p : profile) p.count = 0, p.queued = p.submitted = p.executed = p.host = 0;
+}
+
+// WriteProfile method
+// JSON array with one object per command name; times are per call, in ms.
+// ----------------------------------------------------------------------------
+void Kernel::WriteProfile( FILE* f )
+{
+	fprintf( f, "[" );
+	bool first = true;
+	for (const CLProfile& p : profile) if (p.count)
+	{
+		const double n = p.count;
+		fprintf( f, "%s\n\t{ \"name\": \"%s\", \"count\": %u, \"queuedMs\": %.4f, \"submittedMs\": %.4f, \"executedMs\": %.4f, \"hostMs\": %.4f }",
+			first ? "" : ",", p.name, p.count, p.queued / n, p.submitted / n, p.executed / n, p.host / n );
+		first = false;
 	}
+	fprintf( f, "\n]\n" );
 }
@@ -4,7 +4,9 @@
 class Buffer
 {
 public:
-	enum { DEFAULT = 0, TEXTURE = 8, TARGET = 16, READONLY = 1, WRITEONLY = 2 };
+	// ZEROCOPY: the device works on host memory; pays off on CPUs and
+	// integrated GPUs, see Kernel::unifiedMemory
+	enum { DEFAULT = 0, TEXTURE = 8, TARGET = 16, READONLY = 1, WRITEONLY = 2, ZEROCOPY = 32 };
 	// constructor / destructor
 	Buffer() : hostBuffer( 0 ) {}
 	Buffer( unsigned int N, void* ptr = 0, unsigned int t = DEFAULT );
@@ -14,8 +16,14 @@ public:
 	void CopyToDevice( bool blocking = true );
 	void CopyToDevice2( bool blocking, cl_event* e = 0, const size_t s = 0 );
 	void CopyFromDevice( bool blocking = true );
+	// partial updates; offset and bytes in bytes
+	void CopyRangeToDevice( const size_t offset, const size_t bytes, bool blocking = true, cl_event* e = 0 );
+	void CopyRangeFromDevice( const size_t offset, const size_t bytes, bool blocking = true, cl_event* e = 0 );
 	void CopyTo( Buffer* buffer );
 	void Clear();
+	// mapped access; bytes = 0 maps up to the end of the buffer
+	void* Map( cl_map_flags flags = CL_MAP_READ | CL_MAP_WRITE, const size_t offset = 0, const size_t bytes = 0 );
+	void Unmap( void* mapped );
 	// data members
 	unsigned int* hostBuffer;
 	cl_mem deviceBuffer = 0;
@@ -23,15 +31,75 @@ public:
 	bool ownData, aligned;
 };
 
+// Double-buffered transfers: two device buffers used in turns, so that the
+// host fills one while the kernel reads the other, or reads back one while
+// the kernel writes the other. Transfers run on the second queue; events
+// order them against the kernel runs on the first queue. Per frame:
+//   upload:   fill HostPtr(), Upload(), Run( ..., Ready(), Done() ), Flip()
+//   download: Run( ..., Ready(), Done() ), Download(), Flip(), use Previous()
+class DoubleBuffer
+{
+public:
+	DoubleBuffer( unsigned int N, unsigned int t = Buffer::DEFAULT );
+	~DoubleBuffer();
+	// host memory of the current slot, once its last transfer completed
+	void* HostPtr() { return Host( current ); }
+	// host memory of the other slot; after Flip, the last download
+	void* Previous() { return Host( current ^ 1 ); }
+	void Upload( const size_t bytes = 0 );
+	void Download( const size_t bytes = 0 );
+	Buffer* Device() { return buffer[current]; }
+	// events for the kernel run that uses Device()
+	cl_event* Ready() { return transfer[current] ? &transfer[current] : 0; }
+	cl_event* Done();
+	void Flip() { current ^= 1; }
+private:
+	void* Host( const int slot );
+	Buffer* buffer[2];
+	void* host[2];
+	cl_event transfer[2] = { 0, 0 }, done[2] = { 0, 0 };
+	int current = 0;
+};
+
+// accumulated timings of one kind of OpenCL command, in milliseconds:
+// waiting in the queue (queued to submitted), in the driver (submitted to
+// started) and on the device (started to ended); host is the time spent in
+// the enqueue call itself
+struct CLProfile
+{
+	char name[64] = {};
+	uint count = 0;
+	double queued = 0, submitted = 0, executed = 0, host = 0;
+};
+
+// Compile-time constants for a kernel variant, prepended to the source as
+// #define lines; see Kernel::Specialized
+class KernelDefines
+{
+public:
+	KernelDefines& Set( const char* name );
+	KernelDefines& Set( const char* name, const int value );
+	KernelDefines& Set( const char* name, const float value );
+	string text;
+	int lines = 0;
+};
+
+// device filter for the compute-only path; see Kernel::SelectDevice
+struct DeviceFilter { cl_device_type type = CL_DEVICE_TYPE_ALL; char vendor[64] = {}, name[64] = {}; };
+
 // OpenCL kernel
 class Kernel
 {
 	friend class Buffer;
 public:
 	// constructor / destructor
-	Kernel( char* file, char* entryPoint );
+	Kernel( char* file, char* entryPoint, const KernelDefines* defines = 0 );
 	Kernel( cl_program& existingProgram, char* entryPoint );
 	~Kernel();
+	// variant of a kernel for a set of defines; compiled on first request and
+	// kept for the lifetime of the application
+	static Kernel* Specialized( const char* file, const char* entryPoint, const KernelDefines& defines );
+	static int VariantCount() { return (int)variants.size(); }
 	// get / set
 	cl_kernel& GetKernel() { return kernel; }
 	cl_program& GetProgram() { return program; }
@@ -167,11 +235,22 @@ private:
 	// other methods
 public:
 	static bool InitCL();
+	static bool InitComputeCL();
+	static void SelectDevice( const char* spec );
 	static void CheckCLStarted();
 	static void KillCL();
+	// profiling: commands hand their events to Track; CollectProfile reads
+	// the timestamps of the completed ones, once per frame
+	static void Track( const char* name, cl_event e, const float hostMs );
+	static void CollectProfile();
+	static void ResetProfile();
+	static void WriteProfile( FILE* f );
 private:
+	static bool MatchesFilter( cl_device_id dev );
+	static bool InitDevice( cl_device_id dev );
 	// data members
 	Buffer* acqBuffer = 0;
+	char entry[64] = {};
 	cl_kernel kernel;
 	cl_mem vbo_cl;
 	cl_program program;
@@ -182,6 +261,32 @@ private:
 	inline static bool isNVidia = false, isAMD = false, isIntel = false, isOther = false;
 	inline static bool isAmpere = false, isTuring = false, isPascal = false;
 	inline static int vendorLines = 0;
+	struct Variant { string key; Kernel* kernel; };
+	inline static vector<Variant> variants;
+	struct TrackedEvent { cl_event e; int entry; float hostMs; };
+	inline static vector<TrackedEvent> pendingEvents;
 public:
 	inline static bool candoInterop = false, clStarted = false;
+	inline static bool unifiedMemory = false; // device shares host memory: CPU or integrated GPU
+	inline static DeviceFilter deviceFilter;
+	inline static char deviceName[256] = {};
+	// compiled programs are kept here, keyed by source, options and driver
+	inline static bool programCache = true;
+	inline static const char* programCacheDir = "clcache";
+	inline static bool profiling = false;
+	inline static vector<CLProfile> profile;
+};
+
+// Profiled enqueue: supplies an event to the command when profiling is on,
+// even if the caller asked for none, and tracks it when the scope ends.
+class ProfileScope
+{
+public:
+	ProfileScope( const char* name, cl_event* eventToSet ) : name( name ), user( eventToSet ) {}
+	~ProfileScope();
+	cl_event* Event() { return Kernel::profiling && !user ? &local : user; }
+private:
+	const char* name;
+	cl_event* user, local = 0;
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
 };
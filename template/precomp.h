@@ -8,15 +8,31 @@
 #include <list>
 #include <string>
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 #include <math.h>
 #include <algorithm>
 #include <assert.h>
+#ifdef _WIN32
 #include <io.h>
+#else
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#endif
+
+// OpenMP runtime, for thread counts and worker ids
+#include <omp.h>
 
 // header for AVX, and every technology before it.
 // if your CPU does not support this (unlikely), include the appropriate header instead.
 // see: https://stackoverflow.com/a/11228864/2844473
 #include <immintrin.h>
+#if !defined(_MSC_VER) && !defined(__SSE4_2__)
+#error "build with -msse4.2: it is the lowest level of the SIMD dispatch (see simd.h)"
+#endif
 
 // basic types
 typedef unsigned char uchar;
@@ -35,6 +51,7 @@ using namespace std;
 
 // clang-format off
 
+#ifdef _WIN32
 // windows.h: disable as much as possible to speed up compilation.
 #define NOMINMAX
 #ifndef WIN32_LEAN_AND_MEAN
@@ -79,6 +96,7 @@ using namespace std;
 #define NOMCX
 #define NOIME
 #include "windows.h"
+#endif
 
 // aligned memory allocations
 #ifdef _MSC_VER
@@ -104,7 +122,10 @@ using namespace std;
 #include "imgui_impl_opengl3.h"
 
 // template headers
+#include "allocator.h"
 #include "surface.h"
+#include "assets.h"
+#include "network.h"
 
 // namespaces
 using namespace Tmpl8;
@@ -114,13 +135,18 @@ using namespace Tmpl8;
 
 // OpenCL headers
 #define CL_USE_DEPRECATED_OPENCL_2_0_APIS // safe; see https://stackoverflow.com/a/28500846
-#include "cl/cl.h"
-#include <cl/cl_gl_ext.h>
+#include "CL/cl.h"
+#include <CL/cl_gl_ext.h>
 
 // GLFW
 #define GLFW_USE_CHDIR 0
+#ifdef _WIN32
 #define GLFW_EXPOSE_NATIVE_WIN32
 #define GLFW_EXPOSE_NATIVE_WGL
+#else
+#define GLFW_EXPOSE_NATIVE_X11
+#define GLFW_EXPOSE_NATIVE_GLX
+#endif
 #include <glad.h>
 #include <GLFW/glfw3.h>
 #include <GLFW/glfw3native.h>
@@ -164,13 +190,24 @@ protected:
 	friend class JobThread;
 	void RunCodeWrapper();
 };
+class JobEvent	// auto-reset event
+{
+public:
+	void Set();
+	void Wait();
+private:
+	mutex m_Mutex;
+	condition_variable m_Signal;
+	bool m_Set = false;
+};
 class JobThread
 {
 public:
 	void CreateAndStartThread( unsigned int threadId );
 	void Go();
 	void BackgroundTask();
-	HANDLE m_GoSignal, m_ThreadHandle;
+	JobEvent m_GoSignal;
+	thread m_Thread;
 	int m_ThreadID;
 };
 class JobManager	// singleton class!
@@ -192,17 +229,37 @@ protected:
 	Job* GetNextJob();
 	static JobManager* m_JobManager;
 	Job* m_JobList[4096];
-	CRITICAL_SECTION m_CS;
-	HANDLE m_ThreadDone[64];
+	mutex m_CS;
+	JobEvent m_ThreadDone[64];
 	unsigned int m_NumThreads, m_JobCount;
 	JobThread* m_JobThreadList;
 };
 
+// processor topology, for thread pinning and NUMA-aware work distribution
+struct LogicalProcessor
+{
+	uint group, index;	// processor group and number in that group; on Linux: group 0, cpu id
+	uint core, sibling;	// physical core, and SMT sibling index on that core
+	uint node;			// NUMA node
+};
+class Topology	// singleton class!
+{
+public:
+	static const Topology& Get();
+	static void PinCurrentThread( const LogicalProcessor* lp ); // pass 0 to unpin
+	vector<LogicalProcessor> processors; // sorted by node, core, sibling
+	uint coreCount = 0, nodeCount = 1;
+private:
+	Topology();
+};
+
 // forward declaration of helper functions
 void FatalError( const char* fmt, ... );
 bool FileIsNewer( const char* file1, const char* file2 );
 bool FileExists( const char* f );
 bool RemoveFile( const char* f );
+bool CreateDir( const char* path );
+uint ProcessId();
 string TextFileRead( const char* _File );
 int LineCount( const string s );
 void TextFileWrite( const string& text, const char* _File );
@@ -219,14 +276,14 @@ void TextFileWrite( const string& text, const char* _File );
 #include <iostream>
 #include <bitset>
 #include <array>
-#include <intrin.h>
 
 // instruction set detection
 #ifdef _WIN32
+#include <intrin.h>
 #define cpuid(info, x) __cpuidex(info, x, 0)
 #else
 #include <cpuid.h>
-void cpuid( int info[4], int InfoType ) { __cpuid_count( InfoType, 0, info[0], info[1], info[2], info[3] ); }
+inline void cpuid( int info[4], int InfoType ) { __cpuid_count( InfoType, 0, info[0], info[1], info[2], info[3] ); }
 #endif
 class CPUCaps // from https://github.com/Mysticial/FeatureDetector
 {
@@ -255,6 +312,7 @@ public:
 	static inline bool HW_FMA3 = false;
 	static inline bool HW_FMA4 = false;
 	static inline bool HW_AVX2 = false;
+	static inline bool HW_F16C = false;
 	// SIMD: 512-bit
 	static inline bool HW_AVX512F = false;    //  AVX512 Foundation
 	static inline bool HW_AVX512CD = false;   //  AVX512 Conflict Detection
@@ -287,6 +345,7 @@ public:
 			HW_AES = (info[2] & ((int)1 << 25)) != 0;
 			HW_AVX = (info[2] & ((int)1 << 28)) != 0;
 			HW_FMA3 = (info[2] & ((int)1 << 12)) != 0;
+			HW_F16C = (info[2] & ((int)1 << 29)) != 0;
 			HW_RDRAND = (info[2] & ((int)1 << 30)) != 0;
 		}
 		if (nIds >= 0x00000007)
@@ -319,6 +378,7 @@ public:
 		}
 	}
 };
+#include "simd.h"
 
 // helper function for conversion of f32 colors to int
 inline uint RGBF32_to_RGB8( const float4* v )
@@ -347,6 +407,7 @@ public:
 	virtual void Tick( float deltaTime ) = 0;
 	virtual void UI() { uiUpdated = false; }
 	virtual void Shutdown() { /* defined empty so we can omit it from the renderer */ }
+	virtual bool RunHeadless( int argc, char** argv ) { return false; /* command line modes without a window; true when handled */ }
 	virtual void MouseUp( int button ) { /* defined empty so we can omit it from the renderer */ }
 	virtual void MouseDown( int button ) { /* defined empty so we can omit it from the renderer */ }
 	virtual void MouseMove( int x, int y ) { /* defined empty so we can omit it from the renderer */ }
@@ -366,6 +427,8 @@ public:
 	void Tick() {}
 };
 
+#include "sdf.h"
+#include "stressscene.h"
 #include "scene.h"
 #include "camera.h"
 #include "renderer.h"
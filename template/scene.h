@@ -16,12 +16,17 @@
 // Some speed tricks that severely affect maintainability
 // are enclosed in #ifdef SPEEDTRIX / #endif. Mind these
 // if you plan to alter the scene in any way.
+// With STATICSCENE, the intersection of the analytic
+// primitives is generated from the Showroom description in
+// staticscene.h instead. SDF objects are in sdf.h; many
+// random objects for scaling tests in stressscene.h.
 // -----------------------------------------------------------
 
 // INFOMOV'23: don't disable these
 #define SPEEDTRIX
 #define FOURLIGHTS
 #define USEBVH
+#define STATICSCENE
 
 #define PLANE_X(o,i) {t=-(ray.O.x+o)*ray.rD.x;if(t<ray.t&&t>0)ray.t=t,ray.objIdx=i;}
 #define PLANE_Y(o,i) {t=-(ray.O.y+o)*ray.rD.y;if(t<ray.t&&t>0)ray.t=t,ray.objIdx=i;}
@@ -29,15 +34,20 @@
 
 namespace Tmpl8 {
 
-    __declspec( align( 64 ) ) class Ray {
+    class ALIGN( 64 ) Ray {
     public:
         Ray() = default;
         Ray( const float3 origin, const float3 direction, const float distance = 1e34f, const int idx = -1 ) {
-            O = origin, D = direction, t = distance;
+            t = distance;
             // calculate reciprocal ray direction for triangles and AABBs
+#ifndef SPEEDTRIX
+            O = origin, D = direction;
             rD = float3( 1 / D.x, 1 / D.y, 1 / D.z );
-#ifdef SPEEDTRIX
-            d0 = 1, d1 = d2 = 0; // ready for SIMD matrix math
+#else
+            // w is 1 for the origin, 0 for directions: ready for SIMD matrix math
+            O4 = _mm_setr_ps( origin.x, origin.y, origin.z, 1 );
+            D4 = _mm_setr_ps( direction.x, direction.y, direction.z, 0 );
+            rD4 = _mm_setr_ps( 1 / direction.x, 1 / direction.y, 1 / direction.z, 0 );
 #endif
             objIdx = idx;
         }
@@ -46,9 +56,9 @@ namespace Tmpl8 {
 #ifndef SPEEDTRIX
         float3 O, D, rD;
 #else
-        union { struct { float3 O; float d0; }; __m128 O4; };
-        union { struct { float3 D; float d1; }; __m128 D4; };
-        union { struct { float3 rD; float d2; }; __m128 rD4; };
+        union { float3 O; __m128 O4; };
+        union { float3 D; __m128 D4; };
+        union { float3 rD; __m128 rD4; };
 #endif
         float t = 1e34f;
         int objIdx = -1;
@@ -148,31 +158,41 @@ namespace Tmpl8 {
                 if ( ix == 98 && iz == 98 ) ix = (int) ( I.x * 32.01f ), iz = (int) ( I.z * 32.01f );
                 if ( ix == 94 && iz == 98 ) ix = (int) ( I.x * 64.01f ), iz = (int) ( I.z * 64.01f );
                 return float3( ( ( ix + iz ) & 1 ) ? 1 : 0.3f );
-            } else if ( N.z == -1 ) {
-                // back wall: logo
-                static Surface logo( "../assets/logo.png" );
-                int ix = (int) ( ( I.x + 4 ) * ( 128.0f / 8 ) ), iy = (int) ( ( 2 - I.y ) * ( 64.0f / 3 ) );
-                uint p = logo.pixels[( ix & 127 ) + ( iy & 63 ) * 128];
-                uint3 i3( ( p >> 16 ) & 255, ( p >> 8 ) & 255, p & 255 );
-                return float3( i3 ) * ( 1.0f / 255.0f );
-            } else if ( N.x == 1 ) {
-                // left wall: red
-                static Surface red( "../assets/red.png" );
-                int ix = (int) ( ( I.z - 4 ) * ( 512.0f / 7 ) ), iy = (int) ( ( 2 - I.y ) * ( 512.0f / 3 ) );
-                uint p = red.pixels[( ix & 511 ) + ( iy & 511 ) * 512];
-                uint3 i3( ( p >> 16 ) & 255, ( p >> 8 ) & 255, p & 255 );
-                return float3( i3 ) * ( 1.0f / 255.0f );
-            } else if ( N.x == -1 ) {
-                // right wall: blue
-                static Surface blue( "../assets/blue.png" );
-                int ix = (int) ( ( I.z - 4 ) * ( 512.0f / 7 ) ), iy = (int) ( ( 2 - I.y ) * ( 512.0f / 3 ) );
-                uint p = blue.pixels[( ix & 511 ) + ( iy & 511 ) * 512];
+            }
+            Texturing t;
+            if ( GetTexturing( t ) ) {
+                // walls: logo, red or blue texture
+                const Surface& tex = *t.surface;
+                int ix = (int) ( ( I.cell[t.axis] + t.offset ) * t.scale ), iy = (int) ( ( 2 - I.y ) * t.yScale );
+                uint p = tex.pixels[( ix & ( tex.width - 1 ) ) + ( iy & ( tex.height - 1 ) ) * tex.width];
                 uint3 i3( ( p >> 16 ) & 255, ( p >> 8 ) & 255, p & 255 );
                 return float3( i3 ) * ( 1.0f / 255.0f );
             }
             return float3( 0.93f );
         }
 
+        // wall textures, shared with the batched shading code; mapped from the
+        // texture cache on first use, or up front by Preload
+        static const Surface& Logo() { static const Surface& logo = TextureCache::GetSurface( "../assets/logo.png" ); return logo; }
+        static const Surface& Red() { static const Surface& red = TextureCache::GetSurface( "../assets/red.png" ); return red; }
+        static const Surface& Blue() { static const Surface& blue = TextureCache::GetSurface( "../assets/blue.png" ); return blue; }
+        // texture mapping of the textured walls, shared with the batched shading
+        // code: texel x from I.cell[axis], texel y from the height below y = 2;
+        // texture sizes are powers of two, so texel coordinates wrap by masking
+        struct Texturing { const Surface* surface; int axis; float offset, scale, yScale; };
+        bool GetTexturing( Texturing& t ) const {
+            if ( N.z == -1 ) t = { &Logo(), 0, 4, 128.0f / 8, 64.0f / 3 };            // back wall: logo
+            else if ( N.x == 1 ) t = { &Red(), 2, -4, 512.0f / 7, 512.0f / 3 };      // left wall: red
+            else if ( N.x == -1 ) t = { &Blue(), 2, -4, 512.0f / 7, 512.0f / 3 };    // right wall: blue
+            else return false;
+            return true;
+        }
+        static void Preload() {
+            // in parallel: on a cold start, each texture is decoded by its own thread
+#pragma omp parallel for schedule(dynamic)
+            for ( int i = 0; i < 3; i++ ) i == 0 ? Logo() : i == 1 ? Red() : Blue();
+        }
+
         float3 N;
         float d;
         int objIdx = -1;
@@ -219,8 +239,8 @@ namespace Tmpl8 {
             __m128 t2 = _mm_mul_ps( _mm_sub_ps( bmax4, o4 ), rd4 );
             __m128 vmax4 = _mm_max_ps( t1, t2 );
             __m128 vmin4 = _mm_min_ps( t1, t2 );
-            float tmax = min( vmax4.m128_f32[0], min( vmax4.m128_f32[1], vmax4.m128_f32[2] ) );
-            float tmin = max( vmin4.m128_f32[0], max( vmin4.m128_f32[1], vmin4.m128_f32[2] ) );
+            float tmax = min( Lane( vmax4, 0 ), min( Lane( vmax4, 1 ), Lane( vmax4, 2 ) ) );
+            float tmin = max( Lane( vmin4, 0 ), max( Lane( vmin4, 1 ), Lane( vmin4, 2 ) ) );
             if ( tmin < tmax ) if ( tmin > 0 ) {
                 if ( tmin < ray.t ) {
                     ray.t = tmin;
@@ -278,8 +298,8 @@ namespace Tmpl8 {
             __m128 t1 = _mm_mul_ps( _mm_sub_ps( bmin4, o4 ), rd4 );
             __m128 t2 = _mm_mul_ps( _mm_sub_ps( bmax4, o4 ), rd4 );
             __m128 vmax4 = _mm_max_ps( t1, t2 ), vmin4 = _mm_min_ps( t1, t2 );
-            float tmax = min( vmax4.m128_f32[0], min( vmax4.m128_f32[1], vmax4.m128_f32[2] ) );
-            float tmin = max( vmin4.m128_f32[0], max( vmin4.m128_f32[1], vmin4.m128_f32[2] ) );
+            float tmax = min( Lane( vmax4, 0 ), min( Lane( vmax4, 1 ), Lane( vmax4, 2 ) ) );
+            float tmin = max( Lane( vmin4, 0 ), max( Lane( vmin4, 1 ), Lane( vmin4, 2 ) ) );
             return tmax > 0 && tmin < tmax && tmin < ray.t;
 #else
             float3 O = TransformPosition_SSE( ray.O4, invM );
@@ -401,7 +421,7 @@ namespace Tmpl8 {
     class Torus {
     public:
         Torus() = default;
-        Torus::Torus( int idx, float a, float b ): objIdx( idx ) {
+        Torus( int idx, float a, float b ): objIdx( idx ) {
             rc2 = a * a, rt2 = b * b;
             T = invT = mat4::Identity();
             r2 = sqrf( a + b );
@@ -581,7 +601,7 @@ namespace Tmpl8 {
             return TransformVector( N, T );
         }
 
-        float3 Torus::GetAlbedo( const float3 I ) const {
+        float3 GetAlbedo( const float3 I ) const {
             return float3( 1 ); // material.albedo;
         }
 
@@ -642,6 +662,16 @@ namespace Tmpl8 {
             sphere.pos = float3( -1.8f, -0.4f + tm, 1 );
         }
 
+        void GetRoomBounds( float3& bmin, float3& bmax ) const {
+            // the box enclosed by the six axis-aligned walls: a plane holds
+            // the points P with dot( P, N ) = -d
+            bmin = float3( 1e30f ), bmax = float3( -1e30f );
+            for ( int i = 0; i < 6; i++ ) for ( int a = 0; a < 3; a++ ) if ( plane[i].N.cell[a] != 0 ) {
+                bmin[a] = min( bmin[a], -plane[i].d * plane[i].N.cell[a] );
+                bmax[a] = max( bmax[a], -plane[i].d * plane[i].N.cell[a] );
+            }
+        }
+
         float3 GetLightPos() const {
 #ifndef FOURLIGHTS
             // light point position is the middle of the swinging quad
@@ -654,6 +684,15 @@ namespace Tmpl8 {
 #endif
         }
 
+        float3 GetLightPos( const uint idx ) const {
+#ifndef FOURLIGHTS
+            return GetLightPos();
+#else
+            // center of the specified light; matches the hardcoded quads in FindNearest
+            return float3( ( idx == 1 || idx == 2 ) ? 1.0f : -1.0f, 1.5f, idx < 2 ? -1.0f : 1.0f );
+#endif
+        }
+
         float3 RandomPointOnLight( const float r0, const float r1 ) const {
 #ifndef FOURLIGHTS
             // get a random position on the swinging quad
@@ -725,7 +764,90 @@ namespace Tmpl8 {
 #endif
         }
 
+        // signed distance field objects, see sdf.h; objIdx SDFBASE + index
+        int AddSDF( const SDF::Shape shape, const float3 pos, const float3 size, const float param, const float3 albedo ) {
+            if ( sdfCount == MAXSDFS ) return -1;
+            sdf[sdfCount] = SDF( SDFBASE + sdfCount, shape, pos, size, param, albedo );
+            return sdf[sdfCount++].objIdx;
+        }
+
+        // one of each shape, on the floor in front of the camera
+        void ShowSDFs( const bool show ) {
+            sdfCount = 0;
+            if ( !show ) return;
+            AddSDF( SDF::ROUNDBOX, float3( -1.3f, -0.71f, 0.3f ), float3( 0.28f ), 0.08f, float3( 0.9f, 0.55f, 0.2f ) );
+            AddSDF( SDF::BLEND, float3( -0.45f, -0.77f, 0.5f ), float3( 0.22f ), 0.1f, float3( 0.3f, 0.8f, 0.4f ) );
+            AddSDF( SDF::TWISTEDTORUS, float3( 0.45f, -0.56f, 0.4f ), float3( 0.32f, 0.1f, 0 ), 2, float3( 0.85f ) );
+            AddSDF( SDF::MENGER, float3( 1.3f, -0.69f, 0.3f ), float3( 0.3f ), 3, float3( 0.9f, 0.9f, 0.95f ) );
+        }
+
         void FindNearest( Ray& ray ) const {
+            IntersectAnalytic( ray );
+            if ( stress ) stress->Intersect( ray, animTime, STRESSBASE );
+            for ( int i = 0; i < sdfCount; i++ ) {
+                const float t = sdf[i].March( ray.O, ray.D, ray.t );
+                if ( t < ray.t ) ray.t = t, ray.objIdx = sdf[i].objIdx;
+            }
+        }
+
+        // a batch of rays, stride bytes apart, e.g. a wavefront; with AVX2
+        // the SDFs are traced 8 rays at a time
+        void FindNearest( Ray* rays, const int count, const int stride ) const {
+            const bool packets = sdfCount > 0 && SIMD::level >= SIMD::AVX2;
+            for ( int i = 0; i < count; i++ ) {
+                Ray& ray = *(Ray*) ( (char*) rays + (size_t) i * stride );
+                if ( !packets ) FindNearest( ray );
+                else {
+                    IntersectAnalytic( ray );
+                    if ( stress ) stress->Intersect( ray, animTime, STRESSBASE );
+                }
+            }
+            if ( packets ) IntersectSDFs8( rays, count, stride );
+        }
+
+        bool IsOccluded( const Ray& ray ) const {
+            if ( OccludedAnalytic( ray ) ) return true;
+            if ( stress && stress->IsOccluded( ray, animTime ) ) return true;
+            for ( int i = 0; i < sdfCount; i++ ) if ( sdf[i].March( ray.O, ray.D, ray.t ) < ray.t ) return true;
+            return false;
+        }
+
+        SIMD_AVX2 void IntersectSDFs8( Ray* rays, const int count, const int stride ) const {
+            for ( int i = 0; i < count; i += 8 ) {
+                // up to 8 rays in SoA form; idle lanes get t = 0
+                alignas( 32 ) float o[3][8], d[3][8], t[8];
+                int idx[8];
+                const int n = min( 8, count - i );
+                for ( int j = 0; j < 8; j++ ) {
+                    const Ray& r = *(Ray*) ( (char*) rays + (size_t) ( i + min( j, n - 1 ) ) * stride );
+                    for ( int a = 0; a < 3; a++ ) o[a][j] = r.O.cell[a], d[a][j] = r.D.cell[a];
+                    t[j] = j < n ? r.t : 0, idx[j] = -1;
+                }
+                const __m256 Ox = _mm256_load_ps( o[0] ), Oy = _mm256_load_ps( o[1] ), Oz = _mm256_load_ps( o[2] );
+                const __m256 Dx = _mm256_load_ps( d[0] ), Dy = _mm256_load_ps( d[1] ), Dz = _mm256_load_ps( d[2] );
+                __m256 t8 = _mm256_load_ps( t );
+                for ( int s = 0; s < sdfCount; s++ ) {
+                    const __m256 h = sdf[s].March8( Ox, Oy, Oz, Dx, Dy, Dz, t8 );
+                    const int closer = _mm256_movemask_ps( _mm256_cmp_ps( h, t8, _CMP_LT_OQ ) );
+                    if ( closer == 0 ) continue;
+                    t8 = _mm256_min_ps( t8, h );
+                    for ( int j = 0; j < 8; j++ ) if ( ( closer >> j ) & 1 ) idx[j] = sdf[s].objIdx;
+                }
+                _mm256_store_ps( t, t8 );
+                for ( int j = 0; j < n; j++ ) if ( idx[j] >= 0 ) {
+                    Ray& r = *(Ray*) ( (char*) rays + (size_t) ( i + j ) * stride );
+                    r.t = t[j], r.objIdx = idx[j];
+                }
+            }
+        }
+
+        // the analytic primitives, without the SDFs
+#ifdef STATICSCENE
+        // generated from the Showroom type list, see staticscene.h
+        void IntersectAnalytic( Ray& ray ) const;
+        bool OccludedAnalytic( const Ray& ray ) const;
+#else
+        void IntersectAnalytic( Ray& ray ) const {
             // room walls - ugly shortcut for more speed
 #ifdef SPEEDTRIX
             // prefetching
@@ -744,16 +866,16 @@ namespace Tmpl8 {
 #ifdef FOURLIGHTS
             {
                 const __m128 tq4 = _mm_div_ps( _mm_add_ps( _mm_set1_ps( ray.O.y ), _mm_set1_ps( -1.5f ) ), _mm_xor_ps( _mm_set1_ps( ray.D.y ), _mm_set1_ps( -0.0f ) ) );
-                const __m128 Ix4 = _mm_add_ps( _mm_add_ps( _mm_set1_ps( ray.O.x ), { 1, -1, -1, 1 } ), _mm_mul_ps( tq4, _mm_set1_ps( ray.D.x ) ) );
-                const __m128 Iz4 = _mm_add_ps( _mm_add_ps( _mm_set1_ps( ray.O.z ), { 1, 1, -1, -1 } ), _mm_mul_ps( tq4, _mm_set1_ps( ray.D.z ) ) );
+                const __m128 Ix4 = _mm_add_ps( _mm_add_ps( _mm_set1_ps( ray.O.x ), _mm_setr_ps( 1, -1, -1, 1 ) ), _mm_mul_ps( tq4, _mm_set1_ps( ray.D.x ) ) );
+                const __m128 Iz4 = _mm_add_ps( _mm_add_ps( _mm_set1_ps( ray.O.z ), _mm_setr_ps( 1, 1, -1, -1 ) ), _mm_mul_ps( tq4, _mm_set1_ps( ray.D.z ) ) );
                 const __m128 hitmask = _mm_and_ps( _mm_and_ps( _mm_cmpgt_ps( Ix4, _mm_set1_ps( -0.25f ) ), _mm_cmplt_ps( Ix4, _mm_set1_ps( 0.25f ) ) ), _mm_and_ps( _mm_cmpgt_ps( Iz4, _mm_set1_ps( -0.25f ) ), _mm_cmplt_ps( Iz4, _mm_set1_ps( 0.25f ) ) ) );
                 const __m128 valmask = _mm_and_ps( _mm_cmplt_ps( tq4, _mm_set_ps1( ray.t ) ), _mm_cmpgt_ps( tq4, _mm_setzero_ps() ) );
                 const __m128 mask = _mm_and_ps( hitmask, valmask );
                 const __m128 ft4 = _mm_blendv_ps( _mm_set_ps1( 1e34f ), tq4, mask );
-                if ( ft4.m128_f32[0] < ray.t ) ray.t = ft4.m128_f32[0], ray.objIdx = 0;
-                if ( ft4.m128_f32[1] < ray.t ) ray.t = ft4.m128_f32[1], ray.objIdx = 0;
-                if ( ft4.m128_f32[2] < ray.t ) ray.t = ft4.m128_f32[2], ray.objIdx = 0;
-                if ( ft4.m128_f32[3] < ray.t ) ray.t = ft4.m128_f32[3], ray.objIdx = 0;
+                if ( Lane( ft4, 0 ) < ray.t ) ray.t = Lane( ft4, 0 ), ray.objIdx = 0;
+                if ( Lane( ft4, 1 ) < ray.t ) ray.t = Lane( ft4, 1 ), ray.objIdx = 0;
+                if ( Lane( ft4, 2 ) < ray.t ) ray.t = Lane( ft4, 2 ), ray.objIdx = 0;
+                if ( Lane( ft4, 3 ) < ray.t ) ray.t = Lane( ft4, 3 ), ray.objIdx = 0;
             }
 #else
             quad.Intersect( ray );
@@ -789,7 +911,7 @@ namespace Tmpl8 {
             torus.Intersect( ray );
         }
 
-        bool IsOccluded( const Ray& ray ) const {
+        bool OccludedAnalytic( const Ray& ray ) const {
             if ( cube.IsOccluded( ray ) ) return true;
 #ifdef SPEEDTRIX
             const float3 oc = ray.O - sphere.pos;
@@ -807,8 +929,8 @@ namespace Tmpl8 {
 #ifdef FOURLIGHTS
             {
                 const __m128 tq4 = _mm_div_ps( _mm_add_ps( _mm_set1_ps( ray.O.y ), _mm_set1_ps( -1.5f ) ), _mm_xor_ps( _mm_set1_ps( ray.D.y ), _mm_set1_ps( -0.0f ) ) );
-                const __m128 Ix4 = _mm_add_ps( _mm_add_ps( _mm_set1_ps( ray.O.x ), { 1, -1, -1, 1 } ), _mm_mul_ps( tq4, _mm_set1_ps( ray.D.x ) ) );
-                const __m128 Iz4 = _mm_add_ps( _mm_add_ps( _mm_set1_ps( ray.O.z ), { 1, 1, -1, -1 } ), _mm_mul_ps( tq4, _mm_set1_ps( ray.D.z ) ) );
+                const __m128 Ix4 = _mm_add_ps( _mm_add_ps( _mm_set1_ps( ray.O.x ), _mm_setr_ps( 1, -1, -1, 1 ) ), _mm_mul_ps( tq4, _mm_set1_ps( ray.D.x ) ) );
+                const __m128 Iz4 = _mm_add_ps( _mm_add_ps( _mm_set1_ps( ray.O.z ), _mm_setr_ps( 1, 1, -1, -1 ) ), _mm_mul_ps( tq4, _mm_set1_ps( ray.D.z ) ) );
                 const __m128 hitmask = _mm_and_ps( _mm_and_ps( _mm_cmpgt_ps( Ix4, _mm_set1_ps( -0.25f ) ), _mm_cmplt_ps( Ix4, _mm_set1_ps( 0.25f ) ) ), _mm_and_ps( _mm_cmpgt_ps( Iz4, _mm_set1_ps( -0.25f ) ), _mm_cmplt_ps( Iz4, _mm_set1_ps( 0.25f ) ) ) );
                 const __m128 valmask = _mm_and_ps( _mm_cmplt_ps( tq4, _mm_set_ps1( ray.t ) ), _mm_cmpgt_ps( tq4, _mm_setzero_ps() ) );
                 int hit = _mm_movemask_ps( _mm_and_ps( hitmask, valmask ) );
@@ -820,6 +942,7 @@ namespace Tmpl8 {
             if ( torus.IsOccluded( ray ) ) return true;
             return false; // skip planes and rounded corners
         }
+#endif
 
         float3 GetNormal( const int objIdx, const float3 I, const float3 wo ) const {
             // we get the normal after finding the nearest intersection:
@@ -835,6 +958,8 @@ namespace Tmpl8 {
             else if ( objIdx == 2 ) N = sphere2.GetNormal( I );
             else if ( objIdx == 3 ) N = cube.GetNormal( I );
             else if ( objIdx == 10 ) N = torus.GetNormal( I );
+            else if ( objIdx >= STRESSBASE ) N = stress->GetNormal( objIdx - STRESSBASE, I, animTime );
+            else if ( objIdx >= SDFBASE ) N = sdf[objIdx - SDFBASE].GetNormal( I );
             else {
                 // faster to handle the 6 planes without a call to GetNormal
                 N = float3( 0 );
@@ -856,18 +981,22 @@ namespace Tmpl8 {
             if ( objIdx == 2 ) return sphere2.GetAlbedo( I );
             if ( objIdx == 3 ) return cube.GetAlbedo( I );
             if ( objIdx == 10 ) return torus.GetAlbedo( I );
+            if ( objIdx >= STRESSBASE ) return stress->GetAlbedo( objIdx - STRESSBASE );
+            if ( objIdx >= SDFBASE ) return sdf[objIdx - SDFBASE].GetAlbedo( I );
             return plane[objIdx - 4].GetAlbedo( I );
             // once we have triangle support, we should pass objIdx and the bary-
             // centric coordinates of the hit, instead of the intersection location.
         }
 
         float GetReflectivity( int objIdx, float3 I ) const {
+            if ( objIdx >= STRESSBASE ) return StressScene::reflectivity[stress->GetMaterial( objIdx - STRESSBASE )];
             if ( objIdx == 1 /* ball */ ) return 1;
             if ( objIdx == 6 /* floor */ ) return 0.3f;
             return 0;
         }
 
         float GetRefractivity( int objIdx, float3 I ) const {
+            if ( objIdx >= STRESSBASE ) return StressScene::refractivity[stress->GetMaterial( objIdx - STRESSBASE )];
             return ( objIdx == 3 || objIdx == 10 ) ? 1.0f : 0.0f;
         }
 
@@ -875,7 +1004,7 @@ namespace Tmpl8 {
             return objIdx == 3 ? float3( 0.5f, 0, 0.5f ) : float3( 0 );
         }
 
-        __declspec( align( 64 ) ) // start a new cacheline here
+        ALIGN( 64 ) // start a new cacheline here
         float animTime = 0;
 #ifdef FOURLIGHTS
         Quad quad[4];
@@ -887,6 +1016,14 @@ namespace Tmpl8 {
         Cube cube;
         Plane plane[6];
         Torus torus;
+        static constexpr int SDFBASE = 11, MAXSDFS = 8;
+        SDF sdf[MAXSDFS];
+        int sdfCount = 0;
+        // optional stress scene, owned elsewhere; copies of the scene share it
+        static constexpr int STRESSBASE = SDFBASE + MAXSDFS;
+        const StressScene* stress = 0;
     };
 
-}
\ No newline at end of file
+}
+
+#include "staticscene.h"
\ No newline at end of file
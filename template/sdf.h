@@ -0,0 +1,335 @@
+#pragma once
+
+// -----------------------------------------------------------
+// sdf.h
+// Signed distance field primitives: rounded boxes, a CSG
+// blend, twisted tori and Menger sponges. Rays are sphere
+// traced: each step advances by the distance to the surface,
+// divided by a Lipschitz bound for fields that stretch space.
+// March traces one ray, March8 eight rays at once with AVX2;
+// both clip the ray to the bounding box of the field first.
+// Normals are analytic gradients. Fields are placed, not
+// rotated: they are evaluated at p - pos.
+// -----------------------------------------------------------
+
+namespace Tmpl8 {
+
+    class SDF {
+    public:
+        enum Shape {
+            ROUNDBOX = 0,       // size: half extents; param: corner radius
+            BLEND,              // box of half extents size, merged with a sphere of radius size.x
+                                // on top, minus a hole of radius size.y / 2 along z; param: blend radius
+            TWISTEDTORUS,       // ring of radius size.x in the xy plane, tube radius size.y, twisted
+                                // around y by param radians per unit of height
+            MENGER,             // Menger sponge of half extent size.x; param: iterations
+            SHAPES
+        };
+        static constexpr int MAXSTEPS = 128;
+        static constexpr float HIT = 1e-4f;     // surface distance that counts as a hit
+        static constexpr float MARGIN = 0.01f;  // bounding box padding; entering rays start outside HIT
+
+        SDF() = default;
+        SDF( int idx, Shape s, float3 p, float3 sz, float k, float3 a ):
+            pos( p ), size( sz ), albedo( a ), param( k ), shape( s ), objIdx( idx ) {
+            float3 lo = -size, hi = size;
+            if ( shape == BLEND ) {
+                // the sphere on top; smooth union bulges by at most a quarter of the blend radius
+                lo = float3( -size.x, -size.y, -max( size.z, size.x ) ) - param * 0.25f;
+                hi = float3( size.x, size.y + size.x, max( size.z, size.x ) ) + param * 0.25f;
+            } else if ( shape == TWISTEDTORUS ) {
+                // twisting around y sweeps the ring through a cylinder
+                const float R = size.x + size.y, rho = sqrtf( R * R + size.y * size.y );
+                lo = float3( -rho, -R, -rho ), hi = float3( rho, R, rho );
+                // the twist moves a point by param * its distance to the axis per unit of
+                // height; in the box that distance is at most rho * sqrt( 2 )
+                lipschitz = sqrtf( 1 + sqrf( param * rho * 1.41421356f ) );
+            } else if ( shape == MENGER ) {
+                lo = -size.x, hi = size.x;
+            }
+            bounds = aabb( pos + lo - MARGIN, pos + hi + MARGIN );
+        }
+
+        // -----------------------------------------------------------
+        // Scalar field, gradient and march
+        // -----------------------------------------------------------
+        float Distance( const float3 P ) const {
+            const float3 p = P - pos;
+            switch ( shape ) {
+            case ROUNDBOX: return Box( p, size, param );
+            case BLEND: {
+                float h1, h2;
+                const float3 c = p - float3( 0, size.y, 0 );
+                const float u = SMin( Box( p, size, 0 ), sqrtf( dot( c, c ) ) - size.x, param, h1 );
+                return SMax( u, -( sqrtf( p.x * p.x + p.y * p.y ) - size.y * 0.5f ), param, h2 );
+            }
+            case TWISTEDTORUS: {
+                float s, c;
+                SinCos( param * p.y, s, c );
+                const float qx = c * p.x - s * p.z, qz = s * p.x + c * p.z;
+                const float rho = sqrtf( qx * qx + p.y * p.y ) - size.x;
+                return sqrtf( rho * rho + qz * qz ) - size.y;
+            }
+            default: return Menger( p * ( 1 / size.x ), (int)param ) * size.x;
+            }
+        }
+
+        float3 Gradient( const float3 P ) const {
+            const float3 p = P - pos;
+            switch ( shape ) {
+            case ROUNDBOX: return BoxGradient( p, size, param );
+            case BLEND: {
+                float h1, h2;
+                const float3 c = p - float3( 0, size.y, 0 );
+                const float lc = sqrtf( dot( c, c ) ), lh = sqrtf( p.x * p.x + p.y * p.y );
+                const float u = SMin( Box( p, size, 0 ), lc - size.x, param, h1 );
+                SMax( u, -( lh - size.y * 0.5f ), param, h2 );
+                // smooth min and max mix the gradients with their blend weight
+                const float3 gu = h1 * BoxGradient( p, size, 0 ) + ( 1 - h1 ) * ( c * ( 1 / lc ) );
+                return h2 * gu - ( 1 - h2 ) * float3( p.x / lh, p.y / lh, 0 );
+            }
+            case TWISTEDTORUS: {
+                float s, c;
+                SinCos( param * p.y, s, c );
+                const float qx = c * p.x - s * p.z, qz = s * p.x + c * p.z;
+                const float l = sqrtf( qx * qx + p.y * p.y ), rho = l - size.x, lw = sqrtf( rho * rho + qz * qz );
+                // gradient of the torus at q, then through the jacobian of the twist
+                const float gx = rho / lw * qx / l, gy = rho / lw * p.y / l, gz = qz / lw;
+                return float3( c * gx + s * gz, gy + param * ( qx * gz - qz * gx ), c * gz - s * gx );
+            }
+            default: return MengerGradient( p * ( 1 / size.x ), (int)param );
+            }
+        }
+
+        // distance of the first hit before tmax, or 1e34
+        float March( const float3 O, const float3 D, const float tmax ) const {
+            float t0, t1;
+            if ( !Clip( O, D, tmax, t0, t1 ) ) return 1e34f;
+            float t = t0;
+            bool armed = false; // rays that start on the surface must leave it first
+            for ( int i = 0; i < MAXSTEPS && t < t1; i++ ) {
+                const float d = Distance( O + t * D );
+                if ( armed && d < HIT ) return t;
+                armed |= d >= HIT;
+                t += armed ? d / lipschitz : max( fabsf( d ) / lipschitz, HIT );
+            }
+            return 1e34f;
+        }
+
+        float3 GetNormal( const float3 I ) const {
+            return normalize( Gradient( I ) );
+        }
+
+        float3 GetAlbedo( const float3 I ) const {
+            return albedo;
+        }
+
+        // -----------------------------------------------------------
+        // Eight rays at once, in SoA form; lanes with tmax = 0 are
+        // idle. Only call this when SIMD::level >= SIMD::AVX2.
+        // -----------------------------------------------------------
+        SIMD_AVX2 __m256 March8( const __m256 Ox, const __m256 Oy, const __m256 Oz,
+            const __m256 Dx, const __m256 Dy, const __m256 Dz, const __m256 tmax ) const {
+            const __m256 zero8 = _mm256_setzero_ps(), hit8 = _mm256_set1_ps( HIT ), invL8 = _mm256_set1_ps( 1 / lipschitz );
+            __m256 t0 = zero8, t1 = tmax;
+            const __m256 O8[3] = { Ox, Oy, Oz }, D8[3] = { Dx, Dy, Dz };
+            for ( int a = 0; a < 3; a++ ) {
+                const __m256 rD = _mm256_div_ps( _mm256_set1_ps( 1 ), D8[a] );
+                const __m256 ta = _mm256_mul_ps( _mm256_sub_ps( _mm256_set1_ps( bounds.bmin[a] ), O8[a] ), rD );
+                const __m256 tb = _mm256_mul_ps( _mm256_sub_ps( _mm256_set1_ps( bounds.bmax[a] ), O8[a] ), rD );
+                t0 = _mm256_max_ps( t0, _mm256_min_ps( ta, tb ) ), t1 = _mm256_min_ps( t1, _mm256_max_ps( ta, tb ) );
+            }
+            __m256 active = _mm256_cmp_ps( t0, t1, _CMP_LT_OQ ), armed = zero8, t = t0, result = _mm256_set1_ps( 1e34f );
+            for ( int i = 0; i < MAXSTEPS && _mm256_movemask_ps( active ); i++ ) {
+                const __m256 d = Distance8( _mm256_fmadd_ps( t, Dx, Ox ), _mm256_fmadd_ps( t, Dy, Oy ), _mm256_fmadd_ps( t, Dz, Oz ) );
+                const __m256 hit = _mm256_and_ps( _mm256_and_ps( active, armed ), _mm256_cmp_ps( d, hit8, _CMP_LT_OQ ) );
+                result = _mm256_blendv_ps( result, t, hit );
+                armed = _mm256_or_ps( armed, _mm256_cmp_ps( d, hit8, _CMP_GE_OQ ) );
+                const __m256 leave = _mm256_max_ps( _mm256_mul_ps( Abs8( d ), invL8 ), hit8 );
+                t = _mm256_add_ps( t, _mm256_blendv_ps( leave, _mm256_mul_ps( d, invL8 ), armed ) );
+                active = _mm256_andnot_ps( hit, _mm256_and_ps( active, _mm256_cmp_ps( t, t1, _CMP_LT_OQ ) ) );
+            }
+            return result;
+        }
+
+        aabb bounds;
+        float3 pos, size, albedo;
+        float param = 0, lipschitz = 1;
+        Shape shape = ROUNDBOX;
+        int objIdx = -1;
+
+    private:
+        // ray interval inside the bounding box
+        bool Clip( const float3 O, const float3 D, const float tmax, float& t0, float& t1 ) const {
+            t0 = 0, t1 = tmax;
+            for ( int a = 0; a < 3; a++ ) {
+                const float rD = 1 / D.cell[a];
+                const float ta = ( bounds.bmin[a] - O.cell[a] ) * rD, tb = ( bounds.bmax[a] - O.cell[a] ) * rD;
+                t0 = max( t0, min( ta, tb ) ), t1 = min( t1, max( ta, tb ) );
+            }
+            return t0 < t1;
+        }
+
+        // polynomial smooth minimum and maximum; h weighs the gradient of a
+        static float SMin( const float a, const float b, const float k, float& h ) {
+            h = clamp( 0.5f + 0.5f * ( b - a ) / k, 0.0f, 1.0f );
+            return b + ( a - b ) * h - k * h * ( 1 - h );
+        }
+        static float SMax( const float a, const float b, const float k, float& h ) {
+            h = clamp( 0.5f + 0.5f * ( a - b ) / k, 0.0f, 1.0f );
+            return b + ( a - b ) * h + k * h * ( 1 - h );
+        }
+
+        // half-angle series after reduction to [-pi, pi]; SinCos8 uses the same steps
+        static void SinCos( const float a, float& s, float& c ) {
+            const float x = ( a - 6.28318531f * floorf( a * 0.159154943f + 0.5f ) ) * 0.5f, x2 = x * x;
+            const float hs = x * ( 1 + x2 * ( -1.0f / 6 + x2 * ( 1.0f / 120 + x2 * ( -1.0f / 5040 + x2 * ( 1.0f / 362880 ) ) ) ) );
+            const float hc = 1 + x2 * ( -0.5f + x2 * ( 1.0f / 24 + x2 * ( -1.0f / 720 + x2 * ( 1.0f / 40320 ) ) ) );
+            s = 2 * hs * hc, c = 1 - 2 * hs * hs;
+        }
+
+        // box with rounded edges, of half extents b including the rounding
+        static float Box( const float3 p, const float3 b, const float r ) {
+            const float qx = fabsf( p.x ) - b.x + r, qy = fabsf( p.y ) - b.y + r, qz = fabsf( p.z ) - b.z + r;
+            const float ox = max( qx, 0.0f ), oy = max( qy, 0.0f ), oz = max( qz, 0.0f );
+            return sqrtf( ox * ox + oy * oy + oz * oz ) + min( max( qx, max( qy, qz ) ), 0.0f ) - r;
+        }
+        static float3 BoxGradient( const float3 p, const float3 b, const float r ) {
+            const float3 q( fabsf( p.x ) - b.x + r, fabsf( p.y ) - b.y + r, fabsf( p.z ) - b.z + r );
+            const float3 sign( p.x < 0 ? -1.0f : 1.0f, p.y < 0 ? -1.0f : 1.0f, p.z < 0 ? -1.0f : 1.0f );
+            if ( q.x > 0 || q.y > 0 || q.z > 0 ) {
+                // outside: away from the nearest point of the inner box
+                const float3 o( max( q.x, 0.0f ), max( q.y, 0.0f ), max( q.z, 0.0f ) );
+                return o * sign * ( 1 / length( o ) );
+            }
+            // inside: the nearest face
+            const int a = q.x > q.y ? ( q.x > q.z ? 0 : 2 ) : ( q.y > q.z ? 1 : 2 );
+            float3 g( 0 );
+            g[a] = sign.cell[a];
+            return g;
+        }
+
+        // Inigo Quilez' Menger sponge, in a box of half extent 1
+        static float Menger( const float3 p, const int iterations ) {
+            float d = Box( p, float3( 1 ), 0 ), s = 1;
+            for ( int m = 0; m < iterations; m++ ) {
+                float r[3];
+                for ( int a = 0; a < 3; a++ ) {
+                    const float ps = p.cell[a] * s, f = ps - 2 * floorf( ps * 0.5f ) - 1;
+                    r[a] = fabsf( 1 - 3 * fabsf( f ) );
+                }
+                s *= 3;
+                const float c = ( min( max( r[0], r[1] ), min( max( r[1], r[2] ), max( r[2], r[0] ) ) ) - 1 ) / s;
+                d = max( d, c );
+            }
+            return d;
+        }
+        static float3 MengerGradient( const float3 p, const int iterations ) {
+            float d = Box( p, float3( 1 ), 0 ), s = 1;
+            float3 g = BoxGradient( p, float3( 1 ), 0 );
+            for ( int m = 0; m < iterations; m++ ) {
+                float r[3], f[3];
+                for ( int a = 0; a < 3; a++ ) {
+                    const float ps = p.cell[a] * s;
+                    f[a] = ps - 2 * floorf( ps * 0.5f ) - 1;
+                    r[a] = fabsf( 1 - 3 * fabsf( f[a] ) );
+                }
+                s *= 3;
+                // the distance of this level is set by one axis: the larger of the smallest pair
+                int best = 0;
+                float c = 1e34f;
+                for ( int a = 0; a < 3; a++ ) {
+                    const int b = ( a + 1 ) % 3, larger = r[a] > r[b] ? a : b;
+                    if ( r[larger] < c ) c = r[larger], best = larger;
+                }
+                c = ( c - 1 ) / s;
+                if ( c > d ) {
+                    // d/dp of |1 - 3|f||, scaled back by 1 / s
+                    d = c, g = float3( 0 );
+                    g[best] = ( 1 - 3 * fabsf( f[best] ) < 0 ? 1.0f : -1.0f ) * ( f[best] < 0 ? -1.0f : 1.0f );
+                }
+            }
+            return g;
+        }
+
+        // -----------------------------------------------------------
+        // AVX2 versions of the field, step for step as above
+        // -----------------------------------------------------------
+        SIMD_AVX2 static __m256 Abs8( const __m256 a ) { return _mm256_andnot_ps( _mm256_set1_ps( -0.0f ), a ); }
+        SIMD_AVX2 static __m256 Length8( const __m256 x, const __m256 y, const __m256 z ) {
+            return _mm256_sqrt_ps( _mm256_fmadd_ps( x, x, _mm256_fmadd_ps( y, y, _mm256_mul_ps( z, z ) ) ) );
+        }
+        SIMD_AVX2 static __m256 Clamp01( const __m256 a ) {
+            return _mm256_max_ps( _mm256_setzero_ps(), _mm256_min_ps( _mm256_set1_ps( 1 ), a ) );
+        }
+        SIMD_AVX2 static __m256 Box8( const __m256 x, const __m256 y, const __m256 z, const float3 b, const float r ) {
+            const __m256 zero8 = _mm256_setzero_ps();
+            const __m256 qx = _mm256_sub_ps( Abs8( x ), _mm256_set1_ps( b.x - r ) );
+            const __m256 qy = _mm256_sub_ps( Abs8( y ), _mm256_set1_ps( b.y - r ) );
+            const __m256 qz = _mm256_sub_ps( Abs8( z ), _mm256_set1_ps( b.z - r ) );
+            const __m256 outside = Length8( _mm256_max_ps( qx, zero8 ), _mm256_max_ps( qy, zero8 ), _mm256_max_ps( qz, zero8 ) );
+            const __m256 inside = _mm256_min_ps( _mm256_max_ps( qx, _mm256_max_ps( qy, qz ) ), zero8 );
+            return _mm256_sub_ps( _mm256_add_ps( outside, inside ), _mm256_set1_ps( r ) );
+        }
+        SIMD_AVX2 static void SinCos8( const __m256 a, __m256& s, __m256& c ) {
+            const __m256 one8 = _mm256_set1_ps( 1 );
+            const __m256 turns = _mm256_floor_ps( _mm256_fmadd_ps( a, _mm256_set1_ps( 0.159154943f ), _mm256_set1_ps( 0.5f ) ) );
+            const __m256 x = _mm256_mul_ps( _mm256_fnmadd_ps( turns, _mm256_set1_ps( 6.28318531f ), a ), _mm256_set1_ps( 0.5f ) );
+            const __m256 x2 = _mm256_mul_ps( x, x );
+            __m256 hs = _mm256_fmadd_ps( x2, _mm256_set1_ps( 1.0f / 362880 ), _mm256_set1_ps( -1.0f / 5040 ) );
+            hs = _mm256_fmadd_ps( x2, hs, _mm256_set1_ps( 1.0f / 120 ) );
+            hs = _mm256_fmadd_ps( x2, hs, _mm256_set1_ps( -1.0f / 6 ) );
+            hs = _mm256_mul_ps( x, _mm256_fmadd_ps( x2, hs, one8 ) );
+            __m256 hc = _mm256_fmadd_ps( x2, _mm256_set1_ps( 1.0f / 40320 ), _mm256_set1_ps( -1.0f / 720 ) );
+            hc = _mm256_fmadd_ps( x2, hc, _mm256_set1_ps( 1.0f / 24 ) );
+            hc = _mm256_fmadd_ps( x2, hc, _mm256_set1_ps( -0.5f ) );
+            hc = _mm256_fmadd_ps( x2, hc, one8 );
+            s = _mm256_mul_ps( _mm256_set1_ps( 2 ), _mm256_mul_ps( hs, hc ) );
+            c = _mm256_fnmadd_ps( _mm256_set1_ps( 2 ), _mm256_mul_ps( hs, hs ), one8 );
+        }
+        SIMD_AVX2 __m256 Distance8( const __m256 Px, const __m256 Py, const __m256 Pz ) const {
+            const __m256 x = _mm256_sub_ps( Px, _mm256_set1_ps( pos.x ) );
+            const __m256 y = _mm256_sub_ps( Py, _mm256_set1_ps( pos.y ) );
+            const __m256 z = _mm256_sub_ps( Pz, _mm256_set1_ps( pos.z ) );
+            const __m256 zero8 = _mm256_setzero_ps(), one8 = _mm256_set1_ps( 1 );
+            switch ( shape ) {
+            case ROUNDBOX: return Box8( x, y, z, size, param );
+            case BLEND: {
+                const __m256 k = _mm256_set1_ps( param ), half = _mm256_set1_ps( 0.5f );
+                const __m256 a = Box8( x, y, z, size, 0 );
+                const __m256 b = _mm256_sub_ps( Length8( x, _mm256_sub_ps( y, _mm256_set1_ps( size.y ) ), z ), _mm256_set1_ps( size.x ) );
+                __m256 h = Clamp01( _mm256_fmadd_ps( half, _mm256_div_ps( _mm256_sub_ps( b, a ), k ), half ) );
+                const __m256 u = _mm256_sub_ps( _mm256_fmadd_ps( _mm256_sub_ps( a, b ), h, b ), _mm256_mul_ps( _mm256_mul_ps( k, h ), _mm256_sub_ps( one8, h ) ) );
+                const __m256 hole = _mm256_sub_ps( _mm256_set1_ps( size.y * 0.5f ), Length8( x, y, zero8 ) );
+                h = Clamp01( _mm256_fmadd_ps( half, _mm256_div_ps( _mm256_sub_ps( u, hole ), k ), half ) );
+                return _mm256_add_ps( _mm256_fmadd_ps( _mm256_sub_ps( u, hole ), h, hole ), _mm256_mul_ps( _mm256_mul_ps( k, h ), _mm256_sub_ps( one8, h ) ) );
+            }
+            case TWISTEDTORUS: {
+                __m256 s, c;
+                SinCos8( _mm256_mul_ps( _mm256_set1_ps( param ), y ), s, c );
+                const __m256 qx = _mm256_fmsub_ps( c, x, _mm256_mul_ps( s, z ) ), qz = _mm256_fmadd_ps( s, x, _mm256_mul_ps( c, z ) );
+                const __m256 rho = _mm256_sub_ps( Length8( qx, y, zero8 ), _mm256_set1_ps( size.x ) );
+                return _mm256_sub_ps( Length8( rho, qz, zero8 ), _mm256_set1_ps( size.y ) );
+            }
+            default: {
+                const __m256 scale = _mm256_set1_ps( 1 / size.x ), two8 = _mm256_set1_ps( 2 ), three8 = _mm256_set1_ps( 3 );
+                const __m256 p[3] = { _mm256_mul_ps( x, scale ), _mm256_mul_ps( y, scale ), _mm256_mul_ps( z, scale ) };
+                __m256 d = Box8( p[0], p[1], p[2], float3( 1 ), 0 ), s = one8;
+                for ( int m = 0; m < (int)param; m++ ) {
+                    __m256 r[3];
+                    for ( int a = 0; a < 3; a++ ) {
+                        const __m256 ps = _mm256_mul_ps( p[a], s );
+                        const __m256 f = _mm256_sub_ps( _mm256_fnmadd_ps( two8, _mm256_floor_ps( _mm256_mul_ps( ps, _mm256_set1_ps( 0.5f ) ) ), ps ), one8 );
+                        r[a] = Abs8( _mm256_fnmadd_ps( three8, Abs8( f ), one8 ) );
+                    }
+                    s = _mm256_mul_ps( s, three8 );
+                    const __m256 m3 = _mm256_min_ps( _mm256_max_ps( r[0], r[1] ), _mm256_min_ps( _mm256_max_ps( r[1], r[2] ), _mm256_max_ps( r[2], r[0] ) ) );
+                    d = _mm256_max_ps( d, _mm256_div_ps( _mm256_sub_ps( m3, one8 ), s ) );
+                }
+                return _mm256_mul_ps( d, _mm256_set1_ps( size.x ) );
+            }
+            }
+        }
+    };
+
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+// SIMD support that works with MSVC, GCC and Clang.
+// The build targets a baseline instruction set; code for wider units
+// is selected at run time. Hot kernels are compiled once per level
+// (see kernels.h); the few functions elsewhere that use AVX2 directly
+// are marked with SIMD_AVX2, so that GCC and Clang accept the
+// intrinsics without raising the target of the whole file. MSVC needs
+// no marking: it emits any intrinsic regardless of /arch.
+
+#ifdef _MSC_VER
+#define SIMD_TARGET( isa )
+#else
+#define SIMD_TARGET( isa ) __attribute__( ( target( isa ) ) )
+#endif
+#define SIMD_AVX2 SIMD_TARGET( "avx2,fma,f16c" )
+
+// single lane access; MSVC's m128_f32 and m128i_i32 members do not
+// exist elsewhere
+inline float Lane( const __m128 v, const int i ) { union { __m128 v4; float f[4]; } u = { v }; return u.f[i]; }
+inline int Lane( const __m128i v, const int i ) { union { __m128i v4; int f[4]; } u = { v }; return u.f[i]; }
+
+// Instruction set level, detected once at startup (see template.cpp);
+// level may be lowered at run time to compare the kernels.
+class SIMD
+{
+public:
+	enum ISA { SSE42 = 0, AVX2, AVX512, LEVELS };
+	static inline const char* name[LEVELS] = { "SSE4.2", "AVX2", "AVX-512" };
+	static inline ISA supported = SSE42;	// best level of this cpu and os
+	static inline ISA level = SSE42;		// level in use
+	SIMD()
+	{
+		int info[4];
+		cpuid( info, 1 );
+		// wide registers also need the os to save them on a context switch
+		const bool osxsave = (info[2] & (1 << 27)) != 0;
+		const uint64_t xcr0 = osxsave ? XCR0() : 0;
+		const bool ymm = (xcr0 & 0x06) == 0x06, zmm = (xcr0 & 0xe6) == 0xe6;
+		if (CPUCaps::HW_AVX2 && CPUCaps::HW_FMA3 && CPUCaps::HW_F16C && ymm) supported = AVX2;
+		if (supported == AVX2 && CPUCaps::HW_AVX512F && CPUCaps::HW_AVX512VL && CPUCaps::HW_AVX512BW &&
+			CPUCaps::HW_AVX512DQ && zmm) supported = AVX512;
+		level = supported;
+	}
+	static void Use( const int l ) { level = (ISA)(l < 0 ? 0 : l > supported ? supported : l); }
+private:
+	static uint64_t XCR0()
+	{
+#ifdef _MSC_VER
+		return _xgetbv( 0 );
+#else
+		uint32_t lo, hi;
+		__asm__ __volatile__( "xgetbv" : "=a"( lo ), "=d"( hi ) : "c"( 0 ) );
+		return ((uint64_t)hi << 32) | lo;
+#endif
+	}
+};
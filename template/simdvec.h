@@ -0,0 +1,203 @@
+#pragma once
+
+// Width-generic vector operations for kernels that are compiled once
+// per instruction set level. The including file defines SIMD_LEVEL
+// (0: SSE4.2, 4 lanes; 1: AVX2 + FMA, 8 lanes; 2: AVX-512, 16 lanes)
+// and is built with the matching /arch. Everything is declared in a
+// namespace named after the level, and a kernel file includes nothing
+// else but its own declarations: an inline function from a shared
+// header could otherwise be emitted with wide instructions and picked
+// by the linker for the callers in baseline code.
+// Operations are plain functions, as GCC does not allow operators on
+// its built-in vector types. Masks are the results of comparisons;
+// Select( m, a, b ) takes a where m is set.
+
+#include <immintrin.h>
+
+#if SIMD_LEVEL == 2
+#define SIMD_NAMESPACE avx512
+#define SIMD_FLAGS "avx512f,avx512vl,avx512bw,avx512dq,avx2,fma,f16c"
+#elif SIMD_LEVEL == 1
+#define SIMD_NAMESPACE avx2
+#define SIMD_FLAGS "avx2,fma,f16c"
+#else
+#define SIMD_NAMESPACE sse42
+#define SIMD_FLAGS "sse4.2"
+#endif
+#ifdef _MSC_VER
+#define SIMD_KERNEL
+#define VFN static __forceinline
+#else
+#define SIMD_KERNEL __attribute__( ( target( SIMD_FLAGS ) ) )
+#define VFN static inline __attribute__( ( target( SIMD_FLAGS ), always_inline ) )
+#endif
+
+namespace Tmpl8
+{
+namespace SIMD_NAMESPACE
+{
+
+#if SIMD_LEVEL == 2
+
+enum { W = 16 };
+typedef __m512 vfloat;
+typedef __m512i vint;
+typedef __mmask16 vmask;
+// the unmasked forms of some intrinsics start from an undefined register,
+// which GCC reports as maybe uninitialized; the zero-masked forms with all
+// lanes enabled compile to the same instructions
+static const vmask ALL = 0xffff;
+VFN vfloat Set1( const float a ) { return _mm512_set1_ps( a ); }
+VFN vfloat Load( const float* p ) { return _mm512_loadu_ps( p ); }
+VFN void Store( float* p, const vfloat a ) { _mm512_storeu_ps( p, a ); }
+VFN vfloat Add( const vfloat a, const vfloat b ) { return _mm512_add_ps( a, b ); }
+VFN vfloat Sub( const vfloat a, const vfloat b ) { return _mm512_sub_ps( a, b ); }
+VFN vfloat Mul( const vfloat a, const vfloat b ) { return _mm512_mul_ps( a, b ); }
+VFN vfloat Madd( const vfloat a, const vfloat b, const vfloat c ) { return _mm512_fmadd_ps( a, b, c ); }
+VFN vfloat Div( const vfloat a, const vfloat b ) { return _mm512_div_ps( a, b ); }
+VFN vfloat Min( const vfloat a, const vfloat b ) { return _mm512_maskz_min_ps( ALL, a, b ); }
+VFN vfloat Max( const vfloat a, const vfloat b ) { return _mm512_maskz_max_ps( ALL, a, b ); }
+VFN vfloat Sqrt( const vfloat a ) { return _mm512_maskz_sqrt_ps( ALL, a ); }
+VFN vfloat Abs( const vfloat a ) { return _mm512_abs_ps( a ); }
+VFN vmask Lt( const vfloat a, const vfloat b ) { return _mm512_cmp_ps_mask( a, b, _CMP_LT_OQ ); }
+VFN vmask Gt( const vfloat a, const vfloat b ) { return _mm512_cmp_ps_mask( a, b, _CMP_GT_OQ ); }
+VFN vmask Ge( const vfloat a, const vfloat b ) { return _mm512_cmp_ps_mask( a, b, _CMP_GE_OQ ); }
+VFN vmask And( const vmask a, const vmask b ) { return (vmask)(a & b); }
+VFN vmask Or( const vmask a, const vmask b ) { return (vmask)(a | b); }
+VFN vmask None() { return 0; }
+VFN vfloat Select( const vmask m, const vfloat a, const vfloat b ) { return _mm512_mask_blend_ps( m, b, a ); }
+VFN int Bits( const vmask m ) { return (int)m; }
+VFN vint Set1i( const int a ) { return _mm512_set1_epi32( a ); }
+VFN vint Seq() { return _mm512_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 ); }
+VFN vint Add( const vint a, const vint b ) { return _mm512_add_epi32( a, b ); }
+VFN vint Min( const vint a, const vint b ) { return _mm512_maskz_min_epi32( ALL, a, b ); }
+VFN vint Max( const vint a, const vint b ) { return _mm512_maskz_max_epi32( ALL, a, b ); }
+VFN vint Or( const vint a, const vint b ) { return _mm512_or_si512( a, b ); }
+VFN vint Shl( const vint a, const unsigned n ) { return _mm512_maskz_slli_epi32( ALL, a, n ); }
+VFN vint Shr( const vint a, const unsigned n ) { return _mm512_maskz_srli_epi32( ALL, a, n ); }
+VFN vint Truncate( const vfloat a ) { return _mm512_maskz_cvttps_epi32( ALL, a ); }
+VFN void Store( unsigned* p, const vint a ) { _mm512_storeu_si512( p, a ); }
+VFN vfloat Gather( const float* base, const vint index ) { return _mm512_mask_i32gather_ps( _mm512_setzero_ps(), ALL, index, base, 4 ); }
+VFN vfloat Permute( const vfloat a, const vint index ) { return _mm512_maskz_permutexvar_ps( ALL, index, a ); }
+// W consecutive float4s, transposed to x, y, z and w registers
+VFN void LoadPacked( const float* p, vfloat& x, vfloat& y, vfloat& z, vfloat& w )
+{
+	const vint index = Shl( Seq(), 2 );
+	x = Gather( p, index ), y = Gather( p + 1, index ), z = Gather( p + 2, index ), w = Gather( p + 3, index );
+}
+
+#elif SIMD_LEVEL == 1
+
+enum { W = 8 };
+typedef __m256 vfloat;
+typedef __m256i vint;
+typedef __m256 vmask;
+VFN vfloat Set1( const float a ) { return _mm256_set1_ps( a ); }
+VFN vfloat Load( const float* p ) { return _mm256_loadu_ps( p ); }
+VFN void Store( float* p, const vfloat a ) { _mm256_storeu_ps( p, a ); }
+VFN vfloat Add( const vfloat a, const vfloat b ) { return _mm256_add_ps( a, b ); }
+VFN vfloat Sub( const vfloat a, const vfloat b ) { return _mm256_sub_ps( a, b ); }
+VFN vfloat Mul( const vfloat a, const vfloat b ) { return _mm256_mul_ps( a, b ); }
+VFN vfloat Madd( const vfloat a, const vfloat b, const vfloat c ) { return _mm256_fmadd_ps( a, b, c ); }
+VFN vfloat Div( const vfloat a, const vfloat b ) { return _mm256_div_ps( a, b ); }
+VFN vfloat Min( const vfloat a, const vfloat b ) { return _mm256_min_ps( a, b ); }
+VFN vfloat Max( const vfloat a, const vfloat b ) { return _mm256_max_ps( a, b ); }
+VFN vfloat Sqrt( const vfloat a ) { return _mm256_sqrt_ps( a ); }
+VFN vfloat Abs( const vfloat a ) { return _mm256_andnot_ps( _mm256_set1_ps( -0.0f ), a ); }
+VFN vmask Lt( const vfloat a, const vfloat b ) { return _mm256_cmp_ps( a, b, _CMP_LT_OQ ); }
+VFN vmask Gt( const vfloat a, const vfloat b ) { return _mm256_cmp_ps( a, b, _CMP_GT_OQ ); }
+VFN vmask Ge( const vfloat a, const vfloat b ) { return _mm256_cmp_ps( a, b, _CMP_GE_OQ ); }
+VFN vmask And( const vmask a, const vmask b ) { return _mm256_and_ps( a, b ); }
+VFN vmask Or( const vmask a, const vmask b ) { return _mm256_or_ps( a, b ); }
+VFN vmask None() { return _mm256_setzero_ps(); }
+VFN vfloat Select( const vmask m, const vfloat a, const vfloat b ) { return _mm256_blendv_ps( b, a, m ); }
+VFN int Bits( const vmask m ) { return _mm256_movemask_ps( m ); }
+VFN vint Set1i( const int a ) { return _mm256_set1_epi32( a ); }
+VFN vint Seq() { return _mm256_setr_epi32( 0, 1, 2, 3, 4, 5, 6, 7 ); }
+VFN vint Add( const vint a, const vint b ) { return _mm256_add_epi32( a, b ); }
+VFN vint Min( const vint a, const vint b ) { return _mm256_min_epi32( a, b ); }
+VFN vint Max( const vint a, const vint b ) { return _mm256_max_epi32( a, b ); }
+VFN vint Or( const vint a, const vint b ) { return _mm256_or_si256( a, b ); }
+VFN vint Shl( const vint a, const int n ) { return _mm256_slli_epi32( a, n ); }
+VFN vint Shr( const vint a, const int n ) { return _mm256_srli_epi32( a, n ); }
+VFN vint Truncate( const vfloat a ) { return _mm256_cvttps_epi32( a ); }
+VFN void Store( unsigned* p, const vint a ) { _mm256_storeu_si256( (__m256i*)p, a ); }
+VFN vfloat Gather( const float* base, const vint index ) { return _mm256_i32gather_ps( base, index, 4 ); }
+VFN vfloat Permute( const vfloat a, const vint index ) { return _mm256_permutevar8x32_ps( a, index ); }
+VFN void LoadPacked( const float* p, vfloat& x, vfloat& y, vfloat& z, vfloat& w )
+{
+	// pixels i and i + 4 share a register, so the in-lane transpose yields x0..x7
+	const __m256 r0 = _mm256_insertf128_ps( _mm256_castps128_ps256( _mm_loadu_ps( p ) ), _mm_loadu_ps( p + 16 ), 1 );
+	const __m256 r1 = _mm256_insertf128_ps( _mm256_castps128_ps256( _mm_loadu_ps( p + 4 ) ), _mm_loadu_ps( p + 20 ), 1 );
+	const __m256 r2 = _mm256_insertf128_ps( _mm256_castps128_ps256( _mm_loadu_ps( p + 8 ) ), _mm_loadu_ps( p + 24 ), 1 );
+	const __m256 r3 = _mm256_insertf128_ps( _mm256_castps128_ps256( _mm_loadu_ps( p + 12 ) ), _mm_loadu_ps( p + 28 ), 1 );
+	const __m256 t0 = _mm256_shuffle_ps( r0, r1, 0x44 ), t2 = _mm256_shuffle_ps( r0, r1, 0xee );
+	const __m256 t1 = _mm256_shuffle_ps( r2, r3, 0x44 ), t3 = _mm256_shuffle_ps( r2, r3, 0xee );
+	x = _mm256_shuffle_ps( t0, t1, 0x88 ), y = _mm256_shuffle_ps( t0, t1, 0xdd );
+	z = _mm256_shuffle_ps( t2, t3, 0x88 ), w = _mm256_shuffle_ps( t2, t3, 0xdd );
+}
+
+#else
+
+enum { W = 4 };
+typedef __m128 vfloat;
+typedef __m128i vint;
+typedef __m128 vmask;
+VFN vfloat Set1( const float a ) { return _mm_set1_ps( a ); }
+VFN vfloat Load( const float* p ) { return _mm_loadu_ps( p ); }
+VFN void Store( float* p, const vfloat a ) { _mm_storeu_ps( p, a ); }
+VFN vfloat Add( const vfloat a, const vfloat b ) { return _mm_add_ps( a, b ); }
+VFN vfloat Sub( const vfloat a, const vfloat b ) { return _mm_sub_ps( a, b ); }
+VFN vfloat Mul( const vfloat a, const vfloat b ) { return _mm_mul_ps( a, b ); }
+VFN vfloat Madd( const vfloat a, const vfloat b, const vfloat c ) { return _mm_add_ps( _mm_mul_ps( a, b ), c ); }
+VFN vfloat Div( const vfloat a, const vfloat b ) { return _mm_div_ps( a, b ); }
+VFN vfloat Min( const vfloat a, const vfloat b ) { return _mm_min_ps( a, b ); }
+VFN vfloat Max( const vfloat a, const vfloat b ) { return _mm_max_ps( a, b ); }
+VFN vfloat Sqrt( const vfloat a ) { return _mm_sqrt_ps( a ); }
+VFN vfloat Abs( const vfloat a ) { return _mm_andnot_ps( _mm_set1_ps( -0.0f ), a ); }
+VFN vmask Lt( const vfloat a, const vfloat b ) { return _mm_cmplt_ps( a, b ); }
+VFN vmask Gt( const vfloat a, const vfloat b ) { return _mm_cmpgt_ps( a, b ); }
+VFN vmask Ge( const vfloat a, const vfloat b ) { return _mm_cmpge_ps( a, b ); }
+VFN vmask And( const vmask a, const vmask b ) { return _mm_and_ps( a, b ); }
+VFN vmask Or( const vmask a, const vmask b ) { return _mm_or_ps( a, b ); }
+VFN vmask None() { return _mm_setzero_ps(); }
+VFN vfloat Select( const vmask m, const vfloat a, const vfloat b ) { return _mm_blendv_ps( b, a, m ); }
+VFN int Bits( const vmask m ) { return _mm_movemask_ps( m ); }
+VFN vint Set1i( const int a ) { return _mm_set1_epi32( a ); }
+VFN vint Seq() { return _mm_setr_epi32( 0, 1, 2, 3 ); }
+VFN vint Add( const vint a, const vint b ) { return _mm_add_epi32( a, b ); }
+VFN vint Min( const vint a, const vint b ) { return _mm_min_epi32( a, b ); }
+VFN vint Max( const vint a, const vint b ) { return _mm_max_epi32( a, b ); }
+VFN vint Or( const vint a, const vint b ) { return _mm_or_si128( a, b ); }
+VFN vint Shl( const vint a, const int n ) { return _mm_slli_epi32( a, n ); }
+VFN vint Shr( const vint a, const int n ) { return _mm_srli_epi32( a, n ); }
+VFN vint Truncate( const vfloat a ) { return _mm_cvttps_epi32( a ); }
+VFN void Store( unsigned* p, const vint a ) { _mm_storeu_si128( (__m128i*)p, a ); }
+VFN vfloat Gather( const float* base, const vint index )
+{
+	return _mm_setr_ps( base[_mm_extract_epi32( index, 0 )], base[_mm_extract_epi32( index, 1 )],
+		base[_mm_extract_epi32( index, 2 )], base[_mm_extract_epi32( index, 3 )] );
+}
+VFN vfloat Permute( const vfloat a, const vint index )
+{
+	alignas( 16 ) float f[4];
+	_mm_store_ps( f, a );
+	return Gather( f, index );
+}
+VFN void LoadPacked( const float* p, vfloat& x, vfloat& y, vfloat& z, vfloat& w )
+{
+	x = _mm_loadu_ps( p ), y = _mm_loadu_ps( p + 4 ), z = _mm_loadu_ps( p + 8 ), w = _mm_loadu_ps( p + 12 );
+	_MM_TRANSPOSE4_PS( x, y, z, w );
+}
+
+#endif
+
+// level independent helpers
+VFN vfloat Dot( const vfloat ax, const vfloat ay, const vfloat az, const vfloat bx, const vfloat by, const vfloat bz )
+{
+	return Madd( az, bz, Madd( ay, by, Mul( ax, bx ) ) );
+}
+VFN float Saturate( const float a ) { return a < 0 ? 0 : a > 1 ? 1 : a; }
+
+} // namespace SIMD_NAMESPACE
+} // namespace Tmpl8
@@ -0,0 +1,216 @@
+#pragma once
+
+// -----------------------------------------------------------
+// staticscene.h
+// Compile-time scene specialization. A static scene is a type
+// list of primitives with constant parameters; StaticScene
+// unrolls the list into FindNearest and IsOccluded, and the
+// compiler folds the constants, like the hand-inlined code
+// under SPEEDTRIX - but the numbers live in a description
+// instead of in the intersection code. Animated objects join
+// the list by reference to their Scene member.
+// Parameters are constexpr objects, passed by reference: C++17
+// does not take floats as template arguments.
+// -----------------------------------------------------------
+
+namespace Tmpl8 {
+
+    // room with axis-aligned walls, seen from the inside; the walls get
+    // objIdx, objIdx + 1, .. in the order lo x, hi x, lo y, hi y, lo z, hi z
+    struct RoomDesc {
+        float lo[3], hi[3];
+        int objIdx;
+    };
+
+    // sphere; rays for an enclosing sphere always start inside it
+    struct SphereDesc {
+        float pos[3], r;
+        int objIdx;
+        bool enclosing;
+    };
+
+    // horizontal square light, facing down; size is half its side
+    struct LightDesc {
+        float pos[3], size;
+        int objIdx;
+    };
+
+    // -----------------------------------------------------------
+    // Room: per axis, the sign of the ray direction selects the
+    // wall. Lights and camera are inside, so walls never occlude.
+    // -----------------------------------------------------------
+    template <const RoomDesc& R> struct StaticRoom {
+        template <int a> static void Wall( Ray& ray ) {
+            const bool hi = ray.D.cell[a] >= 0;
+            const float t = ( ( hi ? R.hi[a] : R.lo[a] ) - ray.O.cell[a] ) * ray.rD.cell[a];
+            if ( t < ray.t && t > 0 ) ray.t = t, ray.objIdx = R.objIdx + 2 * a + hi;
+        }
+        static void Intersect( const Scene&, Ray& ray ) {
+            Wall<0>( ray ), Wall<1>( ray ), Wall<2>( ray );
+        }
+        static bool IsOccluded( const Scene&, const Ray& ) {
+            return false;
+        }
+    };
+
+    // -----------------------------------------------------------
+    // Sphere at a fixed position; as Sphere, but with the squared
+    // radius folded in, and with only the far root for enclosing
+    // spheres, which also never occlude.
+    // -----------------------------------------------------------
+    template <const SphereDesc& S> struct StaticSphere {
+        static void Hit( const float3 pos, Ray& ray ) {
+            constexpr float r2 = S.r * S.r;
+            const float3 oc = ray.O - pos;
+            const float b = dot( oc, ray.D );
+            const float c = dot( oc, oc ) - r2;
+            const float d = b * b - c;
+            if ( d <= 0 ) return;
+            const float sd = sqrtf( d );
+            if constexpr ( !S.enclosing ) {
+                const float t = -b - sd;
+                if ( t < ray.t && t > 0 ) {
+                    ray.t = t, ray.objIdx = S.objIdx;
+                    return;
+                }
+                if ( c > 0 ) return; // outside; the far root is behind the near one
+            }
+            const float t = sd - b;
+            if ( t < ray.t && t > 0 ) ray.t = t, ray.objIdx = S.objIdx;
+        }
+        static bool Occludes( const float3 pos, const Ray& ray ) {
+            if constexpr ( S.enclosing ) return false;
+            constexpr float r2 = S.r * S.r;
+            const float3 oc = ray.O - pos;
+            const float b = dot( oc, ray.D );
+            const float c = dot( oc, oc ) - r2;
+            const float d = b * b - c;
+            if ( d <= 0 ) return false;
+            const float t = -b - sqrtf( d );
+            return t < ray.t && t > 0;
+        }
+        static void Intersect( const Scene&, Ray& ray ) {
+            Hit( float3( S.pos[0], S.pos[1], S.pos[2] ), ray );
+        }
+        static bool IsOccluded( const Scene&, const Ray& ray ) {
+            return Occludes( float3( S.pos[0], S.pos[1], S.pos[2] ), ray );
+        }
+    };
+
+    // sphere with a constant radius that moves: its position is read
+    // from the Sphere member that Object points to; S.pos is unused
+    template <auto Object, const SphereDesc& S> struct MovingSphere {
+        static void Intersect( const Scene& scene, Ray& ray ) {
+            StaticSphere<S>::Hit( ( scene.*Object ).pos, ray );
+        }
+        static bool IsOccluded( const Scene& scene, const Ray& ray ) {
+            return StaticSphere<S>::Occludes( ( scene.*Object ).pos, ray );
+        }
+    };
+
+    // -----------------------------------------------------------
+    // Lights: up to four squares at one height, tested together
+    // with SSE, as they share the distance to their plane.
+    // -----------------------------------------------------------
+    template <const LightDesc&... L> struct StaticLights {
+        static_assert( sizeof...( L ) >= 1 && sizeof...( L ) <= 4, "one to four lights" );
+        static constexpr float y[] = { L.pos[1]... };
+        static_assert( ( ( L.pos[1] == y[0] ) && ... ), "lights must share one plane" );
+        // unused lanes have size 0 and never hit
+        alignas( 16 ) static constexpr float x[4] = { L.pos[0]... }, z[4] = { L.pos[2]... };
+        alignas( 16 ) static constexpr float size[4] = { L.size... }, nsize[4] = { -L.size... };
+        static constexpr int objIdx[] = { L.objIdx... };
+        static int Hits( const Ray& ray, const float t ) {
+            const __m128 t4 = _mm_set1_ps( t ), s4 = _mm_load_ps( size ), n4 = _mm_load_ps( nsize );
+            const __m128 Ix4 = _mm_add_ps( _mm_sub_ps( _mm_set1_ps( ray.O.x ), _mm_load_ps( x ) ), _mm_mul_ps( t4, _mm_set1_ps( ray.D.x ) ) );
+            const __m128 Iz4 = _mm_add_ps( _mm_sub_ps( _mm_set1_ps( ray.O.z ), _mm_load_ps( z ) ), _mm_mul_ps( t4, _mm_set1_ps( ray.D.z ) ) );
+            return _mm_movemask_ps( _mm_and_ps( _mm_and_ps( _mm_cmpgt_ps( Ix4, n4 ), _mm_cmplt_ps( Ix4, s4 ) ), _mm_and_ps( _mm_cmpgt_ps( Iz4, n4 ), _mm_cmplt_ps( Iz4, s4 ) ) ) );
+        }
+        static void Intersect( const Scene&, Ray& ray ) {
+            const float t = ( ray.O.y - y[0] ) / -ray.D.y;
+            if ( !( t < ray.t && t > 0 ) ) return;
+            const int hit = Hits( ray, t );
+            if ( hit == 0 ) return;
+            int i = 0;
+            while ( ( ( hit >> i ) & 1 ) == 0 ) i++;
+            ray.t = t, ray.objIdx = objIdx[i];
+        }
+        static bool IsOccluded( const Scene&, const Ray& ray ) {
+            const float t = ( ray.O.y - y[0] ) / -ray.D.y;
+            return t < ray.t && t > 0 && Hits( ray, t ) != 0;
+        }
+    };
+
+    // -----------------------------------------------------------
+    // Animated or complex primitive: forwarded to the Scene member
+    // that Object points to.
+    // -----------------------------------------------------------
+    template <auto Object> struct Dynamic {
+        static void Intersect( const Scene& scene, Ray& ray ) {
+            ( scene.*Object ).Intersect( ray );
+        }
+        static bool IsOccluded( const Scene& scene, const Ray& ray ) {
+            return ( scene.*Object ).IsOccluded( ray );
+        }
+    };
+
+    // -----------------------------------------------------------
+    // StaticScene
+    // Nearest hit: all primitives, in list order. Occlusion: in
+    // list order as well, stopping at the first blocker - list the
+    // cheap and likely occluders first. A StaticScene is itself a
+    // primitive, so lists nest.
+    // -----------------------------------------------------------
+    template <class... P> struct StaticScene {
+        static void FindNearest( const Scene& scene, Ray& ray ) {
+            ( P::Intersect( scene, ray ), ... );
+        }
+        static bool IsOccluded( const Scene& scene, const Ray& ray ) {
+            return ( P::IsOccluded( scene, ray ) || ... );
+        }
+        static void Intersect( const Scene& scene, Ray& ray ) {
+            FindNearest( scene, ray );
+        }
+    };
+
+#ifdef STATICSCENE
+    // -----------------------------------------------------------
+    // Showroom
+    // The scene of scene.h as a static scene; the values match
+    // the Scene constructor. Scene::FindNearest / IsOccluded use
+    // this list for everything but the SDFs when STATICSCENE is
+    // defined.
+    // -----------------------------------------------------------
+    namespace Showroom {
+        inline constexpr RoomDesc room = { { -3, -1, -3 }, { 2.99f, 2, 3.99f }, 4 };
+        inline constexpr SphereDesc ball = { { 0, 0, 0 }, 0.6f, 1, false };
+        inline constexpr SphereDesc corners = { { 0, 2.5f, -3.07f }, 8, 2, true };
+#ifdef FOURLIGHTS
+        inline constexpr LightDesc light0 = { { -1, 1.5f, -1 }, 0.25f, 0 };
+        inline constexpr LightDesc light1 = { { 1, 1.5f, -1 }, 0.25f, 0 };
+        inline constexpr LightDesc light2 = { { 1, 1.5f, 1 }, 0.25f, 0 };
+        inline constexpr LightDesc light3 = { { -1, 1.5f, 1 }, 0.25f, 0 };
+        using Lights = StaticLights<light0, light1, light2, light3>;
+#else
+        using Lights = Dynamic<&Scene::quad>;
+#endif
+        using Primitives = StaticScene<
+            StaticRoom<room>,
+            Dynamic<&Scene::cube>,
+            MovingSphere<&Scene::sphere, ball>,
+            StaticSphere<corners>,
+            Lights,
+            Dynamic<&Scene::torus>
+        >;
+    }
+
+    inline void Scene::IntersectAnalytic( Ray& ray ) const {
+        Showroom::Primitives::FindNearest( *this, ray );
+    }
+
+    inline bool Scene::OccludedAnalytic( const Ray& ray ) const {
+        return Showroom::Primitives::IsOccluded( *this, ray );
+    }
+#endif
+
+}
@@ -0,0 +1,470 @@
+#include "precomp.h"
+
+// StressScene implementation
+static constexpr int SAHBINS = 16;
+// the top levels of the BVH are split serially, the subtrees below
+// PARALLELDEPTH are built in parallel; no node is deeper than the
+// traversal stack of BVHDEPTH entries can handle
+static constexpr uint PARALLELDEPTH = 6, BVHDEPTH = 64;
+
+static inline __m128 Centroid( const aabb& b ) { return _mm_mul_ps( _mm_add_ps( b.bmin4, b.bmax4 ), _mm_set1_ps( 0.5f ) ); }
+
+// distance to the box along the ray, or 1e30 if it is missed or beyond t
+static inline float IntersectAABB( const __m128 O4, const __m128 rD4, const float t, const float3& bmin, const float3& bmax )
+{
+	const __m128 t1 = _mm_mul_ps( _mm_sub_ps( _mm_setr_ps( bmin.x, bmin.y, bmin.z, 0 ), O4 ), rD4 );
+	const __m128 t2 = _mm_mul_ps( _mm_sub_ps( _mm_setr_ps( bmax.x, bmax.y, bmax.z, 0 ), O4 ), rD4 );
+	const __m128 vmax4 = _mm_max_ps( t1, t2 ), vmin4 = _mm_min_ps( t1, t2 );
+	const float tmax = min( Lane( vmax4, 0 ), min( Lane( vmax4, 1 ), Lane( vmax4, 2 ) ) );
+	const float tmin = max( Lane( vmin4, 0 ), max( Lane( vmin4, 1 ), Lane( vmin4, 2 ) ) );
+	return tmax >= tmin && tmin < t && tmax > 0 ? tmin : 1e30f;
+}
+
+// nearest positive root for a torus around the z-axis, as Torus::Intersect,
+// or 1e20 for a miss; the origin is first moved to the bounding sphere, as
+// small tori far away lose too much precision otherwise
+static double TorusRoot( const float3 origin, const float3 D, const double ra2, const double rb2, const double bound2 )
+{
+	double m = dot( origin, origin ), k3 = dot( origin, D );
+	const double h0 = k3 * k3 - m + bound2;
+	if (h0 < 0) return 1e20;
+	const double t0 = max( 0.0, -k3 - sqrt( h0 ) );
+	const double Ox = origin.x + t0 * D.x, Oy = origin.y + t0 * D.y, Oz = origin.z + t0 * D.z;
+	m = Ox * Ox + Oy * Oy + Oz * Oz, k3 = Ox * D.x + Oy * D.y + Oz * D.z;
+	double po = 1, k32 = k3 * k3;
+	const double k = (m - rb2 - ra2) * 0.5;
+	double k2 = k32 + ra2 * D.z * D.z + k;
+	double k1 = k * k3 + ra2 * Oz * D.z;
+	double k0 = k * k + ra2 * Oz * Oz - ra2 * rb2;
+	if (fabs( k3 * (k32 - k2) + k1 ) < 1e-4 * ra2 * ra2)
+	{
+		swap( k1, k3 );
+		po = -1, k0 = 1 / k0, k1 = k1 * k0, k2 = k2 * k0, k3 = k3 * k0, k32 = k3 * k3;
+	}
+	double c2 = 2 * k2 - 3 * k32, c1 = k3 * (k32 - k2) + k1;
+	double c0 = k3 * (k3 * (-3 * k32 + 4 * k2) - 8 * k1) + 4 * k0;
+	c2 *= 0.33333333333, c1 *= 2, c0 *= 0.33333333333;
+	const double Q = c2 * c2 + c0, R = 3 * c0 * c2 - c2 * c2 * c2 - c1 * c1;
+	double h = R * R - Q * Q * Q, z;
+	if (h < 0)
+	{
+		const double sQ = sqrt( Q );
+		z = 2 * sQ * cos( acos( R / (sQ * Q) ) * 0.33333333333 );
+	}
+	else
+	{
+		const double sQ = cbrt( sqrt( h ) + fabs( R ) );
+		z = copysign( fabs( sQ + Q / sQ ), R );
+	}
+	z = c2 - z;
+	double d1 = z - 3 * c2, d2 = z * z - 3 * c0;
+	if (fabs( d1 ) < 1.0e-8 * ra2)
+	{
+		if (d2 < 0) return 1e20;
+		d2 = sqrt( d2 );
+	}
+	else
+	{
+		if (d1 < 0) return 1e20;
+		d1 = sqrt( d1 * 0.5 ), d2 = c1 / d1;
+	}
+	double t = 1e20;
+	for (int s = -1; s <= 1; s += 2)
+	{
+		h = d1 * d1 - z - s * d2;
+		if (h <= 0) continue;
+		h = sqrt( h );
+		double t1 = s * d1 - h - k3, t2 = s * d1 + h - k3;
+		t1 = po < 0 ? 2 / t1 : t1, t2 = po < 0 ? 2 / t2 : t2;
+		if (t1 > 0) t = min( t, t1 );
+		if (t2 > 0) t = min( t, t2 );
+	}
+	return t < 1e20 ? t + t0 : t;
+}
+
+// the axis of a torus becomes z; the other two keep their order
+static inline float3 ToTorus( const float3 v, const int axis ) { return float3( v.cell[(axis + 1) % 3], v.cell[(axis + 2) % 3], v.cell[axis] ); }
+static inline float3 FromTorus( const float3 v, const int axis )
+{
+	float3 r;
+	r.cell[(axis + 1) % 3] = v.x, r.cell[(axis + 2) % 3] = v.y, r.cell[axis] = v.z;
+	return r;
+}
+
+// -----------------------------------------------------------
+// Fill the region with random objects and build the BVH. The
+// median size follows from the density: the bounding cubes of
+// all objects together fill that fraction of the region.
+// -----------------------------------------------------------
+void StressScene::Generate( const StressParams& p )
+{
+	Clear();
+	params = p;
+	count = clamp( p.count, 1, 10000000 );
+	Timer timer;
+	prim = (Primitive*)Memory::AllocLarge( count * sizeof( Primitive ) );
+	const float3 extent = p.regionMax - p.regionMin;
+	const float spread = max( 1.0f, p.sizeSpread ), logSpread = logf( spread );
+	// E[r^3] / m^3 for r log-uniform in [m / sqrt(spread), m * sqrt(spread)]
+	const float moment = logSpread > 0 ? (powf( spread, 1.5f ) - powf( spread, -1.5f )) / (3 * logSpread) : 1;
+	const float median = cbrtf( p.density * extent.x * extent.y * extent.z / (8 * moment * count) );
+	float cdf[TYPES], sum = 0;
+	for (int i = 0; i < TYPES; i++) cdf[i] = sum += max( 0.0f, p.mix[i] );
+	if (sum == 0) for (int i = 0; i < TYPES; i++) cdf[i] = sum = (float)(i + 1);
+#pragma omp parallel for schedule(static)
+	for (int i = 0; i < count; i++)
+	{
+		// a seed per object, so the scene does not depend on the thread count
+		uint seed = InitSeed( (uint)i ^ (p.seed * 0x9e3779b9u) );
+		Primitive& q = prim[i];
+		const float r = median * expf( (RandomFloat( seed ) - 0.5f) * logSpread );
+		const float pick = RandomFloat( seed ) * sum, shade = RandomFloat( seed );
+		int type = 0;
+		while (type < TYPES - 1 && pick >= cdf[type]) type++;
+		// triangles are open surfaces: no glass
+		int material = shade < p.mirror ? MIRROR : shade < p.mirror + p.glass && type != TRIANGLE ? GLASS : DIFFUSE;
+		const bool animated = RandomFloat( seed ) < p.animated;
+		const uint rgb = ((uint)(80 + RandomFloat( seed ) * 175) << 16) + ((uint)(80 + RandomFloat( seed ) * 175) << 8) + (uint)(80 + RandomFloat( seed ) * 175);
+		// the object, over its full motion, stays inside the region
+		float3 c;
+		for (int a = 0; a < 3; a++)
+		{
+			const float margin = a == 1 && animated ? 2 * r : r;
+			c.cell[a] = p.regionMin.cell[a] + (extent.cell[a] > 2 * margin ? margin + RandomFloat( seed ) * (extent.cell[a] - 2 * margin) : 0.5f * extent.cell[a]);
+		}
+		q.p = c, q.r = r, q.a = q.b = float3( 0 ), q.phase = RandomFloat( seed ) * 2 * PI;
+		q.info = type + (material << 2) + (animated ? 16 : 0) + (rgb << 8);
+		if (type == CUBE) q.r = r * 0.8f;
+		else if (type == TORUS) q.r = r * 0.7f, q.a.x = r * 0.3f, q.info += (uint)(RandomFloat( seed ) * 2.999f) << 5;
+		else if (type == TRIANGLE)
+		{
+			// three corners in the cube around c
+			float3 v[3];
+			for (int k = 0; k < 3; k++) v[k] = c + r * (float3( RandomFloat( seed ), RandomFloat( seed ), RandomFloat( seed ) ) * 2 - 1);
+			q.p = v[0], q.a = v[1] - v[0], q.b = v[2] - v[0];
+		}
+	}
+	generateMs = timer.elapsed() * 1000;
+	// binned SAH build
+	timer.reset();
+	primIdx = (uint*)Memory::AllocLarge( count * sizeof( uint ) );
+	aabb* box = (aabb*)Memory::AllocLarge( count * sizeof( aabb ) );
+#pragma omp parallel for schedule(static)
+	for (int i = 0; i < count; i++)
+	{
+		float3 bmin, bmax;
+		Bounds( prim[i], bmin, bmax );
+		primIdx[i] = i, box[i] = aabb( bmin, bmax );
+	}
+	nodeCapacity = count * 2;
+	bvhNode = (BVHNode*)Memory::AllocLarge( nodeCapacity * sizeof( BVHNode ) );
+	bvhNode[0].leftFirst = 0, bvhNode[0].primCount = count;
+	nodesTaken = 2; // node 1 stays unused, so siblings share a cacheline
+	UpdateNodeBounds( 0, box );
+	vector<uint> subtree;
+	Subdivide( 0, box, 0, &subtree );
+#pragma omp parallel for schedule(dynamic, 1)
+	for (int i = 0; i < (int)subtree.size(); i++) Subdivide( subtree[i], box, PARALLELDEPTH );
+	nodesUsed = nodesTaken;
+	Memory::FreeLarge( box );
+	buildMs = timer.elapsed() * 1000;
+}
+
+void StressScene::Clear()
+{
+	Memory::FreeLarge( prim );
+	Memory::FreeLarge( primIdx );
+	Memory::FreeLarge( bvhNode );
+	prim = 0, primIdx = 0, bvhNode = 0;
+	count = nodesUsed = nodeCapacity = 0;
+}
+
+// vertical offset of an animated object; it moves by its own size
+float StressScene::Lift( const Primitive& q, const float time ) const
+{
+	return q.info & 16 ? q.r * sinf( time * 2 + q.phase ) : 0;
+}
+
+// bounds over the full motion of the object
+void StressScene::Bounds( const Primitive& q, float3& bmin, float3& bmax ) const
+{
+	const int type = q.info & 3;
+	if (type == TRIANGLE)
+	{
+		const float3 v1 = q.p + q.a, v2 = q.p + q.b;
+		bmin = fminf( q.p, fminf( v1, v2 ) ), bmax = fmaxf( q.p, fmaxf( v1, v2 ) );
+	}
+	else if (type == TORUS)
+	{
+		const float3 e = FromTorus( float3( q.r + q.a.x, q.r + q.a.x, q.a.x ), (q.info >> 5) & 3 );
+		bmin = q.p - e, bmax = q.p + e;
+	}
+	else bmin = q.p - q.r, bmax = q.p + q.r;
+	if (q.info & 16) bmin.y -= q.r, bmax.y += q.r;
+}
+
+void StressScene::UpdateNodeBounds( const uint nodeIdx, const aabb* box )
+{
+	BVHNode& node = bvhNode[nodeIdx];
+	aabb b;
+	b.Reset();
+	for (uint i = 0; i < node.primCount; i++) b.Grow( box[primIdx[node.leftFirst + i]] );
+	node.aabbMin = float3( b.bmin[0], b.bmin[1], b.bmin[2] ), node.aabbMax = float3( b.bmax[0], b.bmax[1], b.bmax[2] );
+}
+
+// -----------------------------------------------------------
+// Cheapest split of a node by the surface area heuristic,
+// over SAHBINS bins of the centroids along each axis
+// -----------------------------------------------------------
+float StressScene::FindBestSplitPlane( const BVHNode& node, const aabb* box, int& axis, float& splitPos ) const
+{
+	aabb centroids;
+	centroids.Reset();
+	for (uint i = 0; i < node.primCount; i++) centroids.Grow( Centroid( box[primIdx[node.leftFirst + i]] ) );
+	struct Bin { aabb bounds; int count; } bin[3][SAHBINS];
+	float scale[3];
+	for (int a = 0; a < 3; a++)
+	{
+		const float extent = centroids.bmax[a] - centroids.bmin[a];
+		scale[a] = extent > 0 ? SAHBINS / extent : 0;
+		for (int i = 0; i < SAHBINS; i++) bin[a][i].bounds.Reset(), bin[a][i].count = 0;
+	}
+	for (uint i = 0; i < node.primCount; i++)
+	{
+		const aabb& b = box[primIdx[node.leftFirst + i]];
+		const __m128 c = Centroid( b );
+		for (int a = 0; a < 3; a++)
+		{
+			Bin& target = bin[a][min( SAHBINS - 1, (int)((Lane( c, a ) - centroids.bmin[a]) * scale[a]) )];
+			target.count++, target.bounds.Grow( b );
+		}
+	}
+	float bestCost = 1e30f;
+	for (int a = 0; a < 3; a++) if (scale[a] > 0)
+	{
+		// sweep from both sides; split i puts bins 0..i on the left
+		float leftArea[SAHBINS - 1], rightArea[SAHBINS - 1];
+		int leftCount[SAHBINS - 1], rightCount[SAHBINS - 1];
+		aabb leftBox, rightBox;
+		leftBox.Reset(), rightBox.Reset();
+		for (int i = 0, leftSum = 0, rightSum = 0; i < SAHBINS - 1; i++)
+		{
+			leftSum += bin[a][i].count, leftCount[i] = leftSum;
+			leftBox.Grow( bin[a][i].bounds ), leftArea[i] = leftBox.Area();
+			rightSum += bin[a][SAHBINS - 1 - i].count, rightCount[SAHBINS - 2 - i] = rightSum;
+			rightBox.Grow( bin[a][SAHBINS - 1 - i].bounds ), rightArea[SAHBINS - 2 - i] = rightBox.Area();
+		}
+		for (int i = 0; i < SAHBINS - 1; i++)
+		{
+			const float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+			if (leftCount[i] && rightCount[i] && cost < bestCost)
+				axis = a, splitPos = centroids.bmin[a] + (i + 1) / scale[a], bestCost = cost;
+		}
+	}
+	return bestCost;
+}
+
+// -----------------------------------------------------------
+// Split a node and its children; with subtree set, nodes at
+// PARALLELDEPTH are not split but collected for a parallel
+// pass (OpenMP 2.0, as in MSVC, has no tasks)
+// -----------------------------------------------------------
+void StressScene::Subdivide( const uint nodeIdx, const aabb* box, const uint depth, vector<uint>* subtree )
+{
+	BVHNode& node = bvhNode[nodeIdx];
+	if (node.primCount < 2 || depth == BVHDEPTH - 1) return;
+	if (subtree && depth == PARALLELDEPTH)
+	{
+		subtree->push_back( nodeIdx );
+		return;
+	}
+	int axis = 0;
+	float splitPos = 0;
+	const float splitCost = FindBestSplitPlane( node, box, axis, splitPos );
+	const aabb bounds( node.aabbMin, node.aabbMax );
+	if (splitCost >= node.primCount * bounds.Area()) return;
+	// partition the primitive indices
+	uint i = node.leftFirst, j = i + node.primCount - 1;
+	while (i <= j && j != ~0u)
+	{
+		if (Lane( Centroid( box[primIdx[i]] ), axis ) < splitPos) i++;
+		else swap( primIdx[i], primIdx[j--] );
+	}
+	const uint leftCount = i - node.leftFirst;
+	if (leftCount == 0 || leftCount == node.primCount) return;
+	const int left = nodesTaken.fetch_add( 2 );
+	bvhNode[left].leftFirst = node.leftFirst, bvhNode[left].primCount = leftCount;
+	bvhNode[left + 1].leftFirst = i, bvhNode[left + 1].primCount = node.primCount - leftCount;
+	node.leftFirst = left, node.primCount = 0;
+	UpdateNodeBounds( left, box );
+	UpdateNodeBounds( left + 1, box );
+	Subdivide( left, box, depth + 1, subtree );
+	Subdivide( left + 1, box, depth + 1, subtree );
+}
+
+// -----------------------------------------------------------
+// Ray / primitive: true for a hit closer than t, which is
+// then updated. Animated objects are tested at their offset.
+// -----------------------------------------------------------
+bool StressScene::Hit( const Primitive& q, const Ray& ray, float& t, const float time ) const
+{
+	float3 O = ray.O;
+	O.y -= Lift( q, time );
+	float h = 1e30f;
+	switch (q.info & 3)
+	{
+	case SPHERE:
+	{
+		// far root for rays that start inside; the discriminant is taken from
+		// the distance of the center to the ray, as b * b - c cancels out for
+		// the small spheres far away that a stress scene is full of
+		const float3 oc = O - q.p;
+		const float b = dot( oc, ray.D );
+		const float3 f = oc - b * ray.D;
+		const float d = q.r * q.r - dot( f, f );
+		if (d <= 0) return false;
+		const float sd = sqrtf( d );
+		h = -b - sd;
+		if (h <= 0) h = sd - b;
+		break;
+	}
+	case CUBE:
+	{
+		const float3 t1 = (q.p - q.r - O) * ray.rD, t2 = (q.p + q.r - O) * ray.rD;
+		const float tmin = max( max( min( t1.x, t2.x ), min( t1.y, t2.y ) ), min( t1.z, t2.z ) );
+		const float tmax = min( min( max( t1.x, t2.x ), max( t1.y, t2.y ) ), max( t1.z, t2.z ) );
+		if (tmin >= tmax) return false;
+		h = tmin > 0 ? tmin : tmax;
+		break;
+	}
+	case TORUS:
+	{
+		const int axis = (q.info >> 5) & 3;
+		const double ra = q.r, rb = q.a.x;
+		const double root = TorusRoot( ToTorus( O - q.p, axis ), ToTorus( ray.D, axis ), ra * ra, rb * rb, (ra + rb) * (ra + rb) );
+		if (root >= 1e20) return false;
+		h = (float)root;
+		break;
+	}
+	default:
+	{
+		// Moller-Trumbore, two-sided
+		const float3 e = cross( ray.D, q.b );
+		const float a = dot( q.a, e );
+		if (a == 0) return false;
+		const float f = 1 / a;
+		const float3 s = O - q.p;
+		const float u = f * dot( s, e );
+		if (u < 0 || u > 1) return false;
+		const float3 k = cross( s, q.a );
+		const float v = f * dot( ray.D, k );
+		if (v < 0 || u + v > 1) return false;
+		h = f * dot( q.b, k );
+	}
+	}
+	if (h <= 0 || h >= t) return false;
+	t = h;
+	return true;
+}
+
+// -----------------------------------------------------------
+// Nearest hit: BVH traversal, nearest child first; subtrees
+// on the stack are skipped once the hit is closer
+// -----------------------------------------------------------
+void StressScene::Intersect( Ray& ray, const float time, const int objIdxBase ) const
+{
+	if (!count) return;
+	const __m128 O4 = _mm_setr_ps( ray.O.x, ray.O.y, ray.O.z, 0 ), rD4 = _mm_setr_ps( ray.rD.x, ray.rD.y, ray.rD.z, 0 );
+	const BVHNode* node = bvhNode, * stack[BVHDEPTH];
+	float stackDist[BVHDEPTH];
+	uint stackPtr = 0;
+	if (IntersectAABB( O4, rD4, ray.t, node->aabbMin, node->aabbMax ) == 1e30f) return;
+	while (1)
+	{
+		if (node->primCount > 0)
+		{
+			for (uint i = 0; i < node->primCount; i++)
+			{
+				const uint idx = primIdx[node->leftFirst + i];
+				if (Hit( prim[idx], ray, ray.t, time )) ray.objIdx = objIdxBase + idx;
+			}
+			while (stackPtr > 0 && stackDist[stackPtr - 1] >= ray.t) stackPtr--;
+			if (stackPtr == 0) break;
+			node = stack[--stackPtr];
+			continue;
+		}
+		const BVHNode* child1 = &bvhNode[node->leftFirst], * child2 = child1 + 1;
+		float dist1 = IntersectAABB( O4, rD4, ray.t, child1->aabbMin, child1->aabbMax );
+		float dist2 = IntersectAABB( O4, rD4, ray.t, child2->aabbMin, child2->aabbMax );
+		if (dist1 > dist2) swap( dist1, dist2 ), swap( child1, child2 );
+		if (dist1 == 1e30f)
+		{
+			while (stackPtr > 0 && stackDist[stackPtr - 1] >= ray.t) stackPtr--;
+			if (stackPtr == 0) break;
+			node = stack[--stackPtr];
+		}
+		else
+		{
+			node = child1;
+			if (dist2 != 1e30f) stackDist[stackPtr] = dist2, stack[stackPtr++] = child2;
+		}
+	}
+}
+
+// any hit before ray.t
+bool StressScene::IsOccluded( const Ray& ray, const float time ) const
+{
+	if (!count) return false;
+	const __m128 O4 = _mm_setr_ps( ray.O.x, ray.O.y, ray.O.z, 0 ), rD4 = _mm_setr_ps( ray.rD.x, ray.rD.y, ray.rD.z, 0 );
+	const BVHNode* node = bvhNode, * stack[BVHDEPTH];
+	uint stackPtr = 0;
+	float t = ray.t;
+	if (IntersectAABB( O4, rD4, t, node->aabbMin, node->aabbMax ) == 1e30f) return false;
+	while (1)
+	{
+		if (node->primCount > 0)
+		{
+			for (uint i = 0; i < node->primCount; i++) if (Hit( prim[primIdx[node->leftFirst + i]], ray, t, time )) return true;
+			if (stackPtr == 0) return false;
+			node = stack[--stackPtr];
+			continue;
+		}
+		const BVHNode* child1 = &bvhNode[node->leftFirst], * child2 = child1 + 1;
+		const bool hit1 = IntersectAABB( O4, rD4, t, child1->aabbMin, child1->aabbMax ) < 1e30f;
+		const bool hit2 = IntersectAABB( O4, rD4, t, child2->aabbMin, child2->aabbMax ) < 1e30f;
+		if (hit1 && hit2) stack[stackPtr++] = child2;
+		if (hit1 || hit2) node = hit1 ? child1 : child2;
+		else if (stackPtr == 0) return false;
+		else node = stack[--stackPtr];
+	}
+}
+
+// -----------------------------------------------------------
+// Normal at a hit point, in the frame of the moment of the hit
+// -----------------------------------------------------------
+float3 StressScene::GetNormal( const int idx, const float3 I, const float time ) const
+{
+	const Primitive& q = prim[idx];
+	float3 L = I - q.p;
+	L.y -= Lift( q, time );
+	switch (q.info & 3)
+	{
+	case SPHERE: return L * (1 / q.r);
+	case CUBE:
+	{
+		// the axis of the face is the largest component
+		const float3 d = fabs( L );
+		if (d.x >= d.y && d.x >= d.z) return float3( L.x > 0 ? 1.0f : -1.0f, 0, 0 );
+		if (d.y >= d.z) return float3( 0, L.y > 0 ? 1.0f : -1.0f, 0 );
+		return float3( 0, 0, L.z > 0 ? 1.0f : -1.0f );
+	}
+	case TORUS:
+	{
+		const int axis = (q.info >> 5) & 3;
+		const float3 T = ToTorus( L, axis );
+		const float ra2 = q.r * q.r, k = dot( T, T ) - q.a.x * q.a.x;
+		return FromTorus( normalize( T * float3( k - ra2, k - ra2, k + ra2 ) ), axis );
+	}
+	default: return normalize( cross( q.a, q.b ) );
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+namespace Tmpl8
+{
+
+class Ray;
+
+// parameters of a stress scene; the same parameters and seed always
+// produce the same scene, regardless of the number of threads
+struct StressParams
+{
+	int count = 10000;				// objects, 10 to 10M
+	uint seed = 1;
+	float density = 0.02f;			// fraction of the region the objects fill
+	float sizeSpread = 4;			// largest over smallest object; sizes are log-uniform
+	float mix[4] = { 1, 1, 1, 1 };	// relative amounts of spheres, cubes, tori and triangles
+	float mirror = 0.1f, glass = 0.1f;	// fractions of the objects; the rest is diffuse
+	float animated = 0.1f;			// fraction of the objects that bob up and down
+	float3 regionMin = float3( -2.9f, -0.95f, -2.9f ), regionMax = float3( 2.9f, 1.4f, 3.9f ); // inside the room, below the lights
+};
+
+// -----------------------------------------------------------
+// Stress scene
+// Many small randomized primitives inside the room, for
+// measuring how the tracer scales with scene size: spheres,
+// axis-aligned cubes, tori around one of the major axes and
+// triangles, in a binned SAH BVH. Animated objects bob up and
+// down; the BVH holds their swept bounds, so it stays valid
+// at any time and frames never rebuild it. Scene forwards to
+// it (see Scene::stress); its hits get objIdx STRESSBASE + i.
+// -----------------------------------------------------------
+class StressScene
+{
+public:
+	enum Type { SPHERE = 0, CUBE, TORUS, TRIANGLE, TYPES };
+	enum Material { DIFFUSE = 0, MIRROR, GLASS, MATERIALS };
+	~StressScene() { Clear(); }
+	void Generate( const StressParams& p );
+	void Clear();
+	void Intersect( Ray& ray, const float time, const int objIdxBase ) const;
+	bool IsOccluded( const Ray& ray, const float time ) const;
+	float3 GetNormal( const int idx, const float3 I, const float time ) const;
+	float3 GetAlbedo( const int idx ) const { const uint c = prim[idx].info >> 8; return float3( c >> 16, (c >> 8) & 255, c & 255 ) * (1.0f / 255); }
+	Material GetMaterial( const int idx ) const { return (Material)((prim[idx].info >> 2) & 3); }
+	size_t Bytes() const { return (size_t)count * (sizeof( Primitive ) + sizeof( uint )) + (size_t)nodeCapacity * sizeof( BVHNode ); }
+	static constexpr float reflectivity[MATERIALS] = { 0, 1, 0 }, refractivity[MATERIALS] = { 0, 0, 1 };
+	StressParams params;
+	int count = 0, nodesUsed = 0;
+	float generateMs = 0, buildMs = 0;
+private:
+	// 48 bytes: a sphere has center p and radius r, a cube center p and
+	// half size r, a torus center p, radii r and a.x, and axis info bits
+	// 5..6; a triangle has vertex p and edges a and b. info also holds
+	// type, material, an animation bit and the rgb albedo in bits 8..31.
+	struct ALIGN( 16 ) Primitive
+	{
+		float3 p; float r;
+		float3 a; uint info;
+		float3 b; float phase;
+	};
+	struct ALIGN( 32 ) BVHNode
+	{
+		float3 aabbMin; uint leftFirst;
+		float3 aabbMax; uint primCount;
+	};
+	float Lift( const Primitive& q, const float time ) const;
+	void Bounds( const Primitive& q, float3& bmin, float3& bmax ) const;
+	void UpdateNodeBounds( const uint nodeIdx, const aabb* box );
+	void Subdivide( const uint nodeIdx, const aabb* box, const uint depth, vector<uint>* subtree = 0 );
+	float FindBestSplitPlane( const BVHNode& node, const aabb* box, int& axis, float& splitPos ) const;
+	bool Hit( const Primitive& q, const Ray& ray, float& t, const float time ) const;
+	Primitive* prim = 0;
+	uint* primIdx = 0;
+	BVHNode* bvhNode = 0;
+	int nodeCapacity = 0;
+	atomic<int> nodesTaken = 0;
+};
+
+} // namespace Tmpl8
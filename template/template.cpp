@@ -3,7 +3,9 @@
 
 #include "precomp.h"
 
+#ifdef _MSC_VER
 #pragma comment( linker, "/subsystem:windows /ENTRY:mainCRTStartup" )
+#endif
 
 using namespace Tmpl8;
 
@@ -31,6 +33,7 @@ uint keystate[256] = { 0 };
 
 // static member data for instruction set support class
 static const CPUCaps cpucaps;
+static const SIMD simd; // after cpucaps
 
 // provide access to the render target, for OpenCL / OpenGL interop
 GLTexture* GetRenderTarget() { return renderTarget; }
@@ -79,8 +82,11 @@ void ErrorCallback( int, const char* description )
 }
 
 // Application entry point
-void main()
+int main( int argc, char** argv )
 {
+	// command line modes, such as a render worker, run without a window
+	app = new Renderer();
+	if (app->RunHeadless( argc, argv )) return 0;
 	// open a window
 	if (!glfwInit()) FatalError( "glfwInit failed." );
 	glfwSetErrorCallback( ErrorCallback );
@@ -118,6 +124,7 @@ void main()
 	CheckGL();
 	// we want a console window for text output
 #ifndef FULLSCREEN
+#ifdef _WIN32
 	CONSOLE_SCREEN_BUFFER_INFO coninfo;
 	AllocConsole();
 	GetConsoleScreenBufferInfo( GetStdHandle( STD_OUTPUT_HANDLE ), &coninfo );
@@ -128,12 +135,12 @@ void main()
 	freopen_s( &file, "CON", "w", stdout );
 	freopen_s( &file, "CON", "w", stderr );
 	SetWindowPos( GetConsoleWindow(), HWND_TOP, 0, 0, 1280, 800, 0 );
+#endif
 	glfwShowWindow( window );
 #endif
 	// initialize application
 	InitRenderTarget( SCRWIDTH, SCRHEIGHT );
 	Surface* screen = new Surface( SCRWIDTH, SCRHEIGHT );
-	app = new Renderer();
 #if 0
 	// deserizalize
 	FILE* f = fopen( "appstate.dat", "rb" );
@@ -301,6 +308,7 @@ void main()
 	{
 		deltaTime = min( 500.0f, 1000.0f * timer.elapsed() );
 		timer.reset();
+		Memory::NewFrame();
 		app->Tick( deltaTime );
 		// send the rendering result to the screen using OpenGL
 		if (frameNr++ > 1)
@@ -351,27 +359,35 @@ void main()
 	ImGui::DestroyContext();
 	glfwDestroyWindow( window );
 	glfwTerminate();
+	return 0;
 }
 
 // Jobmanager implementation
-DWORD JobThreadProc( LPVOID lpParameter )
+void JobEvent::Set()
 {
-	JobThread* JobThreadInstance = (JobThread*)lpParameter;
-	JobThreadInstance->BackgroundTask();
-	return 0;
+	lock_guard<mutex> lock( m_Mutex );
+	m_Set = true;
+	m_Signal.notify_one();
+}
+
+void JobEvent::Wait()
+{
+	unique_lock<mutex> lock( m_Mutex );
+	m_Signal.wait( lock, [this] { return m_Set; } );
+	m_Set = false;
 }
 
 void JobThread::CreateAndStartThread( unsigned int threadId )
 {
-	m_GoSignal = CreateEvent( 0, FALSE, FALSE, 0 );
-	m_ThreadHandle = CreateThread( 0, 0, (LPTHREAD_START_ROUTINE)&JobThreadProc, (LPVOID)this, 0, 0 );
 	m_ThreadID = threadId;
+	m_Thread = thread( &JobThread::BackgroundTask, this );
+	m_Thread.detach();
 }
 void JobThread::BackgroundTask()
 {
 	while (1)
 	{
-		WaitForSingleObject( m_GoSignal, INFINITE );
+		m_GoSignal.Wait();
 		while (1)
 		{
 			Job* job = JobManager::GetJobManager()->GetNextJob();
@@ -387,7 +403,7 @@ void JobThread::BackgroundTask()
 
 void JobThread::Go()
 {
-	SetEvent( m_GoSignal );
+	m_GoSignal.Set();
 }
 
 void Job::RunCodeWrapper()
@@ -399,24 +415,18 @@ JobManager* JobManager::m_JobManager = 0;
 
 JobManager::JobManager( unsigned int threads ) : m_NumThreads( threads )
 {
-	InitializeCriticalSection( &m_CS );
 }
 
 JobManager::~JobManager()
 {
-	DeleteCriticalSection( &m_CS );
 }
 
 void JobManager::CreateJobManager( unsigned int numThreads )
 {
-	m_JobManager = new JobManager( numThreads );
-	m_JobManager->m_JobThreadList = new JobThread[numThreads];
-	for (unsigned int i = 0; i < numThreads; i++)
-	{
-		m_JobManager->m_JobThreadList[i].CreateAndStartThread( i );
-		m_JobManager->m_ThreadDone[i] = CreateEvent( 0, FALSE, FALSE, 0 );
-	}
+	m_JobManager = new JobManager( min( numThreads, 64u ) );
+	m_JobManager->m_JobThreadList = new JobThread[m_JobManager->m_NumThreads];
 	m_JobManager->m_JobCount = 0;
+	for (unsigned int i = 0; i < m_JobManager->m_NumThreads; i++) m_JobManager->m_JobThreadList[i].CreateAndStartThread( i );
 }
 
 void JobManager::AddJob2( Job* a_Job )
@@ -426,11 +436,8 @@ void JobManager::AddJob2( Job* a_Job )
 
 Job* JobManager::GetNextJob()
 {
-	Job* job = 0;
-	EnterCriticalSection( &m_CS );
-	if (m_JobCount > 0) job = m_JobList[--m_JobCount];
-	LeaveCriticalSection( &m_CS );
-	return job;
+	lock_guard<mutex> lock( m_CS );
+	return m_JobCount > 0 ? m_JobList[--m_JobCount] : 0;
 }
 
 void JobManager::RunJobs( bool MT )
@@ -439,7 +446,7 @@ void JobManager::RunJobs( bool MT )
 	if (MT)
 	{
 		for (unsigned int i = 0; i < m_NumThreads; i++) m_JobThreadList[i].Go();
-		WaitForMultipleObjects( m_NumThreads, m_ThreadDone, TRUE, INFINITE );
+		for (unsigned int i = 0; i < m_NumThreads; i++) m_ThreadDone[i].Wait();
 	}
 	else
 	{
@@ -450,9 +457,11 @@ void JobManager::RunJobs( bool MT )
 
 void JobManager::ThreadDone( unsigned int n )
 {
-	SetEvent( m_ThreadDone[n] );
+	m_ThreadDone[n].Set();
 }
 
+#ifdef _WIN32
+
 DWORD CountSetBits( ULONG_PTR bitMask )
 {
 	DWORD LSHIFT = sizeof( ULONG_PTR ) * 8 - 1, bitSetCount = 0;
@@ -493,6 +502,16 @@ void JobManager::GetProcessorCount( uint& cores, uint& logical )
 	}
 }
 
+#else
+
+void JobManager::GetProcessorCount( uint& cores, uint& logical )
+{
+	const Topology& topology = Topology::Get();
+	cores = topology.coreCount, logical = (uint)topology.processors.size();
+}
+
+#endif
+
 JobManager* JobManager::GetJobManager()
 {
 	if (!m_JobManager)
@@ -504,6 +523,131 @@ JobManager* JobManager::GetJobManager()
 	return m_JobManager;
 }
 
+// Topology implementation
+const Topology& Topology::Get()
+{
+	static const Topology topology;
+	return topology;
+}
+
+#ifdef _WIN32
+
+Topology::Topology()
+{
+	// same query as GetProcessorCount; cores first, then NUMA nodes
+	DWORD len = 0;
+	GetLogicalProcessorInformationEx( RelationAll, 0, &len );
+	char* buffer = (char*)malloc( len );
+	if (GetLogicalProcessorInformationEx( RelationAll, (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)buffer, &len ))
+	{
+		for (char* ptr = buffer; ptr < buffer + len; ptr += ((PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)ptr)->Size)
+		{
+			PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX pi = (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)ptr;
+			if (pi->Relationship != RelationProcessorCore) continue;
+			uint sibling = 0;
+			for (size_t g = 0; g < pi->Processor.GroupCount; ++g) for (uint i = 0; i < sizeof( ULONG_PTR ) * 8; i++)
+				if (pi->Processor.GroupMask[g].Mask & ((ULONG_PTR)1 << i))
+					processors.push_back( { pi->Processor.GroupMask[g].Group, i, coreCount, sibling++, 0 } );
+			coreCount++;
+		}
+		for (char* ptr = buffer; ptr < buffer + len; ptr += ((PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)ptr)->Size)
+		{
+			PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX pi = (PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX)ptr;
+			if (pi->Relationship != RelationNumaNode) continue;
+			const GROUP_AFFINITY& mask = pi->NumaNode.GroupMask;
+			for (LogicalProcessor& lp : processors)
+				if (lp.group == mask.Group && (mask.Mask & ((ULONG_PTR)1 << lp.index))) lp.node = pi->NumaNode.NodeNumber;
+			nodeCount = max( nodeCount, (uint)pi->NumaNode.NodeNumber + 1 );
+		}
+	}
+	free( buffer );
+	sort( processors.begin(), processors.end(), []( const LogicalProcessor& a, const LogicalProcessor& b ) {
+		return a.node != b.node ? a.node < b.node : a.core != b.core ? a.core < b.core : a.sibling < b.sibling; } );
+}
+
+void Topology::PinCurrentThread( const LogicalProcessor* lp )
+{
+	if (lp)
+	{
+		GROUP_AFFINITY affinity = {};
+		affinity.Group = (WORD)lp->group, affinity.Mask = (ULONG_PTR)1 << lp->index;
+		SetThreadGroupAffinity( GetCurrentThread(), &affinity, 0 );
+	}
+	else
+	{
+		DWORD_PTR processMask, systemMask;
+		GetProcessAffinityMask( GetCurrentProcess(), &processMask, &systemMask );
+		SetThreadAffinityMask( GetCurrentThread(), processMask );
+	}
+}
+
+#else
+
+// Linux: topology from sysfs
+#include <sched.h>
+#include <unistd.h>
+static int ReadSysInt( const char* path )
+{
+	FILE* f = fopen( path, "r" );
+	if (!f) return -1;
+	int value = -1;
+	if (fscanf( f, "%d", &value ) != 1) value = -1;
+	fclose( f );
+	return value;
+}
+
+Topology::Topology()
+{
+	// cores are identified by package and core id
+	vector<int> coreKey;
+	char path[256];
+	const int cpus = (int)sysconf( _SC_NPROCESSORS_CONF );
+	for (int cpu = 0; cpu < cpus; cpu++)
+	{
+		sprintf( path, "/sys/devices/system/cpu/cpu%i/topology/core_id", cpu );
+		const int coreId = ReadSysInt( path );
+		if (coreId < 0) continue; // offline
+		sprintf( path, "/sys/devices/system/cpu/cpu%i/topology/physical_package_id", cpu );
+		const int key = (max( 0, ReadSysInt( path ) ) << 16) + coreId;
+		uint core = (uint)(find( coreKey.begin(), coreKey.end(), key ) - coreKey.begin()), sibling = 0;
+		if (core == coreKey.size()) coreKey.push_back( key );
+		for (const LogicalProcessor& lp : processors) if (lp.core == core) sibling++;
+		processors.push_back( { 0, (uint)cpu, core, sibling, 0 } );
+	}
+	coreCount = (uint)coreKey.size();
+	// NUMA nodes list their cpus as ranges, e.g. "0-17,36-53"
+	for (uint node = 0; node < 64; node++)
+	{
+		sprintf( path, "/sys/devices/system/node/node%u/cpulist", node );
+		FILE* f = fopen( path, "r" );
+		if (!f) continue;
+		int first, last;
+		while (fscanf( f, "%d", &first ) == 1)
+		{
+			last = first;
+			int c = fgetc( f );
+			if (c == '-') { if (fscanf( f, "%d", &last ) != 1) break; c = fgetc( f ); }
+			for (LogicalProcessor& lp : processors) if ((int)lp.index >= first && (int)lp.index <= last) lp.node = node;
+			if (c != ',') break;
+		}
+		fclose( f );
+		nodeCount = max( nodeCount, node + 1 );
+	}
+	sort( processors.begin(), processors.end(), []( const LogicalProcessor& a, const LogicalProcessor& b ) {
+		return a.node != b.node ? a.node < b.node : a.core != b.core ? a.core < b.core : a.sibling < b.sibling; } );
+}
+
+void Topology::PinCurrentThread( const LogicalProcessor* lp )
+{
+	cpu_set_t set;
+	CPU_ZERO( &set );
+	if (lp) CPU_SET( lp->index, &set );
+	else for (const LogicalProcessor& p : Get().processors) CPU_SET( p.index, &set );
+	sched_setaffinity( 0, sizeof( cpu_set_t ), &set ); // 0: calling thread
+}
+
+#endif
+
 // Helper functions
 bool FileIsNewer( const char* file1, const char* file2 )
 {
@@ -536,6 +680,24 @@ bool RemoveFile( const char* f )
 	return !remove( f );
 }
 
+bool CreateDir( const char* path )
+{
+#ifdef _WIN32
+	return CreateDirectoryA( path, NULL ) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+	return !mkdir( path, 0755 ) || errno == EEXIST;
+#endif
+}
+
+uint ProcessId()
+{
+#ifdef _WIN32
+	return (uint)GetCurrentProcessId();
+#else
+	return (uint)getpid();
+#endif
+}
+
 uint FileSize( string filename )
 {
 	ifstream s( filename );
@@ -169,15 +169,14 @@ float3 TransformVector( const float3& a, const mat4& M )
 }
 float3 TransformPosition_SSE( const __m128& a, const mat4& M )
 {
-	__m128 a4 = a;
-	a4.m128_f32[3] = 1;
+	const __m128 a4 = _mm_blend_ps( a, _mm_set1_ps( 1 ), 8 );
 	__m128 v0 = _mm_mul_ps( a4, _mm_load_ps( &M.cell[0] ) );
 	__m128 v1 = _mm_mul_ps( a4, _mm_load_ps( &M.cell[4] ) );
 	__m128 v2 = _mm_mul_ps( a4, _mm_load_ps( &M.cell[8] ) );
 	__m128 v3 = _mm_mul_ps( a4, _mm_load_ps( &M.cell[12] ) );
 	_MM_TRANSPOSE4_PS( v0, v1, v2, v3 );
 	__m128 v = _mm_add_ps( _mm_add_ps( v0, v1 ), _mm_add_ps( v2, v3 ) );
-	return float3( v.m128_f32[0], v.m128_f32[1], v.m128_f32[2] );
+	return float3( Lane( v, 0 ), Lane( v, 1 ), Lane( v, 2 ) );
 }
 float3 TransformVector_SSE( const __m128& a, const mat4& M )
 {
@@ -187,5 +186,5 @@ float3 TransformVector_SSE( const __m128& a, const mat4& M )
 	__m128 v3 = _mm_mul_ps( a, _mm_load_ps( &M.cell[12] ) );
 	_MM_TRANSPOSE4_PS( v0, v1, v2, v3 );
 	__m128 v = _mm_add_ps( _mm_add_ps( v0, v1 ), v2 );
-	return float3( v.m128_f32[0], v.m128_f32[1], v.m128_f32[2] );
+	return float3( Lane( v, 0 ), Lane( v, 1 ), Lane( v, 2 ) );
 }
\ No newline at end of file
@@ -13,6 +13,7 @@ struct ALIGN( 8 ) int2
 	int2( const int a ) : x( a ), y( a ) {}
 	union { struct { int x, y; }; int cell[2]; };
 	int& operator [] ( const int n ) { return cell[n]; }
+	int operator [] ( const int n ) const { return cell[n]; }
 };
 struct ALIGN( 8 ) uint2
 {
@@ -21,6 +22,7 @@ struct ALIGN( 8 ) uint2
 	uint2( const uint a ) : x( a ), y( a ) {}
 	union { struct { uint x, y; }; uint cell[2]; };
 	uint& operator [] ( const int n ) { return cell[n]; }
+	uint operator [] ( const int n ) const { return cell[n]; }
 };
 struct ALIGN( 8 ) float2
 {
@@ -30,6 +32,7 @@ struct ALIGN( 8 ) float2
 	float2( const int2 a ) : x( (float)a.x ), y( (float)a.y ) {}
 	union { struct { float x, y; }; float cell[2]; };
 	float& operator [] ( const int n ) { return cell[n]; }
+	float operator [] ( const int n ) const { return cell[n]; }
 };
 struct int3;
 struct ALIGN( 16 ) int4
@@ -40,6 +43,7 @@ struct ALIGN( 16 ) int4
 	int4( const int3 & a, const int d );
 	union { struct { int x, y, z, w; }; int cell[4]; };
 	int& operator [] ( const int n ) { return cell[n]; }
+	int operator [] ( const int n ) const { return cell[n]; }
 };
 struct ALIGN( 16 ) int3
 {
@@ -49,6 +53,7 @@ struct ALIGN( 16 ) int3
 	int3( const int4 a ) : x( a.x ), y( a.y ), z( a.z ) {}
 	union { struct { int x, y, z; int dummy; }; int cell[4]; };
 	int& operator [] ( const int n ) { return cell[n]; }
+	int operator [] ( const int n ) const { return cell[n]; }
 };
 struct uint3;
 struct ALIGN( 16 ) uint4
@@ -59,6 +64,7 @@ struct ALIGN( 16 ) uint4
 	uint4( const uint3 & a, const uint d );
 	union { struct { uint x, y, z, w; }; uint cell[4]; };
 	uint& operator [] ( const int n ) { return cell[n]; }
+	uint operator [] ( const int n ) const { return cell[n]; }
 };
 struct ALIGN( 16 ) uint3
 {
@@ -68,6 +74,7 @@ struct ALIGN( 16 ) uint3
 	uint3( const uint4 a ) : x( a.x ), y( a.y ), z( a.z ) {}
 	union { struct { uint x, y, z; uint dummy; }; uint cell[4]; };
 	uint& operator [] ( const int n ) { return cell[n]; }
+	uint operator [] ( const int n ) const { return cell[n]; }
 };
 struct float3;
 struct ALIGN( 16 ) float4
@@ -79,6 +86,7 @@ struct ALIGN( 16 ) float4
 	float4( const float3 & a );
 	union { struct { float x, y, z, w; }; float cell[4]; };
 	float& operator [] ( const int n ) { return cell[n]; }
+	float operator [] ( const int n ) const { return cell[n]; }
 };
 struct float3
 {
@@ -91,6 +99,7 @@ struct float3
 	float2 yz() { return float2( y, z ); }
 	union { struct { float x, y, z; }; float cell[3]; };
 	float& operator [] ( const int n ) { return cell[n]; }
+	float operator [] ( const int n ) const { return cell[n]; }
 };
 struct ALIGN( 4 ) uchar4
 {
@@ -99,6 +108,7 @@ struct ALIGN( 4 ) uchar4
 	uchar4( const uchar a ) : x( a ), y( a ), z( a ), w( a ) {}
 	union { struct { uchar x, y, z, w; }; uchar cell[4]; };
 	uchar& operator [] ( const int n ) { return cell[n]; }
+	uchar operator [] ( const int n ) const { return cell[n]; }
 };
 
 #pragma warning ( pop )
@@ -109,6 +119,7 @@ struct ALIGN( 4 ) uchar4
 template <class T> void Swap( T& x, T& y ) { T t; t = x, x = y, y = t; }
 
 // random numbers
+uint WangHash( uint s );
 uint InitSeed( uint seedBase );
 uint RandomUInt();
 uint RandomUInt( uint& seed );
@@ -608,8 +619,8 @@ public:
 	{
 		struct
 		{
-			union { __m128 bmin4; float bmin[4]; struct { float3 bmin3; }; };
-			union { __m128 bmax4; float bmax[4]; struct { float3 bmax3; }; };
+			union { __m128 bmin4; float bmin[4]; };
+			union { __m128 bmax4; float bmax[4]; };
 		};
 		__m128 bounds[2] = { _mm_setr_ps( 1e34f, 1e34f, 1e34f, 0 ), _mm_setr_ps( -1e34f, -1e34f, -1e34f, 0 ) };
 	};
@@ -627,7 +638,7 @@ public:
 	mat2( float2 a, float2 b ) { cell[0] = a.x, cell[1] = b.x, cell[2] = a.y, cell[3] = b.y; }
 	// mat2( float2 a, float2 b ) { cell[0] = a.x, cell[1] = a.y, cell[2] = b.x, cell[3] = b.y; }
 	mat2( float a, float b, float c, float d ) { cell[0] = a, cell[1] = b, cell[2] = c, cell[3] = d; }
-	__declspec(align(16)) float cell[4] = { 1, 0, 0, 1 };
+	ALIGN( 16 ) float cell[4] = { 1, 0, 0, 1 };
 	constexpr static mat2 Identity() { return mat2{}; }
 	float operator()( const int i, const int j ) const { return cell[i * 2 + j]; }
 	float& operator()( const int i, const int j ) { return cell[i * 2 + j]; }
@@ -638,7 +649,7 @@ class mat4
 {
 public:
 	mat4() = default;
-	__declspec(align(64)) float cell[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
+	ALIGN( 64 ) float cell[16] = { 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1 };
 	float& operator [] ( const int idx ) { return cell[idx]; }
 	float operator()( const int i, const int j ) const { return cell[i * 4 + j]; }
 	float& operator()( const int i, const int j ) { return cell[i * 4 + j]; }